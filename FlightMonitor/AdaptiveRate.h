@@ -0,0 +1,88 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+// After a decrease, congestion is ignored for this long so that one episode
+// halves the rate once rather than on every report still queued behind it.
+constexpr int kAdaptiveHoldMs = 1000;
+
+// Seconds of clear network to climb from the minimum back to the maximum.
+constexpr double kAdaptiveRecoverySeconds = 10;
+
+// An output rate between two bounds, set additive-increase/multiplicative-
+// decrease as TCP sets its window: halved whenever the network is
+// congested, then raised steadily while it is not. Under congestion the
+// output thins out instead of queueing, so what does get through is fresh.
+// update() is called from one thread; rate() can be read from any.
+class AdaptiveRate {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	AdaptiveRate() = default;
+	AdaptiveRate(double minRate, double maxRate) { setBounds(minRate, maxRate); }
+
+	// Starts at maxRate.
+	void setBounds(double minRate, double maxRate) {
+		min_rate_ = std::max(std::min(minRate, maxRate), 0.0);
+		max_rate_ = std::max(maxRate, min_rate_);
+		reset();
+	}
+
+	// Called each time output goes out at the current rate, with whether
+	// anything since the last call showed congestion.
+	void update(Clock::time_point now, bool congested) {
+		const double rate = rate_.load(std::memory_order_relaxed);
+		double next = rate;
+		if (now < hold_until_) {
+			// Still draining from the last decrease.
+		} else if (congested) {
+			next = std::max(rate / 2, min_rate_);
+			hold_until_ = now + std::chrono::milliseconds(kAdaptiveHoldMs);
+			decreases_.fetch_add(1, std::memory_order_relaxed);
+		} else if (last_ != Clock::time_point()) {
+			const double seconds = std::chrono::duration<double>(now - last_).count();
+			next = std::min(rate + seconds * (max_rate_ - min_rate_) / kAdaptiveRecoverySeconds, max_rate_);
+		}
+		last_ = now;
+		rate_.store(next, std::memory_order_relaxed);
+	}
+
+	// Back to the maximum, forgetting any congestion.
+	void reset() {
+		rate_.store(max_rate_, std::memory_order_relaxed);
+		hold_until_ = Clock::time_point();
+		last_ = Clock::time_point();
+	}
+
+	double rate() const { return rate_.load(std::memory_order_relaxed); }
+	double minRate() const { return min_rate_; }
+	double maxRate() const { return max_rate_; }
+	// Times congestion has halved the rate.
+	uint64_t decreases() const { return decreases_.load(std::memory_order_relaxed); }
+
+private:
+	double min_rate_ = 0;
+	double max_rate_ = 0;
+	std::atomic<double> rate_{ 0 };
+	std::atomic<uint64_t> decreases_{ 0 };
+	Clock::time_point hold_until_;
+	Clock::time_point last_;
+};
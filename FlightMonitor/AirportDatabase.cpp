@@ -0,0 +1,161 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include "AirportDatabase.h"
+#include "Geodesy.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+constexpr double kPi = 3.14159265358979323846;
+
+static double radians(double degrees) { return degrees * kPi / 180; }
+
+void airportUnitVector(double lat, double lon, float out[3]) {
+	const double phi = radians(lat);
+	const double lambda = radians(lon);
+	out[0] = (float)(cos(phi) * cos(lambda));
+	out[1] = (float)(cos(phi) * sin(lambda));
+	out[2] = (float)sin(phi);
+}
+
+HRESULT AirportDatabase::open(LPCWSTR path) {
+	close();
+	HRESULT hr = file_.open(path, FILE_FLAG_RANDOM_ACCESS);
+	if (FAILED(hr))
+		return hr;
+	if (!attach(file_.data(), file_.size())) {
+		winfx::DebugOut(L"%s is not an airport database\n", path);
+		file_.close();
+		return E_FAIL;
+	}
+	return S_OK;
+}
+
+bool AirportDatabase::attach(const uint8_t* data, size_t size) {
+	entries_ = nullptr;
+	runways_ = nullptr;
+	strings_ = nullptr;
+	count_ = 0;
+
+	AirportFileHeader header;
+	if (data == nullptr || size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != kAirportFileMagic || header.version != kAirportFileVersion)
+		return false;
+
+	const uint64_t expected = sizeof(header) + (uint64_t)header.entry_count * sizeof(AirportEntry) +
+		(uint64_t)header.runway_count * sizeof(AirportRunwayEnd) + header.strings_bytes;
+	if (expected != size || header.strings_bytes == 0 || data[size - 1] != 0)
+		return false;
+
+	const uint8_t* p = data + sizeof(header);
+	const AirportEntry* entries = reinterpret_cast<const AirportEntry*>(p);
+	p += (size_t)header.entry_count * sizeof(AirportEntry);
+	const AirportRunwayEnd* runways = reinterpret_cast<const AirportRunwayEnd*>(p);
+	p += (size_t)header.runway_count * sizeof(AirportRunwayEnd);
+
+	// Every entry must point inside the file, so the accessors need no checks.
+	// The string table ends in a NUL, so any offset into it is a C string.
+	for (uint32_t i = 0; i < header.entry_count; i++) {
+		const AirportEntry& e = entries[i];
+		if (e.ident >= header.strings_bytes || e.name >= header.strings_bytes ||
+			(uint64_t)e.first_runway + e.runway_count > header.runway_count ||
+			e.kind >= kAirportKindCount)
+			return false;
+	}
+
+	entries_ = entries;
+	runways_ = runways;
+	strings_ = reinterpret_cast<const char*>(p);
+	count_ = header.entry_count;
+	return true;
+}
+
+void AirportDatabase::close() {
+	entries_ = nullptr;
+	runways_ = nullptr;
+	strings_ = nullptr;
+	count_ = 0;
+	file_.close();
+}
+
+void AirportDatabase::nearest(double lat, double lon, size_t k, unsigned kinds,
+	std::vector<AirportMatch>* out) const {
+	out->clear();
+	if (count_ == 0 || k == 0)
+		return;
+
+	float point[3];
+	airportUnitVector(lat, lon, point);
+	heap_.clear();
+	search(0, count_, 0, point, k, kinds, &heap_);
+
+	std::sort(heap_.begin(), heap_.end());
+	for (const Candidate& candidate : heap_) {
+		const AirportEntry& e = entries_[candidate.index];
+		const double entryLat = e.lat / kAirportPositionScale;
+		const double entryLon = e.lon / kAirportPositionScale;
+		AirportMatch match;
+		match.index = candidate.index;
+		match.distance_m = greatCircleDistance(lat, lon, entryLat, entryLon);
+		match.bearing = greatCircleBearing(lat, lon, entryLat, entryLon);
+		out->push_back(match);
+	}
+}
+
+void AirportDatabase::search(uint32_t lo, uint32_t hi, int axis, const float point[3], size_t k,
+	unsigned kinds, std::vector<Candidate>* heap) const {
+	while (lo < hi) {
+		const uint32_t mid = lo + (hi - lo) / 2;
+		const AirportEntry& e = entries_[mid];
+
+		if (kinds & (1u << e.kind)) {
+			const float dx = e.x - point[0];
+			const float dy = e.y - point[1];
+			const float dz = e.z - point[2];
+			const float distance2 = dx * dx + dy * dy + dz * dz;
+			if (heap->size() < k) {
+				heap->push_back(Candidate{ distance2, mid });
+				std::push_heap(heap->begin(), heap->end());
+			} else if (distance2 < heap->front().distance2) {
+				std::pop_heap(heap->begin(), heap->end());
+				heap->back() = Candidate{ distance2, mid };
+				std::push_heap(heap->begin(), heap->end());
+			}
+		}
+
+		// Search the side of the split holding the point first; the other
+		// side only if the heap could still take something from it.
+		const float split = axis == 0 ? e.x : (axis == 1 ? e.y : e.z);
+		const float delta = point[axis] - split;
+		const int next = axis == 2 ? 0 : axis + 1;
+		uint32_t nearLo = lo, nearHi = mid, farLo = mid + 1, farHi = hi;
+		if (delta > 0) {
+			std::swap(nearLo, farLo);
+			std::swap(nearHi, farHi);
+		}
+		search(nearLo, nearHi, next, point, k, kinds, heap);
+		if (heap->size() == k && delta * delta >= heap->front().distance2)
+			return;
+		lo = farLo;
+		hi = farHi;
+		axis = next;
+	}
+}
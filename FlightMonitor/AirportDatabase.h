@@ -0,0 +1,138 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "framework.h"
+#include "winfx.h"
+#include "MappedFile.h"
+
+// A compact airport and navaid database (.fmapt), built offline by
+// FlightTools buildairports and memory mapped at runtime, so opening even
+// the full worldwide set costs a mapping and a header check.
+//
+// Layout: AirportFileHeader, then entry_count AirportEntry records, then
+// runway_count AirportRunwayEnd records, then the string table. The entries
+// are stored in implicit k-d tree order: the entry at the middle of any
+// range splits the rest of that range on one axis of the unit vector to the
+// entry's position, cycling x, y, z with depth. Working on the unit sphere
+// keeps the search exact across the poles and the antimeridian; distance
+// between unit vectors orders points the same as great-circle distance.
+
+constexpr uint32_t kAirportFileMagic = 0x5450414d;  // "MAPT"
+constexpr uint16_t kAirportFileVersion = 1;
+constexpr wchar_t kAirportFileName[] = L"airports.fmapt";
+
+// Positions are stored as fixed point with this many units per degree.
+constexpr double kAirportPositionScale = 1e7;
+
+enum AirportKind : uint8_t {
+	kAirportLarge = 0,
+	kAirportMedium,
+	kAirportSmall,
+	kAirportHeliport,
+	kAirportSeaplaneBase,
+	kAirportOther,
+	kNavaidVor,
+	kNavaidNdb,
+	kNavaidDme,
+	kNavaidOther,
+	kAirportKindCount
+};
+
+// Masks of AirportKind bits for queries.
+constexpr unsigned kAirportKindsAirports = (1u << kAirportLarge) | (1u << kAirportMedium) |
+	(1u << kAirportSmall) | (1u << kAirportSeaplaneBase);
+constexpr unsigned kAirportKindsNavaids = (1u << kNavaidVor) | (1u << kNavaidNdb) |
+	(1u << kNavaidDme) | (1u << kNavaidOther);
+constexpr unsigned kAirportKindsAll = (1u << kAirportKindCount) - 1;
+
+#pragma pack(push, 1)
+struct AirportFileHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved0;
+	uint32_t entry_count;
+	uint32_t runway_count;
+	uint32_t strings_bytes;
+	uint8_t reserved[12];
+};
+
+struct AirportEntry {
+	float x, y, z;            // unit vector to the position
+	int32_t lat;              // degrees * kAirportPositionScale
+	int32_t lon;
+	int16_t elevation_ft;
+	uint8_t kind;             // AirportKind
+	uint8_t runway_count;     // runway ends
+	uint32_t first_runway;
+	uint32_t ident;           // offsets into the string table
+	uint32_t name;
+};
+
+struct AirportRunwayEnd {
+	char ident[4];            // e.g. "34L", NUL padded
+	uint16_t heading;         // true, tenths of a degree
+	uint16_t length_m;
+};
+#pragma pack(pop)
+
+struct AirportMatch {
+	uint32_t index;
+	double distance_m;
+	double bearing;           // true, from the query point
+};
+
+class AirportDatabase {
+public:
+	HRESULT open(LPCWSTR path);
+	bool attach(const uint8_t* data, size_t size);
+	void close();
+
+	bool isOpen() const { return entries_ != nullptr; }
+	size_t size() const { return count_; }
+	const AirportEntry& entry(uint32_t index) const { return entries_[index]; }
+	const char* ident(uint32_t index) const { return strings_ + entries_[index].ident; }
+	const char* name(uint32_t index) const { return strings_ + entries_[index].name; }
+	const AirportRunwayEnd* runways(uint32_t index) const { return runways_ + entries_[index].first_runway; }
+
+	// Replaces out with up to k entries of the given kinds nearest to the
+	// point, nearest first. Uses scratch space in the database, so only one
+	// thread may query at a time.
+	void nearest(double lat, double lon, size_t k, unsigned kinds, std::vector<AirportMatch>* out) const;
+
+private:
+	struct Candidate {
+		float distance2;
+		uint32_t index;
+		bool operator<(const Candidate& other) const { return distance2 < other.distance2; }
+	};
+
+	void search(uint32_t lo, uint32_t hi, int axis, const float point[3], size_t k, unsigned kinds,
+		std::vector<Candidate>* heap) const;
+
+	MappedFile file_;
+	const AirportEntry* entries_ = nullptr;
+	const AirportRunwayEnd* runways_ = nullptr;
+	const char* strings_ = nullptr;
+	uint32_t count_ = 0;
+	mutable std::vector<Candidate> heap_;
+};
+
+// Unit vector to a position, as stored in AirportEntry.
+void airportUnitVector(double lat, double lon, float out[3]);
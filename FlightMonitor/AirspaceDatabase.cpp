@@ -0,0 +1,424 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include "AirspaceDatabase.h"
+#include "Geodesy.h"
+#include "MappedFile.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+// Children per R-tree node.
+constexpr size_t kAirspaceNodeSize = 16;
+
+// Arcs and circles are drawn with an edge every this many degrees.
+constexpr double kArcStepDegrees = 5;
+
+constexpr double kMetersPerFoot = 0.3048;
+constexpr double kMetersPerNauticalMile = 1852;
+constexpr double kUnlimitedMeters = 1e9;
+
+static const char* const kClassNames[kAirspaceClassCount] = {
+	"A", "B", "C", "D", "E", "F", "G", "CTR", "R", "P", "Q", "OTHER"
+};
+
+const char* airspaceClassName(AirspaceClass airspaceClass) {
+	return airspaceClass < kAirspaceClassCount ? kClassNames[airspaceClass] : "?";
+}
+
+static AirspaceClass parseClass(const std::string& text) {
+	for (int i = 0; i < kAirspaceOther; i++) {
+		if (text == kClassNames[i])
+			return (AirspaceClass)i;
+	}
+	return kAirspaceOther;
+}
+
+static const char* skipSpace(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+		p++;
+	return p;
+}
+
+// "GND", "SFC", "UNLTD", "FL95", "1500ft MSL", "1000 AGL", "600m"...
+static AirspaceLimit parseLimit(const char* p, const char* end) {
+	std::string text;
+	for (; p < end; p++)
+		text += (char)toupper((unsigned char)*p);
+
+	AirspaceLimit limit = { 0, true };
+	const char* s = skipSpace(text.c_str(), text.c_str() + text.size());
+	if (strncmp(s, "GND", 3) == 0 || strncmp(s, "SFC", 3) == 0)
+		return limit;
+	if (strncmp(s, "UNL", 3) == 0) {
+		limit.meters = kUnlimitedMeters;
+		limit.agl = false;
+		return limit;
+	}
+	if (strncmp(s, "FL", 2) == 0) {
+		limit.meters = atof(s + 2) * 100 * kMetersPerFoot;
+		limit.agl = false;
+		return limit;
+	}
+
+	char* after;
+	const double value = strtod(s, &after);
+	if (after == s)
+		return limit;
+
+	// The words after the number give the unit and the reference.
+	double scale = kMetersPerFoot;
+	limit.agl = false;
+	const char* q = after;
+	while (*q) {
+		while (*q && !isalpha((unsigned char)*q))
+			q++;
+		const char* word = q;
+		while (isalpha((unsigned char)*q))
+			q++;
+		const std::string token(word, q);
+		if (token == "M")
+			scale = 1;
+		else if (token == "AGL" || token == "AGND" || token == "ASFC" || token == "GND" || token == "SFC")
+			limit.agl = true;
+	}
+	limit.meters = value * scale;
+	return limit;
+}
+
+// "47:25:10 N", "47:25.5N" or "47.42 N".
+static bool parseCoordinate(const char** text, const char* end, char positive, char negative, double* value) {
+	const char* p = skipSpace(*text, end);
+	double parts[3] = { 0, 0, 0 };
+	int count = 0;
+	while (count < 3 && p < end) {
+		char* after;
+		parts[count] = strtod(p, &after);
+		if (after == p)
+			break;
+		count++;
+		p = after;
+		if (p < end && *p == ':')
+			p++;
+		else
+			break;
+	}
+	p = skipSpace(p, end);
+	if (count == 0 || p >= end)
+		return false;
+
+	const char hemisphere = (char)toupper((unsigned char)*p++);
+	if (hemisphere != positive && hemisphere != negative)
+		return false;
+	const double degrees = parts[0] + parts[1] / 60 + parts[2] / 3600;
+	*value = hemisphere == positive ? degrees : -degrees;
+	*text = p;
+	return true;
+}
+
+static bool parsePoint(const char** text, const char* end, AirspacePoint* point) {
+	return parseCoordinate(text, end, 'N', 'S', &point->lat) &&
+		parseCoordinate(text, end, 'E', 'W', &point->lon);
+}
+
+static void addArc(const AirspacePoint& center, double radius, double from, double to, bool clockwise,
+	std::vector<AirspacePoint>* polygon) {
+	if (clockwise) {
+		while (to <= from)
+			to += 360;
+	} else {
+		while (to >= from)
+			to -= 360;
+	}
+	const double sweep = to - from;
+	const int steps = std::max(1, (int)ceil(fabs(sweep) / kArcStepDegrees));
+	for (int i = 0; i <= steps; i++) {
+		AirspacePoint point;
+		greatCircleDestination(center.lat, center.lon, from + sweep * i / steps, radius, &point.lat, &point.lon);
+		polygon->push_back(point);
+	}
+}
+
+HRESULT AirspaceDatabase::loadOpenAir(LPCWSTR path) {
+	MappedFile file;
+	HRESULT hr = file.open(path);
+	if (FAILED(hr))
+		return hr;
+	const size_t added = parseOpenAir(reinterpret_cast<const char*>(file.data()), file.size());
+	winfx::DebugOut(L"%zu airspaces from %s\n", added, path);
+	return S_OK;
+}
+
+size_t AirspaceDatabase::parseOpenAir(const char* text, size_t size) {
+	const char* p = text;
+	const char* const end = text + size;
+	size_t added = 0;
+
+	std::string name;
+	AirspaceClass airspaceClass = kAirspaceOther;
+	AirspaceLimit floor = { 0, true };
+	AirspaceLimit ceiling = { kUnlimitedMeters, false };
+	std::vector<AirspacePoint> polygon;
+	AirspacePoint center = { 0, 0 };
+	bool clockwise = true;
+	bool open = false;
+
+	auto finish = [&]() {
+		if (open && polygon.size() >= 3) {
+			add(name, airspaceClass, floor, ceiling, polygon);
+			added++;
+		}
+		name.clear();
+		polygon.clear();
+		clockwise = true;
+		open = false;
+	};
+
+	while (p < end) {
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (lineEnd == nullptr)
+			lineEnd = end;
+		const char* line = p;
+		const char* last = lineEnd;
+		p = lineEnd + 1;
+		while (last > line && (last[-1] == '\r' || last[-1] == ' '))
+			last--;
+		if (last - line < 2 || *line == '*')
+			continue;
+
+		const std::string command(line, std::min<size_t>(2, last - line));
+		const char* args = skipSpace(line + command.size(), last);
+		if (command == "AC") {
+			finish();
+			airspaceClass = parseClass(std::string(args, last));
+			floor = { 0, true };
+			ceiling = { kUnlimitedMeters, false };
+			open = true;
+		} else if (command == "AN") {
+			name.assign(args, last);
+		} else if (command == "AL") {
+			floor = parseLimit(args, last);
+		} else if (command == "AH") {
+			ceiling = parseLimit(args, last);
+		} else if (command == "V ") {
+			if (last - args >= 2 && (args[0] == 'X' || args[0] == 'x') && args[1] == '=') {
+				const char* q = args + 2;
+				parsePoint(&q, last, &center);
+			} else if (last - args >= 3 && (args[0] == 'D' || args[0] == 'd') && args[1] == '=') {
+				clockwise = args[2] != '-';
+			}
+		} else if (command == "DP") {
+			AirspacePoint point;
+			if (parsePoint(&args, last, &point))
+				polygon.push_back(point);
+		} else if (command == "DC") {
+			const double radius = atof(args) * kMetersPerNauticalMile;
+			addArc(center, radius, 0, 360, true, &polygon);
+		} else if (command == "DA") {
+			char* q;
+			const double radius = strtod(args, &q) * kMetersPerNauticalMile;
+			const double from = strtod(skipSpace(q, last), &q);
+			const double to = strtod(skipSpace(q, last), &q);
+			addArc(center, radius, from, to, clockwise, &polygon);
+		} else if (command == "DB") {
+			AirspacePoint first, second;
+			if (parsePoint(&args, last, &first) && parsePoint(&args, last, &second)) {
+				const double radius = greatCircleDistance(center.lat, center.lon, first.lat, first.lon);
+				addArc(center, radius, greatCircleBearing(center.lat, center.lon, first.lat, first.lon),
+					greatCircleBearing(center.lat, center.lon, second.lat, second.lon), clockwise, &polygon);
+			}
+		}
+	}
+	finish();
+	return added;
+}
+
+void AirspaceDatabase::add(const std::string& name, AirspaceClass airspaceClass, AirspaceLimit floor,
+	AirspaceLimit ceiling, const std::vector<AirspacePoint>& polygon) {
+	Airspace airspace;
+	airspace.name = name;
+	airspace.airspace_class = airspaceClass;
+	airspace.floor = floor;
+	airspace.ceiling = ceiling;
+	airspace.first_vertex = (uint32_t)vertices_.size();
+	airspace.vertex_count = (uint32_t)polygon.size();
+	airspace.box = { 90, 180, -90, -180 };
+	for (const AirspacePoint& point : polygon) {
+		airspace.box.min_lat = std::min(airspace.box.min_lat, point.lat);
+		airspace.box.min_lon = std::min(airspace.box.min_lon, point.lon);
+		airspace.box.max_lat = std::max(airspace.box.max_lat, point.lat);
+		airspace.box.max_lon = std::max(airspace.box.max_lon, point.lon);
+	}
+	vertices_.insert(vertices_.end(), polygon.begin(), polygon.end());
+	airspaces_.push_back(airspace);
+}
+
+void AirspaceDatabase::clear() {
+	airspaces_.clear();
+	vertices_.clear();
+	order_.clear();
+	levels_.clear();
+}
+
+// Sort-Tile-Recursive order: vertical slices by longitude, each holding
+// enough entries for a whole number of nodes and sorted by latitude, so
+// runs of kAirspaceNodeSize make compact nodes.
+template <typename T>
+static void strSort(std::vector<T>* items) {
+	auto centerLon = [](const T& item) { return item.box.min_lon + item.box.max_lon; };
+	auto centerLat = [](const T& item) { return item.box.min_lat + item.box.max_lat; };
+	std::sort(items->begin(), items->end(),
+		[&](const T& a, const T& b) { return centerLon(a) < centerLon(b); });
+
+	const size_t nodes = (items->size() + kAirspaceNodeSize - 1) / kAirspaceNodeSize;
+	const size_t slices = (size_t)ceil(sqrt((double)nodes));
+	const size_t perSlice = std::max<size_t>(1, slices) * kAirspaceNodeSize;
+	for (size_t first = 0; first < items->size(); first += perSlice) {
+		const size_t last = std::min(first + perSlice, items->size());
+		std::sort(items->begin() + first, items->begin() + last,
+			[&](const T& a, const T& b) { return centerLat(a) < centerLat(b); });
+	}
+}
+
+template <typename T, typename Node>
+static std::vector<Node> groupNodes(const std::vector<T>& items) {
+	std::vector<Node> nodes;
+	for (size_t first = 0; first < items.size(); first += kAirspaceNodeSize) {
+		Node node;
+		node.first = (uint32_t)first;
+		node.count = (uint32_t)std::min(kAirspaceNodeSize, items.size() - first);
+		node.box = items[first].box;
+		for (size_t i = first + 1; i < first + node.count; i++) {
+			node.box.min_lat = std::min(node.box.min_lat, items[i].box.min_lat);
+			node.box.min_lon = std::min(node.box.min_lon, items[i].box.min_lon);
+			node.box.max_lat = std::max(node.box.max_lat, items[i].box.max_lat);
+			node.box.max_lon = std::max(node.box.max_lon, items[i].box.max_lon);
+		}
+		nodes.push_back(node);
+	}
+	return nodes;
+}
+
+void AirspaceDatabase::buildIndex() {
+	order_.clear();
+	levels_.clear();
+	if (airspaces_.empty())
+		return;
+
+	struct Item {
+		AirspaceBox box;
+		uint32_t index;
+	};
+	std::vector<Item> items(airspaces_.size());
+	for (size_t i = 0; i < airspaces_.size(); i++)
+		items[i] = { airspaces_[i].box, (uint32_t)i };
+	strSort(&items);
+	for (const Item& item : items)
+		order_.push_back(item.index);
+
+	// Each level is put in STR order before the one above is built over
+	// it, since a node's children must be contiguous.
+	std::vector<Node> level = groupNodes<Item, Node>(items);
+	while (level.size() > 1) {
+		strSort(&level);
+		levels_.push_back(level);
+		level = groupNodes<Node, Node>(levels_.back());
+	}
+	levels_.push_back(level);
+}
+
+void AirspaceDatabase::query(const AirspaceBox& box, std::vector<uint32_t>* out) const {
+	if (!levels_.empty())
+		queryNode(levels_.size() - 1, 0, box, out);
+}
+
+void AirspaceDatabase::queryNode(size_t level, uint32_t index, const AirspaceBox& box,
+	std::vector<uint32_t>* out) const {
+	const Node& node = levels_[level][index];
+	if (!node.box.intersects(box))
+		return;
+	for (uint32_t i = node.first; i < node.first + node.count; i++) {
+		if (level > 0) {
+			queryNode(level - 1, i, box, out);
+		} else if (airspaces_[order_[i]].box.intersects(box)) {
+			out->push_back(order_[i]);
+		}
+	}
+}
+
+bool AirspaceDatabase::containsPoint(uint32_t index, double lat, double lon) const {
+	const Airspace& airspace = airspaces_[index];
+	if (!airspace.box.contains(lat, lon))
+		return false;
+
+	// Count the edges a ray due east of the point crosses.
+	const AirspacePoint* v = vertices(index);
+	const uint32_t n = airspace.vertex_count;
+	bool inside = false;
+	for (uint32_t i = 0, j = n - 1; i < n; j = i++) {
+		if ((v[i].lat > lat) != (v[j].lat > lat) &&
+			lon < (v[j].lon - v[i].lon) * (lat - v[i].lat) / (v[j].lat - v[i].lat) + v[i].lon) {
+			inside = !inside;
+		}
+	}
+	return inside;
+}
+
+static double cross(const AirspacePoint& o, const AirspacePoint& a, const AirspacePoint& b) {
+	return (a.lon - o.lon) * (b.lat - o.lat) - (a.lat - o.lat) * (b.lon - o.lon);
+}
+
+bool AirspaceDatabase::crossesSegment(uint32_t index, double lat1, double lon1, double lat2, double lon2) const {
+	const Airspace& airspace = airspaces_[index];
+	const AirspaceBox segmentBox = { std::min(lat1, lat2), std::min(lon1, lon2),
+		std::max(lat1, lat2), std::max(lon1, lon2) };
+	if (!airspace.box.intersects(segmentBox))
+		return false;
+	if (containsPoint(index, lat2, lon2))
+		return true;
+
+	const AirspacePoint a = { lat1, lon1 };
+	const AirspacePoint b = { lat2, lon2 };
+	const AirspacePoint* v = vertices(index);
+	const uint32_t n = airspace.vertex_count;
+	for (uint32_t i = 0, j = n - 1; i < n; j = i++) {
+		const double d1 = cross(a, b, v[j]);
+		const double d2 = cross(a, b, v[i]);
+		const double d3 = cross(v[j], v[i], a);
+		const double d4 = cross(v[j], v[i], b);
+		if (((d1 > 0) != (d2 > 0)) && ((d3 > 0) != (d4 > 0)))
+			return true;
+	}
+	return false;
+}
+
+bool AirspaceDatabase::withinLimits(uint32_t index, double altitude, double ground) const {
+	const Airspace& airspace = airspaces_[index];
+	const double floor = airspace.floor.meters + (airspace.floor.agl ? ground : 0);
+	const double ceiling = airspace.ceiling.meters + (airspace.ceiling.agl ? ground : 0);
+	return altitude >= floor && altitude <= ceiling;
+}
+
+bool AirspaceDatabase::overlapsLimits(uint32_t index, double low, double high, double ground) const {
+	const Airspace& airspace = airspaces_[index];
+	const double floor = airspace.floor.meters + (airspace.floor.agl ? ground : 0);
+	const double ceiling = airspace.ceiling.meters + (airspace.ceiling.agl ? ground : 0);
+	return high >= floor && low <= ceiling;
+}
@@ -0,0 +1,134 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "winfx.h"
+
+enum AirspaceClass : uint8_t {
+	kAirspaceA = 0,
+	kAirspaceB,
+	kAirspaceC,
+	kAirspaceD,
+	kAirspaceE,
+	kAirspaceF,
+	kAirspaceG,
+	kAirspaceCtr,
+	kAirspaceRestricted,
+	kAirspaceProhibited,
+	kAirspaceDanger,
+	kAirspaceOther,
+	kAirspaceClassCount
+};
+
+// Classes it takes a clearance or a good reason to be in.
+constexpr unsigned kAirspaceAlertClasses = (1u << kAirspaceA) | (1u << kAirspaceB) |
+	(1u << kAirspaceC) | (1u << kAirspaceD) | (1u << kAirspaceCtr) |
+	(1u << kAirspaceRestricted) | (1u << kAirspaceProhibited) | (1u << kAirspaceDanger);
+
+// Short name, as OpenAir writes it: "B", "R", "CTR"...
+const char* airspaceClassName(AirspaceClass airspaceClass);
+
+struct AirspaceBox {
+	double min_lat;
+	double min_lon;
+	double max_lat;
+	double max_lon;
+
+	bool intersects(const AirspaceBox& other) const {
+		return min_lat <= other.max_lat && max_lat >= other.min_lat &&
+			min_lon <= other.max_lon && max_lon >= other.min_lon;
+	}
+	bool contains(double lat, double lon) const {
+		return lat >= min_lat && lat <= max_lat && lon >= min_lon && lon <= max_lon;
+	}
+};
+
+// A floor or ceiling, in meters above mean sea level or the ground.
+struct AirspaceLimit {
+	double meters;
+	bool agl;
+};
+
+struct AirspacePoint {
+	double lat;
+	double lon;
+};
+
+struct Airspace {
+	std::string name;
+	AirspaceClass airspace_class;
+	AirspaceLimit floor;
+	AirspaceLimit ceiling;
+	AirspaceBox box;
+	uint32_t first_vertex;
+	uint32_t vertex_count;
+};
+
+// Airspace polygons with a packed R-tree over their bounding boxes.
+//
+// Load everything, then call buildIndex() once; the tree is built by
+// Sort-Tile-Recursive packing, so every node is full and boxes overlap
+// little. Arcs and circles are turned into polygon edges at load time.
+// Polygons are tested in plain latitude and longitude, which is fine for
+// airspaces' sizes but not for one that straddles the antimeridian.
+class AirspaceDatabase {
+public:
+	// Adds the airspaces in an OpenAir file.
+	HRESULT loadOpenAir(LPCWSTR path);
+	// Returns the number of airspaces added.
+	size_t parseOpenAir(const char* text, size_t size);
+
+	void add(const std::string& name, AirspaceClass airspaceClass, AirspaceLimit floor,
+		AirspaceLimit ceiling, const std::vector<AirspacePoint>& polygon);
+	void buildIndex();
+	void clear();
+
+	size_t size() const { return airspaces_.size(); }
+	const Airspace& airspace(uint32_t index) const { return airspaces_[index]; }
+	const AirspacePoint* vertices(uint32_t index) const { return &vertices_[airspaces_[index].first_vertex]; }
+
+	// Appends the airspaces whose bounding boxes meet box.
+	void query(const AirspaceBox& box, std::vector<uint32_t>* out) const;
+
+	// Lateral tests against the polygon itself.
+	bool containsPoint(uint32_t index, double lat, double lon) const;
+	bool crossesSegment(uint32_t index, double lat1, double lon1, double lat2, double lon2) const;
+
+	// Whether an altitude (meters MSL) is between the floor and ceiling,
+	// given the terrain height there for limits above the ground.
+	bool withinLimits(uint32_t index, double altitude, double ground) const;
+	// Whether any altitude from low to high is.
+	bool overlapsLimits(uint32_t index, double low, double high, double ground) const;
+
+private:
+	struct Node {
+		AirspaceBox box;
+		uint32_t first;   // into the level below, or into order_ for leaves
+		uint32_t count;
+	};
+
+	void queryNode(size_t level, uint32_t index, const AirspaceBox& box, std::vector<uint32_t>* out) const;
+
+	std::vector<Airspace> airspaces_;
+	std::vector<AirspacePoint> vertices_;
+	std::vector<uint32_t> order_;             // airspaces in leaf order
+	std::vector<std::vector<Node>> levels_;   // levels_[0] are the leaves
+};
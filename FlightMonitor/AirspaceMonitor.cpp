@@ -0,0 +1,177 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include "AirspaceMonitor.h"
+#include "Geodesy.h"
+
+#include <math.h>
+#include <algorithm>
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kMetersPerDegree = 111320;
+
+// Steps used to estimate how soon the track enters an airspace.
+constexpr int kEntrySearchSteps = 24;
+
+// Distance for comparing against the candidate radius. Flat earth is close
+// enough over tens of kilometers.
+static double approximateDistance(double lat1, double lon1, double lat2, double lon2) {
+	const double dy = (lat2 - lat1) * kMetersPerDegree;
+	const double dx = (lon2 - lon1) * kMetersPerDegree * cos(lat1 * kPi / 180);
+	return sqrt(dx * dx + dy * dy);
+}
+
+void AirspaceMonitor::refreshCandidates(double lat, double lon, double lookahead) {
+	radius_ = std::max(kAirspaceCandidateRadiusMeters, 2 * lookahead);
+	const double dlat = radius_ / kMetersPerDegree;
+	const double dlon = radius_ / (kMetersPerDegree * std::max(0.01, cos(lat * kPi / 180)));
+	const AirspaceBox box = { lat - dlat, lon - dlon, lat + dlat, lon + dlon };
+	candidates_.clear();
+	airspaces_->query(box, &candidates_);
+	center_lat_ = lat;
+	center_lon_ = lon;
+	has_candidates_ = true;
+	refreshes_++;
+}
+
+void AirspaceMonitor::onSample(const SimSample& sample) {
+	if (!in_flight_ || airspaces_->size() == 0)
+		return;
+
+	const SimData& data = sample.data;
+	const double lookahead = std::max(0.0, data.gps_groundspeed) * kAirspaceLookaheadSeconds;
+
+	// The candidates cover everything within radius_ of where they were
+	// gathered, so they still do for the look-ahead while the aircraft is
+	// no further than radius_ - lookahead from there.
+	if (!has_candidates_ ||
+		approximateDistance(center_lat_, center_lon_, data.gps_lat, data.gps_lon) + lookahead > radius_) {
+		refreshCandidates(data.gps_lat, data.gps_lon, lookahead);
+	}
+
+	double ground = 0;
+	if (terrain_ != nullptr && !terrain_->elevation(data.gps_lat, data.gps_lon, &ground))
+		ground = 0;
+
+	double aheadLat, aheadLon;
+	greatCircleDestination(data.gps_lat, data.gps_lon, data.gps_track, lookahead, &aheadLat, &aheadLon);
+	const double aheadAlt = data.gps_alt + data.vertical_speed * kAirspaceLookaheadSeconds;
+	const double low = std::min(data.gps_alt, aheadAlt);
+	const double high = std::max(data.gps_alt, aheadAlt);
+
+	// Only the inside test is at the current altitude. The look-ahead takes
+	// the band the segment spans; an airspace overhead or underneath that
+	// the aircraft is climbing or descending into is crossed by even a
+	// segment with no length, whose end is inside it.
+	next_inside_.clear();
+	next_ahead_.clear();
+	for (uint32_t index : candidates_) {
+		if (!airspaces_->overlapsLimits(index, low, high, ground))
+			continue;
+		if (airspaces_->withinLimits(index, data.gps_alt, ground) &&
+			airspaces_->containsPoint(index, data.gps_lat, data.gps_lon))
+			next_inside_.push_back(index);
+		else if (airspaces_->crossesSegment(index, data.gps_lat, data.gps_lon, aheadLat, aheadLon))
+			next_ahead_.push_back(index);
+	}
+	std::sort(next_inside_.begin(), next_inside_.end());
+	std::sort(next_ahead_.begin(), next_ahead_.end());
+
+	const bool changed = next_inside_ != inside_ || next_ahead_ != ahead_;
+	for (uint32_t index : inside_) {
+		if (!std::binary_search(next_inside_.begin(), next_inside_.end(), index)) {
+			for (AirspaceCallbacks* callback : callbacks_)
+				callback->onAirspaceExit(airspaces_->airspace(index));
+		}
+	}
+	for (uint32_t index : next_inside_) {
+		if (!std::binary_search(inside_.begin(), inside_.end(), index)) {
+			for (AirspaceCallbacks* callback : callbacks_)
+				callback->onAirspaceEnter(airspaces_->airspace(index));
+		}
+	}
+	for (uint32_t index : next_ahead_) {
+		if (!std::binary_search(ahead_.begin(), ahead_.end(), index)) {
+			const double seconds = secondsToEntry(index, data, ground, aheadLat, aheadLon);
+			for (AirspaceCallbacks* callback : callbacks_)
+				callback->onAirspaceAhead(airspaces_->airspace(index), seconds);
+		}
+	}
+	inside_.swap(next_inside_);
+	ahead_.swap(next_ahead_);
+	if (changed)
+		updateStatus();
+}
+
+// Walks the look-ahead segment, climbing or descending as the aircraft is,
+// to the first point inside the airspace.
+double AirspaceMonitor::secondsToEntry(uint32_t index, const SimData& data, double ground,
+	double lat, double lon) const {
+	for (int step = 1; step <= kEntrySearchSteps; step++) {
+		const double fraction = (double)step / kEntrySearchSteps;
+		const double pointLat = data.gps_lat + (lat - data.gps_lat) * fraction;
+		const double pointLon = data.gps_lon + (lon - data.gps_lon) * fraction;
+		const double pointAlt = data.gps_alt + data.vertical_speed * kAirspaceLookaheadSeconds * fraction;
+		if (airspaces_->withinLimits(index, pointAlt, ground) &&
+			airspaces_->containsPoint(index, pointLat, pointLon))
+			return kAirspaceLookaheadSeconds * fraction;
+	}
+	return kAirspaceLookaheadSeconds;
+}
+
+void AirspaceMonitor::onStateChange(SimulatorInterfaceState state) {
+	in_flight_ = (state == SimInterfaceInFlight);
+	if (in_flight_)
+		return;
+
+	// Out of the sim is out of every airspace.
+	for (uint32_t index : inside_) {
+		for (AirspaceCallbacks* callback : callbacks_)
+			callback->onAirspaceExit(airspaces_->airspace(index));
+	}
+	inside_.clear();
+	ahead_.clear();
+	has_candidates_ = false;
+	updateStatus();
+}
+
+static std::string describe(const Airspace& airspace) {
+	return std::string(airspaceClassName(airspace.airspace_class)) + " " + airspace.name;
+}
+
+void AirspaceMonitor::updateStatus() {
+	AirspaceStatus status;
+	for (uint32_t index : inside_) {
+		const Airspace& airspace = airspaces_->airspace(index);
+		const bool alert = (kAirspaceAlertClasses & (1u << airspace.airspace_class)) != 0;
+		// Show the airspace that matters most.
+		if (status.inside.empty() || (alert && !status.alert)) {
+			status.inside = describe(airspace);
+			status.alert = alert;
+		}
+	}
+	if (!ahead_.empty())
+		status.ahead = describe(airspaces_->airspace(ahead_[0]));
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	status_ = status;
+}
+
+AirspaceStatus AirspaceMonitor::status() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return status_;
+}
@@ -0,0 +1,113 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "winfx.h"
+#include "AirspaceDatabase.h"
+#include "OutputSink.h"
+#include "TerrainService.h"
+
+// Samples per second checked against the airspaces.
+constexpr double kAirspaceSamplesPerSecond = 5;
+
+// How far ahead along the track to warn of airspace.
+constexpr double kAirspaceLookaheadSeconds = 120;
+
+// The candidate airspaces are those within this distance of where they
+// were last gathered, or twice the look-ahead distance if that is more.
+constexpr double kAirspaceCandidateRadiusMeters = 20000;
+
+// Told about airspace the aircraft enters, leaves, or is about to enter.
+// Called on the SinkScheduler's worker thread.
+class AirspaceCallbacks {
+public:
+	virtual void onAirspaceEnter(const Airspace& airspace) = 0;
+	virtual void onAirspaceExit(const Airspace& airspace) = 0;
+	virtual void onAirspaceAhead(const Airspace& airspace, double seconds) = 0;
+};
+
+struct AirspaceStatus {
+	std::string inside;   // e.g. "B SEATTLE", the first airspace the aircraft is in
+	bool alert = false;   // inside one of kAirspaceAlertClasses
+	std::string ahead;    // the first airspace the track leads into
+};
+
+// Checks each sample against an AirspaceDatabase, in three dimensions, and
+// the look-ahead segment along the current track and vertical speed
+// against it too, so climbing or descending into a shelf above or below
+// warns as well as flying into one.
+//
+// Each sample tests only a candidate set of airspaces near the aircraft.
+// The set is gathered from the R-tree and kept until the aircraft has
+// moved far enough that it might miss something within look-ahead range,
+// so the cost per sample depends on how much airspace is nearby, not on
+// the size of the database.
+class AirspaceMonitor : public OutputSink {
+public:
+	// terrain, if given, turns AGL limits into MSL ones; without it the
+	// ground is taken to be at sea level. It must be registered with the
+	// same SinkScheduler, whose worker thread then makes all its lookups.
+	AirspaceMonitor(const AirspaceDatabase* airspaces, TerrainService* terrain = nullptr) :
+		airspaces_(airspaces), terrain_(terrain) {}
+
+	void addCallback(AirspaceCallbacks* callback) {
+		callbacks_.push_back(callback);
+	}
+
+	const char* sinkName() const override { return "Airspace"; }
+	double sinkRate() const override { return kAirspaceSamplesPerSecond; }
+	unsigned sinkFields() const override { return kSimFieldPosition | kSimFieldTrack | kSimFieldVertical; }
+
+	void onSample(const SimSample& sample) override;
+	void onStateChange(SimulatorInterfaceState state) override;
+
+	// Safe from any thread.
+	AirspaceStatus status() const;
+
+	uint64_t refreshes() const { return refreshes_; }
+	size_t candidateCount() const { return candidates_.size(); }
+
+private:
+	void refreshCandidates(double lat, double lon, double lookahead);
+	double secondsToEntry(uint32_t index, const SimData& data, double ground, double lat, double lon) const;
+	void updateStatus();
+
+	const AirspaceDatabase* airspaces_;
+	TerrainService* terrain_;
+	std::vector<AirspaceCallbacks*> callbacks_;
+	bool in_flight_ = false;
+
+	bool has_candidates_ = false;
+	double center_lat_ = 0;
+	double center_lon_ = 0;
+	double radius_ = 0;
+	std::vector<uint32_t> candidates_;
+	uint64_t refreshes_ = 0;
+
+	// Sorted airspace indexes.
+	std::vector<uint32_t> inside_;
+	std::vector<uint32_t> ahead_;
+	std::vector<uint32_t> next_inside_;
+	std::vector<uint32_t> next_ahead_;
+
+	mutable std::mutex mutex_;
+	AirspaceStatus status_;
+};
@@ -0,0 +1,131 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <algorithm>
+#include <mutex>
+#include <new>
+
+#include "framework.h"
+#include "winfx.h"
+#include "AllocTracker.h"
+
+static thread_local AllocCounts t_counts;
+
+const AllocCounts& threadAllocCounts() {
+	return t_counts;
+}
+
+#if FLIGHTMONITOR_ALLOC_TRACKING
+
+// The replacements go straight to malloc, which is what the CRT's own
+// operator new does, and count on the way through. Nothing here may use the
+// heap through new itself.
+
+static void* countedAlloc(size_t size) {
+	void* p = malloc(size ? size : 1);
+	if (p != nullptr) {
+		t_counts.allocations++;
+		t_counts.bytes += size;
+	}
+	return p;
+}
+
+static void countedFree(void* p) {
+	if (p != nullptr) {
+		t_counts.frees++;
+		free(p);
+	}
+}
+
+void* operator new(size_t size) {
+	void* p = countedAlloc(size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) {
+	void* p = countedAlloc(size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { countedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { countedFree(p); }
+
+#endif  // FLIGHTMONITOR_ALLOC_TRACKING
+
+// Constructed on first use, so sites with static storage can register from
+// any translation unit.
+static std::mutex& registryMutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+
+static std::vector<AllocSite*>& registry() {
+	static std::vector<AllocSite*> sites;
+	return sites;
+}
+
+AllocSite::AllocSite(const char* name) : name_(name) {
+	std::lock_guard<std::mutex> lock(registryMutex());
+	registry().push_back(this);
+}
+
+AllocSite::~AllocSite() {
+	std::lock_guard<std::mutex> lock(registryMutex());
+	std::vector<AllocSite*>& sites = registry();
+	sites.erase(std::remove(sites.begin(), sites.end(), this), sites.end());
+}
+
+void AllocSite::reset() {
+	calls_ = 0;
+	allocations_ = 0;
+	bytes_ = 0;
+}
+
+std::vector<const AllocSite*> allocSites() {
+	std::lock_guard<std::mutex> lock(registryMutex());
+	return std::vector<const AllocSite*>(registry().begin(), registry().end());
+}
+
+void resetAllocSites() {
+	std::lock_guard<std::mutex> lock(registryMutex());
+	for (AllocSite* site : registry())
+		site->reset();
+}
+
+void logAllocSites() {
+	for (const AllocSite* site : allocSites()) {
+		if (site->calls() == 0)
+			continue;
+		winfx::DebugOut(L"%-24S %10llu calls %8llu allocations %10llu bytes\n", site->name(),
+			site->calls(), site->allocations(), site->bytes());
+	}
+}
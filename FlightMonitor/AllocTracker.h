@@ -0,0 +1,90 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+// Counting replacements for the global operator new and delete, and named
+// sites that add up what runs under them, so the per-sample path can be
+// checked to allocate nothing once a flight is under way. Builds that
+// define FLIGHTMONITOR_ALLOC_TRACKING as 0 keep the standard allocator and
+// count nothing.
+#ifndef FLIGHTMONITOR_ALLOC_TRACKING
+#define FLIGHTMONITOR_ALLOC_TRACKING 1
+#endif
+
+struct AllocCounts {
+	uint64_t allocations = 0;
+	uint64_t bytes = 0;
+	uint64_t frees = 0;
+};
+
+// Everything this thread has allocated since it started.
+const AllocCounts& threadAllocCounts();
+
+// A place in the code, with totals over every AllocScope that ran for it.
+// Sites register themselves for allocSites() and must outlive their scopes.
+class AllocSite {
+public:
+	explicit AllocSite(const char* name);
+	~AllocSite();
+	AllocSite(const AllocSite&) = delete;
+	AllocSite& operator=(const AllocSite&) = delete;
+
+	const char* name() const { return name_; }
+	uint64_t calls() const { return calls_.load(std::memory_order_relaxed); }
+	uint64_t allocations() const { return allocations_.load(std::memory_order_relaxed); }
+	uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+	void add(uint64_t allocations, uint64_t bytes) {
+		calls_.fetch_add(1, std::memory_order_relaxed);
+		if (allocations != 0) {
+			allocations_.fetch_add(allocations, std::memory_order_relaxed);
+			bytes_.fetch_add(bytes, std::memory_order_relaxed);
+		}
+	}
+	void reset();
+
+private:
+	const char* name_;
+	std::atomic<uint64_t> calls_{ 0 };
+	std::atomic<uint64_t> allocations_{ 0 };
+	std::atomic<uint64_t> bytes_{ 0 };
+};
+
+// Adds what the current thread allocates while the scope is open to site.
+// Nested scopes each count everything inside them.
+class AllocScope {
+public:
+	explicit AllocScope(AllocSite& site) : site_(site), start_(threadAllocCounts()) {}
+	~AllocScope() {
+		const AllocCounts& now = threadAllocCounts();
+		site_.add(now.allocations - start_.allocations, now.bytes - start_.bytes);
+	}
+
+private:
+	AllocSite& site_;
+	const AllocCounts start_;
+};
+
+// The registered sites, for reports. Allocates, so keep it off the hot path.
+std::vector<const AllocSite*> allocSites();
+void resetAllocSites();
+
+// Writes every site that has run to the debug output.
+void logAllocSites();
@@ -0,0 +1,46 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include "AppPaths.h"
+
+static bool ensureDirectory(const std::wstring& path) {
+	if (CreateDirectory(path.c_str(), NULL))
+		return true;
+	return GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+std::wstring getAppDataDirectory(LPCWSTR subdirectory) {
+	wchar_t base[MAX_PATH] = { 0 };
+	DWORD length = GetEnvironmentVariable(L"LOCALAPPDATA", base, ARRAYSIZE(base));
+	if (length == 0 || length >= ARRAYSIZE(base)) {
+		winfx::DebugOut(L"LOCALAPPDATA is not set\n");
+		return std::wstring();
+	}
+
+	std::wstring path(base);
+	path += L"\\FlightMonitor";
+	if (!ensureDirectory(path))
+		return std::wstring();
+
+	if (subdirectory != nullptr && *subdirectory != L'\0') {
+		path += L"\\";
+		path += subdirectory;
+		if (!ensureDirectory(path))
+			return std::wstring();
+	}
+	return path;
+}
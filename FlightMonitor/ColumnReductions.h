@@ -0,0 +1,111 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLIGHTMONITOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Reductions over one decoded channel (see TrackColumns). Each works two
+// doubles at a time with SSE2 where available, which every x64 CPU has, and
+// falls back to a plain loop elsewhere.
+
+// Largest |x|. Returns 0 for an empty column.
+inline double columnMaxAbs(const double* x, size_t n) {
+	size_t i = 0;
+	double result = 0;
+#ifdef FLIGHTMONITOR_SSE2
+	const __m128d absMask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffll));
+	__m128d m0 = _mm_setzero_pd();
+	__m128d m1 = _mm_setzero_pd();
+	for (; i + 4 <= n; i += 4) {
+		m0 = _mm_max_pd(m0, _mm_and_pd(_mm_loadu_pd(x + i), absMask));
+		m1 = _mm_max_pd(m1, _mm_and_pd(_mm_loadu_pd(x + i + 2), absMask));
+	}
+	m0 = _mm_max_pd(m0, m1);
+	m0 = _mm_max_pd(m0, _mm_unpackhi_pd(m0, m0));
+	result = _mm_cvtsd_f64(m0);
+#endif
+	for (; i < n; i++) {
+		const double a = fabs(x[i]);
+		if (a > result)
+			result = a;
+	}
+	return result;
+}
+
+// Largest value. Returns -HUGE_VAL for an empty column.
+inline double columnMax(const double* x, size_t n) {
+	size_t i = 0;
+	double result = -HUGE_VAL;
+#ifdef FLIGHTMONITOR_SSE2
+	__m128d m0 = _mm_set1_pd(-HUGE_VAL);
+	__m128d m1 = m0;
+	for (; i + 4 <= n; i += 4) {
+		m0 = _mm_max_pd(m0, _mm_loadu_pd(x + i));
+		m1 = _mm_max_pd(m1, _mm_loadu_pd(x + i + 2));
+	}
+	m0 = _mm_max_pd(m0, m1);
+	m0 = _mm_max_pd(m0, _mm_unpackhi_pd(m0, m0));
+	result = _mm_cvtsd_f64(m0);
+#endif
+	for (; i < n; i++) {
+		if (x[i] > result)
+			result = x[i];
+	}
+	return result;
+}
+
+// Sum of weight[i] over the samples where x[i] > threshold, e.g. time spent
+// above an altitude given each sample's duration as the weight.
+inline double columnWeightedAbove(const double* x, const double* weight, size_t n, double threshold) {
+	size_t i = 0;
+	double result = 0;
+#ifdef FLIGHTMONITOR_SSE2
+	const __m128d t = _mm_set1_pd(threshold);
+	__m128d s0 = _mm_setzero_pd();
+	__m128d s1 = _mm_setzero_pd();
+	for (; i + 4 <= n; i += 4) {
+		s0 = _mm_add_pd(s0, _mm_and_pd(_mm_cmpgt_pd(_mm_loadu_pd(x + i), t), _mm_loadu_pd(weight + i)));
+		s1 = _mm_add_pd(s1, _mm_and_pd(_mm_cmpgt_pd(_mm_loadu_pd(x + i + 2), t), _mm_loadu_pd(weight + i + 2)));
+	}
+	s0 = _mm_add_pd(s0, s1);
+	s0 = _mm_add_pd(s0, _mm_unpackhi_pd(s0, s0));
+	result = _mm_cvtsd_f64(s0);
+#endif
+	for (; i < n; i++) {
+		if (x[i] > threshold)
+			result += weight[i];
+	}
+	return result;
+}
+
+// Sample durations in seconds: out[i] = (time[i + 1] - time[i]) / 1000, with
+// the last sample given nextTimeMs - time[n - 1] (pass time[n - 1] if it is
+// the last of the flight). A gap longer than maxGapS, such as the sim being
+// paused, counts as zero.
+inline void columnDurations(const int64_t* time, size_t n, int64_t nextTimeMs, double maxGapS, double* out) {
+	for (size_t i = 0; i < n; i++) {
+		const int64_t next = (i + 1 < n) ? time[i + 1] : nextTimeMs;
+		const double d = (next - time[i]) * 0.001;
+		out[i] = (d > 0 && d <= maxGapS) ? d : 0;
+	}
+}
@@ -0,0 +1,77 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ConfigFile.h"
+
+static const char* skipSpace(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	return p;
+}
+
+std::vector<std::vector<std::string>> splitConfigLines(const char* text, size_t size) {
+	std::vector<std::vector<std::string>> lines;
+	const char* p = text;
+	const char* const end = text + size;
+
+	while (p < end) {
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (lineEnd == nullptr)
+			lineEnd = end;
+		const char* line = skipSpace(p, lineEnd);
+		p = lineEnd + 1;
+		if (line == lineEnd || *line == '#' || *line == '\r')
+			continue;
+
+		// Comma separated fields, trimmed.
+		std::vector<std::string> fields;
+		while (line <= lineEnd) {
+			const char* comma = (const char*)memchr(line, ',', lineEnd - line);
+			const char* fieldEnd = comma ? comma : lineEnd;
+			const char* last = fieldEnd;
+			while (last > line && (last[-1] == '\r' || last[-1] == ' ' || last[-1] == '\t'))
+				last--;
+			fields.emplace_back(line, last);
+			line = skipSpace(fieldEnd + 1, lineEnd);
+			if (comma == nullptr)
+				break;
+		}
+		lines.push_back(std::move(fields));
+	}
+	return lines;
+}
+
+bool parseConfigRange(const std::string& field, double* low, double* high) {
+	const char* text = field.c_str();
+	char* end = nullptr;
+	const double first = strtod(text, &end);
+	if (end == text)
+		return false;
+	double second = first;
+	if (*end == '-') {
+		const char* next = end + 1;
+		second = strtod(next, &end);
+		if (end == next)
+			return false;
+	}
+	if (*end != '\0' || !(first > 0) || !(second >= first))
+		return false;
+	*low = first;
+	*high = second;
+	return true;
+}
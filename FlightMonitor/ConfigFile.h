@@ -0,0 +1,29 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// The small text files in the app data directory (sessions, SimVars) are
+// one record per line of comma separated fields. Returns the fields of each
+// line, trimmed; blank lines and lines starting with # are left out.
+std::vector<std::vector<std::string>> splitConfigLines(const char* text, size_t size);
+
+// A field of the form "<low>-<high>", or one number for both. False unless
+// both are positive numbers and low is no more than high.
+bool parseConfigRange(const std::string& field, double* low, double* high);
@@ -0,0 +1,290 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include <mswsock.h>
+#include <chrono>
+#include <thread>
+#include "DatagramSender.h"
+
+// How long close() waits for datagrams still in flight to complete, so the
+// counters are final.
+constexpr int kRioCloseWaitMs = 100;
+
+static bool setBroadcast(SOCKET sock) {
+	char broadcast = '1';
+	if (setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0) {
+		winfx::DebugOut(L"Error %d setting socket broadcast option\n", WSAGetLastError());
+		return false;
+	}
+	return true;
+}
+
+class SendtoDatagramSender : public DatagramSender {
+public:
+	~SendtoDatagramSender() { close(); }
+
+	HRESULT open() override {
+		sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+		if (sock_ == INVALID_SOCKET) {
+			winfx::DebugOut(L"Error %d allocating socket\n", WSAGetLastError());
+			return E_FAIL;
+		}
+		if (!setBroadcast(sock_)) {
+			close();
+			return E_FAIL;
+		}
+		u_long nonBlocking = 1;
+		if (ioctlsocket(sock_, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+			winfx::DebugOut(L"Error %d making socket non-blocking\n", WSAGetLastError());
+			close();
+			return E_FAIL;
+		}
+		return S_OK;
+	}
+
+	bool send(const char* data, int size, const sockaddr_in& to) override {
+		system_calls_++;
+		if (sendto(sock_, data, size, 0, (const sockaddr*)&to, (int)sizeof(to)) == SOCKET_ERROR) {
+			const int err = WSAGetLastError();
+			if (err != WSAEWOULDBLOCK)
+				winfx::DebugOut(L"Error %d in send.\n", err);
+			countFailure(err);
+			return false;
+		}
+		queued_++;
+		completed_++;
+		return true;
+	}
+
+	int receive(char* buffer, int size, sockaddr_in* from) override {
+		for (;;) {
+			int fromLength = sizeof(*from);
+			const int n = recvfrom(sock_, buffer, size, 0, (sockaddr*)from, &fromLength);
+			if (n >= 0)
+				return n;
+			// A port unreachable from an earlier send; skip it.
+			if (WSAGetLastError() != WSAECONNRESET)
+				return -1;
+		}
+	}
+
+	void close() override {
+		if (sock_ != INVALID_SOCKET) {
+			closesocket(sock_);
+			sock_ = INVALID_SOCKET;
+		}
+	}
+
+	DatagramBackend backend() const override { return kDatagramSendto; }
+
+private:
+	SOCKET sock_ = INVALID_SOCKET;
+};
+
+// Sends from kRioSlots fixed slots in one registered buffer, each holding a
+// datagram and the address it goes to. send() takes a free slot and queues
+// it with RIO_MSG_DEFER, which stays in user mode; flush() hands everything
+// queued to the kernel in one call. The completion queue is polled, also
+// without a system call, whenever a slot is wanted, and each completion
+// returns its slot to the free list.
+class RioDatagramSender : public DatagramSender {
+public:
+	~RioDatagramSender() { close(); }
+
+	HRESULT open() override {
+		sock_ = WSASocket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, WSA_FLAG_REGISTERED_IO);
+		if (sock_ == INVALID_SOCKET) {
+			winfx::DebugOut(L"Error %d allocating Registered I/O socket\n", WSAGetLastError());
+			return E_FAIL;
+		}
+		GUID functions = WSAID_MULTIPLE_RIO;
+		DWORD bytes = 0;
+		rio_.cbSize = sizeof(rio_);
+		if (WSAIoctl(sock_, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &functions, sizeof(functions),
+			&rio_, sizeof(rio_), &bytes, NULL, NULL) == SOCKET_ERROR) {
+			winfx::DebugOut(L"Error %d loading Registered I/O\n", WSAGetLastError());
+			close();
+			return E_FAIL;
+		}
+		if (!setBroadcast(sock_)) {
+			close();
+			return E_FAIL;
+		}
+
+		// Payloads, then an address per slot.
+		const DWORD size = kRioSlots * (kRioSlotBytes + sizeof(SOCKADDR_INET));
+		buffer_ = static_cast<char*>(VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+		if (buffer_ == nullptr) {
+			close();
+			return E_OUTOFMEMORY;
+		}
+		buffer_id_ = rio_.RIORegisterBuffer(buffer_, size);
+		cq_ = rio_.RIOCreateCompletionQueue(kRioSlots + 1, NULL);
+		if (buffer_id_ == RIO_INVALID_BUFFERID || cq_ == RIO_INVALID_CQ) {
+			winfx::DebugOut(L"Error %d registering Registered I/O buffers\n", WSAGetLastError());
+			close();
+			return E_FAIL;
+		}
+		// Nothing is received, but the queue must allow one receive.
+		rq_ = rio_.RIOCreateRequestQueue(sock_, 1, 1, kRioSlots, 1, cq_, cq_, this);
+		if (rq_ == RIO_INVALID_RQ) {
+			winfx::DebugOut(L"Error %d creating Registered I/O queue\n", WSAGetLastError());
+			close();
+			return E_FAIL;
+		}
+		free_count_ = 0;
+		for (int slot = kRioSlots - 1; slot >= 0; slot--)
+			free_[free_count_++] = slot;
+		return S_OK;
+	}
+
+	bool send(const char* data, int size, const sockaddr_in& to) override {
+		if (rq_ == RIO_INVALID_RQ || size > kRioSlotBytes) {
+			countFailure(WSAEMSGSIZE);
+			return false;
+		}
+		reap();
+		if (free_count_ == 0) {
+			// Everything is in flight: push out what is queued and see
+			// whether any of it has finished.
+			flush();
+			if (free_count_ == 0) {
+				countFailure(WSAENOBUFS);
+				return false;
+			}
+		}
+		const int slot = free_[--free_count_];
+		memcpy(buffer_ + slot * kRioSlotBytes, data, size);
+		SOCKADDR_INET* const address = addresses() + slot;
+		memset(address, 0, sizeof(*address));
+		address->Ipv4 = to;
+
+		RIO_BUF payload = { buffer_id_, (ULONG)(slot * kRioSlotBytes), (ULONG)size };
+		RIO_BUF remote = { buffer_id_, (ULONG)((char*)address - buffer_), (ULONG)sizeof(*address) };
+		if (!rio_.RIOSendEx(rq_, &payload, 1, NULL, &remote, NULL, NULL, RIO_MSG_DEFER, (PVOID)(intptr_t)slot)) {
+			free_[free_count_++] = slot;
+			countFailure(WSAGetLastError());
+			return false;
+		}
+		queued_++;
+		deferred_++;
+		return true;
+	}
+
+	void flush() override {
+		if (deferred_ > 0) {
+			system_calls_++;
+			if (!rio_.RIOSendEx(rq_, NULL, 0, NULL, NULL, NULL, NULL, RIO_MSG_COMMIT_ONLY, NULL))
+				winfx::DebugOut(L"Error %d committing sends\n", WSAGetLastError());
+			deferred_ = 0;
+		}
+		reap();
+	}
+
+	void close() override {
+		if (rq_ != RIO_INVALID_RQ) {
+			flush();
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kRioCloseWaitMs);
+			while (free_count_ < kRioSlots && std::chrono::steady_clock::now() < deadline) {
+				std::this_thread::yield();
+				reap();
+			}
+		}
+		// Closing the socket closes its request queue.
+		if (sock_ != INVALID_SOCKET) {
+			closesocket(sock_);
+			sock_ = INVALID_SOCKET;
+		}
+		rq_ = RIO_INVALID_RQ;
+		if (cq_ != RIO_INVALID_CQ) {
+			rio_.RIOCloseCompletionQueue(cq_);
+			cq_ = RIO_INVALID_CQ;
+		}
+		if (buffer_id_ != RIO_INVALID_BUFFERID) {
+			rio_.RIODeregisterBuffer(buffer_id_);
+			buffer_id_ = RIO_INVALID_BUFFERID;
+		}
+		if (buffer_ != nullptr) {
+			VirtualFree(buffer_, 0, MEM_RELEASE);
+			buffer_ = nullptr;
+		}
+	}
+
+	DatagramBackend backend() const override { return kDatagramRegisteredIo; }
+
+	// Submitted but not completed as of the last poll of the completion
+	// queue.
+	int backlog() const override {
+		return rq_ == RIO_INVALID_RQ ? 0 : kRioSlots - free_count_ - deferred_;
+	}
+
+private:
+	SOCKADDR_INET* addresses() const {
+		return reinterpret_cast<SOCKADDR_INET*>(buffer_ + kRioSlots * kRioSlotBytes);
+	}
+
+	// Takes every completion waiting, returning their slots.
+	void reap() {
+		RIORESULT results[32];
+		for (;;) {
+			const ULONG count = rio_.RIODequeueCompletion(cq_, results, ARRAYSIZE(results));
+			if (count == 0 || count == RIO_CORRUPT_CQ)
+				return;
+			for (ULONG i = 0; i < count; i++) {
+				if (results[i].Status == 0)
+					completed_++;
+				else
+					countFailure(results[i].Status);
+				free_[free_count_++] = (int)results[i].RequestContext;
+			}
+		}
+	}
+
+	SOCKET sock_ = INVALID_SOCKET;
+	RIO_EXTENSION_FUNCTION_TABLE rio_ = { 0 };
+	char* buffer_ = nullptr;
+	RIO_BUFFERID buffer_id_ = RIO_INVALID_BUFFERID;
+	RIO_CQ cq_ = RIO_INVALID_CQ;
+	RIO_RQ rq_ = RIO_INVALID_RQ;
+	int free_[kRioSlots];
+	int free_count_ = 0;
+	int deferred_ = 0;
+};
+
+std::unique_ptr<DatagramSender> createDatagramSender(DatagramBackend backend) {
+	if (backend == kDatagramRegisteredIo)
+		return std::unique_ptr<DatagramSender>(new RioDatagramSender);
+	return std::unique_ptr<DatagramSender>(new SendtoDatagramSender);
+}
+
+std::unique_ptr<DatagramSender> openDatagramSender(DatagramBackend backend) {
+	std::unique_ptr<DatagramSender> sender = createDatagramSender(backend);
+	if (SUCCEEDED(sender->open()))
+		return sender;
+	if (backend == kDatagramSendto)
+		return nullptr;
+	winfx::DebugOut(L"Falling back to sendto\n");
+	return openDatagramSender(kDatagramSendto);
+}
+
+const wchar_t* datagramBackendName(DatagramBackend backend) {
+	switch (backend) {
+	case kDatagramSendto: return L"sendto";
+	case kDatagramRegisteredIo: return L"registered I/O";
+	}
+	return L"?";
+}
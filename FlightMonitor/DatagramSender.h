@@ -0,0 +1,103 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+#include "framework.h"
+
+// How a UDP output puts its datagrams on the wire.
+enum DatagramBackend {
+	// One sendto per datagram.
+	kDatagramSendto,
+	// Winsock Registered I/O: datagrams are copied into a buffer registered
+	// with the kernel once, queued without a system call and submitted
+	// together by flush(), with failures reported on a completion queue.
+	// Needs Windows 8 or later; open() fails where it is unavailable. It
+	// does not receive, so ForeFlightBroadcaster gets no XFBK feedback
+	// through it and judges congestion from failures and backlog alone.
+	kDatagramRegisteredIo,
+};
+
+// Datagrams a Registered I/O sender can have queued or in flight at once,
+// and the largest it can send.
+constexpr int kRioSlots = 256;
+constexpr int kRioSlotBytes = 256;
+
+// A UDP socket that sends. Only one thread at a time may call send(),
+// flush(), backlog(), receive() and close(); the counters can be read from
+// any thread.
+class DatagramSender {
+public:
+	virtual ~DatagramSender() {}
+
+	virtual HRESULT open() = 0;
+
+	// Queues or sends a datagram. False if it could not be, which is
+	// counted as a failure.
+	virtual bool send(const char* data, int size, const sockaddr_in& to) = 0;
+
+	// Submits whatever send() queued. The sendto backend has nothing queued.
+	virtual void flush() {}
+
+	// Datagrams submitted that the network stack has not yet finished with.
+	// Winsock cannot say how full a UDP socket's send buffer is, so the
+	// sendto backend reports none; its socket does not block, and a full
+	// buffer fails send() with WSAEWOULDBLOCK instead.
+	virtual int backlog() const { return 0; }
+
+	// Takes a datagram that arrived on this socket, such as a receiver's
+	// feedback, without waiting. Its size, or -1 if there is none or the
+	// backend cannot receive.
+	virtual int receive(char* buffer, int size, sockaddr_in* from) { return -1; }
+
+	virtual void close() = 0;
+
+	virtual DatagramBackend backend() const = 0;
+
+	// Datagrams accepted by send(), those the network stack has confirmed,
+	// those that failed either in send() or on completion, and the system
+	// calls made doing it. With sendto every accepted datagram is complete.
+	uint64_t queued() const { return queued_; }
+	uint64_t completed() const { return completed_; }
+	uint64_t failed() const { return failed_; }
+	uint64_t systemCalls() const { return system_calls_; }
+	// The Winsock error of the last failure, or 0.
+	int lastError() const { return last_error_; }
+
+protected:
+	void countFailure(int error) {
+		failed_++;
+		last_error_ = error;
+	}
+
+	std::atomic<uint64_t> queued_{ 0 };
+	std::atomic<uint64_t> completed_{ 0 };
+	std::atomic<uint64_t> failed_{ 0 };
+	std::atomic<uint64_t> system_calls_{ 0 };
+	std::atomic<int> last_error_{ 0 };
+};
+
+// A sender for backend, with SO_BROADCAST set once open.
+std::unique_ptr<DatagramSender> createDatagramSender(DatagramBackend backend);
+
+// A sender for backend, open, or if backend cannot open, a sendto sender.
+// Null only if no socket could be opened.
+std::unique_ptr<DatagramSender> openDatagramSender(DatagramBackend backend);
+
+const wchar_t* datagramBackendName(DatagramBackend backend);
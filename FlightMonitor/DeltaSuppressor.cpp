@@ -0,0 +1,72 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include "DeltaSuppressor.h"
+
+constexpr double kMetersPerDegree = 111195.0;
+constexpr double kRadiansPerDegree = 0.017453292519943295;
+
+static double angleDelta(double a, double b) {
+	return fabs(remainder(a - b, 360.0));
+}
+
+bool DeltaSuppressor::exceedsThresholds(const SimData& data) const {
+	const SimData& last = last_sent_;
+
+	if (fields_ & kSimFieldPosition) {
+		// Equirectangular distance is plenty for thresholds of a few meters.
+		const double north = (data.gps_lat - last.gps_lat) * kMetersPerDegree;
+		const double east = remainder(data.gps_lon - last.gps_lon, 360.0) * kMetersPerDegree *
+			cos(data.gps_lat * kRadiansPerDegree);
+		if (north * north + east * east > thresholds_.position_m * thresholds_.position_m)
+			return true;
+		if (fabs(data.gps_alt - last.gps_alt) > thresholds_.altitude_m)
+			return true;
+	}
+
+	if (fields_ & kSimFieldTrack) {
+		if (angleDelta(data.gps_track, last.gps_track) > thresholds_.track_deg)
+			return true;
+		if (fabs(data.gps_groundspeed - last.gps_groundspeed) > thresholds_.groundspeed_mps)
+			return true;
+	}
+
+	if (fields_ & kSimFieldAttitude) {
+		if (fabs(data.pitch - last.pitch) > thresholds_.attitude_deg ||
+			fabs(data.bank - last.bank) > thresholds_.attitude_deg ||
+			angleDelta(data.heading, last.heading) > thresholds_.attitude_deg)
+			return true;
+	}
+
+	return false;
+}
+
+bool DeltaSuppressor::shouldSend(const SimSample& sample) {
+	const bool send = !has_sent_ ||
+		std::chrono::steady_clock::now() - last_sent_time_ >= std::chrono::milliseconds(thresholds_.keepalive_ms) ||
+		exceedsThresholds(sample.data);
+
+	if (!send)
+		suppressed_.fetch_add(1, std::memory_order_relaxed);
+	return send;
+}
+
+void DeltaSuppressor::sent(const SimSample& sample) {
+	last_sent_ = sample.data;
+	last_sent_time_ = std::chrono::steady_clock::now();
+	has_sent_ = true;
+	sent_.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,70 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+#include "SimData.h"
+
+// How far a sample has to move from the last one sent before it is worth
+// sending again. Only the fields selected by the suppressor's SimField mask
+// are compared.
+struct DeltaThresholds {
+	double position_m = 5.0;        // horizontal distance
+	double altitude_m = 3.0;
+	double track_deg = 2.0;
+	double groundspeed_mps = 0.5;
+	double attitude_deg = 0.5;      // each of pitch, bank and heading
+	int keepalive_ms = 1000;        // send anyway after this long
+};
+
+// Drops outgoing reports that would tell the receiver nothing new, for
+// example while parked or in a stable cruise. A report is always sent once
+// the keepalive interval has passed so that the receiver does not decide
+// the feed has been lost. The keepalive is timed on the steady clock, not
+// the samples' wall-clock times, so a clock step cannot silence the feed.
+//
+// shouldSend() and sent() are called from one thread; the counters may be
+// read from any.
+class DeltaSuppressor {
+public:
+	DeltaSuppressor(unsigned fields, const DeltaThresholds& thresholds) :
+		fields_(fields), thresholds_(thresholds) {}
+
+	// Whether sample is worth sending. Call sent() once it has gone out; a
+	// report that could not be sent leaves the next one due.
+	bool shouldSend(const SimSample& sample);
+	void sent(const SimSample& sample);
+
+	// Forget the last report so the next one is always sent.
+	void reset() { has_sent_ = false; }
+
+	uint64_t sentCount() const { return sent_.load(std::memory_order_relaxed); }
+	uint64_t suppressedCount() const { return suppressed_.load(std::memory_order_relaxed); }
+
+private:
+	bool exceedsThresholds(const SimData& data) const;
+
+	const unsigned fields_;
+	const DeltaThresholds thresholds_;
+	SimData last_sent_;
+	std::chrono::steady_clock::time_point last_sent_time_;
+	bool has_sent_ = false;
+	std::atomic<uint64_t> sent_{ 0 };
+	std::atomic<uint64_t> suppressed_{ 0 };
+};
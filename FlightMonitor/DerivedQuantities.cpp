@@ -0,0 +1,382 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <limits>
+
+#include "framework.h"
+#include "DerivedQuantities.h"
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kMetersPerDegree = 111320;
+constexpr double kGravity = 9.80665;
+
+// A gap this long (a pause, a reconnect) restarts the windows.
+constexpr int64_t kDerivedMaxGapMs = 5000;
+
+// A value needs this much of its window before it means anything.
+constexpr double kDerivedMinWindowFraction = 0.5;
+
+// The wind is fitted to one velocity a second, once they spread this far
+// across the track in both directions, about a 60 degree turn at 120 knots.
+constexpr int64_t kWindIntervalMs = 1000;
+constexpr int kWindMinSamples = 10;
+constexpr double kWindMinSpreadMps = 5;
+
+static const DerivedQuantityInfo kDerivedQuantities[kDerivedQuantityCount] = {
+	{ "Vertical speed", "m/s", kSimFieldPosition, 0, 2.0 },
+	{ "Velocity north", "m/s", kSimFieldPosition, 0, 1.0 },
+	{ "Velocity east", "m/s", kSimFieldPosition, derivedBit(kDerivedVelocityNorth), 1.0 },
+	{ "Turn rate", "deg/s", kSimFieldTrack, 0, 2.0 },
+	{ "Pitch rate", "deg/s", kSimFieldAttitude, 0, 1.0 },
+	{ "Bank rate", "deg/s", kSimFieldAttitude, 0, 1.0 },
+	{ "Load factor", "G", 0,
+		derivedBit(kDerivedVerticalSpeed) | derivedBit(kDerivedVelocityNorth) | derivedBit(kDerivedVelocityEast), 1.0 },
+	{ "Wind speed", "m/s", 0, derivedBit(kDerivedVelocityNorth) | derivedBit(kDerivedVelocityEast), 120.0 },
+	{ "Wind direction", "deg", 0, derivedBit(kDerivedWindSpeed), 120.0 },
+};
+
+const DerivedQuantityInfo& derivedQuantityInfo(DerivedQuantity quantity) {
+	return kDerivedQuantities[quantity];
+}
+
+static double notAvailable() {
+	return std::numeric_limits<double>::quiet_NaN();
+}
+
+void VelocityCircle::add(int64_t timeMs, double north, double east) {
+	if (count_ == kCapacity) {
+		accumulate(north_[first_], east_[first_], -1);
+		first_ = (first_ + 1) % kCapacity;
+		count_--;
+	}
+	const int index = (first_ + count_) % kCapacity;
+	times_[index] = timeMs;
+	north_[index] = north;
+	east_[index] = east;
+	count_++;
+	accumulate(north, east, 1);
+	while (count_ > 1 && (timeMs - times_[first_]) / 1000.0 > span_) {
+		accumulate(north_[first_], east_[first_], -1);
+		first_ = (first_ + 1) % kCapacity;
+		count_--;
+	}
+}
+
+void VelocityCircle::clear() {
+	first_ = 0;
+	count_ = 0;
+	sum_x_ = sum_y_ = sum_xx_ = sum_yy_ = sum_xy_ = sum_xz_ = sum_yz_ = sum_z_ = 0;
+}
+
+void VelocityCircle::accumulate(double x, double y, double sign) {
+	const double z = x * x + y * y;
+	sum_x_ += sign * x;
+	sum_y_ += sign * y;
+	sum_xx_ += sign * x * x;
+	sum_yy_ += sign * y * y;
+	sum_xy_ += sign * x * y;
+	sum_xz_ += sign * x * z;
+	sum_yz_ += sign * y * z;
+	sum_z_ += sign * z;
+}
+
+bool VelocityCircle::fit(double* north, double* east) const {
+	if (count_ < kWindMinSamples)
+		return false;
+
+	// The smaller spread of the velocities about their mean: near zero on a
+	// straight leg, where any circle through them is as good as another.
+	const double n = count_;
+	const double cxx = sum_xx_ / n - (sum_x_ / n) * (sum_x_ / n);
+	const double cyy = sum_yy_ / n - (sum_y_ / n) * (sum_y_ / n);
+	const double cxy = sum_xy_ / n - (sum_x_ / n) * (sum_y_ / n);
+	const double half = (cxx + cyy) / 2;
+	const double minor = half - sqrt((cxx - cyy) * (cxx - cyy) / 4 + cxy * cxy);
+	if (minor < kWindMinSpreadMps * kWindMinSpreadMps)
+		return false;
+
+	// x^2 + y^2 + Dx + Ey + F = 0 in the least-squares sense, by Cramer's
+	// rule on the normal equations.
+	const double a[3][3] = {
+		{ sum_xx_, sum_xy_, sum_x_ },
+		{ sum_xy_, sum_yy_, sum_y_ },
+		{ sum_x_, sum_y_, n },
+	};
+	const double b[3] = { -sum_xz_, -sum_yz_, -sum_z_ };
+	auto det = [](const double m[3][3]) {
+		return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+			m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+			m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	};
+	const double d = det(a);
+	if (d == 0)
+		return false;
+	double solution[3];
+	for (int column = 0; column < 3; column++) {
+		double m[3][3];
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				m[i][j] = j == column ? b[i] : a[i][j];
+		solution[column] = det(m) / d;
+	}
+
+	// The radius is the airspeed, which had better be more than the wind.
+	const double cx = -solution[0] / 2;
+	const double cy = -solution[1] / 2;
+	const double radius2 = cx * cx + cy * cy - solution[2];
+	if (radius2 <= cx * cx + cy * cy)
+		return false;
+	*north = cx;
+	*east = cy;
+	return true;
+}
+
+void DerivedQuantities::request(unsigned quantities) {
+	for (int i = 0; i < kDerivedQuantityCount; i++)
+		if (quantities & derivedBit((DerivedQuantity)i))
+			requests_[i]++;
+	setDemand();
+}
+
+void DerivedQuantities::release(unsigned quantities) {
+	for (int i = 0; i < kDerivedQuantityCount; i++)
+		if ((quantities & derivedBit((DerivedQuantity)i)) && requests_[i] > 0)
+			requests_[i]--;
+	setDemand();
+}
+
+// Dependencies come earlier in the catalogue, so one pass from the end
+// closes over them.
+void DerivedQuantities::setDemand() {
+	unsigned demand = 0;
+	for (int i = kDerivedQuantityCount - 1; i >= 0; i--) {
+		const unsigned bit = derivedBit((DerivedQuantity)i);
+		if (requests_[i] > 0)
+			demand |= bit;
+		if (demand & bit)
+			demand |= kDerivedQuantities[i].depends;
+	}
+
+	unsigned fields = 0;
+	for (int i = 0; i < kDerivedQuantityCount; i++) {
+		const unsigned bit = derivedBit((DerivedQuantity)i);
+		if ((demand ^ demand_) & bit)
+			clear((DerivedQuantity)i);
+		if (demand & bit)
+			fields |= kDerivedQuantities[i].fields;
+	}
+	demand_ = demand;
+	fields_ = fields;
+	computed_ = 0;
+}
+
+void DerivedQuantities::clear(DerivedQuantity quantity) {
+	switch (quantity) {
+	case kDerivedVerticalSpeed:
+		altitude_.clear();
+		break;
+	case kDerivedVelocityNorth:
+		have_position_ = false;
+		travelled_north_ = travelled_east_ = 0;
+		north_.clear();
+		break;
+	case kDerivedVelocityEast:
+		east_.clear();
+		break;
+	case kDerivedTurnRate:
+		have_track_ = false;
+		track_window_.clear();
+		break;
+	case kDerivedPitchRate:
+		pitch_.clear();
+		break;
+	case kDerivedBankRate:
+		bank_.clear();
+		break;
+	case kDerivedLoadFactor:
+		accel_north_.clear();
+		accel_east_.clear();
+		accel_up_.clear();
+		break;
+	case kDerivedWindSpeed:
+		circle_.clear();
+		last_circle_ms_ = 0;
+		have_wind_ = false;
+		break;
+	default:
+		break;
+	}
+}
+
+void DerivedQuantities::reset() {
+	for (int i = 0; i < kDerivedQuantityCount; i++)
+		clear((DerivedQuantity)i);
+	computed_ = 0;
+}
+
+void DerivedQuantities::onStateChange(SimulatorInterfaceState state) {
+	if (state != SimInterfaceInFlight)
+		reset();
+}
+
+void DerivedQuantities::onSample(const SimSample& sample) {
+	if (epoch_ > 0 && (sample.time_ms < sample_.time_ms || sample.time_ms - sample_.time_ms > kDerivedMaxGapMs))
+		reset();
+	epoch_++;
+	sample_ = sample;
+	computed_ = 0;
+	for (int i = 0; i < kDerivedQuantityCount; i++) {
+		if (demand_ & derivedBit((DerivedQuantity)i))
+			follow((DerivedQuantity)i, sample);
+	}
+}
+
+// Brings quantity's windows up to sample. Those fed from other quantities
+// read them through value(), so each is computed once however many use it.
+void DerivedQuantities::follow(DerivedQuantity quantity, const SimSample& sample) {
+	const SimData& data = sample.data;
+	switch (quantity) {
+	case kDerivedVerticalSpeed:
+		altitude_.add(sample.time_ms, data.gps_alt);
+		break;
+
+	case kDerivedVelocityNorth:
+		if (have_position_) {
+			double dlon = data.gps_lon - last_lon_;
+			if (dlon > 180)
+				dlon -= 360;
+			else if (dlon < -180)
+				dlon += 360;
+			const double lat = (data.gps_lat + last_lat_) / 2;
+			travelled_north_ += (data.gps_lat - last_lat_) * kMetersPerDegree;
+			travelled_east_ += dlon * kMetersPerDegree * cos(lat * kPi / 180);
+		}
+		have_position_ = true;
+		last_lat_ = data.gps_lat;
+		last_lon_ = data.gps_lon;
+		north_.add(sample.time_ms, travelled_north_);
+		break;
+
+	case kDerivedVelocityEast:
+		east_.add(sample.time_ms, travelled_east_);
+		break;
+
+	case kDerivedTurnRate:
+		if (have_track_)
+			track_ += remainder(data.gps_track - track_, 360.0);
+		else
+			track_ = data.gps_track;
+		have_track_ = true;
+		track_window_.add(sample.time_ms, track_);
+		break;
+
+	case kDerivedPitchRate:
+		// SimConnect's pitch is positive nose down.
+		pitch_.add(sample.time_ms, -data.pitch);
+		break;
+
+	case kDerivedBankRate:
+		bank_.add(sample.time_ms, data.bank);
+		break;
+
+	case kDerivedLoadFactor: {
+		const double north = value(kDerivedVelocityNorth);
+		const double east = value(kDerivedVelocityEast);
+		const double up = value(kDerivedVerticalSpeed);
+		if (!isnan(north) && !isnan(east) && !isnan(up)) {
+			accel_north_.add(sample.time_ms, north);
+			accel_east_.add(sample.time_ms, east);
+			accel_up_.add(sample.time_ms, up);
+		}
+		break;
+	}
+
+	case kDerivedWindSpeed: {
+		if (sample.time_ms - last_circle_ms_ < kWindIntervalMs)
+			break;
+		const double north = value(kDerivedVelocityNorth);
+		const double east = value(kDerivedVelocityEast);
+		if (isnan(north) || isnan(east))
+			break;
+		last_circle_ms_ = sample.time_ms;
+		circle_.add(sample.time_ms, north, east);
+		if (circle_.fit(&wind_north_, &wind_east_))
+			have_wind_ = true;
+		break;
+	}
+
+	default:
+		break;
+	}
+	updates_++;
+}
+
+double DerivedQuantities::value(DerivedQuantity quantity) {
+	const unsigned bit = derivedBit(quantity);
+	if (!(demand_ & bit))
+		return notAvailable();
+	if (!(computed_ & bit)) {
+		values_[quantity] = compute(quantity);
+		computed_ |= bit;
+		evaluations_++;
+	}
+	return values_[quantity];
+}
+
+template <int Capacity>
+static double windowSlope(const SlidingWindow<Capacity>& window, DerivedQuantity quantity) {
+	if (window.seconds() < kDerivedQuantities[quantity].window_s * kDerivedMinWindowFraction)
+		return notAvailable();
+	return window.slope();
+}
+
+double DerivedQuantities::compute(DerivedQuantity quantity) {
+	switch (quantity) {
+	case kDerivedVerticalSpeed:
+		return windowSlope(altitude_, quantity);
+	case kDerivedVelocityNorth:
+		return windowSlope(north_, quantity);
+	case kDerivedVelocityEast:
+		return windowSlope(east_, quantity);
+	case kDerivedTurnRate:
+		return windowSlope(track_window_, quantity);
+	case kDerivedPitchRate:
+		return windowSlope(pitch_, quantity);
+	case kDerivedBankRate:
+		return windowSlope(bank_, quantity);
+
+	case kDerivedLoadFactor: {
+		const double north = windowSlope(accel_north_, quantity);
+		const double east = windowSlope(accel_east_, quantity);
+		const double up = windowSlope(accel_up_, quantity) + kGravity;
+		return sqrt(north * north + east * east + up * up) / kGravity;
+	}
+
+	case kDerivedWindSpeed:
+		return have_wind_ ? sqrt(wind_north_ * wind_north_ + wind_east_ * wind_east_) : notAvailable();
+
+	case kDerivedWindDirection: {
+		// The fit's centre is where the wind blows to.
+		if (isnan(value(kDerivedWindSpeed)))
+			return notAvailable();
+		const double direction = atan2(-wind_east_, -wind_north_) * 180 / kPi;
+		return direction < 0 ? direction + 360 : direction;
+	}
+
+	default:
+		return notAvailable();
+	}
+}
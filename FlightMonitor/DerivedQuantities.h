@@ -0,0 +1,172 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "OutputSink.h"
+#include "SlidingWindow.h"
+
+// Quantities worked out from the sample stream rather than read from the
+// simulator. Listed so that each comes after those it is computed from.
+enum DerivedQuantity {
+	kDerivedVerticalSpeed,    // m/s from the GPS altitude, up is positive
+	kDerivedVelocityNorth,    // m/s over the ground from position deltas
+	kDerivedVelocityEast,
+	kDerivedTurnRate,         // degrees/s of ground track, right is positive
+	kDerivedPitchRate,        // degrees/s, nose up is positive
+	kDerivedBankRate,         // degrees/s
+	kDerivedLoadFactor,       // G from the change in velocity
+	kDerivedWindSpeed,        // m/s
+	kDerivedWindDirection,    // degrees true the wind blows from
+	kDerivedQuantityCount,
+};
+
+constexpr unsigned derivedBit(DerivedQuantity quantity) { return 1u << quantity; }
+
+// What a quantity reads and how far back it looks.
+struct DerivedQuantityInfo {
+	const char* name;         // e.g. "Turn rate"
+	const char* units;        // e.g. "deg/s"
+	unsigned fields;          // SimField bits of the samples
+	unsigned depends;         // derivedBit()s of the quantities it is computed from
+	double window_s;
+};
+
+const DerivedQuantityInfo& derivedQuantityInfo(DerivedQuantity quantity);
+
+// Ground velocities over the last couple of minutes, once a second, and the
+// circle through them. With a steady airspeed and wind the ground velocity
+// in a turn traces a circle around the wind vector, so the centre of a
+// least-squares (Kasa) fit is the wind. Running sums keep each add()
+// constant time, as in SlidingWindow.
+class VelocityCircle {
+public:
+	static constexpr int kCapacity = 128;
+
+	explicit VelocityCircle(double spanSeconds) : span_(spanSeconds) {}
+
+	void add(int64_t timeMs, double north, double east);
+	void clear();
+
+	// The centre, in m/s, when the velocities cover enough of a turn to
+	// place it; false on a straight leg.
+	bool fit(double* north, double* east) const;
+
+private:
+	void accumulate(double x, double y, double sign);
+
+	double span_;
+	int64_t times_[kCapacity];
+	double north_[kCapacity];
+	double east_[kCapacity];
+	int first_ = 0;
+	int count_ = 0;
+
+	// Of x (north), y (east) and z = x^2 + y^2.
+	double sum_x_ = 0, sum_y_ = 0;
+	double sum_xx_ = 0, sum_yy_ = 0, sum_xy_ = 0;
+	double sum_xz_ = 0, sum_yz_ = 0, sum_z_ = 0;
+};
+
+// Derived quantities on demand. Subscribers request the quantities they
+// read, and only those, with what they are computed from, follow the
+// samples; the rest of the catalogue costs nothing. Following is
+// incremental, a constant-time window update per sample, and the value
+// itself is worked out on the first read after each sample and kept for
+// the other readers of that sample (its epoch).
+//
+// Register with the SinkScheduler ahead of the sinks that read from it, so
+// that their passes see the sample they were handed. request(), release()
+// and value() are for those sinks on the scheduler's worker thread, or for
+// any one thread when driven directly.
+class DerivedQuantities : public OutputSink {
+public:
+	// Requests are counted, so subscribers come and go independently. A
+	// quantity that starts being followed starts with empty windows.
+	void request(unsigned quantities);
+	void release(unsigned quantities);
+
+	// The requested quantities and those they are computed from.
+	unsigned demand() const { return demand_; }
+
+	const char* sinkName() const override { return "Derived quantities"; }
+	double sinkRate() const override { return 0; }
+	unsigned sinkFields() const override { return fields_; }
+
+	void onSample(const SimSample& sample) override;
+	void onStateChange(SimulatorInterfaceState state) override;
+
+	// At the newest sample; NaN when quantity is not in demand or has too
+	// little history yet. The wind holds its last estimate between turns.
+	double value(DerivedQuantity quantity);
+
+	// Samples seen, window updates and value computations, to measure what
+	// the demand costs.
+	uint64_t epoch() const { return epoch_; }
+	uint64_t updates() const { return updates_; }
+	uint64_t evaluations() const { return evaluations_; }
+
+	// Forgets the history, e.g. between flights. Demand is kept.
+	void reset();
+
+private:
+	void setDemand();
+	void clear(DerivedQuantity quantity);
+	void follow(DerivedQuantity quantity, const SimSample& sample);
+	double compute(DerivedQuantity quantity);
+
+	int requests_[kDerivedQuantityCount] = { 0 };
+	unsigned demand_ = 0;
+	unsigned fields_ = 0;
+
+	uint64_t epoch_ = 0;
+	uint64_t updates_ = 0;
+	uint64_t evaluations_ = 0;
+	SimSample sample_;
+	unsigned computed_ = 0;
+	double values_[kDerivedQuantityCount] = { 0 };
+
+	SlidingWindow<128> altitude_{ 2.0 };
+
+	// Distance travelled north and east, summed from position deltas, so
+	// the windows see a flat odometer rather than wrapping coordinates.
+	bool have_position_ = false;
+	double last_lat_ = 0;
+	double last_lon_ = 0;
+	double travelled_north_ = 0;
+	double travelled_east_ = 0;
+	SlidingWindow<64> north_{ 1.0 };
+	SlidingWindow<64> east_{ 1.0 };
+
+	// The track unwrapped across north.
+	bool have_track_ = false;
+	double track_ = 0;
+	SlidingWindow<128> track_window_{ 2.0 };
+
+	SlidingWindow<64> pitch_{ 1.0 };
+	SlidingWindow<64> bank_{ 1.0 };
+
+	SlidingWindow<64> accel_north_{ 1.0 };
+	SlidingWindow<64> accel_east_{ 1.0 };
+	SlidingWindow<64> accel_up_{ 1.0 };
+
+	VelocityCircle circle_{ 120.0 };
+	int64_t last_circle_ms_ = 0;
+	bool have_wind_ = false;
+	double wind_north_ = 0;
+	double wind_east_ = 0;
+};
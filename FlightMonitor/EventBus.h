@@ -0,0 +1,223 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Typed events between the simulator and whatever listens to it. An event is
+// a plain struct; listeners say which types they want and hear nothing else.
+// Three ways to deliver them:
+//
+// EventBus keeps one list per event type, built at run time. Publishing
+// costs one virtual call per listener of that type.
+//
+// EventPipeline is a set of listeners fixed at compile time. Its calls are
+// direct and can be inlined, and listeners without a handler for a type
+// cost nothing for it. PipelineListener subscribes a whole pipeline to a bus
+// as one listener.
+//
+// QueuedListener moves a listener onto a thread of its own behind a bounded
+// queue, so a slow one cannot hold up the publisher or the listeners after
+// it. Per-sample work has SinkScheduler for this already.
+
+// Events queued for a QueuedListener before the oldest are dropped.
+constexpr size_t kEventQueueCapacity = 64;
+
+template <typename Event>
+class EventListener {
+public:
+	virtual ~EventListener() {}
+	virtual void onEvent(const Event& event) = 0;
+};
+
+template <typename... Events>
+class EventBus {
+public:
+	// Listeners are called in the order they subscribed and must stay alive
+	// until the bus is gone. Subscribe before the first publish().
+	template <typename Event>
+	void subscribe(EventListener<Event>* listener) {
+		std::get<Listeners<Event>>(listeners_).push_back(listener);
+	}
+
+	// Subscribes listener to each of the bus's types it is an
+	// EventListener for.
+	template <typename Listener>
+	void subscribeAll(Listener* listener) {
+		using expand = int[];
+		(void)expand{ 0, (subscribeIf<Events>(listener,
+			std::is_base_of<EventListener<Events>, Listener>()), 0)... };
+	}
+
+	template <typename Event>
+	void publish(const Event& event) const {
+		for (EventListener<Event>* listener : std::get<Listeners<Event>>(listeners_))
+			listener->onEvent(event);
+	}
+
+	template <typename Event>
+	size_t listenerCount() const { return std::get<Listeners<Event>>(listeners_).size(); }
+
+private:
+	template <typename Event>
+	using Listeners = std::vector<EventListener<Event>*>;
+
+	template <typename Event, typename Listener>
+	void subscribeIf(Listener* listener, std::true_type) { subscribe<Event>(listener); }
+	template <typename Event, typename Listener>
+	void subscribeIf(Listener*, std::false_type) {}
+
+	std::tuple<Listeners<Events>...> listeners_;
+};
+
+// Calls listener.onEvent(event) if the listener has one for the type. The
+// call names the class, so it is not virtual even when onEvent is; a
+// pipeline holds exactly the types it was declared with.
+template <typename Listener, typename Event>
+auto deliverEvent(Listener& listener, const Event& event, int) ->
+	decltype(listener.Listener::onEvent(event), void()) {
+	listener.Listener::onEvent(event);
+}
+
+template <typename Listener, typename Event>
+void deliverEvent(Listener&, const Event&, long) {}
+
+// Listeners are held by reference and called in order. A listener's
+// onEvent overloads must be declared in its own class, not only inherited,
+// or they are not found and the events are silently not delivered.
+template <typename... Listeners>
+class EventPipeline {
+public:
+	explicit EventPipeline(Listeners&... listeners) : listeners_(listeners...) {}
+
+	template <typename Event>
+	void publish(const Event& event) {
+		publishEach(event, std::index_sequence_for<Listeners...>());
+	}
+
+private:
+	template <typename Event, size_t... I>
+	void publishEach(const Event& event, std::index_sequence<I...>) {
+		using expand = int[];
+		(void)expand{ 0, (deliverEvent(std::get<I>(listeners_), event, 0), 0)... };
+	}
+
+	std::tuple<Listeners&...> listeners_;
+};
+
+template <typename Pipeline, typename Event>
+class PipelineStage : public EventListener<Event> {
+public:
+	explicit PipelineStage(Pipeline& pipeline) : pipeline_(pipeline) {}
+	void onEvent(const Event& event) override { pipeline_.publish(event); }
+
+private:
+	Pipeline& pipeline_;
+};
+
+// One virtual call from the bus per event, then the pipeline's direct ones.
+template <typename Pipeline, typename... Events>
+class PipelineListener : public PipelineStage<Pipeline, Events>... {
+public:
+	explicit PipelineListener(Pipeline& pipeline) : PipelineStage<Pipeline, Events>(pipeline)... {}
+
+	template <typename Bus>
+	void subscribeTo(Bus& bus) {
+		using expand = int[];
+		(void)expand{ 0, (bus.template subscribe<Events>(
+			static_cast<PipelineStage<Pipeline, Events>*>(this)), 0)... };
+	}
+};
+
+// Delivers events to target on the listener's own thread, in order. When
+// the target falls kEventQueueCapacity behind, the oldest waiting events
+// are dropped and counted; the publisher never waits for it.
+template <typename Event>
+class QueuedListener : public EventListener<Event> {
+public:
+	explicit QueuedListener(EventListener<Event>* target, size_t capacity = kEventQueueCapacity) :
+		target_(target), queue_(capacity > 0 ? capacity : 1) {}
+	~QueuedListener() { stop(); }
+
+	void start() {
+		stopping_ = false;
+		thread_ = std::thread(&QueuedListener::run, this);
+	}
+
+	// Delivers what is already queued, then joins the thread.
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		wake_.notify_one();
+		if (thread_.joinable())
+			thread_.join();
+	}
+
+	void onEvent(const Event& event) override {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (count_ == queue_.size()) {
+				head_ = (head_ + 1) % queue_.size();
+				count_--;
+				dropped_++;
+			}
+			queue_[(head_ + count_) % queue_.size()] = event;
+			count_++;
+		}
+		wake_.notify_one();
+	}
+
+	uint64_t dropped() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return dropped_;
+	}
+
+private:
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		for (;;) {
+			wake_.wait(lock, [this] { return stopping_ || count_ > 0; });
+			if (count_ == 0)
+				return;  // stopping, and nothing left
+			const Event event = queue_[head_];
+			head_ = (head_ + 1) % queue_.size();
+			count_--;
+			lock.unlock();
+			target_->onEvent(event);
+			lock.lock();
+		}
+	}
+
+	EventListener<Event>* target_;
+	std::vector<Event> queue_;   // a ring, allocated once
+	size_t head_ = 0;
+	size_t count_ = 0;
+	uint64_t dropped_ = 0;
+	bool stopping_ = false;
+	mutable std::mutex mutex_;
+	std::condition_variable wake_;
+	std::thread thread_;
+};
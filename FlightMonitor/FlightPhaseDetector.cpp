@@ -0,0 +1,275 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include "FlightPhaseDetector.h"
+
+// A gap this long (a pause, a reconnect) restarts the windows.
+constexpr int64_t kPhaseMaxGapMs = 5000;
+
+constexpr double kParkedSpeedMps = 0.5;
+constexpr int64_t kParkedMs = 30000;
+
+// Faster than this on the ground is a takeoff roll or a landing rollout.
+constexpr double kTaxiSpeedMps = 15;   // about 30 knots
+constexpr double kTakeoffAccelerationMps2 = 0.3;
+
+constexpr double kLiftoffClimbMps = 1.0;
+constexpr double kLiftoffHeightMeters = 5;
+
+// Twenty second vertical speed that counts as climbing or descending,
+// about 300 feet per minute, and how long it must hold.
+constexpr double kClimbRateMps = 1.5;
+constexpr int64_t kPhaseDwellMs = 10000;
+
+constexpr double kApproachHeightMeters = 450;   // about 1500 feet
+
+// A descent whose one second vertical speed comes up to this has levelled
+// off, and may have touched down if it was low enough and slow enough.
+constexpr double kTouchdownLevelMps = 0.25;
+constexpr double kTouchdownMaxHeightMeters = 30;
+constexpr double kTouchdownMaxSpeedMps = 90;
+
+// After levelling off, the aircraft must slow to taxi speed within this
+// time and without climbing or descending this much.
+constexpr int64_t kRolloutMaxMs = 90000;
+constexpr double kRolloutAltitudeMeters = 15;
+
+constexpr double kGroundAltitudeSmoothing = 0.05;
+
+const char* flightPhaseName(FlightPhase phase) {
+	switch (phase) {
+	case kPhaseParked: return "Parked";
+	case kPhaseTaxi: return "Taxi";
+	case kPhaseTakeoffRoll: return "Takeoff roll";
+	case kPhaseClimb: return "Climb";
+	case kPhaseCruise: return "Cruise";
+	case kPhaseDescent: return "Descent";
+	case kPhaseApproach: return "Approach";
+	case kPhaseRollout: return "Rollout";
+	default: return "Unknown";
+	}
+}
+
+double flightPhaseRateScale(FlightPhase phase) {
+	switch (phase) {
+	case kPhaseParked: return 0.1;
+	case kPhaseTaxi: return 0.5;
+	case kPhaseTakeoffRoll:
+	case kPhaseApproach:
+	case kPhaseRollout: return 2;
+	default: return 1;
+	}
+}
+
+void FlightPhaseDetector::reset() {
+	phase_ = kPhaseUnknown;
+	pending_ = kPhaseUnknown;
+	last_time_ms_ = 0;
+	short_climb_.clear();
+	climb_.clear();
+	speed_.clear();
+	history_next_ = 0;
+	for (int i = 0; i < kClimbHistory; i++)
+		history_time_ms_[i] = 0;
+	have_ground_alt_ = false;
+	have_on_ground_ = false;
+	have_agl_ = false;
+	stopped_since_ms_ = -1;
+}
+
+void FlightPhaseDetector::onStateChange(SimulatorInterfaceState state) {
+	if (state != SimInterfaceInFlight)
+		reset();
+}
+
+bool FlightPhaseDetector::heightAboveGround(const SimData& data, double* height) const {
+	double ground;
+	if (terrain_ != nullptr && terrain_->elevation(data.gps_lat, data.gps_lon, &ground)) {
+		*height = data.gps_alt - ground;
+		return true;
+	}
+	if (!have_ground_alt_)
+		return false;
+	*height = data.gps_alt - ground_alt_;
+	return true;
+}
+
+// Whether a level-off is low enough to be a touchdown. The simulator's own
+// on-ground flag and height above the ground are trusted once it has shown
+// that it sends them, then the terrain, then the altitude where the
+// aircraft was last on the ground. With none of these it is not.
+bool FlightPhaseDetector::nearGround(const SimData& data, double height, bool haveHeight) const {
+	if (data.on_ground >= 0.5)
+		return true;
+	if (have_on_ground_)
+		return false;
+	if (have_agl_)
+		return data.alt_agl < kTouchdownMaxHeightMeters;
+	return haveHeight && height < kTouchdownMaxHeightMeters;
+}
+
+void FlightPhaseDetector::setPhase(FlightPhase phase, const SimSample& sample) {
+	pending_ = phase;
+	if (phase == phase_.load(std::memory_order_relaxed))
+		return;
+	phase_ = phase;
+	for (FlightPhaseCallbacks* callback : callbacks_)
+		callback->onFlightPhase(phase, sample);
+}
+
+void FlightPhaseDetector::onSample(const SimSample& sample) {
+	const SimData& data = sample.data;
+	if (sample.time_ms <= last_time_ms_)
+		return;
+	if (last_time_ms_ != 0 && sample.time_ms - last_time_ms_ > kPhaseMaxGapMs) {
+		short_climb_.clear();
+		climb_.clear();
+		speed_.clear();
+	}
+	last_time_ms_ = sample.time_ms;
+	if (data.on_ground >= 0.5)
+		have_on_ground_ = true;
+	if (data.alt_agl != 0)
+		have_agl_ = true;
+
+	short_climb_.add(sample.time_ms, data.gps_alt);
+	climb_.add(sample.time_ms, data.gps_alt);
+	speed_.add(sample.time_ms, data.gps_groundspeed);
+	history_time_ms_[history_next_] = sample.time_ms;
+	history_climb_[history_next_] = short_climb_.slope();
+	history_next_ = (history_next_ + 1) % kClimbHistory;
+
+	const double speed = data.gps_groundspeed;
+	double height = 0;
+	const bool haveHeight = heightAboveGround(data, &height);
+
+	switch (phase()) {
+	case kPhaseUnknown:
+		// Joining part way through: on the ground or in the air.
+		setPhase(speed < kTaxiSpeedMps ? kPhaseTaxi : kPhaseCruise, sample);
+		break;
+
+	case kPhaseParked:
+		if (speed > kParkedSpeedMps)
+			setPhase(kPhaseTaxi, sample);
+		break;
+
+	case kPhaseTaxi:
+		if (speed <= kParkedSpeedMps) {
+			if (stopped_since_ms_ < 0)
+				stopped_since_ms_ = sample.time_ms;
+			else if (sample.time_ms - stopped_since_ms_ >= kParkedMs)
+				setPhase(kPhaseParked, sample);
+		} else {
+			stopped_since_ms_ = -1;
+		}
+		if (speed > kTaxiSpeedMps && speed_.slope() > kTakeoffAccelerationMps2)
+			setPhase(kPhaseTakeoffRoll, sample);
+		break;
+
+	case kPhaseTakeoffRoll:
+		if (short_climb_.slope() > kLiftoffClimbMps && (!haveHeight || height > kLiftoffHeightMeters)) {
+			for (FlightPhaseCallbacks* callback : callbacks_)
+				callback->onLiftoff(sample);
+			// Judge the climb on airborne samples only.
+			climb_.clear();
+			climb_.add(sample.time_ms, data.gps_alt);
+			setPhase(kPhaseClimb, sample);
+		} else if (speed < kTaxiSpeedMps) {
+			// Rejected takeoff.
+			setPhase(kPhaseTaxi, sample);
+		}
+		break;
+
+	case kPhaseRollout:
+		if (speed < kTaxiSpeedMps) {
+			for (FlightPhaseCallbacks* callback : callbacks_)
+				callback->onTouchdown(touchdown_);
+			ground_alt_ = touchdown_.alt;
+			have_ground_alt_ = true;
+			stopped_since_ms_ = -1;
+			setPhase(kPhaseTaxi, sample);
+		} else if (data.gps_alt > touchdown_.alt + kRolloutAltitudeMeters) {
+			// A go-around or a touch and go.
+			setPhase(kPhaseClimb, sample);
+		} else if (data.gps_alt < touchdown_.alt - kRolloutAltitudeMeters) {
+			// Only a pause in the descent.
+			setPhase(kPhaseDescent, sample);
+		} else if (sample.time_ms - touchdown_.time_ms > kRolloutMaxMs) {
+			// Levelled off in the air.
+			setPhase(kPhaseCruise, sample);
+		}
+		break;
+
+	default:
+		updateAirborne(sample, height, haveHeight);
+		break;
+	}
+
+	const FlightPhase current = phase();
+	if (current == kPhaseParked || current == kPhaseTaxi) {
+		ground_alt_ = have_ground_alt_ ?
+			ground_alt_ + (data.gps_alt - ground_alt_) * kGroundAltitudeSmoothing : data.gps_alt;
+		have_ground_alt_ = true;
+	}
+}
+
+void FlightPhaseDetector::updateAirborne(const SimSample& sample, double height, bool haveHeight) {
+	const SimData& data = sample.data;
+	const FlightPhase current = phase();
+
+	if ((current == kPhaseDescent || current == kPhaseApproach) &&
+		short_climb_.slope() > -kTouchdownLevelMps &&
+		data.gps_groundspeed < kTouchdownMaxSpeedMps &&
+		nearGround(data, height, haveHeight)) {
+		// The one second window that has just levelled off mostly covers
+		// the time since contact; the one that ended a window's length ago
+		// is the rate at contact.
+		const int64_t contact_ms = sample.time_ms - 1000;
+		int best = -1;
+		for (int i = 0; i < kClimbHistory; i++) {
+			if (history_time_ms_[i] == 0)
+				continue;
+			if (best < 0 || llabs(history_time_ms_[i] - contact_ms) < llabs(history_time_ms_[best] - contact_ms))
+				best = i;
+		}
+		touchdown_.time_ms = best >= 0 ? history_time_ms_[best] : sample.time_ms;
+		touchdown_.vertical_speed = best >= 0 ? history_climb_[best] : 0;
+		touchdown_.lat = data.gps_lat;
+		touchdown_.lon = data.gps_lon;
+		touchdown_.alt = data.gps_alt;
+		touchdown_.groundspeed = data.gps_groundspeed;
+		setPhase(kPhaseRollout, sample);
+		return;
+	}
+
+	const double climb = climb_.slope();
+	FlightPhase target = kPhaseCruise;
+	if (climb > kClimbRateMps)
+		target = kPhaseClimb;
+	else if (climb < -kClimbRateMps)
+		target = (haveHeight && height < kApproachHeightMeters) ? kPhaseApproach : kPhaseDescent;
+
+	if (target == current) {
+		pending_ = current;
+	} else if (target != pending_) {
+		pending_ = target;
+		pending_since_ms_ = sample.time_ms;
+	} else if (sample.time_ms - pending_since_ms_ >= kPhaseDwellMs) {
+		setPhase(target, sample);
+	}
+}
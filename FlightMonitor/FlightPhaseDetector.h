@@ -0,0 +1,138 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "framework.h"
+#include "winfx.h"
+#include "OutputSink.h"
+#include "SlidingWindow.h"
+#include "TerrainService.h"
+
+enum FlightPhase {
+	kPhaseUnknown,
+	kPhaseParked,
+	kPhaseTaxi,
+	kPhaseTakeoffRoll,
+	kPhaseClimb,
+	kPhaseCruise,
+	kPhaseDescent,
+	kPhaseApproach,
+	kPhaseRollout,
+};
+
+// e.g. "Takeoff roll".
+const char* flightPhaseName(FlightPhase phase);
+
+// How much faster or slower than usual to record in each phase: more often
+// where things happen quickly near the ground, rarely while parked.
+double flightPhaseRateScale(FlightPhase phase);
+
+// Samples per second the detector looks at.
+constexpr double kFlightPhaseSamplesPerSecond = 10;
+
+struct TouchdownInfo {
+	int64_t time_ms = 0;
+	double lat = 0;
+	double lon = 0;
+	double alt = 0;
+	double vertical_speed = 0;  // m/s, negative
+	double groundspeed = 0;     // m/s
+};
+
+// Called on the SinkScheduler's worker thread.
+class FlightPhaseCallbacks {
+public:
+	virtual void onFlightPhase(FlightPhase phase, const SimSample& sample) = 0;
+	virtual void onLiftoff(const SimSample& sample) = 0;
+	virtual void onTouchdown(const TouchdownInfo& touchdown) = 0;
+};
+
+// Works out the phase of flight from the sample stream alone, since the
+// simulator interface only knows whether there is a position. Each sample
+// updates a few sliding windows (vertical speed over one and twenty
+// seconds, acceleration) and steps a small state machine, in constant time
+// and memory.
+//
+// With no on-ground flag the ground is inferred: liftoff is a takeoff roll
+// that starts climbing, and a touchdown is a descent that levels off and
+// then slows to taxi speed. The touchdown is reported once the aircraft has
+// slowed, with the time and vertical speed of the moment it levelled off.
+// A level-off that does not slow down within kRolloutMaxMs, and touch and
+// goes, are not touchdowns.
+//
+// Height above the ground, for the approach phase, comes from the terrain
+// service when there are tiles, and otherwise from the altitude where the
+// aircraft was last on the ground. A level-off is only taken for a
+// touchdown with some sign of the ground: the simulator's on-ground flag or
+// height above the ground, or a low enough height from either source.
+class FlightPhaseDetector : public OutputSink {
+public:
+	// terrain, if given, must be registered with the same SinkScheduler.
+	explicit FlightPhaseDetector(TerrainService* terrain = nullptr) : terrain_(terrain) {}
+
+	void addCallback(FlightPhaseCallbacks* callback) {
+		callbacks_.push_back(callback);
+	}
+
+	const char* sinkName() const override { return "Flight phase"; }
+	double sinkRate() const override { return kFlightPhaseSamplesPerSecond; }
+
+	void onSample(const SimSample& sample) override;
+	void onStateChange(SimulatorInterfaceState state) override;
+
+	// Safe from any thread.
+	FlightPhase phase() const { return phase_.load(std::memory_order_relaxed); }
+
+	void reset();
+
+private:
+	bool heightAboveGround(const SimData& data, double* height) const;
+	bool nearGround(const SimData& data, double height, bool haveHeight) const;
+	void setPhase(FlightPhase phase, const SimSample& sample);
+	void updateAirborne(const SimSample& sample, double height, bool haveHeight);
+
+	TerrainService* terrain_;
+	std::vector<FlightPhaseCallbacks*> callbacks_;
+	std::atomic<FlightPhase> phase_{ kPhaseUnknown };
+
+	int64_t last_time_ms_ = 0;
+	SlidingWindow<32> short_climb_{ 1.0 };
+	SlidingWindow<256> climb_{ 20.0 };
+	SlidingWindow<64> speed_{ 3.0 };
+
+	// Recent one second vertical speeds, to find the rate at touchdown.
+	static constexpr int kClimbHistory = 32;
+	int64_t history_time_ms_[kClimbHistory] = { 0 };
+	double history_climb_[kClimbHistory] = { 0 };
+	int history_next_ = 0;
+
+	// Altitude while last on the ground.
+	bool have_ground_alt_ = false;
+	double ground_alt_ = 0;
+
+	// Whether the simulator has sent an on-ground flag or a height above
+	// the ground.
+	bool have_on_ground_ = false;
+	bool have_agl_ = false;
+
+	int64_t stopped_since_ms_ = -1;
+	FlightPhase pending_ = kPhaseUnknown;
+	int64_t pending_since_ms_ = 0;
+	TouchdownInfo touchdown_;
+};
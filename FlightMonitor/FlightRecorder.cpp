@@ -0,0 +1,72 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include "FlightRecorder.h"
+#include "AppPaths.h"
+
+double FlightRecorder::sinkRate() const {
+	if (phases_ == nullptr)
+		return kRecorderSamplesPerSecond;
+	return kRecorderSamplesPerSecond * flightPhaseRateScale(phases_->phase());
+}
+
+void FlightRecorder::onSample(const SimSample& sample) {
+	if (!in_flight_)
+		return;
+	if (!writer_.isOpen())
+		startRecording(sample);
+	writer_.append(sample);
+	simvar_writer_.update();
+}
+
+void FlightRecorder::onStateChange(SimulatorInterfaceState state) {
+	in_flight_ = (state == SimInterfaceInFlight);
+	if (!in_flight_) {
+		writer_.close();
+		simvar_writer_.close();
+	}
+}
+
+void FlightRecorder::close() {
+	in_flight_ = false;
+	writer_.close();
+	simvar_writer_.close();
+}
+
+void FlightRecorder::startRecording(const SimSample& sample) {
+	if (directory_.empty()) {
+		directory_ = getAppDataDirectory(L"Flights");
+		if (directory_.empty())
+			return;
+	}
+
+	SYSTEMTIME st;
+	GetLocalTime(&st);
+	wchar_t name[64];
+	swprintf_s(name, L"\\flight-%04d%02d%02d-%02d%02d%02d", st.wYear, st.wMonth, st.wDay,
+		st.wHour, st.wMinute, st.wSecond);
+
+	const std::wstring base = directory_ + name;
+	std::wstring path = base + kTrackFileExtension;
+	if (FAILED(writer_.open(path.c_str(), sample.time_ms)))
+		return;
+	winfx::DebugOut(L"Recording flight to %s\n", path.c_str());
+	if (simvars_ != nullptr && !simvars_->empty()) {
+		path = base + kSimVarFileExtension;
+		simvar_writer_.open(path.c_str(), sample.time_ms, *simvars_);
+	}
+}
@@ -0,0 +1,67 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+
+#include "framework.h"
+#include "winfx.h"
+#include "FlightPhaseDetector.h"
+#include "OutputSink.h"
+#include "SimVarChannels.h"
+#include "TrackFile.h"
+
+// Samples per second written to the recording, before scaling by
+// flightPhaseRateScale().
+constexpr double kRecorderSamplesPerSecond = 10;
+
+// Records each flight to %LOCALAPPDATA%\FlightMonitor\Flights. A file is
+// started with the first sample after the simulator enters the InFlight
+// state and is closed when it leaves it.
+//
+// Given a FlightPhaseDetector, records faster during takeoff and landing
+// and slower on the ground. Given SimVarChannels, records them alongside
+// each flight in a .fmvar file of the same name.
+class FlightRecorder : public OutputSink {
+public:
+	explicit FlightRecorder(const FlightPhaseDetector* phases = nullptr) : phases_(phases) {}
+
+	const char* sinkName() const override { return "Recorder"; }
+	double sinkRate() const override;
+
+	void onSample(const SimSample& sample) override;
+	void onStateChange(SimulatorInterfaceState state) override;
+
+	// Records into directory instead of the Flights folder. Call before
+	// the scheduler starts.
+	void setDirectory(const std::wstring& directory) { directory_ = directory; }
+
+	// Call before the scheduler starts.
+	void setSimVars(const SimVarChannels* simvars) { simvars_ = simvars; }
+
+	// Only call once the scheduler has been stopped.
+	void close();
+
+private:
+	void startRecording(const SimSample& sample);
+
+	const FlightPhaseDetector* phases_;
+	bool in_flight_ = false;
+	TrackWriter writer_;
+	const SimVarChannels* simvars_ = nullptr;
+	SimVarWriter simvar_writer_;
+	std::wstring directory_;
+};
@@ -17,8 +17,6 @@
 #include "winfx.h"
 #include "ForeFlightBroadcaster.h"
 
-constexpr char SIM_NAME[] = "MSFS";
-
 HRESULT ForeFlightBroadcaster::InitWinsock() {
 	WORD wVersionRequested = MAKEWORD(2, 2);
 
@@ -33,23 +31,23 @@ HRESULT ForeFlightBroadcaster::InitWinsock() {
 	return S_OK;
 }
 
-HRESULT ForeFlightBroadcaster::init() {
-	sock_ = socket(AF_INET, SOCK_DGRAM, 0);
-	if (sock_ == INVALID_SOCKET) {
-		winfx::DebugOut(L"Error %d allocating socket\n", WSAGetLastError());
+HRESULT ForeFlightBroadcaster::init(const char* destination, u_short port, const char* simName,
+	DatagramBackend backend) {
+	sim_name_ = simName;
+	sender_ = openDatagramSender(backend);
+	if (!sender_)
 		return E_FAIL;
-	}
-
-	char broadcast = '1';
-	if (setsockopt(sock_, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0) {
-		winfx::DebugOut(L"Error %d setting socket broadcast option\n", WSAGetLastError());
-		closesocket(sock_);
-		sock_ = INVALID_SOCKET;
-		return E_FAIL;
-	}
 
 	send_addr_.sin_family = AF_INET;
-	send_addr_.sin_port = htons(FF_GPS_PORT);
+	send_addr_.sin_port = htons(port);
+	if (destination != nullptr && *destination != '\0') {
+		if (inet_pton(AF_INET, destination, &send_addr_.sin_addr) != 1) {
+			winfx::DebugOut(L"Bad ForeFlight destination %S\n", destination);
+			sender_.reset();
+			return E_INVALIDARG;
+		}
+		return S_OK;
+	}
 
 	// TODO: get correct broadcast address
 	
@@ -64,51 +62,142 @@ HRESULT ForeFlightBroadcaster::init() {
 	return S_OK;
 }
 
-void ForeFlightBroadcaster::onSimDataUpdated(const SimData* data) {
-	if (sim_.getState() == SimInterfaceInFlight) {
-		if (message_ordinal_ % kAttitueReportsPerSecond == 0)
-			broadcastPositionReport(data);
-		broadcastAttitudeReport(data);
-		message_ordinal_++;
+void ForeFlightBroadcaster::registerSinks(SinkScheduler& scheduler) {
+	scheduler.addSink(&position_sink_);
+	scheduler.addSink(&attitude_sink_);
+}
+
+void ForeFlightBroadcaster::PositionSink::onStateChange(SimulatorInterfaceState state) {
+	owner_.in_flight_ = (state == SimInterfaceInFlight);
+	owner_.position_filter_.reset();
+	owner_.attitude_filter_.reset();
+}
+
+void ForeFlightBroadcaster::PositionSink::onSample(const SimSample& sample) {
+	if (owner_.in_flight_ && owner_.position_filter_.shouldSend(sample) &&
+		owner_.broadcastPositionReport(&sample.data))
+		owner_.position_filter_.sent(sample);
+}
+
+void ForeFlightBroadcaster::PositionSink::onFlush() {
+	if (owner_.sender_) {
+		owner_.readFeedback();
+		owner_.updateRate(owner_.position_);
+		owner_.sender_->flush();
+	}
+}
+
+void ForeFlightBroadcaster::AttitudeSink::onSample(const SimSample& sample) {
+	if (owner_.in_flight_ && owner_.attitude_filter_.shouldSend(sample) &&
+		owner_.broadcastAttitudeReport(&sample.data))
+		owner_.attitude_filter_.sent(sample);
+}
+
+void ForeFlightBroadcaster::AttitudeSink::onFlush() {
+	if (owner_.sender_) {
+		owner_.readFeedback();
+		owner_.updateRate(owner_.attitude_);
+		owner_.sender_->flush();
+	}
+}
+
+// The count in an "XFBK<name>,<n>" datagram for simName, or false if it is
+// something else.
+static bool parseFeedback(const char* text, const std::string& simName, uint64_t* received) {
+	const size_t prefix = sizeof(kFeedbackPrefix) - 1;
+	if (strncmp(text, kFeedbackPrefix, prefix) != 0)
+		return false;
+	const char* name = text + prefix;
+	if (strncmp(name, simName.c_str(), simName.size()) != 0 || name[simName.size()] != ',')
+		return false;
+	const char* count = name + simName.size() + 1;
+	char* end = nullptr;
+	*received = strtoull(count, &end, 10);
+	return end != count && *end == '\0';
+}
+
+void ForeFlightBroadcaster::readFeedback() {
+	const bool broadcast = send_addr_.sin_addr.s_addr == INADDR_BROADCAST;
+	const auto now = AdaptiveRate::Clock::now();
+	char buffer[128];
+	sockaddr_in from = { 0 };
+	int size;
+	while ((size = sender_->receive(buffer, sizeof(buffer) - 1, &from)) >= 0) {
+		buffer[size] = '\0';
+		uint64_t received = 0;
+		if (!parseFeedback(buffer, sim_name_, &received))
+			continue;
+		if (!broadcast && from.sin_addr.s_addr != send_addr_.sin_addr.s_addr)
+			continue;
+
+		// A new receiver, or one that has restarted, sets a baseline.
+		const bool same = from.sin_addr.s_addr == feedback_from_.sin_addr.s_addr &&
+			from.sin_port == feedback_from_.sin_port;
+		const bool quiet = now - feedback_time_ > std::chrono::milliseconds(kFeedbackTimeoutMs);
+		if (!same && !quiet)
+			continue;
+		feedback_time_ = now;
+		if (!same || received < feedback_received_) {
+			feedback_from_ = from;
+			feedback_sent_ = reports_sent_;
+			feedback_received_ = received;
+			continue;
+		}
+
+		const uint64_t sent = reports_sent_ - feedback_sent_;
+		if (sent < kFeedbackMinReports)
+			continue;
+		const uint64_t arrived = received - feedback_received_;
+		const uint64_t missing = sent > arrived ? sent - arrived : 0;
+		if (missing > kFeedbackSlackReports + kFeedbackLossThreshold * sent) {
+			winfx::DebugOut(L"Receiver missed %llu of %llu reports\n", missing, sent);
+			position_.lossy = true;
+			attitude_.lossy = true;
+		}
+		feedback_sent_ = reports_sent_;
+		feedback_received_ = received;
 	}
 }
 
+void ForeFlightBroadcaster::updateRate(StreamRate& stream) {
+	// Failures in send() and on completion alike, WSAEWOULDBLOCK and
+	// WSAENOBUFS when buffers are full among them.
+	const uint64_t failures = sender_->failed();
+	const bool congested = failures != stream.failures_seen || sender_->backlog() > kCongestedBacklog ||
+		stream.lossy;
+	stream.failures_seen = failures;
+	stream.lossy = false;
+	stream.rate.update(AdaptiveRate::Clock::now(), congested);
+}
+
 BOOL ForeFlightBroadcaster::broadcastPositionReport(const SimData* data) {
-	if (sock_ == INVALID_SOCKET) {
+	if (!sender_) {
 		winfx::DebugOut(L"Cannot send position report. Socket invalid.\n");
 		return FALSE;
 	}
 
 	char send_buffer[256] = { 0 };
 	sprintf_s(send_buffer, "XGPS%s,%0.4f,%0.4f,%0.1f,%0.2f,%01.f",
-		SIM_NAME, data->gps_lon, data->gps_lat, data->gps_alt, data->gps_track, data->gps_groundspeed);
+		sim_name_.c_str(), data->gps_lon, data->gps_lat, data->gps_alt, data->gps_track, data->gps_groundspeed);
 	winfx::DebugOut(L"GPS Message: %S\n", send_buffer);
-	if (sendto(sock_, send_buffer, (int)strlen(send_buffer), 0, (sockaddr*)&send_addr_,
-		(int)sizeof(send_addr_)) == SOCKET_ERROR) {
-		int err = WSAGetLastError();
-		winfx::DebugOut(L"Error %d in send.\n", err);
+	if (!sender_->send(send_buffer, (int)strlen(send_buffer), send_addr_))
 		return FALSE;
-	}
-
+	reports_sent_++;
 	return TRUE;
 }
 
 BOOL ForeFlightBroadcaster::broadcastAttitudeReport(const SimData* data) {
-	if (sock_ == INVALID_SOCKET) {
+	if (!sender_) {
 		winfx::DebugOut(L"Cannot send position report. Socket invalid.\n");
 		return FALSE;
 	}
 
 	char send_buffer[256] = { 0 };
 	sprintf_s(send_buffer, "XATT%s,%0.4f,%0.4f,%0.4f",
-		SIM_NAME, data->heading, -data->pitch, data->bank);
+		sim_name_.c_str(), data->heading, -data->pitch, data->bank);
 	winfx::DebugOut(L"ATT Message: %S\n", send_buffer);
-	if (sendto(sock_, send_buffer, (int)strlen(send_buffer), 0, (sockaddr*)&send_addr_,
-		(int)sizeof(send_addr_)) == SOCKET_ERROR) {
-		int err = WSAGetLastError();
-		winfx::DebugOut(L"Error %d in send.\n", err);
+	if (!sender_->send(send_buffer, (int)strlen(send_buffer), send_addr_))
 		return FALSE;
-	}
-
+	reports_sent_++;
 	return TRUE;
 }
@@ -17,8 +17,14 @@
 
 #include "framework.h"
 #include "winfx.h"
+#include <memory>
+#include "AdaptiveRate.h"
+#include "DatagramSender.h"
 #include "SimData.h"
 #include "SimInterface.h"
+#include "OutputSink.h"
+#include "SinkScheduler.h"
+#include "DeltaSuppressor.h"
 
 // Implement ForeFlight GPS Integration as documented at
 //   https://support.foreflight.com/hc/en-us/articles/204115005-Flight-Simulator-GPS-Integration-UDP-Protocol-
@@ -27,24 +33,154 @@
 #define FF_GPS_PORT       49002
 
 constexpr int kAttitueReportsPerSecond = 5;
+constexpr int kPositionReportsPerSecond = 1;
 
-class ForeFlightBroadcaster : public SimulatorCallbacks {
+// When the network is congested the report rates fall, as far as these,
+// which still send each report within its keepalive.
+constexpr double kAttitudeMinReportsPerSecond = 1;
+constexpr double kPositionMinReportsPerSecond = 0.5;
+
+// Datagrams from earlier ticks still in the network stack beyond which the
+// destination counts as congested.
+constexpr int kCongestedBacklog = 8;
+
+// A receiver may report back to the socket the reports come from with
+// "XFBK<name>,<n>": n is every XGPS and XATT it has had for that aircraft
+// name. Once this many reports have gone out since the last judgement, more
+// than kFeedbackLossThreshold of them missing, beyond a few still on their
+// way, counts as congestion. Broadcast reports take feedback from the first
+// receiver to send it until it has been quiet for kFeedbackTimeoutMs.
+constexpr char kFeedbackPrefix[] = "XFBK";
+constexpr uint64_t kFeedbackMinReports = 20;
+constexpr uint64_t kFeedbackSlackReports = 2;
+constexpr double kFeedbackLossThreshold = 0.1;
+constexpr int kFeedbackTimeoutMs = 5000;
+
+// Reports that differ from the last one sent by less than these are dropped.
+// The keepalives are short enough that ForeFlight never shows the feed as
+// lost while parked.
+inline DeltaThresholds positionReportThresholds() {
+	DeltaThresholds thresholds;
+	thresholds.position_m = 5.0;
+	thresholds.altitude_m = 3.0;
+	thresholds.track_deg = 2.0;
+	thresholds.groundspeed_mps = 0.5;
+	thresholds.keepalive_ms = 2000;
+	return thresholds;
+}
+
+inline DeltaThresholds attitudeReportThresholds() {
+	DeltaThresholds thresholds;
+	thresholds.attitude_deg = 0.5;
+	thresholds.keepalive_ms = 1000;
+	return thresholds;
+}
+
+// Position and attitude reports are two independent sinks so that the
+// scheduler decimates the sample stream to each report's own rate. Each
+// rate adapts to the destination's network: send failures, datagrams
+// backing up in the sender and receiver feedback reporting loss halve it,
+// and it recovers while they are clear.
+class ForeFlightBroadcaster {
 public:
-	ForeFlightBroadcaster(const SimulatorInterface& sim) : sim_(sim) {}
+	ForeFlightBroadcaster() :
+		position_sink_(*this),
+		attitude_sink_(*this),
+		position_filter_(kSimFieldPosition | kSimFieldTrack, positionReportThresholds()),
+		attitude_filter_(kSimFieldAttitude, attitudeReportThresholds()) {}
 
 	static HRESULT InitWinsock();
 
-	HRESULT init();
-	void onSimDataUpdated(const SimData* data) override;
-	void onStateChange(SimulatorInterfaceState state) override {}
-	void onSimDisconnect() override {}
+	// Broadcasts unless given an IPv4 destination address. simName names
+	// the aircraft in the reports, which lets one receiver tell several
+	// simulators apart. The reports go out through backend, or sendto where
+	// it is unavailable.
+	HRESULT init(const char* destination = nullptr, u_short port = FF_GPS_PORT, const char* simName = "MSFS",
+		DatagramBackend backend = kDatagramSendto);
+	void registerSinks(SinkScheduler& scheduler);
+
+	// Bounds on each report rate, per second. Both start at their maximum.
+	// Call before the sinks are scheduled.
+	void setRateBounds(double positionMin, double positionMax, double attitudeMin, double attitudeMax) {
+		position_.rate.setBounds(positionMin, positionMax);
+		attitude_.rate.setBounds(attitudeMin, attitudeMax);
+	}
+
+	// Reports sent successfully and reports suppressed, safe to read from
+	// any thread.
+	uint64_t packetsSent() const {
+		return position_filter_.sentCount() + attitude_filter_.sentCount();
+	}
+	uint64_t packetsSuppressed() const {
+		return position_filter_.suppressedCount() + attitude_filter_.suppressedCount();
+	}
+	// Report rates now, and how often congestion has cut either. Safe to
+	// read from any thread.
+	double positionRate() const { return position_.rate.rate(); }
+	double attitudeRate() const { return attitude_.rate.rate(); }
+	bool congested() const {
+		return position_.rate.rate() < position_.rate.maxRate() || attitude_.rate.rate() < attitude_.rate.maxRate();
+	}
+	uint64_t rateDecreases() const { return position_.rate.decreases() + attitude_.rate.decreases(); }
+	// Null until init succeeds.
+	const DatagramSender* sender() const { return sender_.get(); }
 
 private:
+	class PositionSink : public OutputSink {
+	public:
+		PositionSink(ForeFlightBroadcaster& owner) : owner_(owner) {}
+		const char* sinkName() const override { return "ForeFlight XGPS"; }
+		double sinkRate() const override { return owner_.position_.rate.rate(); }
+		unsigned sinkFields() const override { return kSimFieldPosition | kSimFieldTrack; }
+		void onSample(const SimSample& sample) override;
+		void onStateChange(SimulatorInterfaceState state) override;
+		void onFlush() override;
+	private:
+		ForeFlightBroadcaster& owner_;
+	};
+
+	class AttitudeSink : public OutputSink {
+	public:
+		AttitudeSink(ForeFlightBroadcaster& owner) : owner_(owner) {}
+		const char* sinkName() const override { return "ForeFlight XATT"; }
+		double sinkRate() const override { return owner_.attitude_.rate.rate(); }
+		unsigned sinkFields() const override { return kSimFieldAttitude; }
+		void onSample(const SimSample& sample) override;
+		void onFlush() override;
+	private:
+		ForeFlightBroadcaster& owner_;
+	};
+
+	// A report stream's rate and the congestion it has yet to act on.
+	struct StreamRate {
+		StreamRate(double minRate, double maxRate) : rate(minRate, maxRate) {}
+		AdaptiveRate rate;
+		uint64_t failures_seen = 0;
+		bool lossy = false;
+	};
+
 	BOOL broadcastPositionReport(const SimData* data);
 	BOOL broadcastAttitudeReport(const SimData* data);
+	// Called from each sink's onFlush, before the sender's.
+	void readFeedback();
+	void updateRate(StreamRate& stream);
 
-	SOCKET sock_ = INVALID_SOCKET;
+	std::unique_ptr<DatagramSender> sender_;
 	sockaddr_in send_addr_ = { 0 };
-	const SimulatorInterface& sim_;
-	long message_ordinal_ = 0;
+	std::string sim_name_ = "MSFS";
+	PositionSink position_sink_;
+	AttitudeSink attitude_sink_;
+	DeltaSuppressor position_filter_;
+	DeltaSuppressor attitude_filter_;
+
+	StreamRate position_{ kPositionMinReportsPerSecond, kPositionReportsPerSecond };
+	StreamRate attitude_{ kAttitudeMinReportsPerSecond, kAttitueReportsPerSecond };
+
+	// Only touched from the scheduler thread.
+	bool in_flight_ = false;
+	uint64_t reports_sent_ = 0;
+	sockaddr_in feedback_from_ = { 0 };
+	AdaptiveRate::Clock::time_point feedback_time_;
+	uint64_t feedback_sent_ = 0;
+	uint64_t feedback_received_ = 0;
 };
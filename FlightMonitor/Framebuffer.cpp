@@ -0,0 +1,428 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+// Plain fopen, which MSVC would otherwise reject, keeps this portable.
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "Framebuffer.h"
+
+constexpr int kGlyphWidth = 5;
+constexpr int kGlyphHeight = 7;
+constexpr int kGlyphAdvance = kGlyphWidth + 1;
+constexpr int kLineSpacing = 3;
+
+// 5x7 glyphs for ' ' through '~'. One byte per row, top row first, bit 4
+// is the leftmost pixel.
+static const uint8_t kFont[95][kGlyphHeight] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },  // space
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },  // !
+	{ 0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00 },  // "
+	{ 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a },  // #
+	{ 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04 },  // $
+	{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },  // %
+	{ 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d },  // &
+	{ 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 },  // '
+	{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },  // (
+	{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },  // )
+	{ 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 },  // *
+	{ 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 },  // +
+	{ 0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08 },  // ,
+	{ 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 },  // -
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c },  // .
+	{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },  // /
+	{ 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e },  // 0
+	{ 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e },  // 1
+	{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f },  // 2
+	{ 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e },  // 3
+	{ 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 },  // 4
+	{ 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e },  // 5
+	{ 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e },  // 6
+	{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },  // 7
+	{ 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e },  // 8
+	{ 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c },  // 9
+	{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 },  // :
+	{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08 },  // ;
+	{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },  // <
+	{ 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 },  // =
+	{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },  // >
+	{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 },  // ?
+	{ 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e },  // @
+	{ 0x0e, 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11 },  // A
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e },  // B
+	{ 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e },  // C
+	{ 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c },  // D
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f },  // E
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 },  // F
+	{ 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f },  // G
+	{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },  // H
+	{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e },  // I
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c },  // J
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },  // K
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f },  // L
+	{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 },  // M
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },  // N
+	{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },  // O
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 },  // P
+	{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d },  // Q
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 },  // R
+	{ 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e },  // S
+	{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },  // T
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },  // U
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 },  // V
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a },  // W
+	{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 },  // X
+	{ 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04 },  // Y
+	{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f },  // Z
+	{ 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e },  // [
+	{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 },  // backslash
+	{ 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e },  // ]
+	{ 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 },  // ^
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f },  // _
+	{ 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00 },  // `
+	{ 0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f },  // a
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e },  // b
+	{ 0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e },  // c
+	{ 0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f },  // d
+	{ 0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e },  // e
+	{ 0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08 },  // f
+	{ 0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e },  // g
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 },  // h
+	{ 0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e },  // i
+	{ 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0c },  // j
+	{ 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12 },  // k
+	{ 0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e },  // l
+	{ 0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11 },  // m
+	{ 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 },  // n
+	{ 0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e },  // o
+	{ 0x00, 0x00, 0x1e, 0x11, 0x1e, 0x10, 0x10 },  // p
+	{ 0x00, 0x00, 0x0d, 0x13, 0x0f, 0x01, 0x01 },  // q
+	{ 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10 },  // r
+	{ 0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e },  // s
+	{ 0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06 },  // t
+	{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d },  // u
+	{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04 },  // v
+	{ 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a },  // w
+	{ 0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11 },  // x
+	{ 0x00, 0x00, 0x11, 0x11, 0x0f, 0x01, 0x0e },  // y
+	{ 0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f },  // z
+	{ 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02 },  // {
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },  // |
+	{ 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08 },  // }
+	{ 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00 },  // ~
+};
+
+FbRect FbRect::intersect(const FbRect& other) const {
+	return FbRect(std::max(left, other.left), std::max(top, other.top),
+		std::min(right, other.right), std::min(bottom, other.bottom));
+}
+
+FbRect FbRect::unite(const FbRect& other) const {
+	if (other.empty())
+		return *this;
+	if (empty())
+		return other;
+	return FbRect(std::min(left, other.left), std::min(top, other.top),
+		std::max(right, other.right), std::max(bottom, other.bottom));
+}
+
+void Framebuffer::resize(int width, int height) {
+	width_ = std::max(width, 0);
+	height_ = std::max(height, 0);
+	pixels_.assign(static_cast<size_t>(width_) * height_, 0);
+	clip_ = bounds();
+}
+
+void Framebuffer::setClip(const FbRect& clip) {
+	clip_ = clip.empty() ? bounds() : clip.intersect(bounds());
+}
+
+void Framebuffer::span(int y, int x0, int x1, FbColor color) {
+	if (y < clip_.top || y >= clip_.bottom)
+		return;
+	if (x0 > x1)
+		std::swap(x0, x1);
+	x0 = std::max(x0, clip_.left);
+	x1 = std::min(x1, clip_.right - 1);
+	if (x0 > x1)
+		return;
+	std::fill(row(y) + x0, row(y) + x1 + 1, color);
+}
+
+void Framebuffer::fillRect(const FbRect& rect, FbColor color) {
+	const FbRect r = rect.intersect(clip_);
+	if (r.empty())
+		return;
+	for (int y = r.top; y < r.bottom; y++)
+		std::fill(row(y) + r.left, row(y) + r.right, color);
+}
+
+// Steps k = 0 .. major of a line whose minor coordinate advances by
+// floor((2 k minor + major) / (2 major)) at step k, the pixels Bresenham
+// picks, limited to the steps whose major coordinate lies in [lo, hi].
+static void stepRange(int64_t a0, int64_t sa, int64_t lo, int64_t hi, int64_t major,
+	int64_t* first, int64_t* last) {
+	if (sa > 0) {
+		*first = std::max(*first, lo - a0);
+		*last = std::min(*last, hi - a0);
+	} else {
+		*first = std::max(*first, a0 - hi);
+		*last = std::min(*last, a0 - lo);
+	}
+	*first = std::max<int64_t>(*first, 0);
+	*last = std::min(*last, major);
+}
+
+void Framebuffer::drawLine(int x0, int y0, int x1, int y1, FbColor color) {
+	// Bresenham, but started and stopped where the line enters and leaves
+	// the clip rect, so a long segment costs only the pixels it draws.
+	const bool xMajor = abs(x1 - x0) >= abs(y1 - y0);
+	const int64_t a0 = xMajor ? x0 : y0;
+	const int64_t b0 = xMajor ? y0 : x0;
+	const int64_t sa = (xMajor ? x1 >= x0 : y1 >= y0) ? 1 : -1;
+	const int64_t sb = (xMajor ? y1 >= y0 : x1 >= x0) ? 1 : -1;
+	const int64_t major = xMajor ? abs(x1 - x0) : abs(y1 - y0);
+	const int64_t minor = xMajor ? abs(y1 - y0) : abs(x1 - x0);
+	const int64_t aLo = xMajor ? clip_.left : clip_.top;
+	const int64_t aHi = (xMajor ? clip_.right : clip_.bottom) - 1;
+	const int64_t bLo = xMajor ? clip_.top : clip_.left;
+	const int64_t bHi = (xMajor ? clip_.bottom : clip_.right) - 1;
+
+	int64_t first = 0, last = major;
+	stepRange(a0, sa, aLo, aHi, major, &first, &last);
+
+	// The minor offset m(k) never decreases, so its bounds cut the steps to
+	// a range too: the first k with m(k) >= mLo and the last with m(k) <= mHi.
+	const int64_t mLo = sb > 0 ? bLo - b0 : b0 - bHi;
+	const int64_t mHi = std::min(sb > 0 ? bHi - b0 : b0 - bLo, minor);
+	if (mLo > mHi)
+		return;
+	if (minor > 0) {
+		if (mLo > 0)
+			first = std::max(first, (2 * major * mLo - major + 2 * minor - 1) / (2 * minor));
+		if (mHi < minor)
+			last = std::min(last, (2 * major * (mHi + 1) - major - 1) / (2 * minor));
+	}
+	if (first > last)
+		return;
+
+	// m(k) as a quotient and remainder, advanced one step at a time.
+	const int64_t denom = 2 * std::max<int64_t>(major, 1);
+	int64_t num = 2 * first * minor + major;
+	int64_t m = num / denom;
+	num %= denom;
+	for (int64_t k = first; k <= last; k++) {
+		const int a = static_cast<int>(a0 + sa * k);
+		const int b = static_cast<int>(b0 + sb * m);
+		plot(xMajor ? a : b, xMajor ? b : a, color);
+		num += 2 * minor;
+		if (num >= denom) {
+			num -= denom;
+			m++;
+		}
+	}
+}
+
+void Framebuffer::fillCircle(int cx, int cy, int radius, FbColor color) {
+	for (int dy = -radius; dy <= radius; dy++) {
+		int dx = 0;
+		while ((dx + 1) * (dx + 1) + dy * dy <= radius * radius)
+			dx++;
+		span(cy + dy, cx - dx, cx + dx, color);
+	}
+}
+
+void Framebuffer::drawCircle(int cx, int cy, int radius, FbColor color) {
+	int x = radius;
+	int y = 0;
+	int err = 1 - radius;
+	while (x >= y) {
+		plot(cx + x, cy + y, color);
+		plot(cx + y, cy + x, color);
+		plot(cx - y, cy + x, color);
+		plot(cx - x, cy + y, color);
+		plot(cx - x, cy - y, color);
+		plot(cx - y, cy - x, color);
+		plot(cx + y, cy - x, color);
+		plot(cx + x, cy - y, color);
+		y++;
+		if (err < 0) {
+			err += 2 * y + 1;
+		} else {
+			x--;
+			err += 2 * (y - x) + 1;
+		}
+	}
+}
+
+void Framebuffer::fillTriangle(int x0, int y0, int x1, int y1, int x2, int y2, FbColor color) {
+	// Sort by y, then fill scanlines between the long edge and the two
+	// short ones.
+	if (y0 > y1) { std::swap(x0, x1); std::swap(y0, y1); }
+	if (y1 > y2) { std::swap(x1, x2); std::swap(y1, y2); }
+	if (y0 > y1) { std::swap(x0, x1); std::swap(y0, y1); }
+	if (y0 == y2) {
+		span(y0, std::min({ x0, x1, x2 }), std::max({ x0, x1, x2 }), color);
+		return;
+	}
+	for (int y = y0; y <= y2; y++) {
+		const int xa = x0 + (x2 - x0) * (y - y0) / (y2 - y0);
+		int xb;
+		if (y < y1)
+			xb = x0 + (x1 - x0) * (y - y0) / (y1 - y0);
+		else if (y2 != y1)
+			xb = x1 + (x2 - x1) * (y - y1) / (y2 - y1);
+		else
+			xb = x1;
+		span(y, xa, xb, color);
+	}
+}
+
+int Framebuffer::drawText(int x, int y, const char* text, FbColor color, int scale) {
+	for (; *text; text++) {
+		int c = static_cast<unsigned char>(*text);
+		if (c < 32 || c > 126)
+			c = '?';
+		const uint8_t* glyph = kFont[c - 32];
+		for (int gy = 0; gy < kGlyphHeight; gy++) {
+			const uint8_t bits = glyph[gy];
+			if (bits == 0)
+				continue;
+			for (int gx = 0; gx < kGlyphWidth; gx++) {
+				if (bits & (0x10 >> gx))
+					fillRect(FbRect(x + gx * scale, y + gy * scale, x + (gx + 1) * scale, y + (gy + 1) * scale), color);
+			}
+		}
+		x += kGlyphAdvance * scale;
+	}
+	return x;
+}
+
+int Framebuffer::textWidth(const char* text, int scale) {
+	int n = 0;
+	while (text[n])
+		n++;
+	return n * kGlyphAdvance * scale;
+}
+
+int Framebuffer::lineHeight(int scale) {
+	return (kGlyphHeight + kLineSpacing) * scale;
+}
+
+void Framebuffer::copyFrom(const Framebuffer& source, const FbRect& rect) {
+	if (source.width_ != width_ || source.height_ != height_)
+		return;
+	const FbRect r = rect.intersect(bounds());
+	if (r.empty())
+		return;
+	for (int y = r.top; y < r.bottom; y++)
+		std::copy(source.row(y) + r.left, source.row(y) + r.right, row(y) + r.left);
+}
+
+struct CrcTable {
+	uint32_t entries[256];
+	CrcTable() {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			entries[i] = c;
+		}
+	}
+};
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t length) {
+	static const CrcTable table;
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++)
+		crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void putBe32(std::vector<uint8_t>& out, uint32_t value) {
+	out.push_back(static_cast<uint8_t>(value >> 24));
+	out.push_back(static_cast<uint8_t>(value >> 16));
+	out.push_back(static_cast<uint8_t>(value >> 8));
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+static void writeChunk(FILE* file, const char* type, const std::vector<uint8_t>& data) {
+	std::vector<uint8_t> chunk;
+	putBe32(chunk, static_cast<uint32_t>(data.size()));
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putBe32(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+	fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+bool Framebuffer::writePng(const char* path) const {
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr)
+		return false;
+
+	static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	fwrite(kSignature, 1, sizeof(kSignature), file);
+
+	std::vector<uint8_t> ihdr;
+	putBe32(ihdr, width_);
+	putBe32(ihdr, height_);
+	ihdr.push_back(8);  // bit depth
+	ihdr.push_back(2);  // truecolor
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	writeChunk(file, "IHDR", ihdr);
+
+	// Filter byte 0 and RGB for each row, wrapped in stored deflate blocks.
+	std::vector<uint8_t> raw;
+	raw.reserve(static_cast<size_t>(height_) * (1 + width_ * 3));
+	for (int y = 0; y < height_; y++) {
+		raw.push_back(0);
+		for (int x = 0; x < width_; x++) {
+			const FbColor c = row(y)[x];
+			raw.push_back(static_cast<uint8_t>(c >> 16));
+			raw.push_back(static_cast<uint8_t>(c >> 8));
+			raw.push_back(static_cast<uint8_t>(c));
+		}
+	}
+
+	std::vector<uint8_t> idat = { 0x78, 0x01 };
+	size_t offset = 0;
+	do {
+		const size_t length = std::min<size_t>(raw.size() - offset, 65535);
+		idat.push_back(offset + length == raw.size() ? 1 : 0);
+		idat.push_back(static_cast<uint8_t>(length));
+		idat.push_back(static_cast<uint8_t>(length >> 8));
+		idat.push_back(static_cast<uint8_t>(~length));
+		idat.push_back(static_cast<uint8_t>(~length >> 8));
+		idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + length);
+		offset += length;
+	} while (offset < raw.size());
+
+	uint32_t a = 1, b = 0;
+	for (uint8_t byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBe32(idat, (b << 16) | a);
+	writeChunk(file, "IDAT", idat);
+	writeChunk(file, "IEND", std::vector<uint8_t>());
+
+	const bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
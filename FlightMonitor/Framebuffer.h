@@ -0,0 +1,97 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Pixels are 0x00RRGGBB, rows top to bottom: the layout of a 32 bpp
+// top-down DIB, so Windows can blit the buffer without conversion.
+typedef uint32_t FbColor;
+
+constexpr FbColor fbRgb(int r, int g, int b) {
+	return (static_cast<uint32_t>(r) << 16) | (static_cast<uint32_t>(g) << 8) | static_cast<uint32_t>(b);
+}
+
+struct FbRect {
+	int left = 0;
+	int top = 0;
+	int right = 0;   // exclusive
+	int bottom = 0;  // exclusive
+
+	FbRect() {}
+	FbRect(int l, int t, int r, int b) : left(l), top(t), right(r), bottom(b) {}
+
+	int width() const { return right - left; }
+	int height() const { return bottom - top; }
+	bool empty() const { return right <= left || bottom <= top; }
+	bool contains(int x, int y) const { return x >= left && x < right && y >= top && y < bottom; }
+
+	FbRect intersect(const FbRect& other) const;
+	FbRect unite(const FbRect& other) const;  // bounding box; empty rects are ignored
+	FbRect inflate(int amount) const {
+		return FbRect(left - amount, top - amount, right + amount, bottom + amount);
+	}
+};
+
+// A software framebuffer with the few primitives the track display needs.
+// Every primitive clips to the buffer and to an optional clip rect, so
+// callers can draw freely and redraw only a region.
+class Framebuffer {
+public:
+	void resize(int width, int height);
+
+	int width() const { return width_; }
+	int height() const { return height_; }
+	const FbColor* pixels() const { return pixels_.data(); }
+	FbColor* row(int y) { return pixels_.data() + static_cast<size_t>(y) * width_; }
+	const FbColor* row(int y) const { return pixels_.data() + static_cast<size_t>(y) * width_; }
+	FbRect bounds() const { return FbRect(0, 0, width_, height_); }
+
+	// Restricts drawing to clip (within the buffer). An empty rect resets it.
+	void setClip(const FbRect& clip);
+
+	void fillRect(const FbRect& rect, FbColor color);
+	void drawLine(int x0, int y0, int x1, int y1, FbColor color);
+	void fillCircle(int cx, int cy, int radius, FbColor color);
+	void drawCircle(int cx, int cy, int radius, FbColor color);
+	void fillTriangle(int x0, int y0, int x1, int y1, int x2, int y2, FbColor color);
+
+	// Draws 7-bit ASCII in the built-in 5x7 font, each font pixel scale
+	// pixels square. Returns the x after the last character.
+	int drawText(int x, int y, const char* text, FbColor color, int scale = 1);
+	static int textWidth(const char* text, int scale = 1);
+	static int lineHeight(int scale = 1);
+
+	// Copies rect from source, which must be the same size.
+	void copyFrom(const Framebuffer& source, const FbRect& rect);
+
+	// Uncompressed (stored-deflate) RGB PNG, for tests and tools.
+	bool writePng(const char* path) const;
+
+private:
+	void span(int y, int x0, int x1, FbColor color);  // [x0, x1], clipped
+	void plot(int x, int y, FbColor color) {
+		if (clip_.contains(x, y))
+			pixels_[static_cast<size_t>(y) * width_ + x] = color;
+	}
+
+	int width_ = 0;
+	int height_ = 0;
+	FbRect clip_;
+	std::vector<FbColor> pixels_;
+};
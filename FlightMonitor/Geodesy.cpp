@@ -0,0 +1,86 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "Geodesy.h"
+
+#include <math.h>
+#include <algorithm>
+
+constexpr double kPi = 3.14159265358979323846;
+
+static double radians(double degrees) { return degrees * kPi / 180; }
+static double degrees(double radians) { return radians * 180 / kPi; }
+
+double greatCircleDistance(double lat1, double lon1, double lat2, double lon2) {
+	const double dphi = radians(lat2 - lat1);
+	const double dlambda = radians(lon2 - lon1);
+	const double a = sin(dphi / 2) * sin(dphi / 2) +
+		cos(radians(lat1)) * cos(radians(lat2)) * sin(dlambda / 2) * sin(dlambda / 2);
+	return 2 * kEarthRadiusMeters * asin(std::min(1.0, sqrt(a)));
+}
+
+double greatCircleBearing(double lat1, double lon1, double lat2, double lon2) {
+	const double phi1 = radians(lat1);
+	const double phi2 = radians(lat2);
+	const double dlambda = radians(lon2 - lon1);
+	const double sinHalfDlambda = sin(dlambda / 2);
+	const double y = sin(dlambda) * cos(phi2);
+	// cos(phi1) sin(phi2) - sin(phi1) cos(phi2) cos(dlambda), rearranged so
+	// that it does not cancel between nearby points, which near a pole can
+	// be any longitude apart.
+	const double x = sin(radians(lat2 - lat1)) +
+		2 * sin(phi1) * cos(phi2) * sinHalfDlambda * sinHalfDlambda;
+	const double bearing = degrees(atan2(y, x));
+	return bearing < 0 ? bearing + 360 : bearing;
+}
+
+void greatCircleDestination(double lat, double lon, double bearing, double distance,
+	double* outLat, double* outLon) {
+	const double phi1 = radians(lat);
+	const double theta = radians(bearing);
+	const double delta = distance / kEarthRadiusMeters;
+	const double phi2 = asin(sin(phi1) * cos(delta) + cos(phi1) * sin(delta) * cos(theta));
+	const double lambda = atan2(sin(theta) * sin(delta) * cos(phi1), cos(delta) - sin(phi1) * sin(phi2));
+	double lon2 = lon + degrees(lambda);
+	if (lon2 >= 180)
+		lon2 -= 360;
+	else if (lon2 < -180)
+		lon2 += 360;
+	*outLat = degrees(phi2);
+	*outLon = lon2;
+}
+
+void geodeticToEcef(double lat, double lon, double alt, double* x, double* y, double* z) {
+	constexpr double kE2 = kWgs84Flattening * (2 - kWgs84Flattening);
+	const double phi = radians(lat);
+	const double lambda = radians(lon);
+	const double n = kWgs84SemiMajorMeters / sqrt(1 - kE2 * sin(phi) * sin(phi));
+	*x = (n + alt) * cos(phi) * cos(lambda);
+	*y = (n + alt) * cos(phi) * sin(lambda);
+	*z = (n * (1 - kE2) + alt) * sin(phi);
+}
+
+void geodeticToEnu(double originLat, double originLon, double originAlt,
+	double lat, double lon, double alt, double* east, double* north, double* up) {
+	double ox, oy, oz, x, y, z;
+	geodeticToEcef(originLat, originLon, originAlt, &ox, &oy, &oz);
+	geodeticToEcef(lat, lon, alt, &x, &y, &z);
+	const double dx = x - ox, dy = y - oy, dz = z - oz;
+	const double phi = radians(originLat);
+	const double lambda = radians(originLon);
+	*east = -sin(lambda) * dx + cos(lambda) * dy;
+	*north = -sin(phi) * cos(lambda) * dx - sin(phi) * sin(lambda) * dy + cos(phi) * dz;
+	*up = cos(phi) * cos(lambda) * dx + cos(phi) * sin(lambda) * dy + sin(phi) * dz;
+}
@@ -0,0 +1,44 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Spherical-earth geometry. Good to a few tenths of a percent, which is
+// plenty for distances and bearings to things the aircraft can see.
+// Positions in earth-centered or local east/north/up meters use the WGS-84
+// ellipsoid instead. GeodesyBatch.h does the same over many points at once.
+
+constexpr double kEarthRadiusMeters = 6371008.8;
+constexpr double kWgs84SemiMajorMeters = 6378137.0;
+constexpr double kWgs84Flattening = 1 / 298.257223563;
+
+// Great-circle distance in meters.
+double greatCircleDistance(double lat1, double lon1, double lat2, double lon2);
+
+// Initial true bearing from the first point to the second, 0..360.
+double greatCircleBearing(double lat1, double lon1, double lat2, double lon2);
+
+// The point distance meters from (lat, lon) on the given true bearing.
+void greatCircleDestination(double lat, double lon, double bearing, double distance,
+	double* outLat, double* outLon);
+
+// Earth-centered, earth-fixed meters of a point alt meters above the
+// ellipsoid.
+void geodeticToEcef(double lat, double lon, double alt, double* x, double* y, double* z);
+
+// East, north and up meters of a point from the origin, in the plane
+// tangent to the ellipsoid there.
+void geodeticToEnu(double originLat, double originLon, double originAlt,
+	double lat, double lon, double alt, double* east, double* north, double* up);
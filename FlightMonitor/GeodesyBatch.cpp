@@ -0,0 +1,113 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <intrin.h>
+#include <atomic>
+
+#include "GeodesyBatch.h"
+#include "GeodesyKernels.h"
+
+const GeodesyKernelTable kGeodesyScalarKernels = geodesyKernelTable<ScalarVec>();
+
+static const GeodesyKernelTable* const kKernelTables[] = {
+	&kGeodesyScalarKernels, &kGeodesyAvx2Kernels, &kGeodesyAvx512Kernels,
+};
+
+// The CPU has to have the instructions and the OS has to save the
+// registers they use across context switches (XCR0: SSE and AVX state for
+// AVX2, and the three AVX-512 states as well for AVX-512). x86 builds have
+// only the scalar kernels.
+static GeodesyKernel detectGeodesyKernel() {
+#if defined(_M_IX86)
+	return kGeodesyScalar;
+#else
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return kGeodesyScalar;
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	const bool fma = (info[2] & (1 << 12)) != 0;
+	if (!osxsave || !avx || !fma)
+		return kGeodesyScalar;
+	const unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	const bool avx2 = (info[1] & (1 << 5)) != 0;
+	const bool avx512f = (info[1] & (1 << 16)) != 0;
+	if (avx512f && (xcr0 & 0xe6) == 0xe6)
+		return kGeodesyAvx512;
+	if (avx2 && (xcr0 & 0x6) == 0x6)
+		return kGeodesyAvx2;
+	return kGeodesyScalar;
+#endif
+}
+
+GeodesyKernel bestGeodesyKernel() {
+	static const GeodesyKernel best = detectGeodesyKernel();
+	return best;
+}
+
+static std::atomic<int> s_kernel{ -1 };
+
+GeodesyKernel geodesyKernel() {
+	const int kernel = s_kernel.load(std::memory_order_relaxed);
+	return kernel < 0 ? bestGeodesyKernel() : (GeodesyKernel)kernel;
+}
+
+void setGeodesyKernel(GeodesyKernel kernel) {
+	s_kernel.store(kernel > bestGeodesyKernel() ? bestGeodesyKernel() : kernel);
+}
+
+const char* geodesyKernelName(GeodesyKernel kernel) {
+	switch (kernel) {
+	case kGeodesyScalar: return "scalar";
+	case kGeodesyAvx2: return "AVX2";
+	case kGeodesyAvx512: return "AVX-512";
+	}
+	return "?";
+}
+
+static const GeodesyKernelTable& kernels() {
+	return *kKernelTables[geodesyKernel()];
+}
+
+GeoOrigin makeGeoOrigin(double lat, double lon, double alt) {
+	GeoOrigin origin;
+	origin.lat = lat;
+	origin.lon = lon;
+	origin.alt = alt;
+	origin.sin_lat = sin(lat * kGeodesyRadians);
+	origin.cos_lat = cos(lat * kGeodesyRadians);
+	origin.sin_lon = sin(lon * kGeodesyRadians);
+	origin.cos_lon = cos(lon * kGeodesyRadians);
+	geodeticToEcef(lat, lon, alt, &origin.x, &origin.y, &origin.z);
+	return origin;
+}
+
+void batchDistanceBearing(const GeoOrigin& origin, const double* lat, const double* lon, size_t count,
+	double* distance, double* bearing) {
+	kernels().distance_bearing(origin, lat, lon, count, distance, bearing);
+}
+
+void batchToEcef(const double* lat, const double* lon, const double* alt, size_t count,
+	double* x, double* y, double* z) {
+	kernels().to_ecef(lat, lon, alt, count, x, y, z);
+}
+
+void batchToEnu(const GeoOrigin& origin, const double* lat, const double* lon, const double* alt,
+	size_t count, double* east, double* north, double* up) {
+	kernels().to_enu(origin, lat, lon, alt, count, east, north, up);
+}
@@ -0,0 +1,88 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stddef.h>
+
+#include "Geodesy.h"
+
+// The Geodesy.h functions over many points at once, each from one origin
+// such as the aircraft: traffic, airspace vertices or a whole recording.
+// Points are passed as separate arrays of latitude, longitude and altitude
+// (degrees and meters) and results come back the same way, so the work runs
+// four or eight points to an instruction with AVX2 or AVX-512 where the CPU
+// has them, and one at a time otherwise.
+//
+// Sines, cosines and arctangents are polynomials rather than <cmath> calls.
+// Across the globe, poles included, they agree with Geodesy.h to within the
+// bounds below, which FlightTools geodesy checks; each kernel gets the same
+// answers to within rounding. Both work out bearings in a form that does not
+// cancel between nearby points, which near a pole can be any longitude
+// apart. From a pole itself, where every way is south or north, the bearing
+// is as if the origin had been reached along its own meridian.
+
+// A hundredth of a millimeter of great-circle distance, 1e-8 degrees of
+// bearing and a micrometer of ECEF or ENU position. Most of that is the
+// rounding of the <cmath> versions themselves; the polynomials are good to
+// a unit or two in the last place.
+constexpr double kGeodesyBatchMaxDistanceError = 1e-5;
+constexpr double kGeodesyBatchMaxBearingError = 1e-8;
+constexpr double kGeodesyBatchMaxPositionError = 1e-6;
+
+enum GeodesyKernel {
+	kGeodesyScalar,
+	kGeodesyAvx2,
+	kGeodesyAvx512,
+};
+
+// What the batch functions need of the origin, worked out once.
+struct GeoOrigin {
+	double lat = 0;
+	double lon = 0;
+	double alt = 0;
+	double sin_lat = 0;
+	double cos_lat = 1;
+	double sin_lon = 0;
+	double cos_lon = 1;
+	double x = 0;  // ECEF
+	double y = 0;
+	double z = 0;
+};
+
+GeoOrigin makeGeoOrigin(double lat, double lon, double alt = 0);
+
+// Great-circle distance in meters and initial true bearing, 0..360, from
+// the origin to each point. bearing may be null.
+void batchDistanceBearing(const GeoOrigin& origin, const double* lat, const double* lon, size_t count,
+	double* distance, double* bearing);
+
+// As geodeticToEcef.
+void batchToEcef(const double* lat, const double* lon, const double* alt, size_t count,
+	double* x, double* y, double* z);
+
+// As geodeticToEnu from the origin.
+void batchToEnu(const GeoOrigin& origin, const double* lat, const double* lon, const double* alt,
+	size_t count, double* east, double* north, double* up);
+
+// The widest kernel this CPU and OS support, which is used by default.
+GeodesyKernel bestGeodesyKernel();
+
+// The kernel in use, and choosing another for comparisons. Kernels the CPU
+// does not support fall back to the best it does.
+GeodesyKernel geodesyKernel();
+void setGeodesyKernel(GeodesyKernel kernel);
+
+const char* geodesyKernelName(GeodesyKernel kernel);
@@ -0,0 +1,68 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <immintrin.h>
+
+#include "GeodesyKernels.h"
+
+#if defined(_M_IX86)
+
+// 32-bit MSVC cannot pass vectors by value, so x86 builds only have the
+// scalar kernels; detectGeodesyKernel() never picks this one there.
+const GeodesyKernelTable kGeodesyAvx2Kernels = geodesyKernelTable<ScalarVec>();
+
+#else
+
+// Only called once GeodesyBatch.cpp has found AVX2 and FMA.
+
+struct Avx2Mask {
+	__m256d m;
+};
+
+struct Avx2Vec {
+	static constexpr size_t kWidth = 4;
+	typedef Avx2Mask Mask;
+
+	static Avx2Vec load(const double* p) { return { _mm256_loadu_pd(p) }; }
+	static Avx2Vec set(double d) { return { _mm256_set1_pd(d) }; }
+	void store(double* p) const { _mm256_storeu_pd(p, v); }
+
+	__m256d v;
+};
+
+static inline Avx2Vec operator+(Avx2Vec a, Avx2Vec b) { return { _mm256_add_pd(a.v, b.v) }; }
+static inline Avx2Vec operator-(Avx2Vec a, Avx2Vec b) { return { _mm256_sub_pd(a.v, b.v) }; }
+static inline Avx2Vec operator*(Avx2Vec a, Avx2Vec b) { return { _mm256_mul_pd(a.v, b.v) }; }
+static inline Avx2Vec operator/(Avx2Vec a, Avx2Vec b) { return { _mm256_div_pd(a.v, b.v) }; }
+static inline Avx2Vec operator-(Avx2Vec a) { return { _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)) }; }
+static inline Avx2Mask operator<(Avx2Vec a, Avx2Vec b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ) }; }
+static inline Avx2Mask operator>(Avx2Vec a, Avx2Vec b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; }
+static inline Avx2Mask operator==(Avx2Vec a, Avx2Vec b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ) }; }
+static inline Avx2Mask operator&(Avx2Mask a, Avx2Mask b) { return { _mm256_and_pd(a.m, b.m) }; }
+static inline Avx2Mask operator|(Avx2Mask a, Avx2Mask b) { return { _mm256_or_pd(a.m, b.m) }; }
+static inline Avx2Vec fmadd(Avx2Vec a, Avx2Vec b, Avx2Vec c) { return { _mm256_fmadd_pd(a.v, b.v, c.v) }; }
+static inline Avx2Vec vsqrt(Avx2Vec a) { return { _mm256_sqrt_pd(a.v) }; }
+static inline Avx2Vec vabs(Avx2Vec a) { return { _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v) }; }
+static inline Avx2Vec vmin(Avx2Vec a, Avx2Vec b) { return { _mm256_min_pd(a.v, b.v) }; }
+static inline Avx2Vec vmax(Avx2Vec a, Avx2Vec b) { return { _mm256_max_pd(a.v, b.v) }; }
+static inline Avx2Vec vfloor(Avx2Vec a) { return { _mm256_floor_pd(a.v) }; }
+static inline Avx2Vec vround(Avx2Vec a) {
+	return { _mm256_round_pd(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) };
+}
+static inline Avx2Vec vselect(Avx2Mask m, Avx2Vec a, Avx2Vec b) { return { _mm256_blendv_pd(b.v, a.v, m.m) }; }
+
+const GeodesyKernelTable kGeodesyAvx2Kernels = geodesyKernelTable<Avx2Vec>();
+
+#endif  // _M_IX86
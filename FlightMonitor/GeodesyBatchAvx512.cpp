@@ -0,0 +1,73 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <immintrin.h>
+
+#include "GeodesyKernels.h"
+
+#if defined(_M_IX86)
+
+// 32-bit MSVC cannot pass vectors by value, so x86 builds only have the
+// scalar kernels; detectGeodesyKernel() never picks this one there.
+const GeodesyKernelTable kGeodesyAvx512Kernels = geodesyKernelTable<ScalarVec>();
+
+#else
+
+// Only called once GeodesyBatch.cpp has found AVX-512F, which is all this
+// uses.
+
+struct Avx512Mask {
+	__mmask8 m;
+};
+
+struct Avx512Vec {
+	static constexpr size_t kWidth = 8;
+	typedef Avx512Mask Mask;
+
+	static Avx512Vec load(const double* p) { return { _mm512_loadu_pd(p) }; }
+	static Avx512Vec set(double d) { return { _mm512_set1_pd(d) }; }
+	void store(double* p) const { _mm512_storeu_pd(p, v); }
+
+	__m512d v;
+};
+
+static inline Avx512Vec operator+(Avx512Vec a, Avx512Vec b) { return { _mm512_add_pd(a.v, b.v) }; }
+static inline Avx512Vec operator-(Avx512Vec a, Avx512Vec b) { return { _mm512_sub_pd(a.v, b.v) }; }
+static inline Avx512Vec operator*(Avx512Vec a, Avx512Vec b) { return { _mm512_mul_pd(a.v, b.v) }; }
+static inline Avx512Vec operator/(Avx512Vec a, Avx512Vec b) { return { _mm512_div_pd(a.v, b.v) }; }
+static inline Avx512Vec operator-(Avx512Vec a) { return { _mm512_sub_pd(_mm512_setzero_pd(), a.v) }; }
+static inline Avx512Mask operator<(Avx512Vec a, Avx512Vec b) { return { _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ) }; }
+static inline Avx512Mask operator>(Avx512Vec a, Avx512Vec b) { return { _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ) }; }
+static inline Avx512Mask operator==(Avx512Vec a, Avx512Vec b) { return { _mm512_cmp_pd_mask(a.v, b.v, _CMP_EQ_OQ) }; }
+static inline Avx512Mask operator&(Avx512Mask a, Avx512Mask b) { return { (__mmask8)(a.m & b.m) }; }
+static inline Avx512Mask operator|(Avx512Mask a, Avx512Mask b) { return { (__mmask8)(a.m | b.m) }; }
+static inline Avx512Vec fmadd(Avx512Vec a, Avx512Vec b, Avx512Vec c) { return { _mm512_fmadd_pd(a.v, b.v, c.v) }; }
+static inline Avx512Vec vsqrt(Avx512Vec a) { return { _mm512_sqrt_pd(a.v) }; }
+static inline Avx512Vec vabs(Avx512Vec a) { return { _mm512_abs_pd(a.v) }; }
+static inline Avx512Vec vmin(Avx512Vec a, Avx512Vec b) { return { _mm512_min_pd(a.v, b.v) }; }
+static inline Avx512Vec vmax(Avx512Vec a, Avx512Vec b) { return { _mm512_max_pd(a.v, b.v) }; }
+static inline Avx512Vec vfloor(Avx512Vec a) {
+	return { _mm512_roundscale_pd(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC) };
+}
+static inline Avx512Vec vround(Avx512Vec a) {
+	return { _mm512_roundscale_pd(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) };
+}
+static inline Avx512Vec vselect(Avx512Mask m, Avx512Vec a, Avx512Vec b) {
+	return { _mm512_mask_blend_pd(m.m, b.v, a.v) };
+}
+
+const GeodesyKernelTable kGeodesyAvx512Kernels = geodesyKernelTable<Avx512Vec>();
+
+#endif  // _M_IX86
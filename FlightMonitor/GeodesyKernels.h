@@ -0,0 +1,283 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+#include "GeodesyBatch.h"
+
+// The GeodesyBatch kernels, written once over a vector type V and built by
+// GeodesyBatch.cpp for ScalarVec and by GeodesyBatchAvx2.cpp and
+// GeodesyBatchAvx512.cpp for their own types. Everything here is static so
+// that each of those files keeps its own copy; they are built without an
+// /arch switch, which intrinsics do not need, so that inline library code
+// they share with the rest of the program never picks up AVX instructions.
+//
+// A vector type provides kWidth, load(), set() and store(), a mask type from
+// its comparisons, and the operators and functions ScalarVec has below.
+
+struct GeodesyKernelTable {
+	void (*distance_bearing)(const GeoOrigin& origin, const double* lat, const double* lon, size_t count,
+		double* distance, double* bearing);
+	void (*to_ecef)(const double* lat, const double* lon, const double* alt, size_t count,
+		double* x, double* y, double* z);
+	void (*to_enu)(const GeoOrigin& origin, const double* lat, const double* lon, const double* alt,
+		size_t count, double* east, double* north, double* up);
+};
+
+extern const GeodesyKernelTable kGeodesyScalarKernels;
+extern const GeodesyKernelTable kGeodesyAvx2Kernels;
+extern const GeodesyKernelTable kGeodesyAvx512Kernels;
+
+constexpr double kGeodesyPi = 3.14159265358979323846;
+constexpr double kGeodesyRadians = kGeodesyPi / 180;
+constexpr double kGeodesyDegrees = 180 / kGeodesyPi;
+constexpr double kGeodesyE2 = kWgs84Flattening * (2 - kWgs84Flattening);
+
+// pi/2 in two parts, the first with its low bits clear so that multiples
+// of it are exact, for reducing arguments to within pi/4 of a multiple.
+constexpr double kGeodesyPio2Hi = 1.57079632673412561417e+00;
+constexpr double kGeodesyPio2Lo = 6.07710050650619224932e-11;
+constexpr double kGeodesyTanPi8 = 0.41421356237309504880;
+
+struct ScalarMask {
+	bool m;
+};
+
+struct ScalarVec {
+	static constexpr size_t kWidth = 1;
+	typedef ScalarMask Mask;
+
+	static ScalarVec load(const double* p) { return { *p }; }
+	static ScalarVec set(double d) { return { d }; }
+	void store(double* p) const { *p = v; }
+
+	double v;
+};
+
+static inline ScalarVec operator+(ScalarVec a, ScalarVec b) { return { a.v + b.v }; }
+static inline ScalarVec operator-(ScalarVec a, ScalarVec b) { return { a.v - b.v }; }
+static inline ScalarVec operator*(ScalarVec a, ScalarVec b) { return { a.v * b.v }; }
+static inline ScalarVec operator/(ScalarVec a, ScalarVec b) { return { a.v / b.v }; }
+static inline ScalarVec operator-(ScalarVec a) { return { -a.v }; }
+static inline ScalarMask operator<(ScalarVec a, ScalarVec b) { return { a.v < b.v }; }
+static inline ScalarMask operator>(ScalarVec a, ScalarVec b) { return { a.v > b.v }; }
+static inline ScalarMask operator==(ScalarVec a, ScalarVec b) { return { a.v == b.v }; }
+static inline ScalarMask operator&(ScalarMask a, ScalarMask b) { return { a.m && b.m }; }
+static inline ScalarMask operator|(ScalarMask a, ScalarMask b) { return { a.m || b.m }; }
+static inline ScalarVec fmadd(ScalarVec a, ScalarVec b, ScalarVec c) { return { a.v * b.v + c.v }; }
+static inline ScalarVec vsqrt(ScalarVec a) { return { sqrt(a.v) }; }
+static inline ScalarVec vabs(ScalarVec a) { return { fabs(a.v) }; }
+static inline ScalarVec vmin(ScalarVec a, ScalarVec b) { return { a.v < b.v ? a.v : b.v }; }
+static inline ScalarVec vmax(ScalarVec a, ScalarVec b) { return { a.v > b.v ? a.v : b.v }; }
+static inline ScalarVec vfloor(ScalarVec a) { return { floor(a.v) }; }
+static inline ScalarVec vround(ScalarVec a) { return { nearbyint(a.v) }; }
+static inline ScalarVec vselect(ScalarMask m, ScalarVec a, ScalarVec b) { return m.m ? a : b; }
+
+// sin and cos of x together, to within a unit or two in the last place for
+// |x| up to about 1e5. x is reduced to r within pi/4 of a multiple q of pi/2
+// and the Taylor series taken to r^15 and r^16, whose remainders are below
+// 5e-17 there; q's quadrant then picks and signs the results.
+template <typename V>
+static inline void vsincos(V x, V* s, V* c) {
+	const V q = vround(x * V::set(2 / kGeodesyPi));
+	const V r = (x - q * V::set(kGeodesyPio2Hi)) - q * V::set(kGeodesyPio2Lo);
+	const V z = r * r;
+
+	V ps = V::set(-1.0 / 1307674368000);
+	ps = fmadd(ps, z, V::set(1.0 / 6227020800));
+	ps = fmadd(ps, z, V::set(-1.0 / 39916800));
+	ps = fmadd(ps, z, V::set(1.0 / 362880));
+	ps = fmadd(ps, z, V::set(-1.0 / 5040));
+	ps = fmadd(ps, z, V::set(1.0 / 120));
+	ps = fmadd(ps, z, V::set(-1.0 / 6));
+	const V sinR = fmadd(ps * z, r, r);
+
+	V pc = V::set(1.0 / 20922789888000);
+	pc = fmadd(pc, z, V::set(-1.0 / 87178291200));
+	pc = fmadd(pc, z, V::set(1.0 / 479001600));
+	pc = fmadd(pc, z, V::set(-1.0 / 3628800));
+	pc = fmadd(pc, z, V::set(1.0 / 40320));
+	pc = fmadd(pc, z, V::set(-1.0 / 720));
+	pc = fmadd(pc, z, V::set(1.0 / 24));
+	const V cosR = fmadd(pc * z, z, V::set(1) - z * V::set(0.5));
+
+	// The quadrant, 0..3.
+	const V quadrant = q - V::set(4) * vfloor(q * V::set(0.25));
+	const typename V::Mask odd = (quadrant == V::set(1)) | (quadrant == V::set(3));
+	const typename V::Mask negateSin = quadrant > V::set(1.5);
+	const typename V::Mask negateCos = (quadrant == V::set(1)) | (quadrant == V::set(2));
+	const V sinQ = vselect(odd, cosR, sinR);
+	const V cosQ = vselect(odd, sinR, cosR);
+	*s = vselect(negateSin, -sinQ, sinQ);
+	*c = vselect(negateCos, -cosQ, cosQ);
+}
+
+// atan of t in [0, 1]. Past tan(pi/8) it is pi/4 plus the atan of
+// (t - 1) / (t + 1), and halving the angle once more with
+// u / (1 + sqrt(1 + u^2)) leaves |h| below 0.2, where the series to h^19
+// is good to 5e-16 relative.
+template <typename V>
+static inline V vatan01(V t) {
+	const typename V::Mask high = t > V::set(kGeodesyTanPi8);
+	const V u = vselect(high, (t - V::set(1)) / (t + V::set(1)), t);
+	const V h = u / (V::set(1) + vsqrt(fmadd(u, u, V::set(1))));
+	const V z = h * h;
+
+	V p = V::set(-1.0 / 19);
+	p = fmadd(p, z, V::set(1.0 / 17));
+	p = fmadd(p, z, V::set(-1.0 / 15));
+	p = fmadd(p, z, V::set(1.0 / 13));
+	p = fmadd(p, z, V::set(-1.0 / 11));
+	p = fmadd(p, z, V::set(1.0 / 9));
+	p = fmadd(p, z, V::set(-1.0 / 7));
+	p = fmadd(p, z, V::set(1.0 / 5));
+	p = fmadd(p, z, V::set(-1.0 / 3));
+	const V atanH = fmadd(p * z, h, h);
+	return fmadd(atanH, V::set(2), vselect(high, V::set(kGeodesyPi / 4), V::set(0)));
+}
+
+template <typename V>
+static inline V vatan2(V y, V x) {
+	const V ax = vabs(x);
+	const V ay = vabs(y);
+	const V high = vmax(ax, ay);
+	const V low = vmin(ax, ay);
+	const typename V::Mask zero = high == V::set(0);
+	V a = vatan01(vselect(zero, V::set(0), low / vselect(zero, V::set(1), high)));
+	a = vselect(ay > ax, V::set(kGeodesyPi / 2) - a, a);
+	a = vselect(x < V::set(0), V::set(kGeodesyPi) - a, a);
+	return vselect(y < V::set(0), -a, a);
+}
+
+template <typename V>
+static inline void distanceBearingLanes(const GeoOrigin& origin, V lat, V lon, V* distance, V* bearing) {
+	V sinHalfDlat, cosHalfDlat, sinHalfDlon, cosHalfDlon, sinLat, cosLat;
+	vsincos((lat - V::set(origin.lat)) * V::set(kGeodesyRadians / 2), &sinHalfDlat, &cosHalfDlat);
+	vsincos((lon - V::set(origin.lon)) * V::set(kGeodesyRadians / 2), &sinHalfDlon, &cosHalfDlon);
+	vsincos(lat * V::set(kGeodesyRadians), &sinLat, &cosLat);
+
+	// Haversine, with asin(sqrt(a)) as an atan2 that stays exact near 1.
+	const V sin2HalfDlon = sinHalfDlon * sinHalfDlon;
+	const V a = vmin(fmadd(V::set(origin.cos_lat) * cosLat, sin2HalfDlon, sinHalfDlat * sinHalfDlat),
+		V::set(1));
+	*distance = V::set(2 * kEarthRadiusMeters) * vatan2(vsqrt(a), vsqrt(V::set(1) - a));
+
+	// As greatCircleBearing, from the half angles already at hand.
+	const V sinDlon = V::set(2) * sinHalfDlon * cosHalfDlon;
+	const V y = sinDlon * cosLat;
+	const V x = V::set(2) * fmadd(V::set(origin.sin_lat) * cosLat, sin2HalfDlon, sinHalfDlat * cosHalfDlat);
+	const V degrees = vatan2(y, x) * V::set(kGeodesyDegrees);
+	*bearing = vselect(degrees < V::set(0), degrees + V::set(360), degrees);
+}
+
+template <typename V>
+static inline void ecefLanes(V lat, V lon, V alt, V* x, V* y, V* z) {
+	V sinLat, cosLat, sinLon, cosLon;
+	vsincos(lat * V::set(kGeodesyRadians), &sinLat, &cosLat);
+	vsincos(lon * V::set(kGeodesyRadians), &sinLon, &cosLon);
+	const V n = V::set(kWgs84SemiMajorMeters) / vsqrt(V::set(1) - V::set(kGeodesyE2) * sinLat * sinLat);
+	const V horizontal = (n + alt) * cosLat;
+	*x = horizontal * cosLon;
+	*y = horizontal * sinLon;
+	*z = fmadd(n, V::set(1 - kGeodesyE2), alt) * sinLat;
+}
+
+template <typename V>
+static inline void enuLanes(const GeoOrigin& origin, V lat, V lon, V alt, V* east, V* north, V* up) {
+	V x, y, z;
+	ecefLanes(lat, lon, alt, &x, &y, &z);
+	const V dx = x - V::set(origin.x);
+	const V dy = y - V::set(origin.y);
+	const V dz = z - V::set(origin.z);
+	const V sinLat = V::set(origin.sin_lat), cosLat = V::set(origin.cos_lat);
+	const V sinLon = V::set(origin.sin_lon), cosLon = V::set(origin.cos_lon);
+	*east = cosLon * dy - sinLon * dx;
+	const V toward = cosLon * dx + sinLon * dy;
+	*north = cosLat * dz - sinLat * toward;
+	*up = fmadd(cosLat, toward, sinLat * dz);
+}
+
+// Runs f over count points kWidth at a time, with the last few copied into
+// a full vector padded with copies of the first of them. Null outputs are
+// not stored.
+template <typename V, int kIn, int kOut, typename F>
+static inline void forEachVector(const double* const (&in)[kIn], double* const (&out)[kOut], size_t count,
+	F f) {
+	V vin[kIn], vout[kOut];
+	size_t i = 0;
+	for (; i + V::kWidth <= count; i += V::kWidth) {
+		for (int j = 0; j < kIn; j++)
+			vin[j] = V::load(in[j] + i);
+		f(vin, vout);
+		for (int j = 0; j < kOut; j++) {
+			if (out[j] != nullptr)
+				vout[j].store(out[j] + i);
+		}
+	}
+	const size_t rest = count - i;
+	if (rest == 0)
+		return;
+	double buffer[V::kWidth];
+	for (int j = 0; j < kIn; j++) {
+		for (size_t k = 0; k < V::kWidth; k++)
+			buffer[k] = in[j][i + (k < rest ? k : 0)];
+		vin[j] = V::load(buffer);
+	}
+	f(vin, vout);
+	for (int j = 0; j < kOut; j++) {
+		if (out[j] == nullptr)
+			continue;
+		vout[j].store(buffer);
+		memcpy(out[j] + i, buffer, rest * sizeof(double));
+	}
+}
+
+template <typename V>
+static void distanceBearingKernel(const GeoOrigin& origin, const double* lat, const double* lon, size_t count,
+	double* distance, double* bearing) {
+	const double* const in[] = { lat, lon };
+	double* const out[] = { distance, bearing };
+	forEachVector<V>(in, out, count, [&origin](const V* v, V* r) {
+		distanceBearingLanes(origin, v[0], v[1], &r[0], &r[1]);
+	});
+}
+
+template <typename V>
+static void ecefKernel(const double* lat, const double* lon, const double* alt, size_t count,
+	double* x, double* y, double* z) {
+	const double* const in[] = { lat, lon, alt };
+	double* const out[] = { x, y, z };
+	forEachVector<V>(in, out, count, [](const V* v, V* r) {
+		ecefLanes(v[0], v[1], v[2], &r[0], &r[1], &r[2]);
+	});
+}
+
+template <typename V>
+static void enuKernel(const GeoOrigin& origin, const double* lat, const double* lon, const double* alt,
+	size_t count, double* east, double* north, double* up) {
+	const double* const in[] = { lat, lon, alt };
+	double* const out[] = { east, north, up };
+	forEachVector<V>(in, out, count, [&origin](const V* v, V* r) {
+		enuLanes(origin, v[0], v[1], v[2], &r[0], &r[1], &r[2]);
+	});
+}
+
+template <typename V>
+static constexpr GeodesyKernelTable geodesyKernelTable() {
+	return { distanceBearingKernel<V>, ecefKernel<V>, enuKernel<V> };
+}
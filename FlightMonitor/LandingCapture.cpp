@@ -0,0 +1,256 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include <math.h>
+#include <algorithm>
+#include "LandingCapture.h"
+#include "Geodesy.h"
+#include "TrackFile.h"
+
+constexpr double kLandingPi = 3.14159265358979323846;
+
+// An on-ground edge this far from the hint belongs to another contact.
+constexpr int64_t kContactSearchMs = 5000;
+
+// The load factor peak is looked for this long after contact.
+constexpr int64_t kLandingGForceMs = 2000;
+
+// Without a vertical speed channel, it is taken over this long before
+// contact.
+constexpr int64_t kLandingSinkRateMs = 1000;
+
+// Float distance is measured from this height, the usual screen height.
+constexpr double kFloatHeightMeters = 15.24;   // 50 feet
+
+// Rollout samples slower than this no longer follow the runway.
+constexpr double kRolloutMinSpeedMps = 5;
+
+// How long the capture thread sleeps when nothing wakes it.
+constexpr int kCaptureIdleMs = 250;
+
+static bool anyNonZero(const std::vector<SimSample>& samples, size_t end, double SimData::* field) {
+	for (size_t i = 0; i < end; i++) {
+		if (samples[i].data.*field != 0)
+			return true;
+	}
+	return false;
+}
+
+bool analyzeLanding(const std::vector<SimSample>& samples, int64_t contactHintMs, LandingReport* report) {
+	if (samples.size() < 2)
+		return false;
+
+	// The contact: an on-ground edge near the hint, or the sample nearest it.
+	size_t contact = 0;
+	bool fromOnGround = false;
+	int64_t best = INT64_MAX;
+	for (size_t i = 1; i < samples.size(); i++) {
+		const int64_t distance = llabs(samples[i].time_ms - contactHintMs);
+		if (samples[i].data.on_ground >= 0.5 && samples[i - 1].data.on_ground < 0.5 &&
+			distance <= kContactSearchMs && (!fromOnGround || distance < best)) {
+			contact = i;
+			best = distance;
+			fromOnGround = true;
+		} else if (!fromOnGround && distance < best) {
+			contact = i;
+			best = distance;
+		}
+	}
+	if (contact == 0)
+		return false;
+
+	const SimSample& touch = samples[contact];
+	report->time_ms = touch.time_ms;
+	report->lat = touch.data.gps_lat;
+	report->lon = touch.data.gps_lon;
+	report->from_on_ground = fromOnGround;
+	report->crab = remainder(touch.data.heading - touch.data.gps_track, 360.0);
+
+	// Rate of descent just before the wheels touched.
+	if (anyNonZero(samples, contact, &SimData::vertical_speed)) {
+		report->vertical_speed = samples[contact - 1].data.vertical_speed;
+	} else {
+		size_t from = contact - 1;
+		while (from > 0 && touch.time_ms - samples[from].time_ms < kLandingSinkRateMs)
+			from--;
+		const double seconds = (touch.time_ms - samples[from].time_ms) / 1000.0;
+		report->vertical_speed = seconds > 0 ? (touch.data.gps_alt - samples[from].data.gps_alt) / seconds : 0;
+	}
+
+	report->g_force = 0;
+	for (size_t i = contact; i < samples.size() && samples[i].time_ms - touch.time_ms <= kLandingGForceMs; i++)
+		report->g_force = std::max(report->g_force, samples[i].data.g_force);
+
+	// Distance flown from 50 ft, by the simulator's height above ground if
+	// it gave one, or else by height above the contact point.
+	const bool haveAgl = anyNonZero(samples, contact, &SimData::alt_agl);
+	report->float_distance = -1;
+	double distance = 0;
+	for (size_t i = contact; i > 0; i--) {
+		const SimData& a = samples[i - 1].data;
+		const SimData& b = samples[i].data;
+		distance += greatCircleDistance(a.gps_lat, a.gps_lon, b.gps_lat, b.gps_lon);
+		const double height = haveAgl ? a.alt_agl : a.gps_alt - touch.data.gps_alt;
+		if (height >= kFloatHeightMeters) {
+			report->float_distance = distance;
+			break;
+		}
+	}
+
+	// The rollout line, in meters east and north of the contact point.
+	const double metersPerDegree = kEarthRadiusMeters * kLandingPi / 180;
+	const double eastScale = metersPerDegree * cos(touch.data.gps_lat * kLandingPi / 180);
+	double sumEast = 0, sumNorth = 0, sumSin = 0, sumCos = 0;
+	int rolling = 0;
+	for (size_t i = contact; i < samples.size(); i++) {
+		const SimData& d = samples[i].data;
+		if (d.gps_groundspeed < kRolloutMinSpeedMps || (fromOnGround && d.on_ground < 0.5))
+			break;
+		sumEast += remainder(d.gps_lon - touch.data.gps_lon, 360.0) * eastScale;
+		sumNorth += (d.gps_lat - touch.data.gps_lat) * metersPerDegree;
+		sumSin += sin(d.gps_track * kLandingPi / 180);
+		sumCos += cos(d.gps_track * kLandingPi / 180);
+		rolling++;
+	}
+	report->centerline_offset = 0;
+	if (rolling > 1 && (sumSin != 0 || sumCos != 0)) {
+		const double track = atan2(sumSin, sumCos);
+		// The contact point is the origin; its offset is minus the line's.
+		const double east = -sumEast / rolling;
+		const double north = -sumNorth / rolling;
+		report->centerline_offset = east * cos(track) - north * sin(track);
+	}
+	return true;
+}
+
+void LandingCapture::start(const std::wstring& directory) {
+	stop();
+	directory_ = directory;
+	stopping_ = false;
+	thread_ = std::thread(&LandingCapture::runCapture, this);
+}
+
+void LandingCapture::stop() {
+	stopping_ = true;
+	wake_.notify_one();
+	if (thread_.joinable())
+		thread_.join();
+}
+
+void LandingCapture::onStateChange(SimulatorInterfaceState state) {
+	if (state != SimInterfaceInFlight) {
+		// A new flight starts wherever the simulator puts it.
+		was_on_ground_ = true;
+		armed_ = false;
+	}
+}
+
+void LandingCapture::onSample(const SimSample& sample) {
+	ring_.push(sample);
+
+	const bool onGround = sample.data.on_ground >= 0.5;
+	if (onGround && !was_on_ground_)
+		arm(sample.time_ms);
+	was_on_ground_ = onGround;
+
+	const int64_t requested = requested_ms_.exchange(0, std::memory_order_acquire);
+	if (requested != 0)
+		arm(requested);
+
+	if (armed_ && sample.time_ms >= armed_contact_ms_ + kLandingAfterMs) {
+		armed_ = false;
+		if (full_.load(std::memory_order_acquire)) {
+			// The capture thread is still busy with the last one.
+			dropped_++;
+			return;
+		}
+		mail_contact_ms_ = armed_contact_ms_;
+		mail_end_ = ring_.written();
+		full_.store(true, std::memory_order_release);
+		wake_.notify_one();
+	}
+}
+
+void LandingCapture::arm(int64_t contactMs) {
+	if (armed_ || (last_contact_ms_ != 0 && llabs(contactMs - last_contact_ms_) < kLandingSameContactMs))
+		return;
+	armed_ = true;
+	armed_contact_ms_ = contactMs;
+	last_contact_ms_ = contactMs;
+}
+
+LandingReport LandingCapture::latest() const {
+	std::lock_guard<std::mutex> lock(report_mutex_);
+	return report_;
+}
+
+void LandingCapture::drain() {
+	while (full_.load(std::memory_order_acquire) && thread_.joinable())
+		std::this_thread::yield();
+}
+
+void LandingCapture::runCapture() {
+	while (!stopping_) {
+		if (!full_.load(std::memory_order_acquire)) {
+			std::unique_lock<std::mutex> lock(wake_mutex_);
+			wake_.wait_for(lock, std::chrono::milliseconds(kCaptureIdleMs));
+			continue;
+		}
+		save(mail_contact_ms_, mail_end_);
+		full_.store(false, std::memory_order_release);
+	}
+}
+
+void LandingCapture::save(int64_t contactMs, uint64_t end) {
+	ring_.copy(0, end, &window_);
+	size_t first = 0;
+	while (first < window_.size() && window_[first].time_ms < contactMs - kLandingBeforeMs)
+		first++;
+	window_.erase(window_.begin(), window_.begin() + first);
+
+	LandingReport report;
+	if (!analyzeLanding(window_, contactMs, &report)) {
+		dropped_++;
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(report_mutex_);
+		report.sequence = report_.sequence + 1;
+		report_ = report;
+	}
+	captures_++;
+
+	if (!directory_.empty()) {
+		SYSTEMTIME st;
+		GetLocalTime(&st);
+		wchar_t name[64];
+		swprintf_s(name, L"\\landing-%04d%02d%02d-%02d%02d%02d%s", st.wYear, st.wMonth, st.wDay,
+			st.wHour, st.wMinute, st.wSecond, kTrackFileExtension);
+		const std::wstring path = directory_ + name;
+		TrackWriter writer;
+		if (SUCCEEDED(writer.open(path.c_str(), window_.front().time_ms))) {
+			for (const SimSample& sample : window_)
+				writer.append(sample);
+			writer.close();
+		} else {
+			winfx::DebugOut(L"Could not save landing to %s\n", path.c_str());
+		}
+	}
+
+	for (LandingCallbacks* callback : callbacks_)
+		callback->onLandingReport(report);
+}
@@ -0,0 +1,150 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framework.h"
+#include "winfx.h"
+#include "FlightPhaseDetector.h"
+#include "OutputSink.h"
+#include "SampleRing.h"
+
+// Samples kept at the simulator's full rate: a little over two minutes at
+// 60 Hz.
+constexpr size_t kLandingRingSamples = 8192;
+
+// The window saved around each contact.
+constexpr int64_t kLandingBeforeMs = 30000;
+constexpr int64_t kLandingAfterMs = 30000;
+
+// Triggers this close to the last captured contact are the same landing.
+constexpr int64_t kLandingSameContactMs = 60000;
+
+struct LandingReport {
+	int64_t time_ms = 0;            // contact
+	double lat = 0;
+	double lon = 0;
+	double vertical_speed = 0;      // m/s at contact, negative
+	double g_force = 0;             // peak just after contact, 0 if not recorded
+	double float_distance = -1;     // meters from 50 ft to contact, -1 if unknown
+	double centerline_offset = 0;   // meters right (+) or left of the rollout line
+	double crab = 0;                // heading minus track at contact, degrees
+	bool from_on_ground = false;    // contact from the simulator, not estimated
+	uint32_t sequence = 0;          // increments with each report
+};
+
+// Works out the landing around contactHintMs from samples in time order.
+// The contact is the simulator's on-ground edge nearest the hint when the
+// samples have one, and the hint itself otherwise.
+//
+// There is no runway geometry to measure against, so the centerline is
+// taken to be the line of the rollout: the mean position and track while
+// still rolling after contact. That is where pilots steer once down, so the
+// offset says how far from it the wheels first touched.
+bool analyzeLanding(const std::vector<SimSample>& samples, int64_t contactHintMs, LandingReport* report);
+
+// Called on the capture thread.
+class LandingCallbacks {
+public:
+	virtual void onLandingReport(const LandingReport& report) = 0;
+};
+
+// Keeps every sample of the last couple of minutes in a SampleRing and, on
+// a touchdown, saves the window around it to a recording and reports on
+// the landing.
+//
+// The sink takes every input sample and does no more than copy it into the
+// ring and look for the simulator's on-ground edge, so it never slows the
+// scheduler. The save happens on the capture thread once the window after
+// contact has passed; the sink hands it over through an atomic mailbox.
+// The FlightPhaseDetector's touchdowns are triggers too, for simulators
+// without an on-ground flag.
+class LandingCapture : public OutputSink, public FlightPhaseCallbacks {
+public:
+	LandingCapture() {}
+	~LandingCapture() { stop(); }
+
+	// Captures are saved in directory, or only reported if it is empty.
+	void start(const std::wstring& directory);
+	void stop();
+
+	void addCallback(LandingCallbacks* callback) {
+		callbacks_.push_back(callback);
+	}
+
+	const char* sinkName() const override { return "Landing capture"; }
+	double sinkRate() const override { return 0; }
+
+	void onSample(const SimSample& sample) override;
+	void onStateChange(SimulatorInterfaceState state) override;
+
+	void onFlightPhase(FlightPhase phase, const SimSample& sample) override {}
+	void onLiftoff(const SimSample& sample) override {}
+	void onTouchdown(const TouchdownInfo& touchdown) override { trigger(touchdown.time_ms); }
+
+	// Capture around contactMs. Safe from any thread.
+	void trigger(int64_t contactMs) { requested_ms_.store(contactMs, std::memory_order_release); }
+
+	// Safe from any thread.
+	LandingReport latest() const;
+
+	// Waits until a capture handed to the capture thread has been saved.
+	// Only for replaying faster than real time, where the ring would
+	// otherwise be overwritten before it is read.
+	void drain();
+
+	uint64_t captures() const { return captures_.load(std::memory_order_relaxed); }
+	uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+	void arm(int64_t contactMs);
+	void runCapture();
+	void save(int64_t contactMs, uint64_t end);
+
+	std::vector<LandingCallbacks*> callbacks_;
+	SampleRing<kLandingRingSamples> ring_;
+	std::atomic<int64_t> requested_ms_{ 0 };
+
+	// Sink thread only.
+	bool was_on_ground_ = true;
+	bool armed_ = false;
+	int64_t armed_contact_ms_ = 0;
+	int64_t last_contact_ms_ = 0;
+
+	// The mailbox: the sink fills it and sets full_, the capture thread
+	// empties it and clears full_.
+	std::atomic<bool> full_{ false };
+	int64_t mail_contact_ms_ = 0;
+	uint64_t mail_end_ = 0;
+
+	std::wstring directory_;
+	std::thread thread_;
+	std::mutex wake_mutex_;
+	std::condition_variable wake_;
+	std::atomic<bool> stopping_{ false };
+	std::atomic<uint64_t> captures_{ 0 };
+	std::atomic<uint64_t> dropped_{ 0 };
+
+	mutable std::mutex report_mutex_;
+	LandingReport report_;
+	std::vector<SimSample> window_;
+};
@@ -16,20 +16,54 @@
 #include "framework.h"
 #include "winfx.h"
 #include "MainWindow.h"
+#include "AllocTracker.h"
+#include "AppPaths.h"
+#include "ConfigFile.h"
 #include "ForeFlightBroadcaster.h"
 #include "Resource.h"
+#include "SimConnectBackend.h"
+#include "XPlaneBackend.h"
+
+#include <stdio.h>
 
 // we need commctrl v6 for LoadIconMetric()
 #pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 
 UINT const WMAPP_NOTIFYCALLBACK = WM_APP + 1;
+UINT const WMAPP_SIMCONNECT = WM_APP + 2;
+UINT const WMAPP_ALERT = WM_APP + 3;
 
 #define HANDLE_WMAPP_NOTIFYCALLBACK(hwnd, wParam, lParam, fn) \
     ((fn)((hwnd), (DWORD)LOWORD(lParam), winfx::Point(LOWORD(wParam), HIWORD(wParam))), 0L)
 
-constexpr int kPollTimerIntervalMs = 1000 / kAttitueReportsPerSecond;
 constexpr int kReconnectTimerIntervalMs = 5000;
 
+// Sim data arrives faster than anyone can read it, so updates only mark the
+// window stale and a timer running at the display's refresh rate repaints it.
+constexpr int kDefaultRefreshHz = 60;
+constexpr int kMinRepaintIntervalMs = 10;
+
+constexpr double kMpsToFpm = 196.850394;
+
+constexpr FbColor kTextColor = fbRgb(0, 0, 0);
+constexpr FbColor kConnectedColor = fbRgb(64, 255, 64);
+constexpr FbColor kAirspaceAlertColor = fbRgb(224, 0, 0);
+
+// Optional serial device for NMEA output, e.g. "\\.\COM5" for one end of a
+// virtual null-modem pair.
+constexpr wchar_t kNmeaSerialPortVariable[] = L"FLIGHTMONITOR_NMEA_PORT";
+
+// X-Plane's address to take data from X-Plane instead of SimConnect, or "*"
+// to listen for its DATA output.
+constexpr wchar_t kXPlaneVariable[] = L"FLIGHTMONITOR_XPLANE";
+
+// Set to "rio" to send the ForeFlight reports with Winsock Registered I/O.
+constexpr wchar_t kSendBackendVariable[] = L"FLIGHTMONITOR_SEND_BACKEND";
+
+// ForeFlight position and attitude reports per second, as in sessions.txt:
+// "<min>-<max>,<min>-<max>", or one number for a fixed rate.
+constexpr wchar_t kReportRatesVariable[] = L"FLIGHTMONITOR_REPORT_RATES";
+
 // Ugly hack. The path to the executable is stored by the Shell when you call
 // Shell_NotifyIcon (https://docs.microsoft.com/en-us/windows/win32/api/shellapi/ns-shellapi-notifyicondataa#troubleshooting)
 // Since the Debug and Release versions compile to different locations, they have
@@ -41,6 +75,14 @@ class __declspec(uuid("5a53c7ca-f57d-4ea2-ab43-4ab65994cb61")) AppIcon;
 class __declspec(uuid("f0d5c17f-e9d7-42ce-ad26-b50a93f93f06")) AppIcon;
 #endif
 
+// The renderer's font only covers printable ASCII.
+static void toAscii(const wchar_t* text, char* out, size_t size) {
+	size_t i = 0;
+	for (; text[i] != L'\0' && i + 1 < size; i++)
+		out[i] = (text[i] >= L' ' && text[i] <= L'~') ? static_cast<char>(text[i]) : '?';
+	out[i] = '\0';
+}
+
 void MainWindow::modifyWndClass(WNDCLASSEXW& wc) {
 	wc.lpszMenuName = MAKEINTRESOURCE(IDC_FLIGHTMONITOR);
 	wc.hIcon = ::LoadIcon(winfx::App::getSingleton().getInstance(), MAKEINTRESOURCE(IDI_AIRPLANE_GREEN));
@@ -59,16 +101,69 @@ LRESULT MainWindow::handleWindowMessage(HWND hwndParam, UINT uMsg,
 		HANDLE_MSG(hwndParam, WM_ACTIVATE, onActivate);
 		HANDLE_MSG(hwndParam, WM_COMMAND, onCommand);
 		HANDLE_MSG(hwndParam, WM_DESTROY, onDestroy);
+		HANDLE_MSG(hwndParam, WM_ERASEBKGND, onEraseBkgnd);
 		HANDLE_MSG(hwndParam, WM_PAINT, onPaint);
+		HANDLE_MSG(hwndParam, WM_SHOWWINDOW, onShowWindow);
+		HANDLE_MSG(hwndParam, WM_SIZE, onSize);
 		HANDLE_MSG(hwndParam, WM_TIMER, onTimer);
 		HANDLE_MSG(hwndParam, WMAPP_NOTIFYCALLBACK, onNotifyCallback);
+	case WMAPP_SIMCONNECT:
+		onSimConnectMessage(hwndParam);
+		return 0;
+	case WMAPP_ALERT:
+		showAlerts();
+		return 0;
 	}
 	return Window::handleWindowMessage(hwndParam, uMsg, wParam, lParam);
 }
 
 LRESULT MainWindow::onCreate(HWND hwndParam, LPCREATESTRUCT lpCreateStruct) {
 	// Create a broadcast UDP socket
-	broadcaster_.init();
+	wchar_t backend[16] = { 0 };
+	GetEnvironmentVariable(kSendBackendVariable, backend, ARRAYSIZE(backend));
+	broadcaster_.init(nullptr, FF_GPS_PORT, "MSFS",
+		_wcsicmp(backend, L"rio") == 0 ? kDatagramRegisteredIo : kDatagramSendto);
+	setReportRates();
+
+	// Start the NMEA outputs
+	wchar_t nmea_port[MAX_PATH] = { 0 };
+	GetEnvironmentVariable(kNmeaSerialPortVariable, nmea_port, ARRAYSIZE(nmea_port));
+	nmea_.init(nmea_port);
+
+	// X-Plane in place of SimConnect
+	wchar_t xplane[64] = { 0 };
+	GetEnvironmentVariable(kXPlaneVariable, xplane, ARRAYSIZE(xplane));
+	if (*xplane) {
+		char address[64] = { 0 };
+		if (wcscmp(xplane, L"*") != 0)
+			toAscii(xplane, address, sizeof(address));
+		sim_.setBackend(std::unique_ptr<SimBackend>(new XPlaneBackend(address)));
+	} else {
+		// Any extra SimVars listed in simvars.txt
+		loadSimVars();
+	}
+
+	// Terrain tiles for AGL
+	wchar_t terrain_dir[MAX_PATH] = { 0 };
+	GetEnvironmentVariable(kTerrainDirectoryVariable, terrain_dir, ARRAYSIZE(terrain_dir));
+	terrain_.open(*terrain_dir ? std::wstring(terrain_dir) : getAppDataDirectory(L"Terrain"));
+
+	// Airport database for the nearest airport, if one has been built
+	const std::wstring navdata = getAppDataDirectory(L"Navdata");
+	if (!navdata.empty())
+		nearest_.open((navdata + L"\\" + kAirportFileName).c_str());
+
+	// Airspace, before the monitor starts looking at it
+	loadAirspace();
+
+	// Saves the last minute around each touchdown
+	landing_.start(getAppDataDirectory(L"Landings"));
+
+	// Start delivering samples to the output sinks
+	scheduler_.start();
+
+	// Any other simulators listed in sessions.txt
+	startSessions();
 
 	// Attempt to connect to the simulator.
 	if (FAILED(connectSim())) {
@@ -95,23 +190,59 @@ LRESULT MainWindow::onActivate(HWND hwnd, UINT state, HWND hwndActDeact, BOOL fM
 
 void MainWindow::onTimer(HWND hwndParam, UINT idTimer) {
 	switch (idTimer) {
-	case ID_TIMER_POLL_SIM:
-		sim_.pollSimulator();
-		break;
-
 	case ID_TIMER_SIM_CONNECT:
 		if (SUCCEEDED(connectSim())) {
 			KillTimer(hwndParam, ID_TIMER_SIM_CONNECT);
 		}
 		break;
+
+	case ID_TIMER_REPAINT:
+		if (needs_render_ && IsWindowVisible(hwndParam) && !IsIconic(hwndParam)) {
+			render();
+		}
+		break;
 	}
 }
 
+void MainWindow::onShowWindow(HWND hwndParam, BOOL fShow, UINT status) {
+	if (!fShow) {
+		// Nobody is looking; don't spend anything on drawing.
+		KillTimer(hwndParam, ID_TIMER_REPAINT);
+		return;
+	}
+
+	int refreshHz = kDefaultRefreshHz;
+	HDC hdc = GetDC(hwndParam);
+	if (hdc) {
+		// 0 and 1 mean the hardware default.
+		int vrefresh = GetDeviceCaps(hdc, VREFRESH);
+		if (vrefresh > 1)
+			refreshHz = vrefresh;
+		ReleaseDC(hwndParam, hdc);
+	}
+	int intervalMs = 1000 / refreshHz;
+	if (intervalMs < kMinRepaintIntervalMs)
+		intervalMs = kMinRepaintIntervalMs;
+	SetTimer(hwndParam, ID_TIMER_REPAINT, intervalMs, NULL);
+
+	// The window may have missed updates while it was hidden.
+	needs_render_ = true;
+	render();
+}
+
+void MainWindow::onSize(HWND hwndParam, UINT state, int cx, int cy) {
+	if (state == SIZE_MINIMIZED || cx <= 0 || cy <= 0)
+		return;
+	renderer_.resize(cx, cy);
+	needs_render_ = true;
+	render();
+}
+
 void MainWindow::onCommand(HWND hwnd, int id, HWND hwndCtl, UINT codeNotify) {
 	switch (id) {
 	case ID_FLIGHT_CONNECT:
 		connectSim();
-		InvalidateRect(hwnd, NULL, TRUE);
+		needs_render_ = true;
 		break;
 
 	case IDM_ABOUT:
@@ -166,56 +297,144 @@ void MainWindow::ShowContextMenu(HWND hwnd, winfx::Point point) {
 	}
 }
 
-void MainWindow::onPaint(HWND hwnd) {
-	PAINTSTRUCT ps;
-	HDC hdc = BeginPaint(hwnd, &ps);
+void MainWindow::render() {
+	needs_render_ = false;
 
-	HFONT hFont = CreateFont(18, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
-		DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
-		DEFAULT_QUALITY, FIXED_PITCH, TEXT("Consolas"));
-
-	int posx = 40;
-	auto DrawAttribute = [&](LPCWSTR format, double value) {
-		wchar_t buf[1024];
-		_snwprintf_s(buf, 1023, _TRUNCATE, format, value);
-		DrawText(hdc, buf, -1, (LPRECT)winfx::Rect(10, posx, 300, posx + 20), 
-			DT_NOCLIP);
-		posx += 20;
-	};
+	char buf[64];
+	toAscii(sim_.getStatusMessage().c_str(), buf, sizeof(buf));
+	renderer_.setText(0, buf, sim_.isConnected() ? kConnectedColor : kTextColor);
 
-	// Draw the status message
-	SelectObject(hdc, hFont);
-	if (sim_.isConnected()) {
-		SetTextColor(hdc, RGB(64, 255, 64));
-	} else {
-		SetTextColor(hdc, RGB(0, 0, 0));
-	}
-	DrawText(hdc, sim_.getStatusMessage().c_str(), -1, (LPRECT)winfx::Rect(10, 10, 300, 30),
-		DT_NOCLIP);
-	
 	// Draw the position if available.
 	const SimData* const data = sim_.getData();
+	int line = 1;
+	auto setAttribute = [&](const char* format, double value) {
+		snprintf(buf, sizeof(buf), format, value);
+		renderer_.setText(line++, buf, kTextColor);
+	};
 	if (data) {
-		SetTextColor(hdc, RGB(0, 0, 0));
-		DrawAttribute(L"GPS ALT: %0.2f m", data->gps_alt);
-		DrawAttribute(L"GPS LAT: %0.4f", data->gps_lat);
-		DrawAttribute(L"GPS LON: %0.4f", data->gps_lon);
-		DrawAttribute(L"GPS TRK: %0.1f", data->gps_track);
-		DrawAttribute(L"GPS GS:  %0.1f m/s", data->gps_groundspeed);
-
-		posx += 10;
-		DrawAttribute(L"PITCH: %0.3f", data->pitch);
-		DrawAttribute(L"BANK:  %0.3f", data->bank);
-		DrawAttribute(L"HDG:   %0.1f", data->heading);
+		setAttribute("GPS ALT: %0.2f m", data->gps_alt);
+		setAttribute("GPS LAT: %0.4f", data->gps_lat);
+		setAttribute("GPS LON: %0.4f", data->gps_lon);
+		setAttribute("GPS TRK: %0.1f", data->gps_track);
+		setAttribute("GPS GS:  %0.1f m/s", data->gps_groundspeed);
+		snprintf(buf, sizeof(buf), "PHASE:   %s", flightPhaseName(phases_.phase()));
+		renderer_.setText(line++, buf, kTextColor);
+		double agl;
+		if (terrain_.aglMeters(&agl))
+			setAttribute("AGL:     %0.0f m", agl);
+		else
+			renderer_.setText(line++, "AGL:     --", kTextColor);
+
+		const NearestAirportInfo nearest = nearest_.latest();
+		if (nearest.valid) {
+			snprintf(buf, sizeof(buf), "NRST: %s %0.1f km", nearest.ident, nearest.distance_m / 1000);
+			renderer_.setText(line++, buf, kTextColor);
+			setAttribute("BRG:  %03.0f", nearest.bearing);
+		} else {
+			renderer_.setText(line++, "NRST: --", kTextColor);
+			renderer_.setText(line++, "BRG:  --", kTextColor);
+		}
+		if (nearest.runway_valid) {
+			snprintf(buf, sizeof(buf), "RWY:  %s %+0.0f", nearest.runway, nearest.runway_offset);
+			renderer_.setText(line++, buf, kTextColor);
+		} else {
+			renderer_.setText(line++, "RWY:  --", kTextColor);
+		}
+
+		const AirspaceStatus airspace = airspace_.status();
+		if (!airspace.inside.empty()) {
+			snprintf(buf, sizeof(buf), "IN:   %s", airspace.inside.c_str());
+			renderer_.setText(line++, buf, airspace.alert ? kAirspaceAlertColor : kTextColor);
+		} else if (!airspace.ahead.empty()) {
+			snprintf(buf, sizeof(buf), "AHEAD: %s", airspace.ahead.c_str());
+			renderer_.setText(line++, buf, kTextColor);
+		} else {
+			renderer_.clearText(line++);
+		}
+		setAttribute("PITCH: %0.3f", data->pitch);
+		setAttribute("BANK:  %0.3f", data->bank);
+		setAttribute("HDG:   %0.1f", data->heading);
+
+		const LandingReport landing = landing_.latest();
+		if (landing.sequence != 0) {
+			snprintf(buf, sizeof(buf), "LAND:  %0.0f fpm %0.2f G", landing.vertical_speed * kMpsToFpm, landing.g_force);
+			renderer_.setText(line++, buf, kTextColor);
+		}
+	}
+
+	// Show how much the ForeFlight delta suppression is saving
+	const uint64_t sent = broadcaster_.packetsSent();
+	const uint64_t suppressed = broadcaster_.packetsSuppressed();
+	if (sent + suppressed > 0) {
+		renderer_.clearText(line++);
+		setAttribute("SUPPRESSED: %0.1f%%", 100.0 * suppressed / (sent + suppressed));
+	}
+	// and when the network is congested, how far it has slowed the reports
+	if (broadcaster_.congested()) {
+		snprintf(buf, sizeof(buf), "CONGESTED: ATT %0.1f GPS %0.1f Hz",
+			broadcaster_.attitudeRate(), broadcaster_.positionRate());
+		renderer_.setText(line++, buf, kAirspaceAlertColor);
+	}
+
+	if (sessions_.size() > 0) {
+		int connected = 0, inFlight = 0;
+		for (size_t i = 0; i < sessions_.size(); i++) {
+			const SimulatorInterfaceState state = sessions_.session(i).metrics().state;
+			connected += state != SimInterfaceDisconnected;
+			inFlight += state == SimInterfaceInFlight;
+		}
+		snprintf(buf, sizeof(buf), "SESSIONS: %d/%zu up, %d flying", connected, sessions_.size(), inFlight);
+		renderer_.setText(line++, buf, kTextColor);
+	}
+	while (line < kRenderTextLines)
+		renderer_.clearText(line++);
+
+	renderer_.setAircraft(data);
+
+	// Only the parts of the window that changed are repainted.
+	for (const FbRect& rect : renderer_.update()) {
+		RECT rc = { rect.left, rect.top, rect.right, rect.bottom };
+		InvalidateRect(hwnd, &rc, FALSE);
+	}
+}
+
+BOOL MainWindow::onEraseBkgnd(HWND hwnd, HDC hdc) {
+	// onPaint covers every pixel.
+	return TRUE;
+}
+
+void MainWindow::onPaint(HWND hwnd) {
+	PAINTSTRUCT ps;
+	HDC hdc = BeginPaint(hwnd, &ps);
+
+	const Framebuffer& frame = renderer_.framebuffer();
+	if (frame.width() > 0 && frame.height() > 0) {
+		BITMAPINFO bmi = { 0 };
+		bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+		bmi.bmiHeader.biWidth = frame.width();
+		bmi.bmiHeader.biHeight = -frame.height();  // top-down rows
+		bmi.bmiHeader.biPlanes = 1;
+		bmi.bmiHeader.biBitCount = 32;
+		bmi.bmiHeader.biCompression = BI_RGB;
+
+		// The paint region clips this to the rectangles that changed.
+		SetDIBitsToDevice(hdc, 0, 0, frame.width(), frame.height(), 0, 0,
+			0, frame.height(), frame.pixels(), &bmi, DIB_RGB_COLORS);
 	}
 
-	DeleteObject(hFont);
 	EndPaint(hwnd, &ps);
 }
 
 void MainWindow::onDestroy(HWND hwnd) {
 	DeleteNotificationIcon();
 	sim_.close();
+	scheduler_.stop();
+	sessions_.stop();
+	landing_.stop();
+	nmea_.close();
+	recorder_.close();
+	terrain_.close();
+	logAllocSites();
 	PostQuitMessage(0);
 }
 
@@ -267,23 +486,54 @@ BOOL MainWindow::DeleteNotificationIcon() {
 }
 
 HRESULT MainWindow::connectSim() {
-	HRESULT hr = sim_.connectSim(hwnd);
-	if (SUCCEEDED(hr)) {
-		SetTimer(hwnd, ID_TIMER_POLL_SIM, kPollTimerIntervalMs, NULL);
+	return sim_.connectSim(hwnd, WMAPP_SIMCONNECT);
+}
+
+void MainWindow::onSimConnectMessage(HWND hwnd) {
+	if (sim_.isConnected()) {
+		sim_.dispatch();
+	}
+}
+
+void MainWindow::onEvent(const SimDataEvent&) {
+	// Picked up by the next ID_TIMER_REPAINT tick.
+	needs_render_ = true;
+
+	const uint32_t sequence = nearest_.latest().sequence;
+	if (sequence != nearest_sequence_) {
+		nearest_sequence_ = sequence;
+		updateTooltip();
+	}
+}
+
+// The simulator state, and the nearest airport while there is one.
+// Straight into the notification's buffer; this runs on every nearest
+// airport update.
+void MainWindow::formatTooltip(wchar_t* text, size_t size) const {
+	int length = LoadStringW(winfx::App::getSingleton().getInstance(), tooltip_, text, (int)size);
+	const NearestAirportInfo nearest = nearest_.latest();
+	if (nearest.valid && length > 0 && (size_t)length < size) {
+		length += swprintf_s(text + length, size - length, L"\n%S %0.1f km %03.0f",
+			nearest.ident, nearest.distance_m / 1000, nearest.bearing);
+		if (nearest.runway_valid && length > 0 && (size_t)length < size)
+			swprintf_s(text + length, size - length, L" RWY %S %+0.0f", nearest.runway, nearest.runway_offset);
 	}
-	return hr;
 }
 
-void MainWindow::onSimDataUpdated(const SimData* data) {
-	// When there is new data, invalidate the window to force a repaint.
-	InvalidateRect(hwnd, NULL, TRUE);
+void MainWindow::updateTooltip() {
+	NOTIFYICONDATAW nid = { sizeof(nid) };
+	nid.hWnd = hwnd;
+	nid.uFlags = NIF_TIP | NIF_SHOWTIP | NIF_GUID;
+	nid.guidItem = __uuidof(AppIcon);
+	formatTooltip(nid.szTip, ARRAYSIZE(nid.szTip));
+	Shell_NotifyIconW(NIM_MODIFY, &nid);
 }
 
-void MainWindow::onStateChange(SimulatorInterfaceState state) {
+void MainWindow::onEvent(const SimStateEvent& event) {
 	int icon;
 	int tooltip;
 
-	switch (state) {
+	switch (event.state) {
 	case SimInterfaceDisconnected:
 		icon = IDI_AIRPLANE_RED;
 		tooltip = IDS_NOTCONNECTED;
@@ -310,20 +560,144 @@ void MainWindow::onStateChange(SimulatorInterfaceState state) {
 	nid.guidItem = __uuidof(AppIcon);
 	LoadIconMetric(winfx::App::getSingleton().getInstance(),
 		MAKEINTRESOURCE(icon), LIM_SMALL, &nid.hIcon);
-	LoadString(winfx::App::getSingleton().getInstance(), tooltip,
-		nid.szTip, ARRAYSIZE(nid.szTip));
+	tooltip_ = tooltip;
+	formatTooltip(nid.szTip, ARRAYSIZE(nid.szTip));
 
 	if (!Shell_NotifyIconW(NIM_MODIFY, &nid)) {
 		winfx::DebugOut(L"Failed to modify notify icon.\n");
 	}
 }
 
-void MainWindow::onSimDisconnect() {
-	// Stop the polling timer
-	KillTimer(hwnd, ID_TIMER_POLL_SIM);
+// Every OpenAir file in the Airspace directory: *.txt, as most are
+// distributed, or *.air.
+void MainWindow::loadAirspace() {
+	const std::wstring directory = getAppDataDirectory(L"Airspace");
+	if (directory.empty())
+		return;
+	for (LPCWSTR pattern : { L"\\*.txt", L"\\*.air" }) {
+		WIN32_FIND_DATAW found;
+		HANDLE find = FindFirstFileW((directory + pattern).c_str(), &found);
+		if (find == INVALID_HANDLE_VALUE)
+			continue;
+		do {
+			const std::wstring path = directory + L"\\" + found.cFileName;
+			if (FAILED(airspaces_.loadOpenAir(path.c_str())))
+				winfx::DebugOut(L"Could not read airspace %s\n", path.c_str());
+		} while (FindNextFileW(find, &found));
+		FindClose(find);
+	}
+	airspaces_.buildIndex();
+	winfx::DebugOut(L"Loaded %zu airspaces\n", airspaces_.size());
+}
+
+// Overrides the ForeFlight report rate bounds from the environment, if set.
+void MainWindow::setReportRates() {
+	wchar_t rates[64] = { 0 };
+	GetEnvironmentVariable(kReportRatesVariable, rates, ARRAYSIZE(rates));
+	if (!*rates)
+		return;
+	char text[64] = { 0 };
+	toAscii(rates, text, sizeof(text));
+	const std::vector<std::vector<std::string>> lines = splitConfigLines(text, strlen(text));
+	double positionMin = kPositionMinReportsPerSecond, positionMax = kPositionReportsPerSecond;
+	double attitudeMin = kAttitudeMinReportsPerSecond, attitudeMax = kAttitueReportsPerSecond;
+	if (lines.size() != 1 || lines[0].size() != 2 ||
+		!parseConfigRange(lines[0][0], &positionMin, &positionMax) ||
+		!parseConfigRange(lines[0][1], &attitudeMin, &attitudeMax)) {
+		winfx::DebugOut(L"Bad report rates %s\n", rates);
+		return;
+	}
+	broadcaster_.setRateBounds(positionMin, positionMax, attitudeMin, attitudeMax);
+}
+
+// Only SimConnect carries them, so this replaces the default backend with
+// one that requests them too.
+void MainWindow::loadSimVars() {
+	const std::wstring directory = getAppDataDirectory(nullptr);
+	if (directory.empty())
+		return;
+	std::vector<SimVarConfig> configs;
+	if (FAILED(loadSimVarConfig((directory + L"\\" + kSimVarsFileName).c_str(), &configs)))
+		return;
+	if (configs.empty())
+		return;
+	simvars_.configure(configs);
+	sim_.setBackend(std::unique_ptr<SimBackend>(
+		new SimConnectBackend(SIMCONNECT_OPEN_CONFIGINDEX_LOCAL, &simvars_)));
+	recorder_.setSimVars(&simvars_);
+}
+
+// The simulator this window shows is always the local one; sessions.txt adds
+// more, each fed to its own ForeFlight destination and recording folder.
+void MainWindow::startSessions() {
+	const std::wstring directory = getAppDataDirectory(nullptr);
+	if (directory.empty())
+		return;
+	std::vector<SessionConfig> configs;
+	if (FAILED(loadSessionConfig((directory + L"\\" + kSessionsFileName).c_str(), &configs)))
+		return;
+	for (const SessionConfig& config : configs)
+		sessions_.add(config);
+	sessions_.start();
+}
+
+// The airspace callbacks come from the scheduler's worker thread and the
+// landing reports from the capture thread; the balloons are shown from the
+// UI thread.
+void MainWindow::onAirspaceEnter(const Airspace& airspace) {
+	wchar_t buf[128];
+	swprintf_s(buf, L"Entered %S %S", airspaceClassName(airspace.airspace_class), airspace.name.c_str());
+	postAlert(buf);
+}
+
+// Leaving needs no balloon; the status line follows on the next repaint.
+void MainWindow::onAirspaceExit(const Airspace& airspace) {
+}
+
+void MainWindow::onAirspaceAhead(const Airspace& airspace, double seconds) {
+	wchar_t buf[128];
+	swprintf_s(buf, L"%S %S ahead in %0.0f s", airspaceClassName(airspace.airspace_class),
+		airspace.name.c_str(), seconds);
+	postAlert(buf);
+}
+
+void MainWindow::onLandingReport(const LandingReport& report) {
+	wchar_t buf[128];
+	swprintf_s(buf, L"Landed at %0.0f fpm, %0.2f G", report.vertical_speed * kMpsToFpm, report.g_force);
+	postAlert(buf);
+}
+
+void MainWindow::postAlert(std::wstring text) {
+	{
+		std::lock_guard<std::mutex> lock(alerts_mutex_);
+		alerts_.push_back(std::move(text));
+	}
+	PostMessage(hwnd, WMAPP_ALERT, 0, 0);
+}
+
+void MainWindow::showAlerts() {
+	std::deque<std::wstring> alerts;
+	{
+		std::lock_guard<std::mutex> lock(alerts_mutex_);
+		alerts.swap(alerts_);
+	}
+	if (alerts.empty())
+		return;
+
+	// A balloon shows one message at a time, so only the latest matters.
+	NOTIFYICONDATAW nid = { sizeof(nid) };
+	nid.hWnd = hwnd;
+	nid.uFlags = NIF_INFO | NIF_GUID;
+	nid.guidItem = __uuidof(AppIcon);
+	nid.dwInfoFlags = NIIF_WARNING;
+	wcsncpy_s(nid.szInfoTitle, winfx::loadString(IDS_APP_TITLE).c_str(), _TRUNCATE);
+	wcsncpy_s(nid.szInfo, alerts.back().c_str(), _TRUNCATE);
+	Shell_NotifyIconW(NIM_MODIFY, &nid);
+}
 
+void MainWindow::onEvent(const SimDisconnectEvent&) {
 	// Set a timer to attempt to periodically retry connecting
 	SetTimer(hwnd, ID_TIMER_SIM_CONNECT, kReconnectTimerIntervalMs, NULL);
 
-	InvalidateRect(hwnd, NULL, TRUE);
+	needs_render_ = true;
 }
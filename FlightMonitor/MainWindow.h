@@ -17,20 +17,49 @@
 
 #include "framework.h"
 #include "winfx.h"
+#include <deque>
+#include <mutex>
+#include "AirspaceDatabase.h"
+#include "AirspaceMonitor.h"
+#include "FlightPhaseDetector.h"
+#include "FlightRecorder.h"
+#include "LandingCapture.h"
 #include "ForeFlightBroadcaster.h"
+#include "NearestAirport.h"
+#include "NmeaBroadcaster.h"
+#include "SessionManager.h"
+#include "SinkScheduler.h"
 #include "SimInterface.h"
+#include "TerrainService.h"
+#include "TrackLodSink.h"
+#include "TrackRenderer.h"
 #include "Resource.h"
 
 #define ID_TIMER_SIM_CONNECT 100
-#define ID_TIMER_POLL_SIM    101
+#define ID_TIMER_REPAINT 101
 
-class MainWindow : public winfx::Window, public SimulatorCallbacks {
+class MainWindow : public winfx::Window, public EventListener<SimDataEvent>,
+	public EventListener<SimStateEvent>, public EventListener<SimDisconnectEvent>,
+	public AirspaceCallbacks, public LandingCallbacks {
 public:
 	MainWindow() : 
-		winfx::Window(winfx::loadString(IDC_FLIGHTMONITOREX), winfx::loadString(IDS_APP_TITLE)),
-		broadcaster_(sim_) {
-		sim_.addCallback(this);
-		sim_.addCallback(&broadcaster_);
+		winfx::Window(winfx::loadString(IDC_FLIGHTMONITOREX), winfx::loadString(IDS_APP_TITLE)) {
+		// The scheduler first: it carries the network outputs, and the
+		// window's own handlers touch the notification area.
+		sim_.events().subscribeAll(&scheduler_);
+		sim_.events().subscribeAll(this);
+		broadcaster_.registerSinks(scheduler_);
+		scheduler_.addSink(&nmea_);
+		scheduler_.addSink(&phases_);
+		scheduler_.addSink(&recorder_);
+		scheduler_.addSink(&track_sink_);
+		scheduler_.addSink(&terrain_);
+		scheduler_.addSink(&nearest_);
+		scheduler_.addSink(&airspace_);
+		scheduler_.addSink(&landing_);
+		airspace_.addCallback(this);
+		phases_.addCallback(&landing_);
+		landing_.addCallback(this);
 	}
 
 	virtual void modifyWndClass(WNDCLASSEXW& wc) override;
@@ -38,14 +67,20 @@ public:
 
 	virtual LRESULT handleWindowMessage(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) override;
 	virtual winfx::Size getDefaultWindowSize() override {
-		return winfx::Size(400, 300);
+		return winfx::Size(440, 500);
 	}
 
 	LRESULT onCreate(HWND hwnd, LPCREATESTRUCT lpCreateStruct) override;
 
-	void onSimDataUpdated(const SimData* data) override;
-	void onStateChange(SimulatorInterfaceState state) override;
-	void onSimDisconnect() override;
+	void onEvent(const SimDataEvent& event) override;
+	void onEvent(const SimStateEvent& event) override;
+	void onEvent(const SimDisconnectEvent& event) override;
+
+	void onAirspaceEnter(const Airspace& airspace) override;
+	void onAirspaceExit(const Airspace& airspace) override;
+	void onAirspaceAhead(const Airspace& airspace, double seconds) override;
+
+	void onLandingReport(const LandingReport& report) override;
 
 protected:
 	BOOL AddNotificationIcon();
@@ -56,13 +91,45 @@ protected:
 	LRESULT onActivate(HWND hwnd, UINT state, HWND hwndActDeact, BOOL fMinimized);
 	void onCommand(HWND hwnd, int id, HWND hwndCtl, UINT codeNotify);
 	void onDestroy(HWND hwnd);
+	BOOL onEraseBkgnd(HWND hwnd, HDC hdc);
 	void onPaint(HWND hwnd);
+	void onShowWindow(HWND hwnd, BOOL fShow, UINT status);
+	void onSize(HWND hwnd, UINT state, int cx, int cy);
+	void onSimConnectMessage(HWND hwnd);
 	void onTimer(HWND hwnd, UINT idTimer);
 	void onNotifyCallback(HWND, UINT idNotify, winfx::Point point);
+	void loadAirspace();
+	void setReportRates();
+	void loadSimVars();
+	void startSessions();
+	void postAlert(std::wstring text);
+	void showAlerts();
+	void render();
+	void updateTooltip();
+	void formatTooltip(wchar_t* text, size_t size) const;
 
 private:
+	SimVarChannels simvars_;
 	ForeFlightBroadcaster broadcaster_;
+	NmeaBroadcaster nmea_;
+	TerrainService terrain_;
+	FlightPhaseDetector phases_{ &terrain_ };
+	FlightRecorder recorder_{ &phases_ };
+	TrackLod track_;
+	TrackLodSink track_sink_{ &track_ };
+	NearestAirport nearest_;
+	AirspaceDatabase airspaces_;
+	AirspaceMonitor airspace_{ &airspaces_, &terrain_ };
+	LandingCapture landing_;
+	TrackRenderer renderer_{ &track_ };
+	bool needs_render_ = true;
+	int tooltip_ = IDS_NOTCONNECTED;
+	uint32_t nearest_sequence_ = 0;
+	std::mutex alerts_mutex_;
+	std::deque<std::wstring> alerts_;
+	SinkScheduler scheduler_;
 	SimulatorInterface sim_;
+	SessionManager sessions_;
 };
 
 class AboutDialog : public winfx::Dialog {
@@ -0,0 +1,93 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include "MappedFile.h"
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		close();
+		file_ = other.file_;
+		mapping_ = other.mapping_;
+		data_ = other.data_;
+		size_ = other.size_;
+		other.file_ = INVALID_HANDLE_VALUE;
+		other.mapping_ = NULL;
+		other.data_ = nullptr;
+		other.size_ = 0;
+	}
+	return *this;
+}
+
+HRESULT MappedFile::open(LPCWSTR path, DWORD accessHint) {
+	close();
+
+	file_ = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | accessHint, NULL);
+	if (file_ == INVALID_HANDLE_VALUE) {
+		DWORD err = GetLastError();
+		winfx::DebugOut(L"Error %d opening %s\n", err, path);
+		return HRESULT_FROM_WIN32(err);
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file_, &size)) {
+		DWORD err = GetLastError();
+		close();
+		return HRESULT_FROM_WIN32(err);
+	}
+	if ((ULONGLONG)size.QuadPart > (SIZE_T)-1) {
+		close();
+		return E_OUTOFMEMORY;
+	}
+	size_ = (size_t)size.QuadPart;
+
+	// An empty file cannot be mapped, but is a perfectly good empty view.
+	if (size_ == 0)
+		return S_OK;
+
+	mapping_ = CreateFileMapping(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping_ == NULL) {
+		DWORD err = GetLastError();
+		close();
+		return HRESULT_FROM_WIN32(err);
+	}
+
+	data_ = (const uint8_t*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+	if (data_ == nullptr) {
+		DWORD err = GetLastError();
+		close();
+		return HRESULT_FROM_WIN32(err);
+	}
+
+	return S_OK;
+}
+
+void MappedFile::close() {
+	if (data_ != nullptr) {
+		UnmapViewOfFile(data_);
+		data_ = nullptr;
+	}
+	if (mapping_ != NULL) {
+		CloseHandle(mapping_);
+		mapping_ = NULL;
+	}
+	if (file_ != INVALID_HANDLE_VALUE) {
+		CloseHandle(file_);
+		file_ = INVALID_HANDLE_VALUE;
+	}
+	size_ = 0;
+}
@@ -0,0 +1,49 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <utility>
+
+#include "framework.h"
+#include "winfx.h"
+
+// A read-only view of a whole file.
+class MappedFile {
+public:
+	MappedFile() {}
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	// accessHint is passed to CreateFile, e.g. FILE_FLAG_SEQUENTIAL_SCAN for
+	// a single pass or FILE_FLAG_RANDOM_ACCESS for lookups.
+	HRESULT open(LPCWSTR path, DWORD accessHint = FILE_FLAG_SEQUENTIAL_SCAN);
+	void close();
+
+	bool isOpen() const { return file_ != INVALID_HANDLE_VALUE; }
+	const uint8_t* data() const { return data_; }
+	size_t size() const { return size_; }
+
+private:
+	HANDLE file_ = INVALID_HANDLE_VALUE;
+	HANDLE mapping_ = NULL;
+	const uint8_t* data_ = nullptr;
+	size_t size_ = 0;
+};
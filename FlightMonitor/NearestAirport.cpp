@@ -0,0 +1,88 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include "NearestAirport.h"
+
+#include <math.h>
+#include <string.h>
+
+static double angleDifference(double a, double b) {
+	double difference = fmod(a - b, 360);
+	if (difference > 180)
+		difference -= 360;
+	else if (difference < -180)
+		difference += 360;
+	return difference;
+}
+
+void NearestAirport::onSample(const SimSample& sample) {
+	if (!in_flight_ || !db_.isOpen())
+		return;
+
+	const SimData& data = sample.data;
+	db_.nearest(data.gps_lat, data.gps_lon, 1, kAirportKindsAirports, &matches_);
+	NearestAirportInfo info;
+	if (!matches_.empty()) {
+		const AirportMatch& match = matches_[0];
+		info.valid = true;
+		strncpy_s(info.ident, db_.ident(match.index), _TRUNCATE);
+		info.distance_m = match.distance_m;
+		info.bearing = match.bearing;
+
+		if (match.distance_m <= kRunwayAlignmentRangeMeters) {
+			const AirportEntry& entry = db_.entry(match.index);
+			const AirportRunwayEnd* runways = db_.runways(match.index);
+			for (int i = 0; i < entry.runway_count; i++) {
+				const double offset = angleDifference(data.gps_track, runways[i].heading / 10.0);
+				if (!info.runway_valid || fabs(offset) < fabs(info.runway_offset)) {
+					info.runway_valid = true;
+					memcpy(info.runway, runways[i].ident, sizeof(info.runway));
+					info.runway_offset = offset;
+				}
+			}
+			info.runway[sizeof(info.runway) - 1] = '\0';
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	// Displays only show the nearest tenth of a kilometer and whole
+	// degrees, so only bump the sequence when those change.
+	const bool changed = info.valid != info_.valid || strcmp(info.ident, info_.ident) != 0 ||
+		lround(info.distance_m / 100) != lround(info_.distance_m / 100) ||
+		lround(info.bearing) != lround(info_.bearing) ||
+		info.runway_valid != info_.runway_valid || strcmp(info.runway, info_.runway) != 0 ||
+		lround(info.runway_offset) != lround(info_.runway_offset);
+	info.sequence = info_.sequence + (changed ? 1 : 0);
+	info_ = info;
+}
+
+void NearestAirport::onStateChange(SimulatorInterfaceState state) {
+	in_flight_ = (state == SimInterfaceInFlight);
+	if (!in_flight_) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (info_.valid) {
+			const uint32_t sequence = info_.sequence;
+			info_ = NearestAirportInfo();
+			info_.sequence = sequence + 1;
+		}
+	}
+}
+
+NearestAirportInfo NearestAirport::latest() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return info_;
+}
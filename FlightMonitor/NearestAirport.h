@@ -0,0 +1,69 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "winfx.h"
+#include "AirportDatabase.h"
+#include "OutputSink.h"
+
+// Samples per second at which the nearest airport is looked up.
+constexpr double kNearestAirportSamplesPerSecond = 1;
+
+// Runway alignment is only reported this close to the airport.
+constexpr double kRunwayAlignmentRangeMeters = 15000;
+
+struct NearestAirportInfo {
+	bool valid = false;
+	char ident[8] = {};
+	double distance_m = 0;
+	double bearing = 0;          // true, from the aircraft
+	bool runway_valid = false;
+	char runway[4] = {};         // the runway end best aligned with the track
+	double runway_offset = 0;    // track minus runway heading, -180..180
+	uint32_t sequence = 0;       // changes when the displayed values do
+};
+
+// Finds the nearest airport to the aircraft in the airport database
+// (FlightTools buildairports), and the runway its track lines up with best.
+// Without a database it reports nothing.
+class NearestAirport : public OutputSink {
+public:
+	const char* sinkName() const override { return "NearestAirport"; }
+	double sinkRate() const override { return kNearestAirportSamplesPerSecond; }
+	unsigned sinkFields() const override { return kSimFieldPosition | kSimFieldTrack; }
+
+	void onSample(const SimSample& sample) override;
+	void onStateChange(SimulatorInterfaceState state) override;
+
+	// Call before the scheduler starts.
+	HRESULT open(LPCWSTR path) { return db_.open(path); }
+
+	// Safe from any thread.
+	NearestAirportInfo latest() const;
+
+private:
+	AirportDatabase db_;
+	std::vector<AirportMatch> matches_;
+	bool in_flight_ = false;
+
+	mutable std::mutex mutex_;
+	NearestAirportInfo info_;
+};
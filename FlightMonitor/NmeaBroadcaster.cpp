@@ -0,0 +1,366 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include "NmeaBroadcaster.h"
+
+constexpr double kKnotsPerMeterPerSecond = 1.943844;
+constexpr double kKphPerMeterPerSecond = 3.6;
+
+static constexpr NmeaHeader kRmcHeader = makeNmeaHeader("$GPRMC");
+static constexpr NmeaHeader kGgaHeader = makeNmeaHeader("$GPGGA");
+static constexpr NmeaHeader kVtgHeader = makeNmeaHeader("$GPVTG");
+static constexpr NmeaHeader kHdtHeader = makeNmeaHeader("$HCHDT");
+static constexpr NmeaHeader kXdrHeader = makeNmeaHeader("$IIXDR");
+
+static bool setNonBlocking(SOCKET sock) {
+	u_long non_blocking = 1;
+	return ioctlsocket(sock, FIONBIO, &non_blocking) == 0;
+}
+
+HRESULT UdpNmeaOutput::init(const char* destination, u_short port) {
+	sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock_ == INVALID_SOCKET) {
+		winfx::DebugOut(L"Error %d allocating NMEA UDP socket\n", WSAGetLastError());
+		return E_FAIL;
+	}
+
+	char broadcast = '1';
+	if (setsockopt(sock_, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0 ||
+		!setNonBlocking(sock_)) {
+		winfx::DebugOut(L"Error %d setting NMEA UDP socket options\n", WSAGetLastError());
+		close();
+		return E_FAIL;
+	}
+
+	send_addr_.sin_family = AF_INET;
+	send_addr_.sin_port = htons(port);
+	send_addr_.sin_addr.s_addr = INADDR_BROADCAST;
+	if (destination != nullptr && *destination != '\0' &&
+		inet_pton(AF_INET, destination, &send_addr_.sin_addr) != 1) {
+		winfx::DebugOut(L"Bad NMEA destination %S\n", destination);
+		close();
+		return E_INVALIDARG;
+	}
+	open_ = true;
+	return S_OK;
+}
+
+void UdpNmeaOutput::write(const char* data, int length) {
+	if (sendto(sock_, data, length, 0, (sockaddr*)&send_addr_,
+		(int)sizeof(send_addr_)) == SOCKET_ERROR) {
+		int err = WSAGetLastError();
+		if (err != WSAEWOULDBLOCK)
+			winfx::DebugOut(L"Error %d in NMEA UDP send.\n", err);
+	}
+}
+
+void UdpNmeaOutput::close() {
+	if (sock_ != INVALID_SOCKET) {
+		closesocket(sock_);
+		sock_ = INVALID_SOCKET;
+	}
+	open_ = false;
+}
+
+HRESULT TcpNmeaOutput::init() {
+	listen_sock_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listen_sock_ == INVALID_SOCKET) {
+		winfx::DebugOut(L"Error %d allocating NMEA TCP socket\n", WSAGetLastError());
+		return E_FAIL;
+	}
+
+	sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(NMEA_TCP_PORT);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(listen_sock_, (sockaddr*)&addr, (int)sizeof(addr)) == SOCKET_ERROR ||
+		listen(listen_sock_, SOMAXCONN) == SOCKET_ERROR ||
+		!setNonBlocking(listen_sock_)) {
+		winfx::DebugOut(L"Error %d listening on NMEA TCP port\n", WSAGetLastError());
+		close();
+		return E_FAIL;
+	}
+
+	open_ = true;
+	return S_OK;
+}
+
+void TcpNmeaOutput::poll() {
+	if (listen_sock_ == INVALID_SOCKET)
+		return;
+
+	for (;;) {
+		SOCKET sock = accept(listen_sock_, NULL, NULL);
+		if (sock == INVALID_SOCKET)
+			break;
+
+		Client* slot = nullptr;
+		for (Client& client : clients_) {
+			if (client.sock == INVALID_SOCKET) {
+				slot = &client;
+				break;
+			}
+		}
+		if (slot == nullptr || !setNonBlocking(sock)) {
+			winfx::DebugOut(L"Rejecting NMEA TCP client\n");
+			closesocket(sock);
+			continue;
+		}
+
+		BOOL no_delay = TRUE;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+		slot->sock = sock;
+		slot->pending_length = 0;
+		winfx::DebugOut(L"NMEA TCP client connected\n");
+	}
+}
+
+bool TcpNmeaOutput::flush(Client& client) {
+	while (client.pending_length > 0) {
+		int sent = send(client.sock, client.pending, client.pending_length, 0);
+		if (sent == SOCKET_ERROR) {
+			int err = WSAGetLastError();
+			if (err == WSAEWOULDBLOCK)
+				return false;
+			winfx::DebugOut(L"Error %d in NMEA TCP send. Dropping client.\n", err);
+			dropClient(client);
+			return false;
+		}
+		client.pending_length -= sent;
+		memmove(client.pending, client.pending + sent, client.pending_length);
+	}
+	return true;
+}
+
+void TcpNmeaOutput::write(const char* data, int length) {
+	for (Client& client : clients_) {
+		if (client.sock == INVALID_SOCKET)
+			continue;
+		if (!flush(client))
+			continue;
+		memcpy(client.pending, data, length);
+		client.pending_length = length;
+		flush(client);
+	}
+}
+
+void TcpNmeaOutput::dropClient(Client& client) {
+	closesocket(client.sock);
+	client.sock = INVALID_SOCKET;
+	client.pending_length = 0;
+}
+
+void TcpNmeaOutput::close() {
+	for (Client& client : clients_) {
+		if (client.sock != INVALID_SOCKET)
+			dropClient(client);
+	}
+	if (listen_sock_ != INVALID_SOCKET) {
+		closesocket(listen_sock_);
+		listen_sock_ = INVALID_SOCKET;
+	}
+	open_ = false;
+}
+
+HRESULT SerialNmeaOutput::init(LPCWSTR portName) {
+	port_ = CreateFile(portName, GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+		FILE_FLAG_OVERLAPPED, NULL);
+	if (port_ == INVALID_HANDLE_VALUE) {
+		winfx::DebugOut(L"Error %d opening NMEA serial port %s\n", GetLastError(), portName);
+		return E_FAIL;
+	}
+
+	DCB dcb = { sizeof(dcb) };
+	if (GetCommState(port_, &dcb)) {
+		dcb.BaudRate = CBR_4800;
+		dcb.ByteSize = 8;
+		dcb.Parity = NOPARITY;
+		dcb.StopBits = ONESTOPBIT;
+		SetCommState(port_, &dcb);
+	}
+
+	overlapped_.hEvent = CreateEvent(NULL, TRUE, TRUE, NULL);
+	if (overlapped_.hEvent == NULL) {
+		winfx::DebugOut(L"Error %d creating NMEA serial port event\n", GetLastError());
+		close();
+		return E_FAIL;
+	}
+	open_ = true;
+	return S_OK;
+}
+
+void SerialNmeaOutput::write(const char* data, int length) {
+	if (write_pending_) {
+		if (!HasOverlappedIoCompleted(&overlapped_))
+			return;
+		write_pending_ = false;
+	}
+
+	memcpy(buffer_, data, length);
+	ResetEvent(overlapped_.hEvent);
+	if (!WriteFile(port_, buffer_, length, NULL, &overlapped_)) {
+		DWORD err = GetLastError();
+		if (err != ERROR_IO_PENDING) {
+			winfx::DebugOut(L"Error %d writing NMEA serial port\n", err);
+			return;
+		}
+	}
+	write_pending_ = true;
+}
+
+void SerialNmeaOutput::close() {
+	if (port_ != INVALID_HANDLE_VALUE) {
+		if (write_pending_) {
+			CancelIo(port_);
+			WaitForSingleObject(overlapped_.hEvent, INFINITE);
+			write_pending_ = false;
+		}
+		CloseHandle(port_);
+		port_ = INVALID_HANDLE_VALUE;
+	}
+	if (overlapped_.hEvent) {
+		CloseHandle(overlapped_.hEvent);
+		overlapped_.hEvent = NULL;
+	}
+	open_ = false;
+}
+
+HRESULT NmeaBroadcaster::init(LPCWSTR serialPort, const char* udpDestination, u_short udpPort) {
+	HRESULT hr_udp = udp_.init(udpDestination, udpPort);
+	HRESULT hr_tcp = tcp_.init();
+	HRESULT hr_serial = S_FALSE;
+	if (serialPort != nullptr && *serialPort != L'\0')
+		hr_serial = serial_.init(serialPort);
+
+	if (FAILED(hr_udp) && FAILED(hr_tcp) && hr_serial != S_OK)
+		return E_FAIL;
+	return S_OK;
+}
+
+void NmeaBroadcaster::close() {
+	for (NmeaOutput* output : outputs_)
+		output->close();
+}
+
+double NmeaBroadcaster::sinkRate() const {
+	double rate = kNmeaUdpReportsPerSecond;
+	if (kNmeaTcpReportsPerSecond > rate)
+		rate = kNmeaTcpReportsPerSecond;
+	if (kNmeaSerialReportsPerSecond > rate)
+		rate = kNmeaSerialReportsPerSecond;
+	return rate;
+}
+
+void NmeaBroadcaster::onStateChange(SimulatorInterfaceState state) {
+	in_flight_ = (state == SimInterfaceInFlight);
+}
+
+void NmeaBroadcaster::onSample(const SimSample& sample) {
+	tcp_.poll();
+	if (!in_flight_)
+		return;
+
+	const SimData* const data = &sample.data;
+
+	// Build the report at most once per sample, and only if some output is
+	// due for one.
+	int length = 0;
+	for (NmeaOutput* output : outputs_) {
+		if (!output->ready())
+			continue;
+		if (length == 0) {
+			length = buildReport(data);
+			if (length == 0)
+				return;
+		}
+		output->write(report_, length);
+	}
+}
+
+int NmeaBroadcaster::buildReport(const SimData* data) {
+	SYSTEMTIME now;
+	GetSystemTime(&now);
+
+	const double knots = data->gps_groundspeed * kKnotsPerMeterPerSecond;
+	const double kph = data->gps_groundspeed * kKphPerMeterPerSecond;
+	int length = 0;
+
+	auto append = [&]() {
+		int n = sentence_.finish();
+		memcpy(report_ + length, sentence_.data(), n);
+		length += n;
+	};
+
+	sentence_.begin(kRmcHeader);
+	sentence_.addTime(now.wHour, now.wMinute, now.wSecond, now.wMilliseconds);
+	sentence_.addChar('A');
+	sentence_.addLatitude(data->gps_lat);
+	sentence_.addLongitude(data->gps_lon);
+	sentence_.addFixed(knots, 1);
+	sentence_.addFixed(data->gps_track, 1);
+	sentence_.addDate(now.wDay, now.wMonth, now.wYear);
+	sentence_.addEmpty();
+	sentence_.addEmpty();
+	sentence_.addChar('A');
+	append();
+
+	sentence_.begin(kGgaHeader);
+	sentence_.addTime(now.wHour, now.wMinute, now.wSecond, now.wMilliseconds);
+	sentence_.addLatitude(data->gps_lat);
+	sentence_.addLongitude(data->gps_lon);
+	sentence_.addInt(1);
+	sentence_.addInt(12, 2);
+	sentence_.addFixed(0.9, 1);
+	sentence_.addFixed(data->gps_alt, 1);
+	sentence_.addChar('M');
+	sentence_.addFixed(0.0, 1);
+	sentence_.addChar('M');
+	sentence_.addEmpty();
+	sentence_.addEmpty();
+	append();
+
+	sentence_.begin(kVtgHeader);
+	sentence_.addFixed(data->gps_track, 1);
+	sentence_.addChar('T');
+	sentence_.addEmpty();
+	sentence_.addChar('M');
+	sentence_.addFixed(knots, 1);
+	sentence_.addChar('N');
+	sentence_.addFixed(kph, 1);
+	sentence_.addChar('K');
+	sentence_.addChar('A');
+	append();
+
+	sentence_.begin(kHdtHeader);
+	sentence_.addFixed(data->heading, 1);
+	sentence_.addChar('T');
+	append();
+
+	// SimConnect reports pitch as positive nose down; NMEA wants nose up.
+	sentence_.begin(kXdrHeader);
+	sentence_.addChar('A');
+	sentence_.addFixed(-data->pitch, 1);
+	sentence_.addChar('D');
+	sentence_.addString("PTCH");
+	sentence_.addChar('A');
+	sentence_.addFixed(data->bank, 1);
+	sentence_.addChar('D');
+	sentence_.addString("ROLL");
+	append();
+
+	return length;
+}
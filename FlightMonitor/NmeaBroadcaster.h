@@ -0,0 +1,152 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "framework.h"
+#include "winfx.h"
+#include "SimData.h"
+#include "SimInterface.h"
+#include "OutputSink.h"
+#include "NmeaSentence.h"
+#include "RateLimiter.h"
+
+// NMEA 0183 output for EFBs and moving maps that do not speak the ForeFlight
+// protocol. The same sentences are served over UDP broadcast, to any number
+// of TCP clients, and to a (virtual) serial port, each at its own rate.
+//
+// Sentences: $GPRMC, $GPGGA, $GPVTG, $HCHDT (true heading) and $IIXDR with
+// pitch and roll transducer readings.
+
+#define NMEA_UDP_PORT     10110
+#define NMEA_TCP_PORT     10110
+
+constexpr double kNmeaUdpReportsPerSecond = 5;
+constexpr double kNmeaTcpReportsPerSecond = 5;
+constexpr double kNmeaSerialReportsPerSecond = 1;
+constexpr int kNmeaMaxTcpClients = 8;
+constexpr int kNmeaSentencesPerReport = 5;
+constexpr int kNmeaMaxReportSize = kNmeaMaxSentence * kNmeaSentencesPerReport;
+
+// One destination for NMEA reports. Every output owns its own rate limiter
+// and must never block the caller; an output that cannot take a report right
+// now drops it.
+class NmeaOutput {
+public:
+	explicit NmeaOutput(double reportsPerSecond) : limiter_(reportsPerSecond) {}
+	virtual ~NmeaOutput() {}
+
+	bool isOpen() const { return open_; }
+	bool ready() { return open_ && limiter_.ready(); }
+
+	virtual void poll() {}
+	virtual void write(const char* data, int length) = 0;
+	virtual void close() = 0;
+
+protected:
+	RateLimiter limiter_;
+	bool open_ = false;
+};
+
+class UdpNmeaOutput : public NmeaOutput {
+public:
+	UdpNmeaOutput() : NmeaOutput(kNmeaUdpReportsPerSecond) {}
+	~UdpNmeaOutput() { close(); }
+
+	// Broadcasts unless given an IPv4 destination address.
+	HRESULT init(const char* destination = nullptr, u_short port = NMEA_UDP_PORT);
+	void write(const char* data, int length) override;
+	void close() override;
+
+private:
+	SOCKET sock_ = INVALID_SOCKET;
+	sockaddr_in send_addr_ = { 0 };
+};
+
+class TcpNmeaOutput : public NmeaOutput {
+public:
+	TcpNmeaOutput() : NmeaOutput(kNmeaTcpReportsPerSecond) {}
+	~TcpNmeaOutput() { close(); }
+
+	HRESULT init();
+	void poll() override;
+	void write(const char* data, int length) override;
+	void close() override;
+
+private:
+	// Whatever part of the last report the kernel would not take. A client
+	// with pending bytes skips new reports until it has drained, so a slow
+	// reader sees gaps rather than torn sentences.
+	struct Client {
+		SOCKET sock = INVALID_SOCKET;
+		char pending[kNmeaMaxReportSize];
+		int pending_length = 0;
+	};
+
+	bool flush(Client& client);
+	void dropClient(Client& client);
+
+	SOCKET listen_sock_ = INVALID_SOCKET;
+	Client clients_[kNmeaMaxTcpClients];
+};
+
+class SerialNmeaOutput : public NmeaOutput {
+public:
+	SerialNmeaOutput() : NmeaOutput(kNmeaSerialReportsPerSecond) {}
+	~SerialNmeaOutput() { close(); }
+
+	// portName is a device such as L"\\\\.\\COM5", typically one end of a
+	// virtual null-modem pair with the EFB attached to the other end.
+	HRESULT init(LPCWSTR portName);
+	void write(const char* data, int length) override;
+	void close() override;
+
+private:
+	HANDLE port_ = INVALID_HANDLE_VALUE;
+	OVERLAPPED overlapped_ = { 0 };
+	bool write_pending_ = false;
+	char buffer_[kNmeaMaxReportSize];
+};
+
+class NmeaBroadcaster : public OutputSink {
+public:
+	NmeaBroadcaster() {}
+
+	// Opens the UDP and TCP outputs, and the serial output when serialPort is
+	// non-empty. The UDP reports are broadcast unless given a destination
+	// address. Fails only if no output could be opened.
+	HRESULT init(LPCWSTR serialPort = nullptr, const char* udpDestination = nullptr,
+		u_short udpPort = NMEA_UDP_PORT);
+	void close();
+
+	// The scheduler runs this sink at the fastest output rate; each output's
+	// limiter then thins that down to its own rate.
+	const char* sinkName() const override { return "NMEA"; }
+	double sinkRate() const override;
+	void onSample(const SimSample& sample) override;
+	void onStateChange(SimulatorInterfaceState state) override;
+
+private:
+	int buildReport(const SimData* data);
+
+	UdpNmeaOutput udp_;
+	TcpNmeaOutput tcp_;
+	SerialNmeaOutput serial_;
+	NmeaOutput* const outputs_[3] = { &udp_, &tcp_, &serial_ };
+
+	bool in_flight_ = false;
+	NmeaSentence sentence_;
+	char report_[kNmeaMaxReportSize];
+};
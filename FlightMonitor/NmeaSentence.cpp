@@ -0,0 +1,154 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include "NmeaSentence.h"
+
+static const uint64_t kPow10[] = {
+	1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull
+};
+
+static const char kHexDigits[] = "0123456789ABCDEF";
+
+void NmeaSentence::begin(const NmeaHeader& header) {
+	length_ = 0;
+	overflow_ = false;
+	for (int i = 0; i < header.length; i++)
+		buffer_[length_++] = header.text[i];
+	checksum_ = header.checksum;
+}
+
+void NmeaSentence::put(char c) {
+	// Leave room for the "*hh\r\n" trailer.
+	if (length_ >= kNmeaMaxSentence - 5) {
+		overflow_ = true;
+		return;
+	}
+	buffer_[length_++] = c;
+	checksum_ ^= static_cast<uint8_t>(c);
+}
+
+void NmeaSentence::putDigits(uint64_t value, int minDigits) {
+	char digits[20];
+	int n = 0;
+	do {
+		digits[n++] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value != 0 && n < 20);
+	while (n < minDigits && n < 20)
+		digits[n++] = '0';
+	while (n > 0)
+		put(digits[--n]);
+}
+
+void NmeaSentence::addEmpty() {
+	separator();
+}
+
+void NmeaSentence::addChar(char c) {
+	separator();
+	put(c);
+}
+
+void NmeaSentence::addString(const char* str) {
+	separator();
+	while (*str)
+		put(*str++);
+}
+
+void NmeaSentence::addFixed(double value, int decimals, int minIntDigits) {
+	separator();
+	if (!isfinite(value))
+		return;
+	if (decimals < 0) decimals = 0;
+	if (decimals > 7) decimals = 7;
+
+	const uint64_t scale = kPow10[decimals];
+	const uint64_t scaled = static_cast<uint64_t>(llround(fabs(value) * scale));
+	if (value < 0 && scaled != 0)
+		put('-');
+	putDigits(scaled / scale, minIntDigits);
+	if (decimals > 0) {
+		put('.');
+		putDigits(scaled % scale, decimals);
+	}
+}
+
+void NmeaSentence::addInt(int value, int minDigits) {
+	separator();
+	// Widened first, since INT_MIN has no int magnitude.
+	int64_t wide = value;
+	if (wide < 0) {
+		put('-');
+		wide = -wide;
+	}
+	putDigits(static_cast<uint64_t>(wide), minDigits);
+}
+
+void NmeaSentence::addAngle(double value, int degreeDigits, char positive, char negative) {
+	// NMEA positions are dddmm.mmmm. Round once in units of 1/10000 minute
+	// so that 59.99995 minutes carries into the degrees instead of printing
+	// as "60.0000".
+	constexpr uint64_t kMinuteScale = 10000;
+	const uint64_t total = static_cast<uint64_t>(llround(fabs(value) * 60.0 * kMinuteScale));
+	const uint64_t degrees = total / (60 * kMinuteScale);
+	const uint64_t minutes = total % (60 * kMinuteScale);
+
+	separator();
+	putDigits(degrees, degreeDigits);
+	putDigits(minutes / kMinuteScale, 2);
+	put('.');
+	putDigits(minutes % kMinuteScale, 4);
+	separator();
+	put(value < 0 ? negative : positive);
+}
+
+void NmeaSentence::addLatitude(double lat) {
+	addAngle(lat, 2, 'N', 'S');
+}
+
+void NmeaSentence::addLongitude(double lon) {
+	addAngle(lon, 3, 'E', 'W');
+}
+
+void NmeaSentence::addTime(int hour, int minute, int second, int millis) {
+	separator();
+	putDigits(hour, 2);
+	putDigits(minute, 2);
+	putDigits(second, 2);
+	put('.');
+	putDigits(millis / 10, 2);
+}
+
+void NmeaSentence::addDate(int day, int month, int year) {
+	separator();
+	putDigits(day, 2);
+	putDigits(month, 2);
+	putDigits(year % 100, 2);
+}
+
+int NmeaSentence::finish() {
+	if (overflow_) {
+		length_ = 0;
+		return 0;
+	}
+	buffer_[length_++] = '*';
+	buffer_[length_++] = kHexDigits[checksum_ >> 4];
+	buffer_[length_++] = kHexDigits[checksum_ & 0x0f];
+	buffer_[length_++] = '\r';
+	buffer_[length_++] = '\n';
+	buffer_[length_] = '\0';
+	return length_;
+}
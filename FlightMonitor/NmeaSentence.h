@@ -0,0 +1,78 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+
+// NMEA 0183 limits a sentence to 82 characters including the leading '$'
+// and the trailing CR/LF.
+constexpr int kNmeaMaxSentence = 82;
+
+// The fixed start of a sentence ("$GPRMC") along with its checksum. The
+// checksum covers everything between the '$' and the '*', so the part
+// contributed by the header is computed once at compile time and each
+// sentence only has to fold in the bytes of its fields.
+struct NmeaHeader {
+	const char* text;
+	int length;
+	uint8_t checksum;
+};
+
+constexpr NmeaHeader makeNmeaHeader(const char* text) {
+	int length = 0;
+	uint8_t checksum = 0;
+	while (text[length] != '\0') {
+		if (length > 0)
+			checksum ^= static_cast<uint8_t>(text[length]);
+		length++;
+	}
+	return NmeaHeader{ text, length, checksum };
+}
+
+// Builds one sentence into a fixed buffer. No heap allocations and no
+// printf: numbers are formatted as scaled integers. Fields that would
+// overflow the sentence are dropped and the sentence is marked invalid.
+class NmeaSentence {
+public:
+	void begin(const NmeaHeader& header);
+
+	void addEmpty();
+	void addChar(char c);
+	void addString(const char* str);
+	void addFixed(double value, int decimals, int minIntDigits = 1);
+	void addInt(int value, int minDigits = 1);
+	void addLatitude(double lat);
+	void addLongitude(double lon);
+	void addTime(int hour, int minute, int second, int millis);
+	void addDate(int day, int month, int year);
+
+	// Append "*hh\r\n". Returns the sentence length, or 0 if it overflowed.
+	int finish();
+
+	const char* data() const { return buffer_; }
+	int length() const { return length_; }
+
+private:
+	void put(char c);
+	void putDigits(uint64_t value, int minDigits);
+	void addAngle(double value, int degreeDigits, char positive, char negative);
+	void separator() { put(','); }
+
+	char buffer_[kNmeaMaxSentence + 1] = { 0 };
+	int length_ = 0;
+	uint8_t checksum_ = 0;
+	bool overflow_ = false;
+};
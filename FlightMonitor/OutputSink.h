@@ -0,0 +1,52 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "SimData.h"
+#include "SimInterface.h"
+
+// A consumer of the sample stream. Sinks are registered with a SinkScheduler
+// which calls them on its own worker thread at the rate they ask for, so a
+// sink may block briefly without holding up SimConnect dispatch or other
+// sinks' deadlines any more than its own work takes.
+class OutputSink {
+public:
+	virtual ~OutputSink() {}
+
+	virtual const char* sinkName() const = 0;
+
+	// Samples per second this sink wants. Zero means every input sample.
+	// Read on every scheduling pass, so a sink may change it at runtime.
+	virtual double sinkRate() const = 0;
+
+	// SimField bits this sink consumes. A sample in which none of these
+	// fields changed since the last delivery is held back (up to
+	// kSinkIdleRefreshMs) instead of being delivered again.
+	virtual unsigned sinkFields() const { return kSimFieldAll; }
+
+	// When the sink rate is above the input rate, interpolate between the two
+	// most recent input samples instead of only delivering fresh ones. This
+	// adds one input interval of latency.
+	virtual bool sinkInterpolates() const { return false; }
+
+	virtual void onSample(const SimSample& sample) = 0;
+	virtual void onStateChange(SimulatorInterfaceState state) {}
+
+	// Called after each scheduling pass that delivered a sample to this
+	// sink, once every sink due in it has run. Sinks that queue their
+	// output submit it here, so what a pass produces goes out together.
+	virtual void onFlush() {}
+};
@@ -0,0 +1,57 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+
+// Lets an event through at most once per interval. The next deadline is
+// advanced from the previous one rather than from "now" so that a steady
+// input stream produces a steady output cadence without drifting.
+class RateLimiter {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	RateLimiter() = default;
+	explicit RateLimiter(double ratePerSecond) { setRate(ratePerSecond); }
+
+	void setRate(double ratePerSecond) {
+		interval_ = ratePerSecond > 0 ?
+			std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / ratePerSecond)) :
+			Clock::duration::zero();
+	}
+
+	bool ready() { return ready(Clock::now()); }
+
+	bool ready(Clock::time_point now) {
+		// Accept events slightly early so that a caller already running at
+		// this rate (such as a sink driven by the SinkScheduler) is not
+		// skipped every other time because of timer jitter.
+		if (now + interval_ / 8 < next_)
+			return false;
+		next_ += interval_;
+		// If we fell more than an interval behind (paused sim, slow consumer)
+		// restart the cadence instead of bursting to catch up.
+		if (next_ <= now)
+			next_ = now + interval_;
+		return true;
+	}
+
+	void reset() { next_ = Clock::time_point(); }
+
+private:
+	Clock::duration interval_ = Clock::duration::zero();
+	Clock::time_point next_;
+};
@@ -0,0 +1,79 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "SimData.h"
+
+// The last Capacity samples, written by one thread and read by another
+// without locks. Unlike a queue, reading does not consume: the reader
+// copies any range still held, and the writer never waits for it, so a
+// slow reader can only lose the oldest samples, never delay the writer.
+//
+// Samples are numbered from zero as they are written. Once n have been
+// written the writer may already be storing sample n over sample
+// n - Capacity, so only the Capacity - 1 before it are safe to read. A copy
+// is checked against the write position afterwards, and whatever the
+// writer may have overwritten in the meantime is dropped from the front of
+// the result.
+template <size_t Capacity>
+class SampleRing {
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	SampleRing() : samples_(Capacity) {}
+
+	// Writer thread only.
+	void push(const SimSample& sample) {
+		const uint64_t next = written_.load(std::memory_order_relaxed);
+		samples_[next & (Capacity - 1)] = sample;
+		written_.store(next + 1, std::memory_order_release);
+	}
+
+	// Number of samples ever written; the newest is written() - 1.
+	uint64_t written() const { return written_.load(std::memory_order_acquire); }
+
+	// Copies samples [first, end) that are still held into out and returns
+	// the number of the first one copied.
+	uint64_t copy(uint64_t first, uint64_t end, std::vector<SimSample>* out) const {
+		out->clear();
+		const uint64_t available = written();
+		if (end > available)
+			end = available;
+		if (available >= Capacity && first <= available - Capacity)
+			first = available - Capacity + 1;
+		for (uint64_t i = first; i < end; i++)
+			out->push_back(samples_[i & (Capacity - 1)]);
+
+		// Anything the writer reached while we copied may be torn.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const uint64_t after = written_.load(std::memory_order_relaxed);
+		if (after >= Capacity && first <= after - Capacity) {
+			const uint64_t lost = after - Capacity + 1 - first;
+			out->erase(out->begin(), out->begin() + (size_t)std::min<uint64_t>(lost, out->size()));
+			first += lost;
+		}
+		return first;
+	}
+
+private:
+	std::vector<SimSample> samples_;
+	std::atomic<uint64_t> written_{ 0 };
+};
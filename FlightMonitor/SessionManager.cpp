@@ -0,0 +1,247 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+
+#include "framework.h"
+#include "winfx.h"
+#include "SessionManager.h"
+#include "AppPaths.h"
+#include "ConfigFile.h"
+#include "MappedFile.h"
+#include "SimConnectBackend.h"
+#include "XPlaneBackend.h"
+
+static std::wstring widen(const std::string& str) {
+	std::wstring result;
+	int length = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int)str.size(), NULL, 0);
+	if (length > 0) {
+		result.resize(length);
+		MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int)str.size(), &result[0], length);
+	}
+	return result;
+}
+
+std::vector<SessionConfig> parseSessionConfig(const char* text, size_t size) {
+	std::vector<SessionConfig> configs;
+	for (const std::vector<std::string>& fields : splitConfigLines(text, size)) {
+		if (fields[0].empty())
+			continue;
+
+		SessionConfig config;
+		config.name = widen(fields[0]);
+		config.sim_name = fields[0];
+		if (fields.size() > 1 && fields[1].compare(0, 6, "xplane") == 0) {
+			config.xplane = true;
+			if (fields[1].size() > 7 && fields[1][6] == ':')
+				config.xplane_address = fields[1].substr(7);
+		} else if (fields.size() > 1 && !fields[1].empty()) {
+			config.config_index = strtoul(fields[1].c_str(), nullptr, 10);
+		}
+		if (fields.size() > 2 && !fields[2].empty()) {
+			const size_t colon = fields[2].find(':');
+			config.destination = fields[2].substr(0, colon);
+			if (colon != std::string::npos)
+				config.port = (u_short)atoi(fields[2].c_str() + colon + 1);
+		}
+		if (fields.size() > 3 && !fields[3].empty())
+			config.sim_name = fields[3];
+		if (fields.size() > 4 && !fields[4].empty() &&
+			!parseConfigRange(fields[4], &config.position_min_rate, &config.position_max_rate))
+			winfx::DebugOut(L"Bad position report rates for session %s\n", config.name.c_str());
+		if (fields.size() > 5 && !fields[5].empty() &&
+			!parseConfigRange(fields[5], &config.attitude_min_rate, &config.attitude_max_rate))
+			winfx::DebugOut(L"Bad attitude report rates for session %s\n", config.name.c_str());
+		configs.push_back(config);
+	}
+	return configs;
+}
+
+HRESULT loadSessionConfig(LPCWSTR path, std::vector<SessionConfig>* configs) {
+	MappedFile file;
+	HRESULT hr = file.open(path);
+	if (FAILED(hr))
+		return hr;
+	*configs = parseSessionConfig(reinterpret_cast<const char*>(file.data()), file.size());
+	winfx::DebugOut(L"%zu simulator sessions from %s\n", configs->size(), path);
+	return S_OK;
+}
+
+static std::unique_ptr<SimBackend> createBackend(const SessionConfig& config) {
+	if (config.xplane)
+		return std::unique_ptr<SimBackend>(new XPlaneBackend(config.xplane_address.c_str()));
+	return std::unique_ptr<SimBackend>(new SimConnectBackend(config.config_index));
+}
+
+SimSession::SimSession(const SessionConfig& config, std::unique_ptr<SimBackend> backend) :
+	config_(config),
+	event_(CreateEvent(NULL, FALSE, FALSE, NULL)),
+	sim_(backend ? std::move(backend) : createBackend(config)) {
+	listener_.subscribeTo(sim_.events());
+
+	broadcaster_.init(config_.destination.empty() ? nullptr : config_.destination.c_str(),
+		config_.port, config_.sim_name.c_str());
+	broadcaster_.setRateBounds(config_.position_min_rate, config_.position_max_rate,
+		config_.attitude_min_rate, config_.attitude_max_rate);
+	broadcaster_.registerSinks(scheduler_);
+	scheduler_.addSink(&phases_);
+	if (config_.record) {
+		// Flights\<name>, so each seat's recordings stay apart.
+		const std::wstring flights = getAppDataDirectory(L"Flights");
+		if (!flights.empty()) {
+			recorder_.setDirectory(getAppDataDirectory((L"Flights\\" + config_.name).c_str()));
+			scheduler_.addSink(&recorder_);
+		}
+	}
+}
+
+SimSession::~SimSession() {
+	stop();
+	CloseHandle(event_);
+}
+
+SessionMetrics SimSession::metrics() const {
+	SessionMetrics metrics;
+	metrics.state = state_;
+	metrics.samples = samples_;
+	metrics.dispatches = dispatches_;
+	metrics.connects = connects_;
+	metrics.disconnects = disconnects_;
+	if (metrics.dispatches > 0)
+		metrics.dispatch_us_mean = dispatch_ns_ / 1000.0 / metrics.dispatches;
+	metrics.dispatch_us_max = dispatch_ns_max_ / 1000.0;
+	return metrics;
+}
+
+void SimSession::onEvent(const SimDataEvent&) {
+	samples_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SimSession::onEvent(const SimStateEvent& event) {
+	state_ = event.state;
+}
+
+void SimSession::onEvent(const SimDisconnectEvent&) {
+	disconnects_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SimSession::start() {
+	scheduler_.start();
+}
+
+bool SimSession::connect() {
+	if (FAILED(sim_.connectSim(NULL, 0, event_)))
+		return false;
+	connects_.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+void SimSession::dispatch() {
+	const auto start = std::chrono::steady_clock::now();
+	sim_.dispatch();
+	const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start).count();
+
+	dispatches_.fetch_add(1, std::memory_order_relaxed);
+	dispatch_ns_.fetch_add(ns, std::memory_order_relaxed);
+	if (ns > dispatch_ns_max_.load(std::memory_order_relaxed))
+		dispatch_ns_max_.store(ns, std::memory_order_relaxed);  // only the dispatch thread writes it
+}
+
+void SimSession::stop() {
+	if (sim_.isConnected())
+		sim_.close();
+	scheduler_.stop();
+	recorder_.close();
+}
+
+SimSession* SessionManager::add(const SessionConfig& config, std::unique_ptr<SimBackend> backend) {
+	sessions_.emplace_back(new SimSession(config, std::move(backend)));
+	return sessions_.back().get();
+}
+
+void SessionManager::start(size_t sessionsPerThread) {
+	if (!threads_.empty() || sessions_.empty())
+		return;
+	sessionsPerThread = std::max<size_t>(1, std::min(sessionsPerThread, kSessionsPerThread));
+
+	stop_event_ = CreateEvent(NULL, TRUE, FALSE, NULL);
+	for (auto& session : sessions_)
+		session->start();
+	for (size_t first = 0; first < sessions_.size(); first += sessionsPerThread) {
+		const size_t count = std::min(sessionsPerThread, sessions_.size() - first);
+		threads_.emplace_back(&SessionManager::run, this, first, count);
+	}
+	winfx::DebugOut(L"%zu simulator sessions on %zu threads\n", sessions_.size(), threads_.size());
+}
+
+void SessionManager::stop() {
+	if (threads_.empty())
+		return;
+	SetEvent(stop_event_);
+	for (auto& thread : threads_)
+		thread.join();
+	threads_.clear();
+	CloseHandle(stop_event_);
+	stop_event_ = NULL;
+
+	for (auto& session : sessions_)
+		session->stop();
+}
+
+void SessionManager::run(size_t first, size_t count) {
+	HANDLE handles[kSessionsPerThread + 1];
+	handles[0] = stop_event_;
+	std::vector<ULONGLONG> retryAt(count, 0);
+	for (size_t i = 0; i < count; i++)
+		handles[i + 1] = sessions_[first + i]->event_;
+
+	for (;;) {
+		// Reconnect whatever is due, and sleep no longer than the next retry.
+		const ULONGLONG now = GetTickCount64();
+		DWORD timeout = INFINITE;
+		for (size_t i = 0; i < count; i++) {
+			SimSession* session = sessions_[first + i].get();
+			if (session->sim_.isConnected())
+				continue;
+			if (retryAt[i] <= now && !session->connect())
+				retryAt[i] = now + kSessionRetryIntervalMs;
+			if (!session->sim_.isConnected())
+				timeout = std::min(timeout, (DWORD)(retryAt[i] - now));
+		}
+
+		const DWORD result = WaitForMultipleObjects((DWORD)count + 1, handles, FALSE, timeout);
+		if (result == WAIT_OBJECT_0 || result == WAIT_FAILED)
+			break;
+		if (result == WAIT_TIMEOUT)
+			continue;
+
+		// The wait reports only the lowest signaled handle. Dispatch it, then
+		// sweep the rest of the group starting just after it so a busy
+		// session cannot starve the ones behind it.
+		const size_t ready = result - WAIT_OBJECT_0 - 1;
+		for (size_t n = 0; n < count; n++) {
+			const size_t i = (ready + n) % count;
+			SimSession* session = sessions_[first + i].get();
+			if (n > 0 && WaitForSingleObject(handles[i + 1], 0) != WAIT_OBJECT_0)
+				continue;
+			if (session->sim_.isConnected())
+				session->dispatch();
+			if (!session->sim_.isConnected())
+				retryAt[i] = GetTickCount64() + kSessionRetryIntervalMs;
+		}
+	}
+}
@@ -0,0 +1,162 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framework.h"
+#include "winfx.h"
+#include "FlightPhaseDetector.h"
+#include "FlightRecorder.h"
+#include "ForeFlightBroadcaster.h"
+#include "SimBackend.h"
+#include "SimInterface.h"
+#include "SinkScheduler.h"
+
+// The sessions file in the app data directory. One simulator per line:
+//
+//   name, SimConnect.cfg index, ForeFlight destination[:port], aircraft name,
+//   position reports per second, attitude reports per second
+//
+// e.g. "Seat 2, 1, 192.168.1.52, SEAT2". Only the name is required; by
+// default a session talks to the local simulator, broadcasts its reports
+// and names itself after the session. In place of the index, "xplane:<address>"
+// subscribes to X-Plane at that address and plain "xplane" listens for its
+// DATA output. Report rates are "<min>-<max>", between which congestion
+// moves them, or one number for a fixed rate; by default 0.5-1 and 1-5.
+// Lines starting with # are comments.
+constexpr wchar_t kSessionsFileName[] = L"sessions.txt";
+
+// Sessions waited on by one dispatch thread. WaitForMultipleObjects takes
+// at most MAXIMUM_WAIT_OBJECTS handles, one of which is the stop event.
+constexpr size_t kSessionsPerThread = 16;
+static_assert(kSessionsPerThread < MAXIMUM_WAIT_OBJECTS, "Too many sessions per thread");
+
+constexpr DWORD kSessionRetryIntervalMs = 5000;
+
+struct SessionConfig {
+	std::wstring name;
+	DWORD config_index = SIMCONNECT_OPEN_CONFIGINDEX_LOCAL;
+	bool xplane = false;
+	std::string xplane_address; // empty listens for DATA output
+	std::string destination;    // IPv4 address; empty broadcasts
+	u_short port = FF_GPS_PORT;
+	std::string sim_name;       // in ForeFlight reports
+	double position_min_rate = kPositionMinReportsPerSecond;
+	double position_max_rate = kPositionReportsPerSecond;
+	double attitude_min_rate = kAttitudeMinReportsPerSecond;
+	double attitude_max_rate = kAttitueReportsPerSecond;
+	bool record = true;
+};
+
+std::vector<SessionConfig> parseSessionConfig(const char* text, size_t size);
+HRESULT loadSessionConfig(LPCWSTR path, std::vector<SessionConfig>* configs);
+
+// Counters for one session, safe to read from any thread.
+struct SessionMetrics {
+	SimulatorInterfaceState state = SimInterfaceDisconnected;
+	uint64_t samples = 0;
+	uint64_t dispatches = 0;
+	uint64_t connects = 0;          // successful ones
+	uint64_t disconnects = 0;
+	double dispatch_us_mean = 0;    // time spent in one dispatch
+	double dispatch_us_max = 0;
+};
+
+// One simulator and everything fed from it: its own scheduler, ForeFlight
+// reports to its own destination, flight phases and a recording in its own
+// folder.
+class SimSession {
+public:
+	SimSession(const SessionConfig& config, std::unique_ptr<SimBackend> backend);
+	~SimSession();
+
+	const SessionConfig& config() const { return config_; }
+	SessionMetrics metrics() const;
+
+	// Extra outputs; add them before the manager starts.
+	SinkScheduler& scheduler() { return scheduler_; }
+
+	// The session's counters; called through pipeline_.
+	void onEvent(const SimDataEvent& event);
+	void onEvent(const SimStateEvent& event);
+	void onEvent(const SimDisconnectEvent& event);
+
+private:
+	friend class SessionManager;
+
+	// start() and stop() are called on the thread that starts and stops the
+	// manager, while no dispatch thread is running; connect() and
+	// dispatch() on the session's dispatch thread.
+	void start();
+	bool connect();
+	void dispatch();
+	void stop();
+
+	SessionConfig config_;
+	HANDLE event_;
+	SimulatorInterface sim_;
+	SinkScheduler scheduler_;
+	ForeFlightBroadcaster broadcaster_;
+	FlightPhaseDetector phases_;
+	FlightRecorder recorder_{ &phases_ };
+
+	// Who hears the simulator is fixed, so it is one subscription and
+	// direct calls rather than a virtual call per listener.
+	using Pipeline = EventPipeline<SinkScheduler, SimSession>;
+	Pipeline pipeline_{ scheduler_, *this };
+	PipelineListener<Pipeline, SimDataEvent, SimStateEvent, SimDisconnectEvent> listener_{ pipeline_ };
+
+	std::atomic<SimulatorInterfaceState> state_{ SimInterfaceDisconnected };
+	std::atomic<uint64_t> samples_{ 0 };
+	std::atomic<uint64_t> dispatches_{ 0 };
+	std::atomic<uint64_t> connects_{ 0 };
+	std::atomic<uint64_t> disconnects_{ 0 };
+	std::atomic<uint64_t> dispatch_ns_{ 0 };
+	std::atomic<uint64_t> dispatch_ns_max_{ 0 };
+};
+
+// Runs many simulator sessions from one process. Rather than a message loop
+// per simulator, each backend sets an event when it has data and a few
+// threads wait on up to kSessionsPerThread events each, dispatching
+// whichever session is ready. Disconnected sessions are retried from the
+// same threads.
+class SessionManager {
+public:
+	~SessionManager() { stop(); }
+
+	// backend defaults to the config's X-Plane or SimConnect connection.
+	SimSession* add(const SessionConfig& config, std::unique_ptr<SimBackend> backend = nullptr);
+
+	// Starts one dispatch thread per sessionsPerThread sessions.
+	void start(size_t sessionsPerThread = kSessionsPerThread);
+	void stop();
+
+	size_t size() const { return sessions_.size(); }
+	SimSession& session(size_t index) { return *sessions_[index]; }
+	size_t threadCount() const { return threads_.size(); }
+
+private:
+	void run(size_t first, size_t count);
+
+	std::vector<std::unique_ptr<SimSession>> sessions_;
+	std::vector<std::thread> threads_;
+	HANDLE stop_event_ = NULL;
+};
@@ -0,0 +1,38 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "framework.h"
+#include "winfx.h"
+
+class SimulatorInterface;
+
+// Where a SimulatorInterface gets its data: SimConnect to a local or
+// remote simulator, or a stand-in for testing.
+class SimBackend {
+public:
+	virtual ~SimBackend() {}
+
+	// When messages are waiting the backend posts userMessage to hwnd, if
+	// hwnd is given, and sets event, if that is given.
+	virtual HRESULT open(HWND hwnd, UINT userMessage, HANDLE event) = 0;
+
+	// Hands waiting messages to sim: setSimData() for each sample and
+	// onSimDisconnect() if the simulator has gone.
+	virtual HRESULT dispatch(SimulatorInterface* sim) = 0;
+
+	virtual void close() = 0;
+};
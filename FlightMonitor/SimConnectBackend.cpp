@@ -0,0 +1,180 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+
+#include "framework.h"
+#include "winfx.h"
+#include "SimConnectBackend.h"
+#include "SimInterface.h"
+
+constexpr DWORD REQUEST_1 = 0;
+constexpr DWORD DEFINITION_1 = 0;
+
+// SimVar group g is definition and request kSimVarDefinitionBase + g.
+constexpr DWORD kSimVarDefinitionBase = 1;
+
+// For turning periods under a second into a count of sim frames.
+constexpr int kAssumedSimFrameMs = 16;
+
+#define CHECK_OR_FAIL(f) { \
+  HRESULT hr = (f); \
+  if (!SUCCEEDED(hr)) { \
+    winfx::DebugOut(L"Error adding to data definition: %08x", hr); \
+	return hr; \
+  } \
+}
+
+HRESULT SimConnectBackend::open(HWND hwnd, UINT userMessage, HANDLE event) {
+	close();
+	HRESULT hr = SimConnect_Open(&sim_, "FlightMonitor", hwnd, userMessage, event, config_index_);
+	if (FAILED(hr)) {
+		sim_ = INVALID_HANDLE_VALUE;
+		return hr;
+	}
+
+	hr = buildDefinition();
+	if (SUCCEEDED(hr)) {
+		hr = requestData();
+	}
+	if (FAILED(hr)) {
+		close();
+		return hr;
+	}
+	return S_OK;
+}
+
+HRESULT SimConnectBackend::dispatch(SimulatorInterface* sim) {
+	dispatch_sim_ = sim;
+	return SimConnect_CallDispatch(sim_, dispatchProc, this);
+}
+
+void SimConnectBackend::close() {
+	if (sim_ == INVALID_HANDLE_VALUE)
+		return;
+	SimConnect_Close(sim_);
+	sim_ = INVALID_HANDLE_VALUE;
+}
+
+HRESULT SimConnectBackend::buildDefinition() {
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "GPS POSITION ALT", "meters"));
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "GPS POSITION LAT", "degrees"));
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "GPS POSITION LON", "degrees"));
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "GPS GROUND TRUE TRACK", "degrees"));
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "GPS GROUND SPEED", "meters per second"));
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "PLANE PITCH DEGREES", "degrees"));
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "PLANE BANK DEGREES", "degrees"));
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "PLANE HEADING DEGREES TRUE", "degrees"));
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "VERTICAL SPEED", "meters per second"));
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "G FORCE", "gforce"));
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "PLANE ALT ABOVE GROUND", "meters"));
+	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "SIM ON GROUND", "bool"));
+	if (simvars_ == nullptr)
+		return S_OK;
+
+	static const SIMCONNECT_DATATYPE kDataTypes[] = {
+		SIMCONNECT_DATATYPE_FLOAT64, SIMCONNECT_DATATYPE_FLOAT32,
+		SIMCONNECT_DATATYPE_INT32, SIMCONNECT_DATATYPE_INT64,
+	};
+	const std::vector<SimVarGroup>& groups = simvars_->groups();
+	for (size_t g = 0; g < groups.size(); g++) {
+		const DWORD definition = kSimVarDefinitionBase + (DWORD)g;
+		for (size_t i = 0; i < groups[g].fields.size(); i++) {
+			const SimVarConfig& channel = simvars_->channel(groups[g].first + i);
+			CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, definition, channel.name.c_str(),
+				channel.units.empty() ? NULL : channel.units.c_str(), kDataTypes[channel.type]));
+		}
+	}
+	return S_OK;
+}
+
+HRESULT SimConnectBackend::requestData() {
+	// One stream at the simulator frame rate. The SinkScheduler decimates it
+	// to whatever rate each output wants.
+	HRESULT hr = SimConnect_RequestDataOnSimObject(sim_, REQUEST_1, DEFINITION_1,
+		SIMCONNECT_OBJECT_ID_USER, SIMCONNECT_PERIOD_SIM_FRAME);
+	if (FAILED(hr)) {
+		winfx::DebugOut(L"RequestData failed with error %08x\n", hr);
+		return hr;
+	}
+	if (simvars_ == nullptr)
+		return S_OK;
+
+	// The extra channels at their own periods: whole seconds as a count of
+	// seconds, anything quicker as a count of frames at about 60 fps.
+	const std::vector<SimVarGroup>& groups = simvars_->groups();
+	for (size_t g = 0; g < groups.size(); g++) {
+		const DWORD id = kSimVarDefinitionBase + (DWORD)g;
+		const int period = groups[g].period_ms;
+		const bool seconds = period >= 1000;
+		const DWORD interval = seconds ? period / 1000 - 1 : std::max(period / kAssumedSimFrameMs, 1) - 1;
+		hr = SimConnect_RequestDataOnSimObject(sim_, id, id, SIMCONNECT_OBJECT_ID_USER,
+			seconds ? SIMCONNECT_PERIOD_SECOND : SIMCONNECT_PERIOD_SIM_FRAME, 0, 0, interval);
+		if (FAILED(hr)) {
+			winfx::DebugOut(L"RequestData for SimVars failed with error %08x\n", hr);
+			return hr;
+		}
+	}
+	return S_OK;
+}
+
+void CALLBACK SimConnectBackend::dispatchProc(SIMCONNECT_RECV* recv_data, DWORD cbData,
+											   void* pContext) {
+	SimConnectBackend* backend = (SimConnectBackend*)pContext;
+	SimulatorInterface* sim = backend->dispatch_sim_;
+	const SIMCONNECT_RECV_OPEN* open_data = NULL;
+	const SIMCONNECT_RECV_SIMOBJECT_DATA* object_data = NULL;
+	const SIMCONNECT_RECV_EXCEPTION* except = NULL;
+
+	// Data comes every sim frame, too often to log.
+	if (recv_data->dwID != SIMCONNECT_RECV_ID_SIMOBJECT_DATA)
+		winfx::DebugOut(L"SimDispatchProc: %lx\n", recv_data->dwID);
+
+	switch (recv_data->dwID) {
+	case SIMCONNECT_RECV_ID_OPEN:
+		winfx::DebugOut(L"SIMCONNECT_RECV_ID_OPEN\n");
+		open_data = (SIMCONNECT_RECV_OPEN*)recv_data;
+		winfx::DebugOut(L"RECV_OPEN: %S SIM VER: %d.%d\n", 
+			open_data->szApplicationName,
+			open_data->dwApplicationBuildMajor, 
+			open_data->dwApplicationBuildMinor);
+		break;
+	case SIMCONNECT_RECV_ID_QUIT:
+		winfx::DebugOut(L"SIMCONNECT_RECV_ID_QUIT\n");
+		sim->onSimDisconnect();
+		break;
+	case SIMCONNECT_RECV_ID_EXCEPTION:
+		except = (SIMCONNECT_RECV_EXCEPTION*)recv_data;
+		winfx::DebugOut(L"SIMCONNECT_RECV_ID_EXCEPTION: dwException = %08x\n", 
+			except->dwException);
+		break;
+	case SIMCONNECT_RECV_ID_SIMOBJECT_DATA:
+		object_data = (SIMCONNECT_RECV_SIMOBJECT_DATA*)recv_data;
+		if (object_data->dwRequestID == REQUEST_1) {
+			DWORD object_id = object_data->dwObjectID;
+			const SimData* const sim_data = (SimData*)&object_data->dwData;
+			sim->setSimData(sim_data);
+		} else if (backend->simvars_ != nullptr && object_data->dwRequestID >= kSimVarDefinitionBase) {
+			const size_t header = (const BYTE*)&object_data->dwData - (const BYTE*)recv_data;
+			if (cbData > header)
+				backend->simvars_->decode(object_data->dwRequestID - kSimVarDefinitionBase,
+					&object_data->dwData, cbData - header);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
@@ -0,0 +1,47 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "framework.h"
+#include "winfx.h"
+#include "SimBackend.h"
+#include "SimVarChannels.h"
+
+// SimConnect, to the simulator on this machine or, with a configIndex other
+// than SIMCONNECT_OPEN_CONFIGINDEX_LOCAL, to the one described by that
+// section of SimConnect.cfg. Given simvars, each of its groups is requested
+// as a data definition of its own and decoded into it as it arrives.
+class SimConnectBackend : public SimBackend {
+public:
+	explicit SimConnectBackend(DWORD configIndex = SIMCONNECT_OPEN_CONFIGINDEX_LOCAL,
+		SimVarChannels* simvars = nullptr) :
+		config_index_(configIndex), simvars_(simvars) {}
+	~SimConnectBackend() { close(); }
+
+	HRESULT open(HWND hwnd, UINT userMessage, HANDLE event) override;
+	HRESULT dispatch(SimulatorInterface* sim) override;
+	void close() override;
+
+private:
+	HRESULT buildDefinition();
+	HRESULT requestData();
+	static void CALLBACK dispatchProc(SIMCONNECT_RECV* recv_data, DWORD cbData, void* pContext);
+
+	DWORD config_index_;
+	SimVarChannels* simvars_;
+	HANDLE sim_ = INVALID_HANDLE_VALUE;
+	SimulatorInterface* dispatch_sim_ = nullptr;
+};
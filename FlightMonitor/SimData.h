@@ -15,6 +15,11 @@
 
 #pragma once
 
+#include <stdint.h>
+
+// Field layout must match the data definition built in
+// SimConnectBackend::buildDefinition, since SimConnect hands us the raw
+// block of doubles.
 struct SimData {
 	double  gps_alt = 0;
 	double  gps_lat = 0;
@@ -24,4 +29,25 @@ struct SimData {
 	double  pitch = 0;
 	double  bank = 0;
 	double  heading = 0;
+	double  vertical_speed = 0;   // m/s, up is positive
+	double  g_force = 0;          // load factor, 1 in level flight
+	double  alt_agl = 0;          // meters above the simulator's ground
+	double  on_ground = 0;        // 1 when any gear is on the ground
+};
+
+// Groups of SimData fields, used by consumers to say which parts of a sample
+// they care about.
+enum SimField : unsigned {
+	kSimFieldPosition = 1 << 0,   // gps_alt, gps_lat, gps_lon
+	kSimFieldTrack    = 1 << 1,   // gps_track, gps_groundspeed
+	kSimFieldAttitude = 1 << 2,   // pitch, bank, heading
+	kSimFieldVertical = 1 << 3,   // vertical_speed, g_force, alt_agl, on_ground
+	kSimFieldAll      = kSimFieldPosition | kSimFieldTrack | kSimFieldAttitude | kSimFieldVertical
+};
+
+// A SimData sample stamped with the wall-clock time it was received, in
+// milliseconds since the Unix epoch.
+struct SimSample {
+	int64_t time_ms = 0;
+	SimData data;
 };
@@ -15,65 +15,41 @@
 
 #include "framework.h"
 #include "winfx.h"
-#include "MainWindow.h"
-#include "ForeFlightBroadcaster.h"
 #include "SimInterface.h"
+#include "AllocTracker.h"
+#include "SimConnectBackend.h"
 
-constexpr DWORD REQUEST_1 = 0;
-constexpr DWORD DEFINITION_1 = 0;
-
-static void CALLBACK SimDispatchProc(SIMCONNECT_RECV* pData, DWORD cbData, void* pContext);
-
-#define CHECK_OR_FAIL(f) { \
-  HRESULT hr = (f); \
-  if (!SUCCEEDED(hr)) { \
-    winfx::DebugOut(L"Error adding to data definition: %08x", hr); \
-	return hr; \
-  } \
+SimulatorInterface::SimulatorInterface() : backend_(new SimConnectBackend()) {
 }
 
-HRESULT SimulatorInterface::connectSim(HWND hwnd) {
+HRESULT SimulatorInterface::connectSim(HWND hwnd, UINT userMessage, HANDLE event) {
 	winfx::DebugOut(L"Attempting to connect to sim\n");
-	HRESULT hr = SimConnect_Open(&sim_, "FlightMonitor", hwnd, 0, 0, SIMCONNECT_OPEN_CONFIGINDEX_LOCAL);
+	HRESULT hr = backend_->open(hwnd, userMessage, event);
 	if (FAILED(hr)) {
 		return hr;
 	}
 
-	hr = buildDefinition();
-	if (FAILED(hr)) {
-		SimConnect_Close(sim_);
-		sim_ = INVALID_HANDLE_VALUE;
-		return hr;
-	}
-
 	setState(SimInterfaceConnected);
 	return S_OK;
 }
 
-HRESULT SimulatorInterface::buildDefinition() {
-	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "GPS POSITION ALT", "meters"));
-	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "GPS POSITION LAT", "degrees"));
-	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "GPS POSITION LON", "degrees"));
-	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "GPS GROUND TRUE TRACK", "degrees"));
-	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "GPS GROUND SPEED", "meters per second"));
-	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "PLANE PITCH DEGREES", "degrees"));
-	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "PLANE BANK DEGREES", "degrees"));
-	CHECK_OR_FAIL(SimConnect_AddToDataDefinition(sim_, DEFINITION_1, "PLANE HEADING DEGREES TRUE", "degrees"));
-	return S_OK;
-}
-
-static std::map<SimulatorInterfaceState, std::wstring> stateMessages = {
-	{SimInterfaceDisconnected, L"Attempting to connect to simulator"},
-	{SimInterfaceConnected, L"Connected to simulator"},
-	{SimInterfaceReceivingData, L"Recieving data from simulator"},
-	{SimInterfaceInFlight, L"In Flight"}
+// Indexed by SimulatorInterfaceState.
+static const std::wstring stateMessages[] = {
+	L"Attempting to connect to simulator",
+	L"Connected to simulator",
+	L"Recieving data from simulator",
+	L"In Flight",
 };
 
+// Everything one sample costs on the dispatch thread, callbacks included.
+static AllocSite setSimDataSite("setSimData");
+
 const std::wstring& SimulatorInterface::getStatusMessage() const {
 	return stateMessages[state_];
 }
 
 void SimulatorInterface::setSimData(const SimData* simData) {
+	AllocScope scope(setSimDataSite);
 	data_ = *simData;
 	if (!positionIsValid()) {
 		setState(SimInterfaceReceivingData);
@@ -82,9 +58,9 @@ void SimulatorInterface::setSimData(const SimData* simData) {
 	}
 
 	// Notify listeners of new data
-	for (SimulatorCallbacks* callback : callbacks_) {
-		callback->onSimDataUpdated(simData);
-	}
+	SimDataEvent event;
+	event.data = *simData;
+	events_.publish(event);
 }
 
 void SimulatorInterface::onSimDisconnect() {
@@ -94,34 +70,27 @@ void SimulatorInterface::onSimDisconnect() {
 void SimulatorInterface::setState(SimulatorInterfaceState state) {
 	if (state_ != state) {
 		state_ = state;
-		for (SimulatorCallbacks* callback : callbacks_) {
-			callback->onStateChange(state);
-		}
+		events_.publish(SimStateEvent{ state });
 	}
 }
 
 void SimulatorInterface::close() {
-	SimConnect_Close(sim_);
-	sim_ = INVALID_HANDLE_VALUE;
+	backend_->close();
 	setState(SimInterfaceDisconnected);
-	for (SimulatorCallbacks* callback : callbacks_) {
-		callback->onSimDisconnect();
-	}
+	events_.publish(SimDisconnectEvent());
 }
 
-HRESULT SimulatorInterface::pollSimulator() {
+HRESULT SimulatorInterface::dispatch() {
 	if (!isConnected()) {
-		winfx::DebugOut(L"Invalid call to pollSimulator when not connected.\n");
+		winfx::DebugOut(L"Invalid call to dispatch when not connected.\n");
 		return E_FAIL;
 	}
-	winfx::DebugOut(L"Requesting data from simulator...\n");
-	HRESULT hr = SimConnect_RequestDataOnSimObjectType(sim_, REQUEST_1, DEFINITION_1, 0, SIMCONNECT_SIMOBJECT_TYPE_USER);
+	HRESULT hr = backend_->dispatch(this);
 	if (FAILED(hr)) {
-		winfx::DebugOut(L"RequestData failed with error %08x\n", hr);
+		winfx::DebugOut(L"CallDispatch failed with error %08x\n", hr);
 		close();
 		return hr;
 	}
-	SimConnect_CallDispatch(sim_, SimDispatchProc, this);
 	return S_OK;
 }
 
@@ -135,46 +104,3 @@ bool SimulatorInterface::positionIsValid() {
 		(data_.gps_lon < 0.1 && data_.gps_lon > -0.1) &&
 		data_.gps_alt < 10);
 }
-
-static void CALLBACK SimDispatchProc(SIMCONNECT_RECV* recv_data, DWORD cbData, 
-									 void* pContext) {
-	SimulatorInterface* sim = (SimulatorInterface*)pContext;
-	const SIMCONNECT_RECV_OPEN* open_data = NULL;
-	const SIMCONNECT_RECV_SIMOBJECT_DATA_BYTYPE* object_data = NULL;
-	const SIMCONNECT_RECV_EXCEPTION* except = NULL;
-
-	winfx::DebugOut(L"SimDispatchProc: %lx\n", recv_data->dwID);
-
-	switch (recv_data->dwID) {
-	case SIMCONNECT_RECV_ID_OPEN:
-		winfx::DebugOut(L"SIMCONNECT_RECV_ID_OPEN\n");
-		open_data = (SIMCONNECT_RECV_OPEN*)recv_data;
-		winfx::DebugOut(L"RECV_OPEN: %S SIM VER: %d.%d\n", 
-			open_data->szApplicationName,
-			open_data->dwApplicationBuildMajor, 
-			open_data->dwApplicationBuildMinor);
-		break;
-	case SIMCONNECT_RECV_ID_QUIT:
-		winfx::DebugOut(L"SIMCONNECT_RECV_ID_QUIT\n");
-		sim->onSimDisconnect();
-		break;
-	case SIMCONNECT_RECV_ID_EXCEPTION:
-		except = (SIMCONNECT_RECV_EXCEPTION*)recv_data;
-		winfx::DebugOut(L"SIMCONNECT_RECV_ID_EXCEPTION: dwException = %08x\n", 
-			except->dwException);
-		break;
-	case SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE:
-		object_data = (SIMCONNECT_RECV_SIMOBJECT_DATA_BYTYPE*)recv_data;
-		winfx::DebugOut(L"SIMCONNECT_RECIV_ID_SIMOBJECT_DATA_BYTYPE: dwRequestID = %d\n", 
-			object_data->dwRequestID);
-		if (object_data->dwRequestID == REQUEST_1) {
-			DWORD object_id = object_data->dwObjectID;
-			const SimData* const sim_data = (SimData*)&object_data->dwData;
-			sim->setSimData(sim_data);
-		}
-		break;
-	default:
-		break;
-	}
-}
-
@@ -17,6 +17,9 @@
 
 #include "framework.h"
 #include "winfx.h"
+#include <memory>
+#include "EventBus.h"
+#include "SimBackend.h"
 #include "SimData.h"
 
 enum SimulatorInterfaceState {
@@ -26,21 +29,40 @@ enum SimulatorInterfaceState {
 	SimInterfaceInFlight
 };
 
-class SimulatorCallbacks {
-public:
-	virtual void onSimDataUpdated(const SimData* data) = 0;
-	virtual void onStateChange(SimulatorInterfaceState state) = 0;
-	virtual void onSimDisconnect() = 0;
+// What SimulatorInterface publishes, on the thread that calls dispatch().
+
+// A new sample.
+struct SimDataEvent {
+	SimData data;
+};
+
+struct SimStateEvent {
+	SimulatorInterfaceState state;
+};
+
+// The connection has closed; a reconnect is up to the owner.
+struct SimDisconnectEvent {
 };
 
+using SimEventBus = EventBus<SimDataEvent, SimStateEvent, SimDisconnectEvent>;
+
 class SimulatorInterface {
 public:
-	HRESULT connectSim(HWND hwnd);
-	HRESULT pollSimulator();
+	// SimConnect to the simulator on this machine.
+	SimulatorInterface();
+	explicit SimulatorInterface(std::unique_ptr<SimBackend> backend) : backend_(std::move(backend)) {}
+
+	// Switches to another data source. Only while disconnected.
+	void setBackend(std::unique_ptr<SimBackend> backend) { backend_ = std::move(backend); }
+
+	// The backend posts userMessage to hwnd, and sets event if one is given,
+	// whenever data is waiting; the owner should then call dispatch().
+	HRESULT connectSim(HWND hwnd, UINT userMessage, HANDLE event = NULL);
+	HRESULT dispatch();
 	void close();
-	void addCallback(SimulatorCallbacks* callback) {
-		callbacks_.push_back(callback);
-	}
+	// Listeners subscribe here, before connecting, for the events they
+	// want. Those on the network path should come first.
+	SimEventBus& events() { return events_; }
 
 	bool isConnected() const { return state_ != SimInterfaceDisconnected;  }
 	const SimData* getData() const {
@@ -57,11 +79,10 @@ public:
 
 private:
 	bool positionIsValid();
-	HRESULT buildDefinition();
 	void setState(SimulatorInterfaceState state);
 
-	std::vector<SimulatorCallbacks*> callbacks_;
-	HANDLE sim_ = INVALID_HANDLE_VALUE;
+	std::unique_ptr<SimBackend> backend_;
+	SimEventBus events_;
 	SimulatorInterfaceState state_ = SimInterfaceDisconnected;
 	SimData data_;
 };
@@ -0,0 +1,258 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "framework.h"
+#include "winfx.h"
+#include "SimVarChannels.h"
+#include "ConfigFile.h"
+#include "MappedFile.h"
+#include "TrackFile.h"
+
+static int64_t wallClockMs() {
+	using namespace std::chrono;
+	return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+static bool parseSimVarType(const std::string& name, SimVarType* type) {
+	if (name.empty() || name == "float64")
+		*type = kSimVarFloat64;
+	else if (name == "float32")
+		*type = kSimVarFloat32;
+	else if (name == "int32" || name == "bool")
+		*type = kSimVarInt32;
+	else if (name == "int64")
+		*type = kSimVarInt64;
+	else
+		return false;
+	return true;
+}
+
+static uint32_t simVarTypeSize(SimVarType type) {
+	return (type == kSimVarFloat64 || type == kSimVarInt64) ? 8 : 4;
+}
+
+std::vector<SimVarConfig> parseSimVarConfig(const char* text, size_t size) {
+	std::vector<SimVarConfig> configs;
+	for (const std::vector<std::string>& fields : splitConfigLines(text, size)) {
+		if (fields[0].empty())
+			continue;
+		SimVarConfig config;
+		config.name = fields[0];
+		if (fields.size() > 1)
+			config.units = fields[1];
+		if (fields.size() > 2 && !parseSimVarType(fields[2], &config.type)) {
+			winfx::DebugOut(L"SimVar %S has unknown type %S\n", fields[0].c_str(), fields[2].c_str());
+			continue;
+		}
+		if (fields.size() > 3 && atoi(fields[3].c_str()) > 0)
+			config.period_ms = atoi(fields[3].c_str());
+		configs.push_back(config);
+	}
+	return configs;
+}
+
+HRESULT loadSimVarConfig(LPCWSTR path, std::vector<SimVarConfig>* configs) {
+	MappedFile file;
+	HRESULT hr = file.open(path);
+	if (FAILED(hr))
+		return hr;
+	*configs = parseSimVarConfig(reinterpret_cast<const char*>(file.data()), file.size());
+	winfx::DebugOut(L"%zu SimVars from %s\n", configs->size(), path);
+	return S_OK;
+}
+
+void SimVarChannels::configure(const std::vector<SimVarConfig>& configs) {
+	channels_ = configs;
+	if (channels_.size() > (size_t)kMaxTrackChannels) {
+		winfx::DebugOut(L"Only the first %d SimVars are used\n", kMaxTrackChannels);
+		channels_.resize(kMaxTrackChannels);
+	}
+	std::stable_sort(channels_.begin(), channels_.end(),
+		[](const SimVarConfig& a, const SimVarConfig& b) { return a.period_ms < b.period_ms; });
+
+	groups_.clear();
+	for (size_t i = 0; i < channels_.size(); i++) {
+		if (groups_.empty() || groups_.back().period_ms != channels_[i].period_ms) {
+			SimVarGroup group;
+			group.period_ms = channels_[i].period_ms;
+			group.first = i;
+			groups_.push_back(group);
+		}
+		SimVarGroup& group = groups_.back();
+		SimVarField field;
+		field.offset = (uint32_t)group.payload_bytes;
+		field.type = channels_[i].type;
+		group.fields.push_back(field);
+		group.payload_bytes += simVarTypeSize(field.type);
+	}
+
+	values_.assign(channels_.size() * kSimVarHistory, NAN);
+	times_.assign(groups_.size() * kSimVarHistory, 0);
+	sequences_.assign(groups_.size(), 0);
+}
+
+bool SimVarChannels::decode(size_t group, const void* payload, size_t size) {
+	if (group >= groups_.size() || size < groups_[group].payload_bytes)
+		return false;
+	const SimVarGroup& g = groups_[group];
+	const uint8_t* const p = static_cast<const uint8_t*>(payload);
+	const int64_t now = wallClockMs();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	const size_t slot = sequences_[group] % kSimVarHistory;
+	times_[group * kSimVarHistory + slot] = now;
+	double* value = &values_[g.first * kSimVarHistory + slot];
+	for (const SimVarField& field : g.fields) {
+		switch (field.type) {
+		case kSimVarFloat64: { double v; memcpy(&v, p + field.offset, sizeof(v)); *value = v; break; }
+		case kSimVarFloat32: { float v; memcpy(&v, p + field.offset, sizeof(v)); *value = v; break; }
+		case kSimVarInt32: { int32_t v; memcpy(&v, p + field.offset, sizeof(v)); *value = v; break; }
+		case kSimVarInt64: { int64_t v; memcpy(&v, p + field.offset, sizeof(v)); *value = (double)v; break; }
+		}
+		value += kSimVarHistory;
+	}
+	sequences_[group]++;
+	return true;
+}
+
+uint64_t SimVarChannels::sequence(size_t group) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return sequences_[group];
+}
+
+size_t SimVarChannels::read(size_t group, uint64_t* sequence, int64_t* times, double* values,
+	size_t maxRows) const {
+	const SimVarGroup& g = groups_[group];
+	const size_t columns = g.fields.size();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	const uint64_t newest = sequences_[group];
+	uint64_t next = *sequence;
+	if (newest > kSimVarHistory && next < newest - kSimVarHistory)
+		next = newest - kSimVarHistory;
+	size_t rows = 0;
+	for (; next < newest && rows < maxRows; next++, rows++) {
+		const size_t slot = next % kSimVarHistory;
+		times[rows] = times_[group * kSimVarHistory + slot];
+		for (size_t c = 0; c < columns; c++)
+			values[rows * columns + c] = values_[(g.first + c) * kSimVarHistory + slot];
+	}
+	*sequence = next;
+	return rows;
+}
+
+void SimVarChannels::latest(double* values) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (size_t group = 0; group < groups_.size(); group++) {
+		const SimVarGroup& g = groups_[group];
+		const uint64_t sequence = sequences_[group];
+		const size_t slot = (sequence + kSimVarHistory - 1) % kSimVarHistory;
+		for (size_t c = 0; c < g.fields.size(); c++)
+			values[g.first + c] = sequence ? values_[(g.first + c) * kSimVarHistory + slot] : NAN;
+	}
+}
+
+HRESULT SimVarWriter::open(LPCWSTR path, int64_t createdTimeMs, const SimVarChannels& channels) {
+	close();
+	if (channels.empty())
+		return E_INVALIDARG;
+
+	// "GENERAL ENG RPM:1 (rpm)", each NUL terminated.
+	std::string names;
+	for (size_t i = 0; i < channels.channelCount(); i++) {
+		const SimVarConfig& channel = channels.channel(i);
+		names += channel.name;
+		if (!channel.units.empty())
+			names += " (" + channel.units + ")";
+		names.push_back('\0');
+	}
+
+	if (_wfopen_s(&file_, path, L"wb") != 0 || file_ == nullptr) {
+		winfx::DebugOut(L"Could not create SimVar file %s\n", path);
+		file_ = nullptr;
+		return E_FAIL;
+	}
+	setvbuf(file_, nullptr, _IONBF, 0);
+
+	TrackFileHeader header = { 0 };
+	header.magic = kTrackFileMagic;
+	header.version = kTrackFileVersion;
+	header.channel_count = (uint16_t)channels.channelCount();
+	header.created_time_ms = createdTimeMs;
+	strncpy_s(header.source, "SimVars", _TRUNCATE);
+	header.names_bytes = (uint32_t)names.size();
+	if (fwrite(&header, sizeof(header), 1, file_) != 1 ||
+		fwrite(names.data(), names.size(), 1, file_) != 1) {
+		close();
+		return E_FAIL;
+	}
+	fflush(file_);
+
+	channels_ = &channels;
+	const std::vector<SimVarGroup>& groups = channels.groups();
+	encoders_.clear();
+	sequences_.clear();
+	size_t widest = 0;
+	for (size_t g = 0; g < groups.size(); g++) {
+		encoders_.emplace_back((int)groups[g].fields.size());
+		encoders_.back().setFirstChannel((uint32_t)groups[g].first);
+		sequences_.push_back(channels.sequence(g));
+		widest = std::max(widest, groups[g].fields.size());
+	}
+	times_.resize(kSimVarHistory);
+	values_.resize(kSimVarHistory * widest);
+	block_.reserve(sizeof(TrackBlockHeader) + (widest + 1) * (sizeof(uint32_t) + kTrackStreamMaxBytes));
+	return S_OK;
+}
+
+void SimVarWriter::update() {
+	if (file_ == nullptr)
+		return;
+	for (size_t g = 0; g < encoders_.size(); g++) {
+		const size_t columns = channels_->groups()[g].fields.size();
+		const size_t rows = channels_->read(g, &sequences_[g], times_.data(), values_.data(), kSimVarHistory);
+		for (size_t r = 0; r < rows; r++) {
+			encoders_[g].append(times_[r], &values_[r * columns]);
+			if (encoders_[g].full())
+				writeBlock(g);
+		}
+	}
+}
+
+void SimVarWriter::writeBlock(size_t group) {
+	block_.clear();
+	encoders_[group].finish(&block_);
+	if (block_.empty())
+		return;
+	if (fwrite(block_.data(), block_.size(), 1, file_) != 1)
+		winfx::DebugOut(L"Error writing SimVar block\n");
+	fflush(file_);
+}
+
+void SimVarWriter::close() {
+	if (file_ == nullptr)
+		return;
+	update();
+	for (size_t g = 0; g < encoders_.size(); g++)
+		writeBlock(g);
+	fclose(file_);
+	file_ = nullptr;
+	channels_ = nullptr;
+}
@@ -0,0 +1,152 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "winfx.h"
+#include "TrackCodec.h"
+
+// Simulation variables beyond the fixed SimData fields, named in a file so
+// that logging engine parameters, flaps, gear or autopilot modes for an
+// investigation needs no rebuild. The simvars file in the app data
+// directory has one per line:
+//
+//   SimVar name, units, type, period in ms
+//
+// e.g. "GENERAL ENG RPM:1, rpm, float64, 1000". The type is float64 (the
+// default), float32, int32, int64 or bool; the period defaults to
+// kSimVarDefaultPeriodMs. Lines starting with # are comments.
+constexpr wchar_t kSimVarsFileName[] = L"simvars.txt";
+constexpr int kSimVarDefaultPeriodMs = 1000;
+
+// Recordings of them, next to each flight's .fmtrk.
+constexpr wchar_t kSimVarFileExtension[] = L".fmvar";
+
+// Samples of each group kept for readers on other threads. Enough for a
+// group at the simulator frame rate between two recorder samples.
+constexpr size_t kSimVarHistory = 128;
+
+enum SimVarType {
+	kSimVarFloat64,
+	kSimVarFloat32,
+	kSimVarInt32,
+	kSimVarInt64,
+};
+
+struct SimVarConfig {
+	std::string name;      // e.g. "GENERAL ENG RPM:1"
+	std::string units;     // e.g. "rpm"
+	SimVarType type = kSimVarFloat64;
+	int period_ms = kSimVarDefaultPeriodMs;
+};
+
+std::vector<SimVarConfig> parseSimVarConfig(const char* text, size_t size);
+HRESULT loadSimVarConfig(LPCWSTR path, std::vector<SimVarConfig>* configs);
+
+// Where one channel's value sits in its group's payload.
+struct SimVarField {
+	uint32_t offset;
+	SimVarType type;
+};
+
+// Channels that share a period, sent by the simulator as one data
+// definition: channels first to first + fields.size(), packed back to back.
+struct SimVarGroup {
+	int period_ms = 0;
+	size_t first = 0;
+	std::vector<SimVarField> fields;
+	size_t payload_bytes = 0;
+};
+
+// The extra channels and their recent values. The simulator sends each
+// group at its own period, apart from the SimData stream, and decode()
+// unpacks a payload through the group's offset table into a ring per
+// channel. Other threads read the newest values or a group's samples since
+// they last looked.
+class SimVarChannels {
+public:
+	// Orders the channels by period so each group's are together. Call
+	// before connecting.
+	void configure(const std::vector<SimVarConfig>& configs);
+
+	bool empty() const { return channels_.empty(); }
+	size_t channelCount() const { return channels_.size(); }
+	const SimVarConfig& channel(size_t index) const { return channels_[index]; }
+	const std::vector<SimVarGroup>& groups() const { return groups_; }
+
+	// Called on the dispatch thread with a payload for group, stamped with
+	// the time now. False if it is too short.
+	bool decode(size_t group, const void* payload, size_t size);
+
+	// Samples of group decoded so far.
+	uint64_t sequence(size_t group) const;
+
+	// Copies up to maxRows of group's samples after *sequence, oldest
+	// first: a time each into times and the group's values row by row into
+	// values. Samples that have left the history are skipped. Advances
+	// *sequence and returns the rows copied.
+	size_t read(size_t group, uint64_t* sequence, int64_t* times, double* values, size_t maxRows) const;
+
+	// The newest value of every channel, in channel order; NaN before the
+	// first.
+	void latest(double* values) const;
+
+private:
+	std::vector<SimVarConfig> channels_;
+	std::vector<SimVarGroup> groups_;
+
+	// Columnar: channel c's ring is values_[c * kSimVarHistory] onward and
+	// group g's times are times_[g * kSimVarHistory] onward, both indexed
+	// by the group's sequence.
+	mutable std::mutex mutex_;
+	std::vector<double> values_;
+	std::vector<int64_t> times_;
+	std::vector<uint64_t> sequences_;
+};
+
+// Records SimVarChannels to a .fmvar file: a TrackFileHeader that names the
+// channels, then TrackCodec blocks that each hold one group's channels
+// (first_channel says which) at the group's own rate.
+class SimVarWriter {
+public:
+	~SimVarWriter() { close(); }
+
+	// Records from the samples decoded after this call.
+	HRESULT open(LPCWSTR path, int64_t createdTimeMs, const SimVarChannels& channels);
+
+	// Appends what each group has decoded since the last call.
+	void update();
+	void close();
+
+	bool isOpen() const { return file_ != nullptr; }
+
+private:
+	void writeBlock(size_t group);
+
+	const SimVarChannels* channels_ = nullptr;
+	FILE* file_ = nullptr;
+	std::vector<TrackBlockEncoder> encoders_;
+	std::vector<uint64_t> sequences_;
+	std::vector<int64_t> times_;
+	std::vector<double> values_;
+	std::vector<uint8_t> block_;
+};
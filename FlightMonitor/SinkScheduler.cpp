@@ -0,0 +1,225 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include <math.h>
+#include "SinkScheduler.h"
+
+static int64_t wallClockMs() {
+	using namespace std::chrono;
+	return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// Interpolate along the shorter arc so that 359 -> 1 passes through 0.
+static double lerpAngle(double a, double b, double f, double low) {
+	double angle = a + remainder(b - a, 360.0) * f;
+	if (angle < low)
+		angle += 360.0;
+	else if (angle >= low + 360.0)
+		angle -= 360.0;
+	return angle;
+}
+
+static double lerp(double a, double b, double f) {
+	return a + (b - a) * f;
+}
+
+static SimSample interpolate(const SimSample& a, const SimSample& b, double f) {
+	SimSample out;
+	out.time_ms = a.time_ms + (int64_t)llround((double)(b.time_ms - a.time_ms) * f);
+	out.data.gps_alt = lerp(a.data.gps_alt, b.data.gps_alt, f);
+	out.data.gps_lat = lerp(a.data.gps_lat, b.data.gps_lat, f);
+	out.data.gps_lon = lerpAngle(a.data.gps_lon, b.data.gps_lon, f, -180.0);
+	out.data.gps_track = lerpAngle(a.data.gps_track, b.data.gps_track, f, 0.0);
+	out.data.gps_groundspeed = lerp(a.data.gps_groundspeed, b.data.gps_groundspeed, f);
+	out.data.pitch = lerp(a.data.pitch, b.data.pitch, f);
+	out.data.bank = lerp(a.data.bank, b.data.bank, f);
+	out.data.heading = lerpAngle(a.data.heading, b.data.heading, f, 0.0);
+	out.data.vertical_speed = lerp(a.data.vertical_speed, b.data.vertical_speed, f);
+	out.data.g_force = lerp(a.data.g_force, b.data.g_force, f);
+	out.data.alt_agl = lerp(a.data.alt_agl, b.data.alt_agl, f);
+	out.data.on_ground = f < 0.5 ? a.data.on_ground : b.data.on_ground;
+	return out;
+}
+
+static bool fieldsEqual(const SimData& a, const SimData& b, unsigned fields) {
+	if ((fields & kSimFieldPosition) &&
+		(a.gps_alt != b.gps_alt || a.gps_lat != b.gps_lat || a.gps_lon != b.gps_lon))
+		return false;
+	if ((fields & kSimFieldTrack) &&
+		(a.gps_track != b.gps_track || a.gps_groundspeed != b.gps_groundspeed))
+		return false;
+	if ((fields & kSimFieldAttitude) &&
+		(a.pitch != b.pitch || a.bank != b.bank || a.heading != b.heading))
+		return false;
+	if ((fields & kSimFieldVertical) &&
+		(a.vertical_speed != b.vertical_speed || a.g_force != b.g_force ||
+		a.alt_agl != b.alt_agl || a.on_ground != b.on_ground))
+		return false;
+	return true;
+}
+
+void SinkScheduler::addSink(OutputSink* sink) {
+	SinkSlot slot;
+	slot.sink = sink;
+	slot.allocs.reset(new AllocSite(sink->sinkName()));
+	slots_.push_back(std::move(slot));
+}
+
+void SinkScheduler::start() {
+	if (thread_.joinable())
+		return;
+	stopping_ = false;
+	thread_ = std::thread(&SinkScheduler::run, this);
+}
+
+void SinkScheduler::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_one();
+	if (thread_.joinable())
+		thread_.join();
+}
+
+void SinkScheduler::onEvent(const SimDataEvent& event) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		previous_ = latest_;
+		previous_time_ = latest_time_;
+		latest_.data = event.data;
+		latest_.time_ms = wallClockMs();
+		latest_time_ = Clock::now();
+		input_seq_++;
+	}
+	wake_.notify_one();
+}
+
+void SinkScheduler::onEvent(const SimStateEvent& event) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		state_ = event.state;
+		state_seq_++;
+	}
+	wake_.notify_one();
+}
+
+void SinkScheduler::run() {
+	uint64_t delivered_state_seq = 0;
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!stopping_) {
+		work_latest_ = latest_;
+		work_previous_ = previous_;
+		work_latest_time_ = latest_time_;
+		work_previous_time_ = previous_time_;
+		work_input_seq_ = input_seq_;
+		const SimulatorInterfaceState state = state_;
+		const uint64_t state_seq = state_seq_;
+		lock.unlock();
+
+		if (state_seq != delivered_state_seq) {
+			for (SinkSlot& slot : slots_)
+				slot.sink->onStateChange(state);
+			delivered_state_seq = state_seq;
+		}
+
+		const Clock::time_point now = Clock::now();
+		Clock::time_point wake = Clock::time_point::max();
+		for (SinkSlot& slot : slots_)
+			slot.delivered = service(slot, now, &wake);
+		for (SinkSlot& slot : slots_) {
+			if (slot.delivered) {
+				AllocScope scope(*slot.allocs);
+				slot.sink->onFlush();
+			}
+		}
+
+		lock.lock();
+		if (stopping_)
+			break;
+		// Something arrived while the sinks were running; go round again.
+		if (input_seq_ != work_input_seq_ || state_seq_ != delivered_state_seq)
+			continue;
+		if (wake == Clock::time_point::max())
+			wake_.wait(lock);
+		else
+			wake_.wait_until(lock, wake);
+	}
+}
+
+bool SinkScheduler::service(SinkSlot& slot, Clock::time_point now, Clock::time_point* wake) {
+	if (work_input_seq_ == 0)
+		return false;
+
+	OutputSink* const sink = slot.sink;
+	const double rate = sink->sinkRate();
+	SimSample sample;
+
+	if (rate <= 0) {
+		if (slot.delivered_seq == work_input_seq_)
+			return false;
+		sample = work_latest_;
+	} else {
+		if (now < slot.next_due) {
+			if (slot.next_due < *wake)
+				*wake = slot.next_due;
+			return false;
+		}
+
+		const Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+			std::chrono::duration<double>(1.0 / rate));
+		slot.next_due += period;
+		if (slot.next_due <= now)
+			slot.next_due = now + period;
+		if (slot.next_due < *wake)
+			*wake = slot.next_due;
+
+		if (sink->sinkInterpolates() && work_input_seq_ > 1 &&
+			work_latest_time_ > work_previous_time_) {
+			// Render one input interval in the past, which always lies between
+			// the two samples we have unless the input has stalled.
+			const Clock::duration input_interval = work_latest_time_ - work_previous_time_;
+			const Clock::time_point t = now - input_interval;
+			double f = std::chrono::duration<double>(t - work_previous_time_).count() /
+				std::chrono::duration<double>(input_interval).count();
+			if (f < 0) f = 0;
+			if (f > 1) f = 1;
+			sample = interpolate(work_previous_, work_latest_, f);
+		} else {
+			if (slot.delivered_seq == work_input_seq_)
+				return false;
+			sample = work_latest_;
+		}
+	}
+
+	if (slot.delivered_seq != 0 &&
+		fieldsEqual(slot.last_delivered, sample.data, sink->sinkFields()) &&
+		now - slot.last_delivery < std::chrono::milliseconds(kSinkIdleRefreshMs)) {
+		slot.delivered_seq = work_input_seq_;
+		return false;
+	}
+
+	{
+		AllocScope scope(*slot.allocs);
+		sink->onSample(sample);
+	}
+	slot.last_delivered = sample.data;
+	slot.last_delivery = now;
+	slot.delivered_seq = work_input_seq_;
+	return true;
+}
@@ -0,0 +1,90 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AllocTracker.h"
+#include "SimData.h"
+#include "SimInterface.h"
+#include "OutputSink.h"
+
+// How long a sink can go without a delivery because its fields did not
+// change.
+constexpr int kSinkIdleRefreshMs = 1000;
+
+// Fans the single SimConnect sample stream out to any number of OutputSinks,
+// each at its own rate. The simulator thread only stamps and stores the
+// newest sample; decimation, interpolation and the sinks themselves run on
+// the scheduler's worker thread.
+//
+// Sinks must be added before start() and stay registered until stop().
+class SinkScheduler : public EventListener<SimDataEvent>, public EventListener<SimStateEvent> {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	SinkScheduler() {}
+	~SinkScheduler() { stop(); }
+
+	void addSink(OutputSink* sink);
+
+	void start();
+	void stop();
+
+	void onEvent(const SimDataEvent& event) override;
+	void onEvent(const SimStateEvent& event) override;
+
+private:
+	struct SinkSlot {
+		OutputSink* sink = nullptr;
+		Clock::time_point next_due;
+		Clock::time_point last_delivery;
+		uint64_t delivered_seq = 0;
+		bool delivered = false;              // in the current pass
+		SimData last_delivered;
+		std::unique_ptr<AllocSite> allocs;   // what onSample allocates
+	};
+
+	void run();
+	bool service(SinkSlot& slot, Clock::time_point now, Clock::time_point* wake);
+
+	std::vector<SinkSlot> slots_;
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	bool stopping_ = false;
+
+	// Guarded by mutex_. Written by the simulator thread.
+	SimSample latest_;
+	SimSample previous_;
+	Clock::time_point latest_time_;
+	Clock::time_point previous_time_;
+	uint64_t input_seq_ = 0;
+	SimulatorInterfaceState state_ = SimInterfaceDisconnected;
+	uint64_t state_seq_ = 0;
+
+	// Worker-thread copies of the above.
+	SimSample work_latest_;
+	SimSample work_previous_;
+	Clock::time_point work_latest_time_;
+	Clock::time_point work_previous_time_;
+	uint64_t work_input_seq_ = 0;
+};
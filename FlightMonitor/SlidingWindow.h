@@ -0,0 +1,106 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+
+// The mean and least-squares slope of a value over the last few seconds,
+// e.g. altitude into vertical speed. Running sums make each add() constant
+// time; the samples live in a fixed ring, so a window fed faster than
+// Capacity samples per span simply covers less time.
+//
+// Times are kept relative to the oldest sample so the sums stay small and
+// the slope does not lose precision to cancellation.
+template <int Capacity>
+class SlidingWindow {
+public:
+	explicit SlidingWindow(double spanSeconds) : span_(spanSeconds) {}
+
+	void add(int64_t timeMs, double value) {
+		if (count_ == 0)
+			base_ms_ = timeMs;
+		if (count_ == Capacity)
+			removeOldest();
+		const double t = (timeMs - base_ms_) / 1000.0;
+		const int index = (first_ + count_) % Capacity;
+		times_[index] = timeMs;
+		values_[index] = value;
+		count_++;
+		sum_t_ += t;
+		sum_v_ += value;
+		sum_tt_ += t * t;
+		sum_tv_ += t * value;
+		while (count_ > 1 && (timeMs - times_[first_]) / 1000.0 > span_)
+			removeOldest();
+	}
+
+	void clear() {
+		count_ = 0;
+		first_ = 0;
+		sum_t_ = sum_v_ = sum_tt_ = sum_tv_ = 0;
+	}
+
+	int count() const { return count_; }
+
+	// Seconds between the oldest and newest samples.
+	double seconds() const {
+		return count_ ? (times_[(first_ + count_ - 1) % Capacity] - times_[first_]) / 1000.0 : 0;
+	}
+
+	double mean() const { return count_ ? sum_v_ / count_ : 0; }
+
+	// Change per second; zero until there are two samples at different times.
+	double slope() const {
+		const double d = count_ * sum_tt_ - sum_t_ * sum_t_;
+		if (count_ < 2 || d <= 1e-12)
+			return 0;
+		return (count_ * sum_tv_ - sum_t_ * sum_v_) / d;
+	}
+
+private:
+	void removeOldest() {
+		const double t = (times_[first_] - base_ms_) / 1000.0;
+		const double v = values_[first_];
+		sum_t_ -= t;
+		sum_v_ -= v;
+		sum_tt_ -= t * t;
+		sum_tv_ -= t * v;
+		first_ = (first_ + 1) % Capacity;
+		count_--;
+		if (count_ > 0)
+			rebase(times_[first_]);
+	}
+
+	// Moves the time origin to baseMs, adjusting the sums to match.
+	void rebase(int64_t baseMs) {
+		const double shift = (baseMs - base_ms_) / 1000.0;
+		sum_tt_ += -2 * shift * sum_t_ + count_ * shift * shift;
+		sum_tv_ -= shift * sum_v_;
+		sum_t_ -= count_ * shift;
+		base_ms_ = baseMs;
+	}
+
+	double span_;
+	int64_t base_ms_ = 0;
+	int64_t times_[Capacity];
+	double values_[Capacity];
+	int first_ = 0;
+	int count_ = 0;
+	double sum_t_ = 0;
+	double sum_v_ = 0;
+	double sum_tt_ = 0;
+	double sum_tv_ = 0;
+};
@@ -0,0 +1,347 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include "TerrainService.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kMetersPerDegree = 111320;
+
+// Prefetch samples the projected track this often, in degrees, so no tile
+// it crosses is stepped over.
+constexpr double kPrefetchStepDegrees = 0.25;
+
+// Touching one byte per page faults a tile's heights in.
+constexpr size_t kPageBytes = 4096;
+
+// One-degree tiles on the whole globe; tileKey() numbers them from zero.
+constexpr size_t kTileKeys = 180 * 360;
+
+std::wstring terrainTileName(int lat, int lon) {
+	wchar_t name[16];
+	swprintf_s(name, L"%c%02d%c%03d.hgt", lat < 0 ? L'S' : L'N', abs(lat),
+		lon < 0 ? L'W' : L'E', abs(lon));
+	return name;
+}
+
+bool TerrainTile::attach(const uint8_t* data, size_t size, int lat, int lon) {
+	data_ = nullptr;
+	size_ = 0;
+	for (int posts : { kTerrainTileSize1, kTerrainTileSize3 }) {
+		if (size == (size_t)posts * posts * 2) {
+			data_ = data;
+			size_ = posts;
+			lat_ = lat;
+			lon_ = lon;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool TerrainTile::elevation(double lat, double lon, double* meters) const {
+	const int last = size_ - 1;
+	const double y = (lat_ + 1 - lat) * last;  // posts south of the north edge
+	const double x = (lon - lon_) * last;
+	if (!(y >= 0 && y <= last && x >= 0 && x <= last))
+		return false;
+
+	const int row = std::min((int)y, last - 1);
+	const int column = std::min((int)x, last - 1);
+	const double fy = y - row;
+	const double fx = x - column;
+	const int h00 = height(row, column);
+	const int h01 = height(row, column + 1);
+	const int h10 = height(row + 1, column);
+	const int h11 = height(row + 1, column + 1);
+
+	if (h00 != kTerrainVoid && h01 != kTerrainVoid && h10 != kTerrainVoid && h11 != kTerrainVoid) {
+		const double north = h00 + (h01 - h00) * fx;
+		const double south = h10 + (h11 - h10) * fx;
+		*meters = north + (south - north) * fy;
+		return true;
+	}
+
+	// Weight whichever posts have data.
+	const int heights[4] = { h00, h01, h10, h11 };
+	const double weights[4] = { (1 - fy) * (1 - fx), (1 - fy) * fx, fy * (1 - fx), fy * fx };
+	double sum = 0;
+	double weight = 0;
+	for (int i = 0; i < 4; i++) {
+		if (heights[i] != kTerrainVoid) {
+			sum += heights[i] * weights[i];
+			weight += weights[i];
+		}
+	}
+	if (weight <= 0)
+		return false;
+	*meters = sum / weight;
+	return true;
+}
+
+HRESULT TerrainService::open(const std::wstring& directory, size_t cacheTiles) {
+	close();
+	if (directory.empty())
+		return E_INVALIDARG;
+
+	directory_ = directory;
+	slots_.resize(std::max<size_t>(cacheTiles, 2));
+	tile_state_.assign(kTileKeys, kTileUnknown);
+	mapped_tiles_ = 0;
+	hits_ = 0;
+	misses_ = 0;
+	prefetched_ = 0;
+	next_prefetch_ms_ = 0;
+
+	stopping_ = false;
+	loader_ = std::thread(&TerrainService::runLoader, this);
+	return S_OK;
+}
+
+void TerrainService::close() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_one();
+	if (loader_.joinable())
+		loader_.join();
+
+	requests_.clear();
+	loaded_.clear();
+	last_key_ = -1;
+	last_tile_ = nullptr;
+	tile_state_.clear();
+	mapped_tiles_ = 0;
+	slots_.clear();
+	agl_valid_ = false;
+}
+
+void TerrainService::onSample(const SimSample& sample) {
+	if (!in_flight_)
+		return;
+
+	const SimData& data = sample.data;
+	if (sample.time_ms >= next_prefetch_ms_) {
+		next_prefetch_ms_ = sample.time_ms + kTerrainPrefetchIntervalMs;
+		prefetch(data.gps_lat, data.gps_lon, data.gps_track, data.gps_groundspeed);
+	}
+
+	double ground;
+	if (elevation(data.gps_lat, data.gps_lon, &ground)) {
+		agl_ = data.gps_alt - ground;
+		agl_valid_ = true;
+	} else {
+		agl_valid_ = false;
+	}
+}
+
+void TerrainService::onStateChange(SimulatorInterfaceState state) {
+	in_flight_ = (state == SimInterfaceInFlight);
+	if (!in_flight_)
+		agl_valid_ = false;
+}
+
+bool TerrainService::aglMeters(double* agl) const {
+	if (!agl_valid_)
+		return false;
+	*agl = agl_;
+	return true;
+}
+
+bool TerrainService::elevation(double lat, double lon, double* meters) {
+	const double south = floor(lat);
+	const double west = floor(lon);
+	if (!(south >= -90 && south < 90 && west >= -180 && west < 180))
+		return false;
+	const TerrainTile* tile = findTile((int)south, (int)west);
+	return tile != nullptr && tile->elevation(lat, lon, meters);
+}
+
+const TerrainTile* TerrainService::findTile(int lat, int lon) {
+	if (tile_state_.empty())
+		return nullptr;  // not open
+
+	// Consecutive lookups are nearly always in the same tile.
+	const int key = tileKey(lat, lon);
+	if (key == last_key_) {
+		hits_++;
+		return last_tile_;
+	}
+
+	const TerrainTile* tile = nullptr;
+	const int state = tile_state_[key];
+	if (state >= 0) {
+		hits_++;
+		CacheSlot& slot = slots_[state];
+		slot.last_used = ++use_clock_;
+		tile = &slot.tile;
+	} else if (state != kTileMissing) {
+		// The loader did not get there first; map it now.
+		misses_++;
+		MappedFile file;
+		if (SUCCEEDED(openTile(key, &file)))
+			tile = insertTile(key, std::move(file));
+		else
+			tile_state_[key] = kTileMissing;
+	}
+
+	// The tile being left keeps the last_used it had when it was entered.
+	// That is fine as the last tile is never the one evicted.
+	last_key_ = key;
+	last_tile_ = tile;
+	return tile;
+}
+
+const TerrainTile* TerrainService::insertTile(int key, MappedFile&& file) {
+	if (slots_.empty())
+		return nullptr;
+
+	// Evict the least recently used tile other than the one in use.
+	size_t victim = slots_.size();
+	for (size_t i = 0; i < slots_.size(); i++) {
+		if (slots_[i].key < 0) {
+			victim = i;
+			break;
+		}
+		if (slots_[i].key != last_key_ &&
+			(victim == slots_.size() || slots_[i].last_used < slots_[victim].last_used)) {
+			victim = i;
+		}
+	}
+
+	CacheSlot& slot = slots_[victim];
+	if (slot.key >= 0) {
+		tile_state_[slot.key] = kTileUnknown;
+		mapped_tiles_--;
+	}
+	slot.file = std::move(file);
+	if (!slot.tile.attach(slot.file.data(), slot.file.size(), key / 360 - 90, key % 360 - 180)) {
+		winfx::DebugOut(L"Terrain tile %s is not an SRTM tile\n",
+			terrainTileName(key / 360 - 90, key % 360 - 180).c_str());
+		slot.file.close();
+		slot.key = -1;
+		tile_state_[key] = kTileMissing;
+		return nullptr;
+	}
+	slot.key = key;
+	slot.last_used = ++use_clock_;
+	tile_state_[key] = (int)victim;
+	mapped_tiles_++;
+	return &slot.tile;
+}
+
+HRESULT TerrainService::openTile(int key, MappedFile* file) const {
+	// Built on the stack: flying off the edge of the data probes a new
+	// name every degree and that should not touch the heap.
+	const int lat = key / 360 - 90;
+	const int lon = key % 360 - 180;
+	wchar_t path[MAX_PATH];
+	if (swprintf_s(path, L"%s\\%c%02d%c%03d.hgt", directory_.c_str(), lat < 0 ? L'S' : L'N', abs(lat),
+		lon < 0 ? L'W' : L'E', abs(lon)) < 0)
+		return E_INVALIDARG;
+	if (GetFileAttributes(path) == INVALID_FILE_ATTRIBUTES)
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);  // no data there; not worth logging
+	return file->open(path, FILE_FLAG_RANDOM_ACCESS);
+}
+
+void TerrainService::prefetch(double lat, double lon, double trackDegrees, double groundspeed) {
+	if (tile_state_.empty())
+		return;
+	takeLoadedTiles();
+
+	const double distance = std::max(0.0, groundspeed) * kTerrainPrefetchSeconds;
+	const double step = kPrefetchStepDegrees * kMetersPerDegree;
+	const double track = trackDegrees * kPi / 180;
+	const double north = cos(track) / kMetersPerDegree;
+	const double east = sin(track) / (kMetersPerDegree * std::max(0.01, cos(lat * kPi / 180)));
+	const int steps = (int)std::min(1000.0, ceil(distance / step));
+
+	wanted_.clear();
+	for (int i = 0; i <= steps; i++) {
+		const double d = std::min(i * step, distance);
+		const double south = floor(lat + d * north);
+		double west = floor(lon + d * east);
+		if (west >= 180)
+			west -= 360;
+		else if (west < -180)
+			west += 360;
+		if (!(south >= -90 && south < 90 && west >= -180 && west < 180))
+			continue;
+
+		const int key = tileKey((int)south, (int)west);
+		if (tile_state_[key] != kTileUnknown)
+			continue;
+		tile_state_[key] = kTileRequested;
+		wanted_.push_back(key);
+	}
+	if (wanted_.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		requests_.insert(requests_.end(), wanted_.begin(), wanted_.end());
+	}
+	wake_.notify_one();
+}
+
+void TerrainService::takeLoadedTiles() {
+	// Swapping with a member rather than a local keeps both capacities.
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		taken_.swap(loaded_);
+	}
+	for (LoadedTile& tile : taken_) {
+		if (tile_state_[tile.key] != kTileRequested)
+			continue;  // a lookup needed it first
+		if (!tile.file.isOpen()) {
+			tile_state_[tile.key] = kTileMissing;
+			continue;
+		}
+		tile_state_[tile.key] = kTileUnknown;
+		if (insertTile(tile.key, std::move(tile.file)) != nullptr)
+			prefetched_++;
+	}
+	taken_.clear();
+}
+
+void TerrainService::runLoader() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (;;) {
+		wake_.wait(lock, [this] { return stopping_ || !requests_.empty(); });
+		if (stopping_)
+			return;
+		LoadedTile tile;
+		tile.key = requests_.front();
+		requests_.pop_front();
+		lock.unlock();
+
+		if (SUCCEEDED(openTile(tile.key, &tile.file))) {
+			// Fault the heights in here rather than on the first lookups.
+			volatile uint8_t touch = 0;
+			for (size_t offset = 0; offset < tile.file.size(); offset += kPageBytes)
+				touch = tile.file.data()[offset];
+			(void)touch;
+		}
+
+		lock.lock();
+		loaded_.push_back(std::move(tile));
+	}
+}
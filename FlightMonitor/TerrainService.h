@@ -0,0 +1,173 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framework.h"
+#include "winfx.h"
+#include "MappedFile.h"
+#include "OutputSink.h"
+
+// Samples per second at which AGL is worked out.
+constexpr double kTerrainSamplesPerSecond = 10;
+
+// Tiles kept mapped at once. A tile is one degree square, so this covers
+// a few hundred kilometers of flight either side of the aircraft.
+constexpr size_t kTerrainCacheTiles = 16;
+
+// How far ahead along the current track tiles are loaded in the
+// background, and how often that is checked.
+constexpr double kTerrainPrefetchSeconds = 600;
+constexpr int64_t kTerrainPrefetchIntervalMs = 1000;
+
+// Optional directory to read tiles from instead of
+// %LOCALAPPDATA%\FlightMonitor\Terrain.
+constexpr wchar_t kTerrainDirectoryVariable[] = L"FLIGHTMONITOR_TERRAIN_DIR";
+
+// SRTM tiles: one degree square, named for their south-west corner (e.g.
+// N47W123.hgt), holding size x size big-endian 16-bit heights in meters,
+// north row first. The edges are shared with the neighbouring tiles.
+constexpr int kTerrainTileSize1 = 3601;   // 1 arc-second
+constexpr int kTerrainTileSize3 = 1201;   // 3 arc-second
+constexpr int16_t kTerrainVoid = -32768;
+
+// SRTM file name for the tile whose south-west corner is (lat, lon).
+std::wstring terrainTileName(int lat, int lon);
+
+// A view of one tile's heights, wherever they are held.
+class TerrainTile {
+public:
+	bool attach(const uint8_t* data, size_t size, int lat, int lon);
+
+	// Bilinear interpolation between the four surrounding posts. Void
+	// posts are left out; false if all four are void.
+	bool elevation(double lat, double lon, double* meters) const;
+
+	int size() const { return size_; }
+
+private:
+	int height(int row, int column) const {
+		const uint8_t* p = data_ + ((size_t)row * size_ + column) * 2;
+		return (int16_t)((p[0] << 8) | p[1]);
+	}
+
+	const uint8_t* data_ = nullptr;
+	int size_ = 0;
+	int lat_ = 0;
+	int lon_ = 0;
+};
+
+// Terrain elevation under any point, from a directory of SRTM tiles.
+//
+// Tiles are memory mapped and the most recently used kTerrainCacheTiles of
+// them stay mapped. Lookups in a mapped tile take a few tens of
+// nanoseconds. A lookup in a tile that is not mapped opens it on the spot,
+// so prefetch() loads the tiles ahead of the aircraft on a thread of its own
+// and touches their pages, and the aircraft rarely reaches an unmapped one.
+//
+// As a sink it keeps aglMeters() up to date. elevation() and prefetch() must
+// only be called from one thread: the scheduler's worker once registered.
+class TerrainService : public OutputSink {
+public:
+	TerrainService() {}
+	~TerrainService() { close(); }
+
+	const char* sinkName() const override { return "Terrain"; }
+	double sinkRate() const override { return kTerrainSamplesPerSecond; }
+	unsigned sinkFields() const override { return kSimFieldPosition | kSimFieldTrack; }
+
+	void onSample(const SimSample& sample) override;
+	void onStateChange(SimulatorInterfaceState state) override;
+
+	// Starts the loader thread. Tiles that are not in directory simply have
+	// no elevation.
+	HRESULT open(const std::wstring& directory, size_t cacheTiles = kTerrainCacheTiles);
+	void close();
+
+	bool elevation(double lat, double lon, double* meters);
+
+	// Queues the tiles along the next kTerrainPrefetchSeconds of flight on
+	// the given track, and takes over any the loader has finished.
+	void prefetch(double lat, double lon, double trackDegrees, double groundspeed);
+
+	// Height above the terrain at the last sample. Safe from any thread.
+	bool aglMeters(double* agl) const;
+
+	uint64_t hits() const { return hits_; }
+	uint64_t misses() const { return misses_; }
+	uint64_t prefetched() const { return prefetched_; }
+	size_t mappedTiles() const { return mapped_tiles_; }
+
+private:
+	struct CacheSlot {
+		int key = -1;
+		MappedFile file;
+		TerrainTile tile;
+		uint64_t last_used = 0;
+	};
+
+	struct LoadedTile {
+		int key;
+		MappedFile file;  // not open if the tile does not exist
+	};
+
+	// What tile_state_ holds for a key that is not mapped into a slot.
+	enum : int { kTileUnknown = -1, kTileMissing = -2, kTileRequested = -3 };
+
+	static int tileKey(int lat, int lon) { return (lat + 90) * 360 + (lon + 180); }
+
+	const TerrainTile* findTile(int lat, int lon);
+	const TerrainTile* insertTile(int key, MappedFile&& file);
+	HRESULT openTile(int key, MappedFile* file) const;
+	void takeLoadedTiles();
+	void runLoader();
+
+	std::wstring directory_;
+
+	// Owned by the lookup thread.
+	std::vector<CacheSlot> slots_;
+	std::vector<int> tile_state_;   // key -> slot, or kTileMissing etc.
+	size_t mapped_tiles_ = 0;
+	std::vector<int> wanted_;       // scratch for prefetch()
+	std::vector<LoadedTile> taken_; // scratch for takeLoadedTiles()
+	int last_key_ = -1;
+	const TerrainTile* last_tile_ = nullptr;
+	uint64_t use_clock_ = 0;
+	int64_t next_prefetch_ms_ = 0;
+	uint64_t hits_ = 0;
+	uint64_t misses_ = 0;
+	uint64_t prefetched_ = 0;
+	bool in_flight_ = false;
+
+	// Handed between the lookup thread and the loader. Guarded by mutex_.
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::deque<int> requests_;
+	std::vector<LoadedTile> loaded_;
+	bool stopping_ = false;
+	std::thread loader_;
+
+	std::atomic<double> agl_{ 0 };
+	std::atomic<bool> agl_valid_{ false };
+};
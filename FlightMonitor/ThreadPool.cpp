@@ -0,0 +1,122 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "ThreadPool.h"
+
+static thread_local int current_worker = -1;
+static thread_local const void* current_pool = nullptr;
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+	thread_count_ = threadCount;
+
+	for (unsigned i = 0; i < threadCount; i++)
+		queues_.push_back(std::make_unique<WorkQueue>());
+	for (unsigned i = 0; i < threadCount; i++)
+		workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	work_available_.notify_all();
+	for (std::thread& worker : workers_)
+		worker.join();
+}
+
+int ThreadPool::currentWorker() {
+	return current_worker;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+	unsigned index;
+	if (current_pool == this)
+		index = static_cast<unsigned>(current_worker);
+	else
+		index = next_queue_++ % threadCount();
+
+	{
+		// Count the task before publishing it, so a worker that takes it at
+		// once cannot decrement queued_ below zero, and under the mutex so
+		// a worker about to sleep cannot miss it. A worker woken early spins
+		// in popTask until the push below lands.
+		std::lock_guard<std::mutex> lock(mutex_);
+		outstanding_++;
+		queued_++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+		queues_[index]->tasks.push_back(std::move(task));
+	}
+	work_available_.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	all_done_.wait(lock, [this] { return outstanding_ == 0; });
+}
+
+bool ThreadPool::popTask(unsigned index, std::function<void()>* task) {
+	{
+		WorkQueue& own = *queues_[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			*task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+
+	const unsigned count = threadCount();
+	for (unsigned i = 1; i < count; i++) {
+		WorkQueue& victim = *queues_[(index + i) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			*task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+	current_worker = static_cast<int>(index);
+	current_pool = this;
+
+	std::function<void()> task;
+	for (;;) {
+		if (popTask(index, &task)) {
+			queued_--;
+			task();
+			task = nullptr;
+
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (--outstanding_ == 0)
+				all_done_.notify_all();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		work_available_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+		if (stopping_ && queued_ == 0)
+			return;
+	}
+}
@@ -0,0 +1,74 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads with one task queue each. A worker takes
+// new work from the back of its own queue and, when that is empty, steals
+// from the front of the others', so uneven tasks (a ten hour flight next to
+// a circuit) keep every core busy without a single contended queue.
+class ThreadPool {
+public:
+	// threadCount 0 uses one thread per hardware thread.
+	explicit ThreadPool(unsigned threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned threadCount() const { return thread_count_; }
+
+	// Tasks submitted from a worker go to that worker's queue; others are
+	// dealt round robin.
+	void submit(std::function<void()> task);
+
+	// Blocks until every submitted task has finished.
+	void wait();
+
+	// Index of the calling worker in [0, threadCount), or -1 when called
+	// from a thread that does not belong to a pool. Lets tasks keep
+	// per-thread partial results without locking.
+	static int currentWorker();
+
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void workerLoop(unsigned index);
+	bool popTask(unsigned index, std::function<void()>* task);
+
+	unsigned thread_count_;
+	std::vector<std::unique_ptr<WorkQueue>> queues_;
+	std::vector<std::thread> workers_;
+	std::atomic<unsigned> next_queue_{ 0 };
+
+	std::mutex mutex_;
+	std::condition_variable work_available_;
+	std::condition_variable all_done_;
+	std::atomic<size_t> queued_{ 0 };
+	size_t outstanding_ = 0;
+	bool stopping_ = false;
+};
@@ -0,0 +1,360 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "TrackCodec.h"
+
+static const char* const kChannelNames[kTrackChannels] = {
+	"gps_alt",
+	"gps_lat",
+	"gps_lon",
+	"gps_track",
+	"gps_groundspeed",
+	"pitch",
+	"bank",
+	"heading",
+	"vertical_speed",
+	"g_force",
+	"alt_agl",
+	"on_ground",
+};
+
+const char* trackChannelName(int channel) {
+	if (channel < 0 || channel >= kTrackChannels)
+		return "unknown";
+	return kChannelNames[channel];
+}
+
+// Both are only called with a non-zero value.
+static int leadingZeros(uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return 63 - (int)index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+		return 31 - (int)index;
+	_BitScanReverse(&index, (unsigned long)value);
+	return 63 - (int)index;
+#else
+	return __builtin_clzll(value);
+#endif
+}
+
+static int trailingZeros(uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return (int)index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward(&index, (unsigned long)value))
+		return (int)index;
+	_BitScanForward(&index, (unsigned long)(value >> 32));
+	return 32 + (int)index;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+static uint64_t doubleBits(double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static double bitsDouble(uint64_t bits) {
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static int64_t signExtend(uint64_t value, int bits) {
+	const uint64_t sign = 1ull << (bits - 1);
+	return (int64_t)((value ^ sign) - sign);
+}
+
+void BitWriter::write(uint64_t value, int bits) {
+	while (bits > 0) {
+		if (bit_pos_ == 0)
+			bytes_.push_back(0);
+		const int space = 8 - bit_pos_;
+		const int n = bits < space ? bits : space;
+		const uint8_t chunk = (uint8_t)((value >> (bits - n)) & ((1u << n) - 1));
+		bytes_.back() |= (uint8_t)(chunk << (space - n));
+		bit_pos_ = (bit_pos_ + n) & 7;
+		bits -= n;
+	}
+}
+
+void BitReader::refill() {
+	while (avail_ <= 56) {
+		const uint64_t byte = p_ < end_ ? *p_++ : 0;
+		buffer_ |= byte << (56 - avail_);
+		avail_ += 8;
+		fed_bytes_++;
+	}
+}
+
+uint64_t BitReader::read(int bits) {
+	if (bits == 0)
+		return 0;
+	if (bits > 56) {
+		const uint64_t high = read(bits - 32);
+		return (high << 32) | read(32);
+	}
+	if (avail_ < bits)
+		refill();
+	const uint64_t value = buffer_ >> (64 - bits);
+	buffer_ <<= bits;
+	avail_ -= bits;
+	return value;
+}
+
+TrackBlockEncoder::TrackBlockEncoder(int channelCount) :
+	channel_count_(channelCount),
+	channels_(channelCount) {
+	time_bits_.reserve(kTrackStreamMaxBytes);
+	for (ChannelState& channel : channels_)
+		channel.bits.reserve(kTrackStreamMaxBytes);
+}
+
+void TrackBlockEncoder::append(const SimSample& sample) {
+	double values[kTrackChannels];
+	memcpy(values, &sample.data, sizeof(values));
+	append(sample.time_ms, values);
+}
+
+void TrackBlockEncoder::append(int64_t time_ms, const double* values) {
+	appendTime(time_ms);
+	for (int i = 0; i < channel_count_; i++)
+		appendValue(channels_[i], values[i]);
+	count_++;
+}
+
+void TrackBlockEncoder::appendTime(int64_t time_ms) {
+	if (count_ == 0) {
+		first_time_ms_ = time_ms;
+		previous_time_ms_ = time_ms;
+		previous_delta_ = 0;
+		return;
+	}
+
+	// Delta-of-delta with Gorilla's variable-length buckets. At a steady
+	// sample rate almost every timestamp costs a single bit.
+	const int64_t delta = time_ms - previous_time_ms_;
+	const int64_t dod = delta - previous_delta_;
+	if (dod == 0) {
+		time_bits_.write(0, 1);
+	} else if (dod >= -64 && dod <= 63) {
+		time_bits_.write(0x2, 2);
+		time_bits_.write((uint64_t)dod, 7);
+	} else if (dod >= -256 && dod <= 255) {
+		time_bits_.write(0x6, 3);
+		time_bits_.write((uint64_t)dod, 9);
+	} else if (dod >= -2048 && dod <= 2047) {
+		time_bits_.write(0xe, 4);
+		time_bits_.write((uint64_t)dod, 12);
+	} else {
+		time_bits_.write(0xf, 4);
+		time_bits_.write((uint64_t)dod, 64);
+	}
+	previous_delta_ = delta;
+	previous_time_ms_ = time_ms;
+}
+
+void TrackBlockEncoder::appendValue(ChannelState& channel, double value) {
+	const uint64_t bits = doubleBits(value);
+	if (count_ == 0) {
+		channel.bits.write(bits, 64);
+		channel.previous = bits;
+		channel.has_window = false;
+		return;
+	}
+
+	const uint64_t x = bits ^ channel.previous;
+	channel.previous = bits;
+	if (x == 0) {
+		channel.bits.write(0, 1);
+		return;
+	}
+
+	int leading = leadingZeros(x);
+	const int trailing = trailingZeros(x);
+	if (leading > 31)
+		leading = 31;
+
+	if (channel.has_window && leading >= channel.leading && trailing >= channel.trailing) {
+		// The meaningful bits fit in the previous window.
+		channel.bits.write(0x2, 2);
+		channel.bits.write(x >> channel.trailing, 64 - channel.leading - channel.trailing);
+	} else {
+		const int significant = 64 - leading - trailing;
+		channel.bits.write(0x3, 2);
+		channel.bits.write((uint64_t)leading, 5);
+		channel.bits.write((uint64_t)(significant - 1), 6);
+		channel.bits.write(x >> trailing, significant);
+		channel.leading = leading;
+		channel.trailing = trailing;
+		channel.has_window = true;
+	}
+}
+
+void TrackBlockEncoder::finish(std::vector<uint8_t>* out) {
+	if (count_ == 0)
+		return;
+
+	const size_t start = out->size();
+	const size_t offsets_bytes = sizeof(uint32_t) * (channel_count_ + 1);
+	size_t total = sizeof(TrackBlockHeader) + offsets_bytes + time_bits_.bytes().size();
+	for (const ChannelState& channel : channels_)
+		total += channel.bits.bytes().size();
+	out->resize(start + total);
+	uint8_t* const block = out->data() + start;
+
+	TrackBlockHeader header = { 0 };
+	header.magic = kTrackBlockMagic;
+	header.block_bytes = (uint32_t)total;
+	header.sample_count = (uint16_t)count_;
+	header.channel_count = (uint16_t)channel_count_;
+	header.first_channel = first_channel_;
+	header.first_time_ms = first_time_ms_;
+	header.last_time_ms = previous_time_ms_;
+	memcpy(block, &header, sizeof(header));
+
+	uint32_t offset = (uint32_t)(sizeof(TrackBlockHeader) + offsets_bytes);
+	uint8_t* const offsets = block + sizeof(TrackBlockHeader);
+	auto copyStream = [&](int index, const BitWriter& bits) {
+		memcpy(offsets + index * sizeof(uint32_t), &offset, sizeof(offset));
+		if (!bits.bytes().empty())
+			memcpy(block + offset, bits.bytes().data(), bits.bytes().size());
+		offset += (uint32_t)bits.bytes().size();
+	};
+	copyStream(0, time_bits_);
+	for (int i = 0; i < channel_count_; i++)
+		copyStream(i + 1, channels_[i].bits);
+
+	count_ = 0;
+	time_bits_.clear();
+	for (ChannelState& channel : channels_)
+		channel.bits.clear();
+}
+
+SimSample TrackColumns::sample(int index) const {
+	SimSample sample;
+	sample.time_ms = time_ms[index];
+	double values[kTrackChannels] = { 0 };
+	for (int i = 0; i < kTrackChannels && i < channel_count; i++) {
+		if (!channels[i].empty())
+			values[i] = channels[i][index];
+	}
+	memcpy(&sample.data, values, sizeof(values));
+	return sample;
+}
+
+static bool decodeTimes(BitReader& reader, int count, int64_t first, int64_t* out) {
+	int64_t previous = first;
+	int64_t delta = 0;
+	out[0] = first;
+	for (int i = 1; i < count; i++) {
+		int64_t dod;
+		if (!reader.readBit()) {
+			dod = 0;
+		} else if (!reader.readBit()) {
+			dod = signExtend(reader.read(7), 7);
+		} else if (!reader.readBit()) {
+			dod = signExtend(reader.read(9), 9);
+		} else if (!reader.readBit()) {
+			dod = signExtend(reader.read(12), 12);
+		} else {
+			dod = (int64_t)reader.read(64);
+		}
+		delta += dod;
+		previous += delta;
+		out[i] = previous;
+	}
+	return !reader.overrun();
+}
+
+static bool decodeValues(BitReader& reader, int count, double* out) {
+	uint64_t previous = reader.read(64);
+	out[0] = bitsDouble(previous);
+	int leading = 0;
+	int trailing = 0;
+	for (int i = 1; i < count; i++) {
+		if (reader.readBit()) {
+			if (reader.readBit()) {
+				leading = (int)reader.read(5);
+				const int significant = (int)reader.read(6) + 1;
+				trailing = 64 - leading - significant;
+				if (trailing < 0)
+					return false;
+			}
+			previous ^= reader.read(64 - leading - trailing) << trailing;
+		}
+		out[i] = bitsDouble(previous);
+	}
+	return !reader.overrun();
+}
+
+bool decodeTrackBlock(const uint8_t* data, size_t size, TrackColumns* out, uint64_t channelMask) {
+	TrackBlockHeader header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != kTrackBlockMagic || header.block_bytes > size ||
+		header.channel_count > kMaxTrackChannels || header.sample_count == 0)
+		return false;
+
+	const int channels = header.channel_count;
+	const int count = header.sample_count;
+	const size_t offsets_end = sizeof(header) + sizeof(uint32_t) * (channels + 1);
+	if (offsets_end > header.block_bytes)
+		return false;
+
+	uint32_t offsets[kMaxTrackChannels + 2];
+	memcpy(offsets, data + sizeof(header), sizeof(uint32_t) * (channels + 1));
+	offsets[channels + 1] = header.block_bytes;
+	for (int i = 0; i <= channels; i++) {
+		if (offsets[i] < offsets_end || offsets[i] > offsets[i + 1])
+			return false;
+	}
+
+	out->count = count;
+	out->channel_count = channels;
+	out->first_channel = (int)header.first_channel;
+	out->time_ms.resize(count);
+	BitReader time_reader(data + offsets[0], offsets[1] - offsets[0]);
+	if (!decodeTimes(time_reader, count, header.first_time_ms, out->time_ms.data()))
+		return false;
+
+	for (int i = 0; i < channels; i++) {
+		if (i < 64 && !(channelMask & (1ull << i))) {
+			out->channels[i].clear();
+			continue;
+		}
+		out->channels[i].resize(count);
+		BitReader reader(data + offsets[i + 1], offsets[i + 2] - offsets[i + 1]);
+		if (!decodeValues(reader, count, out->channels[i].data()))
+			return false;
+	}
+	for (int i = channels; i < kMaxTrackChannels; i++)
+		out->channels[i].clear();
+	return true;
+}
@@ -0,0 +1,165 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "SimData.h"
+
+// Time-series compression for recorded SimData, after Facebook's Gorilla
+// (Pelkonen et al., VLDB 2015): timestamps are stored as delta-of-delta and
+// each channel as the XOR of consecutive doubles.
+//
+// Samples are grouped into blocks of at most kTrackBlockSamples. Every block
+// starts from raw values, so any block can be decoded without the ones before
+// it, and each channel is a separate bit stream so a reader can decode only
+// the channels it needs.
+
+// One channel per double in SimData, in declaration order.
+constexpr int kTrackChannels = sizeof(SimData) / sizeof(double);
+static_assert(sizeof(SimData) == kTrackChannels * sizeof(double),
+	"SimData must contain only doubles");
+
+// Upper bound on channels in a block, so readers of older or newer files
+// can size fixed arrays. Recordings of SimData use kTrackChannels; files of
+// extra SimVars (see SimVarChannels.h) can have many more.
+constexpr int kMaxTrackChannels = 256;
+constexpr int kTrackBlockSamples = 1024;
+constexpr uint32_t kTrackBlockMagic = 0x4b4c4254;  // "TBLK"
+
+const char* trackChannelName(int channel);
+
+#pragma pack(push, 1)
+struct TrackBlockHeader {
+	uint32_t magic;
+	uint32_t block_bytes;       // including this header
+	uint16_t sample_count;
+	uint16_t channel_count;
+	uint32_t first_channel;     // of the file's channels; 0 but in SimVar files
+	int64_t first_time_ms;
+	int64_t last_time_ms;
+	// Followed by uint32_t stream_offsets[channel_count + 1], measured from
+	// the start of the block: the timestamp stream, then one per channel.
+	// Each stream runs to the next offset, the last one to block_bytes.
+};
+#pragma pack(pop)
+
+// The longest any stream of a block can get, with every value in its
+// longest form: a control prefix, the window and 64 significant bits.
+// Timestamps are shorter still. Encoders reserve this much up front so
+// that blocks of any content do not reallocate.
+constexpr size_t kTrackStreamMaxBytes = (kTrackBlockSamples * (2 + 5 + 6 + 64) + 7) / 8;
+constexpr size_t kTrackBlockMaxBytes = sizeof(TrackBlockHeader) +
+	(kTrackChannels + 1) * (sizeof(uint32_t) + kTrackStreamMaxBytes);
+
+class BitWriter {
+public:
+	void write(uint64_t value, int bits);
+	void writeBit(bool bit) { write(bit ? 1 : 0, 1); }
+
+	// Keeps the buffer's capacity so that a reused writer does not allocate.
+	void clear() { bytes_.clear(); bit_pos_ = 0; }
+	void reserve(size_t bytes) { bytes_.reserve(bytes); }
+	const std::vector<uint8_t>& bytes() const { return bytes_; }
+
+private:
+	std::vector<uint8_t> bytes_;
+	int bit_pos_ = 0;
+};
+
+class BitReader {
+public:
+	BitReader(const uint8_t* data, size_t size) : p_(data), end_(data + size), size_(size) {}
+
+	uint64_t read(int bits);
+	bool readBit() { return read(1) != 0; }
+
+	// True if more bits were read than the stream holds.
+	bool overrun() const { return fed_bytes_ * 8 - avail_ > size_ * 8; }
+
+private:
+	void refill();
+
+	const uint8_t* p_;
+	const uint8_t* end_;
+	const size_t size_;
+	size_t fed_bytes_ = 0;
+	uint64_t buffer_ = 0;
+	int avail_ = 0;
+};
+
+// Accumulates one block. Memory is bounded by one block of compressed data
+// and is reused from block to block.
+class TrackBlockEncoder {
+public:
+	explicit TrackBlockEncoder(int channelCount = kTrackChannels);
+
+	void append(const SimSample& sample);
+	void append(int64_t time_ms, const double* values);
+
+	int sampleCount() const { return count_; }
+	bool empty() const { return count_ == 0; }
+	bool full() const { return count_ == kTrackBlockSamples; }
+
+	// Where this encoder's channels start among the file's, for files
+	// whose blocks each hold some of the channels.
+	void setFirstChannel(uint32_t channel) { first_channel_ = channel; }
+
+	// Appends the encoded block to out and starts a new block.
+	void finish(std::vector<uint8_t>* out);
+
+private:
+	struct ChannelState {
+		BitWriter bits;
+		uint64_t previous = 0;
+		int leading = 0;
+		int trailing = 0;
+		bool has_window = false;
+	};
+
+	void appendTime(int64_t time_ms);
+	void appendValue(ChannelState& channel, double value);
+
+	int channel_count_;
+	uint32_t first_channel_ = 0;
+	int count_ = 0;
+	int64_t first_time_ms_ = 0;
+	int64_t previous_time_ms_ = 0;
+	int64_t previous_delta_ = 0;
+	BitWriter time_bits_;
+	std::vector<ChannelState> channels_;
+};
+
+// A decoded block in columnar form. Decoding into the same TrackColumns
+// repeatedly reuses its buffers.
+struct TrackColumns {
+	int count = 0;
+	int channel_count = 0;
+	int first_channel = 0;
+	std::vector<int64_t> time_ms;
+	std::vector<double> channels[kMaxTrackChannels];
+
+	const double* channel(int index) const { return channels[index].data(); }
+	SimSample sample(int index) const;
+};
+
+// Decodes one block. Channels whose bit is clear in channelMask are skipped
+// and left empty; channels past the 64th are always decoded. Returns false
+// if the block is malformed.
+bool decodeTrackBlock(const uint8_t* data, size_t size, TrackColumns* out,
+	uint64_t channelMask = ~0ull);
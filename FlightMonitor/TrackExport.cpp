@@ -0,0 +1,286 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <string.h>
+
+#include "TrackExport.h"
+
+static const uint64_t kPow10[] = {
+	1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull
+};
+
+bool parseExportFormat(const char* name, ExportFormat* format) {
+	if (_stricmp(name, "gpx") == 0)
+		*format = ExportFormat::Gpx;
+	else if (_stricmp(name, "kml") == 0)
+		*format = ExportFormat::Kml;
+	else if (_stricmp(name, "csv") == 0)
+		*format = ExportFormat::Csv;
+	else
+		return false;
+	return true;
+}
+
+const char* exportFormatExtension(ExportFormat format) {
+	switch (format) {
+	case ExportFormat::Gpx: return ".gpx";
+	case ExportFormat::Kml: return ".kml";
+	case ExportFormat::Csv: return ".csv";
+	}
+	return "";
+}
+
+void ExportStream::flush() {
+	if (length_ == 0)
+		return;
+	if (!failed_ && fwrite(buffer_, 1, length_, file_) != length_)
+		failed_ = true;
+	bytes_written_ += length_;
+	length_ = 0;
+}
+
+void ExportStream::putString(const char* str) {
+	while (*str)
+		put(*str++);
+}
+
+void ExportStream::putEscaped(const char* str) {
+	for (; *str; str++) {
+		switch (*str) {
+		case '<': putString("&lt;"); break;
+		case '>': putString("&gt;"); break;
+		case '&': putString("&amp;"); break;
+		case '"': putString("&quot;"); break;
+		default: put(*str); break;
+		}
+	}
+}
+
+void ExportStream::putDigits(uint64_t value, int minDigits) {
+	char digits[20];
+	int n = 0;
+	do {
+		digits[n++] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value != 0 && n < 20);
+	while (n < minDigits && n < 20)
+		digits[n++] = '0';
+	while (n > 0)
+		put(digits[--n]);
+}
+
+void ExportStream::putInt(int64_t value, int minDigits) {
+	if (value < 0) {
+		put('-');
+		putDigits(0 - static_cast<uint64_t>(value), minDigits);
+	} else {
+		putDigits(static_cast<uint64_t>(value), minDigits);
+	}
+}
+
+void ExportStream::putFixed(double value, int decimals) {
+	if (decimals < 0) decimals = 0;
+	if (decimals > 8) decimals = 8;
+	// Beyond about 9e10 the scaled value no longer fits; nothing exported
+	// comes close, so print it as zero rather than garbage.
+	if (!isfinite(value) || fabs(value) > 9e10) {
+		put('0');
+		return;
+	}
+
+	const uint64_t scale = kPow10[decimals];
+	const uint64_t scaled = static_cast<uint64_t>(llround(fabs(value) * scale));
+	if (value < 0 && scaled != 0)
+		put('-');
+	putDigits(scaled / scale, 1);
+	if (decimals > 0) {
+		put('.');
+		putDigits(scaled % scale, decimals);
+	}
+}
+
+// Days since 1970-01-01 to a proleptic Gregorian date (Howard Hinnant's
+// civil_from_days).
+static void civilFromDays(int64_t days, int* year, int* month, int* day) {
+	days += 719468;
+	const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	const unsigned doe = static_cast<unsigned>(days - era * 146097);
+	const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const unsigned mp = (5 * doy + 2) / 153;
+	const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+	const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+	*year = static_cast<int>(yoe + era * 400 + (m <= 2));
+	*month = static_cast<int>(m);
+	*day = static_cast<int>(d);
+}
+
+void ExportStream::putIsoTime(int64_t timeMs) {
+	constexpr int64_t kMsPerDay = 86400000;
+	int64_t day = timeMs / kMsPerDay;
+	int64_t ms = timeMs % kMsPerDay;
+	if (ms < 0) {
+		ms += kMsPerDay;
+		day--;
+	}
+
+	if (day != cached_day_) {
+		int y, m, d;
+		civilFromDays(day, &y, &m, &d);
+		snprintf(cached_date_, sizeof(cached_date_), "%04d-%02d-%02d", y, m, d);
+		cached_day_ = day;
+	}
+
+	putString(cached_date_);
+	put('T');
+	putDigits(static_cast<uint64_t>(ms / 3600000), 2);
+	put(':');
+	putDigits(static_cast<uint64_t>(ms / 60000 % 60), 2);
+	put(':');
+	putDigits(static_cast<uint64_t>(ms / 1000 % 60), 2);
+	put('.');
+	putDigits(static_cast<uint64_t>(ms % 1000), 3);
+	put('Z');
+}
+
+class GpxExporter : public TrackExporter {
+public:
+	explicit GpxExporter(ExportStream* out) : out_(out) {}
+
+	void begin(const char* name) override {
+		out_->putString(
+			"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			"<gpx version=\"1.1\" creator=\"FlightMonitor\" xmlns=\"http://www.topografix.com/GPX/1/1\">\n"
+			"<trk><name>");
+		out_->putEscaped(name);
+		out_->putString("</name><trkseg>\n");
+	}
+
+	void point(const SimSample& sample) override {
+		out_->putString("<trkpt lat=\"");
+		out_->putFixed(sample.data.gps_lat, 7);
+		out_->putString("\" lon=\"");
+		out_->putFixed(sample.data.gps_lon, 7);
+		out_->putString("\"><ele>");
+		out_->putFixed(sample.data.gps_alt, 1);
+		out_->putString("</ele><time>");
+		out_->putIsoTime(sample.time_ms);
+		out_->putString("</time></trkpt>\n");
+	}
+
+	void end() override {
+		out_->putString("</trkseg></trk>\n</gpx>\n");
+	}
+
+private:
+	ExportStream* out_;
+};
+
+// A single LineString with absolute altitudes; Google Earth draws it as one
+// path and stays responsive with hundreds of thousands of vertices.
+class KmlExporter : public TrackExporter {
+public:
+	explicit KmlExporter(ExportStream* out) : out_(out) {}
+
+	void begin(const char* name) override {
+		out_->putString(
+			"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			"<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+			"<Document><name>");
+		out_->putEscaped(name);
+		out_->putString(
+			"</name>\n"
+			"<Style id=\"track\"><LineStyle><color>ff00aaff</color><width>3</width></LineStyle></Style>\n"
+			"<Placemark><name>");
+		out_->putEscaped(name);
+		out_->putString(
+			"</name><styleUrl>#track</styleUrl>\n"
+			"<LineString><tessellate>1</tessellate><altitudeMode>absolute</altitudeMode><coordinates>\n");
+	}
+
+	void point(const SimSample& sample) override {
+		out_->putFixed(sample.data.gps_lon, 7);
+		out_->put(',');
+		out_->putFixed(sample.data.gps_lat, 7);
+		out_->put(',');
+		out_->putFixed(sample.data.gps_alt, 1);
+		out_->put('\n');
+	}
+
+	void end() override {
+		out_->putString("</coordinates></LineString></Placemark>\n</Document>\n</kml>\n");
+	}
+
+private:
+	ExportStream* out_;
+};
+
+class CsvExporter : public TrackExporter {
+public:
+	explicit CsvExporter(ExportStream* out) : out_(out) {}
+
+	void begin(const char* name) override {
+		out_->putString("time_utc,time_ms,latitude,longitude,altitude_m,track_deg,"
+			"groundspeed_mps,pitch_deg,bank_deg,heading_deg,vertical_speed_mps,g_force,"
+			"alt_agl_m,on_ground\n");
+	}
+
+	void point(const SimSample& sample) override {
+		const SimData& d = sample.data;
+		out_->putIsoTime(sample.time_ms);
+		out_->put(',');
+		out_->putInt(sample.time_ms);
+		out_->put(',');
+		out_->putFixed(d.gps_lat, 7);
+		out_->put(',');
+		out_->putFixed(d.gps_lon, 7);
+		out_->put(',');
+		out_->putFixed(d.gps_alt, 1);
+		out_->put(',');
+		out_->putFixed(d.gps_track, 1);
+		out_->put(',');
+		out_->putFixed(d.gps_groundspeed, 2);
+		out_->put(',');
+		out_->putFixed(d.pitch, 2);
+		out_->put(',');
+		out_->putFixed(d.bank, 2);
+		out_->put(',');
+		out_->putFixed(d.heading, 1);
+		out_->put(',');
+		out_->putFixed(d.vertical_speed, 2);
+		out_->put(',');
+		out_->putFixed(d.g_force, 2);
+		out_->put(',');
+		out_->putFixed(d.alt_agl, 1);
+		out_->put(',');
+		out_->putInt((int64_t)d.on_ground);
+		out_->put('\n');
+	}
+
+	void end() override {}
+
+private:
+	ExportStream* out_;
+};
+
+std::unique_ptr<TrackExporter> makeTrackExporter(ExportFormat format, ExportStream* out) {
+	switch (format) {
+	case ExportFormat::Gpx: return std::make_unique<GpxExporter>(out);
+	case ExportFormat::Kml: return std::make_unique<KmlExporter>(out);
+	case ExportFormat::Csv: return std::make_unique<CsvExporter>(out);
+	}
+	return nullptr;
+}
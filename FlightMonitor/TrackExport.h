@@ -0,0 +1,87 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+
+#include "SimData.h"
+
+// Streaming export of recorded samples to formats other tools read. Samples
+// are written as they arrive through a fixed buffer, so memory does not grow
+// with the length of the flight. Numbers are formatted as scaled integers
+// rather than through printf, which dominates the cost otherwise.
+
+enum class ExportFormat {
+	Gpx,
+	Kml,
+	Csv,
+};
+
+// Parses "gpx", "kml" or "csv". Returns false for anything else.
+bool parseExportFormat(const char* name, ExportFormat* format);
+const char* exportFormatExtension(ExportFormat format);
+
+// A write buffer in front of a FILE*. Write errors are sticky: once a
+// flush() has failed, failed() stays true and later output is dropped.
+// Callers flush() at the end and then check failed().
+class ExportStream {
+public:
+	explicit ExportStream(FILE* file) : file_(file) {}
+	~ExportStream() { flush(); }
+
+	void put(char c) {
+		if (length_ == sizeof(buffer_))
+			flush();
+		buffer_[length_++] = c;
+	}
+	void putString(const char* str);
+	void putEscaped(const char* str);  // XML text
+	void putInt(int64_t value, int minDigits = 1);
+	void putFixed(double value, int decimals);
+
+	// ISO 8601 UTC with milliseconds, e.g. 2020-09-12T17:03:44.100Z.
+	void putIsoTime(int64_t timeMs);
+
+	void flush();
+	bool failed() const { return failed_; }
+	uint64_t bytesWritten() const { return bytes_written_ + length_; }
+
+private:
+	void putDigits(uint64_t value, int minDigits);
+
+	FILE* file_;
+	char buffer_[64 * 1024];
+	size_t length_ = 0;
+	uint64_t bytes_written_ = 0;
+	bool failed_ = false;
+
+	// putIsoTime formats the date part once per day.
+	int64_t cached_day_ = INT64_MIN;
+	char cached_date_[11] = { 0 };
+};
+
+class TrackExporter {
+public:
+	virtual ~TrackExporter() {}
+
+	virtual void begin(const char* name) = 0;
+	virtual void point(const SimSample& sample) = 0;
+	virtual void end() = 0;
+};
+
+std::unique_ptr<TrackExporter> makeTrackExporter(ExportFormat format, ExportStream* out);
@@ -0,0 +1,437 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <memory>
+
+#include "framework.h"
+#include "winfx.h"
+#include "TrackFile.h"
+
+constexpr int kAltChannel = offsetof(SimData, gps_alt) / sizeof(double);
+constexpr int kLatChannel = offsetof(SimData, gps_lat) / sizeof(double);
+constexpr int kLonChannel = offsetof(SimData, gps_lon) / sizeof(double);
+
+std::wstring trackIndexPath(LPCWSTR trackPath) {
+	std::wstring path = trackPath;
+	const size_t slash = path.find_last_of(L"\\/");
+	const size_t dot = path.find_last_of(L'.');
+	if (dot != std::wstring::npos && (slash == std::wstring::npos || dot > slash))
+		path.resize(dot);
+	return path + kTrackIndexExtension;
+}
+
+HRESULT TrackWriter::open(LPCWSTR path, int64_t createdTimeMs, const char* source) {
+	close();
+
+	if (_wfopen_s(&file_, path, L"wb") != 0 || file_ == nullptr) {
+		winfx::DebugOut(L"Could not create track file %s\n", path);
+		file_ = nullptr;
+		return E_FAIL;
+	}
+	// Blocks go out whole and are flushed straight away, so a stream
+	// buffer would only copy them, and be allocated on the first write.
+	setvbuf(file_, nullptr, _IONBF, 0);
+	block_.reserve(kTrackBlockMaxBytes);
+
+	TrackFileHeader header = { 0 };
+	header.magic = kTrackFileMagic;
+	header.version = kTrackFileVersion;
+	header.channel_count = kTrackChannels;
+	header.created_time_ms = createdTimeMs;
+	strncpy_s(header.source, source, _TRUNCATE);
+	if (fwrite(&header, sizeof(header), 1, file_) != 1) {
+		close();
+		return E_FAIL;
+	}
+	fflush(file_);
+	bytes_written_ = sizeof(header);
+
+	// A recording without its index is still a recording, so failing here
+	// only costs readers a walk.
+	const std::wstring indexPath = trackIndexPath(path);
+	if (_wfopen_s(&index_, indexPath.c_str(), L"wb") != 0 || index_ == nullptr) {
+		winfx::DebugOut(L"Could not create track index %s\n", indexPath.c_str());
+		index_ = nullptr;
+		return S_OK;
+	}
+	setvbuf(index_, nullptr, _IONBF, 0);
+	TrackIndexHeader indexHeader = { 0 };
+	indexHeader.magic = kTrackIndexMagic;
+	indexHeader.version = kTrackIndexVersion;
+	indexHeader.entry_bytes = sizeof(TrackIndexEntry);
+	indexHeader.created_time_ms = createdTimeMs;
+	if (fwrite(&indexHeader, sizeof(indexHeader), 1, index_) != 1) {
+		fclose(index_);
+		index_ = nullptr;
+	}
+	return S_OK;
+}
+
+void TrackWriter::append(const SimSample& sample) {
+	if (file_ == nullptr)
+		return;
+	const SimData& data = sample.data;
+	if (encoder_.empty()) {
+		entry_.min_lat = entry_.max_lat = data.gps_lat;
+		entry_.min_lon = entry_.max_lon = data.gps_lon;
+		entry_.min_alt = entry_.max_alt = data.gps_alt;
+	} else {
+		entry_.min_lat = std::min(entry_.min_lat, data.gps_lat);
+		entry_.max_lat = std::max(entry_.max_lat, data.gps_lat);
+		entry_.min_lon = std::min(entry_.min_lon, data.gps_lon);
+		entry_.max_lon = std::max(entry_.max_lon, data.gps_lon);
+		entry_.min_alt = std::min(entry_.min_alt, data.gps_alt);
+		entry_.max_alt = std::max(entry_.max_alt, data.gps_alt);
+	}
+	encoder_.append(sample);
+	if (encoder_.full())
+		writeBlock();
+}
+
+void TrackWriter::writeBlock() {
+	block_.clear();
+	const int count = encoder_.sampleCount();
+	encoder_.finish(&block_);
+	if (block_.empty())
+		return;
+	if (fwrite(block_.data(), block_.size(), 1, file_) != 1) {
+		winfx::DebugOut(L"Error writing track block\n");
+		// Later entries would point past what is there.
+		if (index_ != nullptr) {
+			fclose(index_);
+			index_ = nullptr;
+		}
+	}
+	fflush(file_);
+
+	// The entry goes out after its block, so it never describes a block
+	// that is not on disk.
+	if (index_ != nullptr) {
+		TrackBlockHeader header;
+		memcpy(&header, block_.data(), sizeof(header));
+		entry_.offset = bytes_written_;
+		entry_.block_bytes = (uint32_t)block_.size();
+		entry_.sample_count = (uint16_t)count;
+		entry_.first_time_ms = header.first_time_ms;
+		entry_.last_time_ms = header.last_time_ms;
+		if (fwrite(&entry_, sizeof(entry_), 1, index_) != 1)
+			winfx::DebugOut(L"Error writing track index\n");
+		fflush(index_);
+	}
+	bytes_written_ += block_.size();
+}
+
+void TrackWriter::close() {
+	if (file_ == nullptr)
+		return;
+	writeBlock();
+	fclose(file_);
+	file_ = nullptr;
+	if (index_ != nullptr) {
+		fclose(index_);
+		index_ = nullptr;
+	}
+}
+
+bool TrackQuery::mayMatch(const TrackBlockRef& block) const {
+	if (block.last_time_ms < from_ms || block.first_time_ms > to_ms)
+		return false;
+	if (!block.bounded)
+		return true;
+	if (has_area && (block.max_lat < min_lat || block.min_lat > max_lat ||
+		block.max_lon < min_lon || block.min_lon > max_lon))
+		return false;
+	return block.max_alt >= min_alt && block.min_alt <= max_alt;
+}
+
+bool TrackQuery::matches(int64_t timeMs, double lat, double lon, double alt) const {
+	if (timeMs < from_ms || timeMs > to_ms)
+		return false;
+	if (has_area && (lat < min_lat || lat > max_lat || lon < min_lon || lon > max_lon))
+		return false;
+	return alt >= min_alt && alt <= max_alt;
+}
+
+void trackTimeSlice(const TrackColumns& columns, int64_t fromMs, int64_t toMs, int* begin, int* end) {
+	const int64_t* first = columns.time_ms.data();
+	const int64_t* last = first + columns.count;
+	*begin = (int)(std::lower_bound(first, last, fromMs) - first);
+	*end = (int)(std::upper_bound(first + *begin, last, toMs) - first);
+}
+
+HRESULT TrackReader::open(LPCWSTR path) {
+	HRESULT hr = file_.open(path);
+	if (FAILED(hr))
+		return hr;
+	size_t offset = readHeader(file_.data(), file_.size());
+	if (offset == 0) {
+		file_.close();
+		return E_FAIL;
+	}
+	// Only recordings of SimData have an index; a .fmvar beside one shares
+	// its name.
+	if (header_.names_bytes == 0 && header_.channel_count == kTrackChannels)
+		offset = readIndex(trackIndexPath(path).c_str(), offset);
+	walkBlocks(offset);
+	return S_OK;
+}
+
+bool TrackReader::attach(const uint8_t* data, size_t size) {
+	const size_t offset = readHeader(data, size);
+	if (offset == 0)
+		return false;
+	walkBlocks(offset);
+	return true;
+}
+
+// Starts over on data, reading the header and the channel names. Returns
+// where the blocks start, or 0 if it is not a recording.
+size_t TrackReader::readHeader(const uint8_t* data, size_t size) {
+	blocks_.clear();
+	names_.clear();
+	sample_count_ = 0;
+	indexed_blocks_ = 0;
+	data_ = data;
+	size_ = size;
+
+	if (size < sizeof(header_))
+		return 0;
+	memcpy(&header_, data, sizeof(header_));
+	if (header_.magic != kTrackFileMagic || header_.version > kTrackFileVersion)
+		return 0;
+
+	size_t offset = sizeof(header_);
+	if (header_.names_bytes > size - offset)
+		return 0;
+	const char* names = reinterpret_cast<const char*>(data + offset);
+	const char* const namesEnd = names + header_.names_bytes;
+	while (names < namesEnd) {
+		const char* end = static_cast<const char*>(memchr(names, 0, namesEnd - names));
+		if (end == nullptr)
+			end = namesEnd;
+		names_.emplace_back(names, end);
+		names = end + 1;
+	}
+	offset += header_.names_bytes;
+	return offset;
+}
+
+// Takes the blocks the index at path lists from offset on, and returns
+// where they end. Entries are checked against the file's size, and the
+// first and last blocks' headers against their entries, which catches an
+// index left from another recording without touching the blocks between.
+size_t TrackReader::readIndex(LPCWSTR path, size_t offset) {
+	MappedFile index;
+	if (FAILED(index.open(path)))
+		return offset;
+	TrackIndexHeader header;
+	if (index.size() < sizeof(header))
+		return offset;
+	memcpy(&header, index.data(), sizeof(header));
+	if (header.magic != kTrackIndexMagic || header.version > kTrackIndexVersion ||
+		header.entry_bytes < sizeof(TrackIndexEntry) || header.created_time_ms != header_.created_time_ms)
+		return offset;
+
+	const size_t start = offset;
+	for (size_t at = sizeof(header); at + header.entry_bytes <= index.size(); at += header.entry_bytes) {
+		TrackIndexEntry entry;
+		memcpy(&entry, index.data() + at, sizeof(entry));
+		if (entry.offset != offset || entry.block_bytes < sizeof(TrackBlockHeader) ||
+			entry.block_bytes > size_ - offset)
+			break;
+		TrackBlockRef ref;
+		ref.offset = offset;
+		ref.size = entry.block_bytes;
+		ref.sample_count = entry.sample_count;
+		ref.first_time_ms = entry.first_time_ms;
+		ref.last_time_ms = entry.last_time_ms;
+		ref.bounded = true;
+		ref.min_lat = entry.min_lat;
+		ref.max_lat = entry.max_lat;
+		ref.min_lon = entry.min_lon;
+		ref.max_lon = entry.max_lon;
+		ref.min_alt = entry.min_alt;
+		ref.max_alt = entry.max_alt;
+		blocks_.push_back(ref);
+		sample_count_ += entry.sample_count;
+		offset += entry.block_bytes;
+	}
+
+	auto matches = [this](const TrackBlockRef& ref) {
+		TrackBlockHeader block;
+		memcpy(&block, data_ + ref.offset, sizeof(block));
+		return block.magic == kTrackBlockMagic && block.block_bytes == ref.size &&
+			block.sample_count == ref.sample_count && block.first_time_ms == ref.first_time_ms &&
+			block.last_time_ms == ref.last_time_ms;
+	};
+	if (!blocks_.empty() && (!matches(blocks_.front()) || !matches(blocks_.back()))) {
+		winfx::DebugOut(L"Ignoring track index %s\n", path);
+		blocks_.clear();
+		sample_count_ = 0;
+		return start;
+	}
+	indexed_blocks_ = blocks_.size();
+	return offset;
+}
+
+void TrackReader::walkBlocks(size_t offset) {
+	while (offset + sizeof(TrackBlockHeader) <= size_) {
+		TrackBlockHeader block;
+		memcpy(&block, data_ + offset, sizeof(block));
+		if (block.magic != kTrackBlockMagic || block.block_bytes < sizeof(block) ||
+			block.block_bytes > size_ - offset) {
+			// A partly written final block; everything before it is good.
+			break;
+		}
+		TrackBlockRef ref = { 0 };
+		ref.offset = offset;
+		ref.size = block.block_bytes;
+		ref.sample_count = block.sample_count;
+		ref.first_time_ms = block.first_time_ms;
+		ref.last_time_ms = block.last_time_ms;
+		blocks_.push_back(ref);
+		sample_count_ += block.sample_count;
+		offset += block.block_bytes;
+	}
+
+	time_ordered_ = true;
+	for (size_t i = 1; i < blocks_.size() && time_ordered_; i++)
+		time_ordered_ = blocks_[i].first_time_ms >= blocks_[i - 1].last_time_ms;
+}
+
+bool TrackReader::readBlock(size_t index, TrackColumns* out, uint64_t channelMask) const {
+	if (index >= blocks_.size())
+		return false;
+	const TrackBlockRef& ref = blocks_[index];
+	return decodeTrackBlock(data_ + ref.offset, ref.size, out, channelMask);
+}
+
+size_t TrackReader::seek(int64_t timeMs) const {
+	if (!time_ordered_) {
+		for (size_t i = 0; i < blocks_.size(); i++) {
+			if (blocks_[i].last_time_ms >= timeMs)
+				return i;
+		}
+		return blocks_.size();
+	}
+	auto block = std::lower_bound(blocks_.begin(), blocks_.end(), timeMs,
+		[](const TrackBlockRef& ref, int64_t time) { return ref.last_time_ms < time; });
+	return block - blocks_.begin();
+}
+
+size_t TrackReader::scan(const TrackQuery& query, std::vector<TrackBlockView>* out) {
+	const bool needsBounds = query.has_area || query.min_alt > -DBL_MAX || query.max_alt < DBL_MAX;
+	std::unique_ptr<TrackColumns> columns;
+	size_t ruledOut = 0;
+	for (size_t i = seek(query.from_ms); i < blocks_.size(); i++) {
+		TrackBlockRef& block = blocks_[i];
+		if (block.first_time_ms > query.to_ms) {
+			if (time_ordered_)
+				break;
+			continue;
+		}
+		if (block.last_time_ms < query.from_ms)
+			continue;
+		if (needsBounds && !block.bounded) {
+			if (!columns)
+				columns.reset(new TrackColumns);
+			boundBlock(block, columns.get());
+		}
+		if (!query.mayMatch(block)) {
+			ruledOut++;
+			continue;
+		}
+		TrackBlockView view;
+		view.index = i;
+		view.block = &block;
+		view.data = data_ + block.offset;
+		view.size = block.size;
+		out->push_back(view);
+	}
+	return ruledOut;
+}
+
+void TrackReader::boundBlocks() {
+	std::unique_ptr<TrackColumns> columns;
+	for (TrackBlockRef& block : blocks_) {
+		if (block.bounded)
+			continue;
+		if (!columns)
+			columns.reset(new TrackColumns);
+		boundBlock(block, columns.get());
+	}
+}
+
+bool TrackReader::boundBlock(TrackBlockRef& block, TrackColumns* columns) const {
+	const uint64_t mask = (1ull << kAltChannel) | (1ull << kLatChannel) | (1ull << kLonChannel);
+	if (header_.channel_count != kTrackChannels ||
+		!decodeTrackBlock(data_ + block.offset, block.size, columns, mask) || columns->count == 0)
+		return false;
+	const double* lat = columns->channel(kLatChannel);
+	const double* lon = columns->channel(kLonChannel);
+	const double* alt = columns->channel(kAltChannel);
+	block.min_lat = block.max_lat = lat[0];
+	block.min_lon = block.max_lon = lon[0];
+	block.min_alt = block.max_alt = alt[0];
+	for (int i = 1; i < columns->count; i++) {
+		block.min_lat = std::min(block.min_lat, lat[i]);
+		block.max_lat = std::max(block.max_lat, lat[i]);
+		block.min_lon = std::min(block.min_lon, lon[i]);
+		block.max_lon = std::max(block.max_lon, lon[i]);
+		block.min_alt = std::min(block.min_alt, alt[i]);
+		block.max_alt = std::max(block.max_alt, alt[i]);
+	}
+	block.bounded = true;
+	return true;
+}
+
+HRESULT TrackReader::writeIndex(LPCWSTR path) {
+	if (header_.names_bytes != 0 || header_.channel_count != kTrackChannels)
+		return E_FAIL;
+	boundBlocks();
+
+	FILE* file = nullptr;
+	if (_wfopen_s(&file, path, L"wb") != 0 || file == nullptr)
+		return E_FAIL;
+	TrackIndexHeader header = { 0 };
+	header.magic = kTrackIndexMagic;
+	header.version = kTrackIndexVersion;
+	header.entry_bytes = sizeof(TrackIndexEntry);
+	header.created_time_ms = header_.created_time_ms;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	// Entries must describe the blocks from the first on, so an unreadable
+	// block ends the index.
+	for (size_t i = 0; ok && i < blocks_.size() && blocks_[i].bounded; i++) {
+		const TrackBlockRef& block = blocks_[i];
+		TrackIndexEntry entry = { 0 };
+		entry.offset = block.offset;
+		entry.block_bytes = block.size;
+		entry.sample_count = block.sample_count;
+		entry.first_time_ms = block.first_time_ms;
+		entry.last_time_ms = block.last_time_ms;
+		entry.min_lat = block.min_lat;
+		entry.max_lat = block.max_lat;
+		entry.min_lon = block.min_lon;
+		entry.max_lon = block.max_lon;
+		entry.min_alt = block.min_alt;
+		entry.max_alt = block.max_alt;
+		ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+	}
+	if (fclose(file) != 0)
+		ok = false;
+	return ok ? S_OK : E_FAIL;
+}
@@ -0,0 +1,207 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <float.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "winfx.h"
+#include "SimData.h"
+#include "TrackCodec.h"
+#include "MappedFile.h"
+
+// A recorded flight (.fmtrk): a TrackFileHeader followed by TrackCodec
+// blocks back to back. Blocks are written whole, so a recording cut short by
+// a crash loses at most the block in progress.
+
+constexpr uint32_t kTrackFileMagic = 0x4b52544d;  // "MTRK"
+constexpr uint16_t kTrackFileVersion = 1;
+constexpr wchar_t kTrackFileExtension[] = L".fmtrk";
+
+#pragma pack(push, 1)
+struct TrackFileHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t channel_count;
+	int64_t created_time_ms;
+	char source[32];          // e.g. "MSFS", NUL padded
+	uint32_t names_bytes;     // channel names after the header; 0 for SimData
+	uint8_t reserved[12];
+};
+// With names_bytes, the header is followed by that many bytes of channel
+// names, each NUL terminated, and then the blocks.
+#pragma pack(pop)
+
+// Beside each recording of SimData is a sparse index (.fmidx): a
+// TrackIndexHeader and then an entry per block with its time range and the
+// bounds of its positions, written as each block is. Readers open through
+// it without walking the blocks, and skip the blocks a query rules out
+// without touching them. Blocks the index lacks (older recordings, a crash
+// between a block and its entry) are walked and bounded as before.
+constexpr uint32_t kTrackIndexMagic = 0x5844494d;  // "MIDX"
+constexpr uint16_t kTrackIndexVersion = 1;
+constexpr wchar_t kTrackIndexExtension[] = L".fmidx";
+
+#pragma pack(push, 1)
+struct TrackIndexHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entry_bytes;     // sizeof(TrackIndexEntry) when written
+	int64_t created_time_ms;  // as in the recording's header
+	uint8_t reserved[16];
+};
+
+struct TrackIndexEntry {
+	uint64_t offset;          // of the block in the recording
+	uint32_t block_bytes;
+	uint16_t sample_count;
+	uint16_t reserved;
+	int64_t first_time_ms;
+	int64_t last_time_ms;
+	double min_lat, max_lat;
+	double min_lon, max_lon;
+	double min_alt, max_alt;
+};
+#pragma pack(pop)
+
+// The index beside the recording at trackPath.
+std::wstring trackIndexPath(LPCWSTR trackPath);
+
+class TrackWriter {
+public:
+	~TrackWriter() { close(); }
+
+	HRESULT open(LPCWSTR path, int64_t createdTimeMs, const char* source = "MSFS");
+	void append(const SimSample& sample);
+	void close();
+
+	bool isOpen() const { return file_ != nullptr; }
+	uint64_t bytesWritten() const { return bytes_written_; }
+
+private:
+	void writeBlock();
+
+	FILE* file_ = nullptr;
+	FILE* index_ = nullptr;
+	uint64_t bytes_written_ = 0;
+	TrackBlockEncoder encoder_;
+	TrackIndexEntry entry_ = { 0 };
+	std::vector<uint8_t> block_;
+};
+
+struct TrackBlockRef {
+	size_t offset;
+	uint32_t size;
+	uint16_t sample_count;
+	int64_t first_time_ms;
+	int64_t last_time_ms;
+	// Of the block's positions, once bounded is set.
+	bool bounded;
+	double min_lat, max_lat;
+	double min_lon, max_lon;
+	double min_alt, max_alt;
+};
+
+// What a range scan wants: a time window and, optionally, an area and a
+// band of altitudes. Longitudes do not wrap.
+struct TrackQuery {
+	int64_t from_ms = INT64_MIN;
+	int64_t to_ms = INT64_MAX;
+	bool has_area = false;
+	double min_lat = 0, max_lat = 0;
+	double min_lon = 0, max_lon = 0;
+	double min_alt = -DBL_MAX;
+	double max_alt = DBL_MAX;
+
+	// False when no sample of block can match.
+	bool mayMatch(const TrackBlockRef& block) const;
+	bool matches(int64_t timeMs, double lat, double lon, double alt) const;
+};
+
+// A block a scan selected: its bytes, still compressed, where they lie in
+// the mapped recording. Valid while the reader is open.
+struct TrackBlockView {
+	size_t index;
+	const TrackBlockRef* block;
+	const uint8_t* data;
+	size_t size;
+
+	bool decode(TrackColumns* out, uint64_t channelMask = ~0ull) const {
+		return decodeTrackBlock(data, size, out, channelMask);
+	}
+};
+
+// The samples of a decoded block from fromMs to toMs: [*begin, *end).
+void trackTimeSlice(const TrackColumns& columns, int64_t fromMs, int64_t toMs, int* begin, int* end);
+
+// Reads a recording through a memory mapping, or from memory the caller
+// already has. Opening reads the index, or else walks the block headers;
+// blocks are decoded on demand, in any order.
+class TrackReader {
+public:
+	HRESULT open(LPCWSTR path);
+	bool attach(const uint8_t* data, size_t size);
+
+	const TrackFileHeader& header() const { return header_; }
+	// Empty unless the file names its channels.
+	const std::vector<std::string>& channelNames() const { return names_; }
+	size_t blockCount() const { return blocks_.size(); }
+	const TrackBlockRef& block(size_t index) const { return blocks_[index]; }
+	uint64_t sampleCount() const { return sample_count_; }
+	size_t fileSize() const { return size_; }
+
+	bool readBlock(size_t index, TrackColumns* out, uint64_t channelMask = ~0ull) const;
+
+	// Blocks the index covered when the reader opened.
+	size_t indexedBlockCount() const { return indexed_blocks_; }
+
+	// The first block that ends at or after timeMs: the one holding it, or
+	// the next after a gap; blockCount() if there is none. A binary search
+	// unless the clock went backwards during the recording.
+	size_t seek(int64_t timeMs) const;
+
+	// Appends the blocks query may match to out, in order. Blocks outside
+	// its time window are never visited, and of those in it the index's
+	// bounds rule out the rest without touching their data; blocks without
+	// bounds are decoded once to get them. Returns the blocks ruled out.
+	size_t scan(const TrackQuery& query, std::vector<TrackBlockView>* out);
+
+	// Works out the bounds of the blocks the index lacked.
+	void boundBlocks();
+
+	// Writes the index for this recording, e.g. for one made before
+	// recordings had them.
+	HRESULT writeIndex(LPCWSTR path);
+
+private:
+	size_t readHeader(const uint8_t* data, size_t size);
+	size_t readIndex(LPCWSTR path, size_t offset);
+	void walkBlocks(size_t offset);
+	bool boundBlock(TrackBlockRef& block, TrackColumns* columns) const;
+
+	MappedFile file_;
+	const uint8_t* data_ = nullptr;
+	size_t size_ = 0;
+	TrackFileHeader header_ = { 0 };
+	std::vector<std::string> names_;
+	std::vector<TrackBlockRef> blocks_;
+	uint64_t sample_count_ = 0;
+	size_t indexed_blocks_ = 0;
+	bool time_ordered_ = true;
+};
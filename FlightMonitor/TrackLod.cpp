@@ -0,0 +1,185 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "TrackLod.h"
+
+static LodBounds pointBounds(const LodPoint& point) {
+	return LodBounds{ point.lat, point.lon, point.lat, point.lon };
+}
+
+static void extendBounds(LodBounds& box, const LodBounds& other) {
+	if (other.min_lat < box.min_lat) box.min_lat = other.min_lat;
+	if (other.min_lon < box.min_lon) box.min_lon = other.min_lon;
+	if (other.max_lat > box.max_lat) box.max_lat = other.max_lat;
+	if (other.max_lon > box.max_lon) box.max_lon = other.max_lon;
+}
+
+void TrackLod::clear() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	points_.clear();
+	for (std::vector<Bucket>& level : levels_)
+		level.clear();
+	depth_ = 0;
+
+	// Reserving keeps the capacity of earlier flights; pages are only
+	// touched as the track reaches them.
+	size_t reserve = static_cast<size_t>(kLodReserveSeconds * kLodSamplesPerSecond);
+	points_.reserve(reserve);
+	for (size_t level = 0; reserve >= 2; level++) {
+		reserve = (reserve + kLodFanout - 1) / kLodFanout;
+		if (level == levels_.size())
+			levels_.emplace_back();
+		levels_[level].reserve(reserve);
+	}
+}
+
+void TrackLod::append(double lat, double lon, double alt) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	LodPoint point;
+	point.lat = lat;
+	point.lon = lon;
+	point.alt = static_cast<float>(alt);
+	point.index = static_cast<uint32_t>(points_.size());
+	points_.push_back(point);
+
+	// Walk up the pyramid. At each level the new sample either starts a
+	// bucket (when the entry below it was itself new and begins a group) or
+	// widens an existing one.
+	size_t below = point.index;
+	bool created = true;
+	for (size_t level = 0; ; level++) {
+		if (level == depth_) {
+			// The top level gets a parent once it has two entries. That
+			// parent is the only bucket of the new top level.
+			const size_t belowCount = (level == 0) ? points_.size() : levels_[level - 1].size();
+			if (belowCount < 2)
+				return;
+			Bucket top;
+			if (level == 0) {
+				top.box = pointBounds(points_[0]);
+				extendBounds(top.box, pointBounds(points_[1]));
+				top.min_alt = std::min(points_[0].alt, points_[1].alt);
+				top.max_alt = std::max(points_[0].alt, points_[1].alt);
+				top.representative = 1;
+			} else {
+				const Bucket& a = levels_[level - 1][0];
+				const Bucket& b = levels_[level - 1][1];
+				top.box = a.box;
+				extendBounds(top.box, b.box);
+				top.min_alt = std::min(a.min_alt, b.min_alt);
+				top.max_alt = std::max(a.max_alt, b.max_alt);
+				top.representative = b.representative;
+			}
+			top.count = 2;
+			if (depth_ == levels_.size())
+				levels_.emplace_back();
+			levels_[depth_++].push_back(top);
+			return;
+		}
+
+		std::vector<Bucket>& buckets = levels_[level];
+		if (created && below % kLodFanout == 0) {
+			Bucket bucket;
+			bucket.box = pointBounds(point);
+			bucket.min_alt = point.alt;
+			bucket.max_alt = point.alt;
+			bucket.representative = point.index;
+			bucket.count = 1;
+			buckets.push_back(bucket);
+		} else {
+			Bucket& bucket = buckets[below / kLodFanout];
+			extendBounds(bucket.box, pointBounds(point));
+			if (point.alt < bucket.min_alt) bucket.min_alt = point.alt;
+			if (point.alt > bucket.max_alt) bucket.max_alt = point.alt;
+			if (created) {
+				// The second child's representative sits near the middle.
+				if (++bucket.count == 2)
+					bucket.representative = point.index;
+			}
+			created = false;
+		}
+		below /= kLodFanout;
+	}
+}
+
+size_t TrackLod::query(const LodBounds& viewport, double resolution, std::vector<LodPoint>* out) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	const size_t start = out->size();
+	if (depth_ == 0) {
+		out->insert(out->end(), points_.begin(), points_.end());
+	} else {
+		const size_t top = depth_;
+		for (size_t i = 0; i < levels_[top - 1].size(); i++)
+			queryBucket(top, i, viewport, resolution, out);
+	}
+	return out->size() - start;
+}
+
+// level counts from 1; levels_[level - 1] holds its buckets.
+void TrackLod::queryBucket(size_t level, size_t index, const LodBounds& viewport, double resolution,
+	std::vector<LodPoint>* out) const {
+	const Bucket& bucket = levels_[level - 1][index];
+	const bool small = (bucket.box.max_lat - bucket.box.min_lat) <= resolution &&
+		(bucket.box.max_lon - bucket.box.min_lon) <= resolution;
+	if (small || !bucket.box.intersects(viewport)) {
+		out->push_back(points_[bucket.representative]);
+		return;
+	}
+
+	const size_t first = index * kLodFanout;
+	if (level == 1) {
+		const size_t last = std::min(first + kLodFanout, points_.size());
+		for (size_t i = first; i < last; i++)
+			out->push_back(points_[i]);
+	} else {
+		const size_t last = std::min(first + kLodFanout, levels_[level - 2].size());
+		for (size_t i = first; i < last; i++)
+			queryBucket(level - 1, i, viewport, resolution, out);
+	}
+}
+
+size_t TrackLod::pointsSince(uint32_t index, std::vector<LodPoint>* out) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (index >= points_.size())
+		return 0;
+	out->insert(out->end(), points_.begin() + index, points_.end());
+	return points_.size() - index;
+}
+
+bool TrackLod::bounds(LodBounds* bounds) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (points_.empty())
+		return false;
+	if (depth_ == 0) {
+		*bounds = pointBounds(points_[0]);
+		return true;
+	}
+	*bounds = levels_[depth_ - 1][0].box;
+	return true;
+}
+
+size_t TrackLod::sampleCount() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return points_.size();
+}
+
+size_t TrackLod::memoryBytes() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	size_t bytes = points_.size() * sizeof(LodPoint);
+	for (size_t level = 0; level < depth_; level++)
+		bytes += levels_[level].size() * sizeof(Bucket);
+	return bytes;
+}
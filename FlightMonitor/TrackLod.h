@@ -0,0 +1,102 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+// Samples per second kept at the base of the pyramid.
+constexpr double kLodSamplesPerSecond = 10;
+
+// Children per bucket at each level above the base.
+constexpr int kLodFanout = 4;
+
+// Room reserved at the start of each flight, so appending does not touch
+// the heap for the first this many seconds. Longer flights grow as usual.
+constexpr double kLodReserveSeconds = 4 * 3600;
+
+struct LodPoint {
+	double lat;
+	double lon;
+	float alt;
+	uint32_t index;  // sample number within the flight
+};
+
+struct LodBounds {
+	double min_lat;
+	double min_lon;
+	double max_lat;
+	double max_lon;
+
+	bool intersects(const LodBounds& other) const {
+		return min_lat <= other.max_lat && max_lat >= other.min_lat &&
+			min_lon <= other.max_lon && max_lon >= other.min_lon;
+	}
+};
+
+// A level-of-detail pyramid over the current flight's track, so drawing or
+// querying any part of it costs in proportion to what is returned rather
+// than to the length of the flight.
+//
+// Level 0 holds the samples. Each bucket of level k + 1 covers kLodFanout
+// consecutive entries of level k and stores their bounding box, altitude
+// range and a representative sample. Appending a sample updates one bucket
+// per level, and the levels above the base add up to a third of a bucket
+// per sample, well under the size of the base itself.
+//
+// Only the standard library, so it builds anywhere; TrackLodSink feeds it
+// from the SinkScheduler's worker thread. Queries may come from any thread.
+class TrackLod {
+public:
+	void append(double lat, double lon, double alt);
+	void clear();
+
+	// Appends to out, in flight order, the track within viewport drawn at
+	// resolution degrees per pixel: wherever a bucket fits within a pixel
+	// only its representative is returned. Buckets outside the viewport
+	// contribute their representative, so lines leaving and re-entering
+	// the viewport are still drawn. Returns the number of points added.
+	size_t query(const LodBounds& viewport, double resolution, std::vector<LodPoint>* out) const;
+
+	// Appends the samples from index on, at full resolution. Lets a
+	// display that has drawn the track so far add only what is new.
+	size_t pointsSince(uint32_t index, std::vector<LodPoint>* out) const;
+
+	// Bounds of the whole flight. False if there are no samples.
+	bool bounds(LodBounds* bounds) const;
+
+	size_t sampleCount() const;
+	size_t memoryBytes() const;
+
+private:
+	struct Bucket {
+		LodBounds box;
+		float min_alt;
+		float max_alt;
+		uint32_t representative;  // index into level 0
+		uint32_t count;           // children so far
+	};
+
+	void queryBucket(size_t level, size_t index, const LodBounds& viewport, double resolution,
+		std::vector<LodPoint>* out) const;
+
+	mutable std::mutex mutex_;
+	std::vector<LodPoint> points_;
+	std::vector<std::vector<Bucket>> levels_;  // levels_[0] is level 1
+	size_t depth_ = 0;                         // levels_ in use; the rest are spare
+};
@@ -0,0 +1,29 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "TrackLodSink.h"
+
+void TrackLodSink::onSample(const SimSample& sample) {
+	if (in_flight_)
+		track_->append(sample.data.gps_lat, sample.data.gps_lon, sample.data.gps_alt);
+}
+
+void TrackLodSink::onStateChange(SimulatorInterfaceState state) {
+	// Each flight starts a new track.
+	const bool inFlight = (state == SimInterfaceInFlight);
+	if (inFlight && !in_flight_)
+		track_->clear();
+	in_flight_ = inFlight;
+}
@@ -0,0 +1,37 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "OutputSink.h"
+#include "TrackLod.h"
+
+// Feeds a TrackLod the current flight's positions from the SinkScheduler,
+// starting a new track each time the simulator goes into flight.
+class TrackLodSink : public OutputSink {
+public:
+	explicit TrackLodSink(TrackLod* track) : track_(track) {}
+
+	const char* sinkName() const override { return "TrackLod"; }
+	double sinkRate() const override { return kLodSamplesPerSecond; }
+	unsigned sinkFields() const override { return kSimFieldPosition; }
+
+	void onSample(const SimSample& sample) override;
+	void onStateChange(SimulatorInterfaceState state) override;
+
+private:
+	TrackLod* const track_;
+	bool in_flight_ = false;
+};
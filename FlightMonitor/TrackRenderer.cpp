@@ -0,0 +1,404 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <algorithm>
+
+#include "TrackRenderer.h"
+
+constexpr double kPi = 3.14159265358979323846;
+
+constexpr FbColor kBackgroundColor = fbRgb(255, 255, 255);
+constexpr FbColor kMapColor = fbRgb(232, 238, 244);
+constexpr FbColor kMapBorderColor = fbRgb(160, 168, 176);
+constexpr FbColor kTrackColor = fbRgb(200, 40, 160);
+constexpr FbColor kMarkerColor = fbRgb(0, 0, 0);
+constexpr FbColor kSkyColor = fbRgb(60, 140, 220);
+constexpr FbColor kGroundColor = fbRgb(140, 95, 50);
+constexpr FbColor kHorizonColor = fbRgb(255, 255, 255);
+constexpr FbColor kSymbolColor = fbRgb(255, 200, 0);
+constexpr FbColor kInstrumentColor = fbRgb(40, 40, 40);
+
+constexpr int kMargin = 10;
+// Wide enough for "GPS LON: -122.2683" and "GPS ALT: 12345.67 m".
+constexpr char kTextPanelSizing[] = "GPS ALT: 12345.67 m";
+constexpr int kMarkerSize = 7;
+
+// The view is refitted once the track comes within this fraction of its
+// edge, and then with this much room on every side, so that a growing
+// track is not rescaled on every sample.
+constexpr double kViewEdgeFraction = 0.05;
+constexpr double kViewMarginFraction = 0.25;
+
+// Smallest view, in degrees of latitude, so a parked aircraft is not
+// drawn at absurd magnification.
+constexpr double kMinViewDegrees = 0.02;
+
+// Pitch scale of the attitude indicator: its radius covers this many
+// degrees.
+constexpr double kAttitudeDegreesPerRadius = 30;
+
+// Changes below these are not redrawn.
+constexpr double kAttitudeRedrawDegrees = 0.2;
+
+void TrackRenderer::resize(int width, int height) {
+	if (width == frame_.width() && height == frame_.height())
+		return;
+	frame_.resize(width, height);
+	map_layer_.resize(width, height);
+	layout();
+	full_redraw_ = true;
+}
+
+void TrackRenderer::layout() {
+	const int width = frame_.width();
+	const int height = frame_.height();
+	text_scale_ = height >= 240 ? 2 : 1;
+	const int lineHeight = Framebuffer::lineHeight(text_scale_);
+
+	status_rect_ = FbRect(kMargin, kMargin, width - kMargin, kMargin + lineHeight);
+	const int top = status_rect_.bottom + kMargin;
+	const int textWidth = Framebuffer::textWidth(kTextPanelSizing, text_scale_);
+	text_rect_ = FbRect(kMargin, top, std::min(kMargin + textWidth, width), height - kMargin);
+
+	// The right column holds the map above the attitude indicator.
+	const int left = text_rect_.right + kMargin;
+	const int columnWidth = width - kMargin - left;
+	const int attitudeSize = std::max(0, std::min(columnWidth, (height - top - kMargin) / 2));
+	attitude_rect_ = FbRect(left + (columnWidth - attitudeSize) / 2, height - kMargin - attitudeSize,
+		left + (columnWidth + attitudeSize) / 2, height - kMargin);
+	map_rect_ = FbRect(left, top, width - kMargin, attitude_rect_.top - kMargin);
+}
+
+void TrackRenderer::setText(int line, const char* text, FbColor color) {
+	if (line < 0 || line >= kRenderTextLines)
+		return;
+	TextLine& l = lines_[line];
+	if (l.text == text && l.color == color)
+		return;
+	l.text = text;
+	l.color = color;
+	l.dirty = true;
+}
+
+void TrackRenderer::setAircraft(const SimData* data) {
+	has_aircraft_ = data != nullptr;
+	if (data)
+		aircraft_ = *data;
+}
+
+void TrackRenderer::addDirty(const FbRect& rect) {
+	const FbRect r = rect.intersect(frame_.bounds());
+	if (r.empty())
+		return;
+	// A handful of regions at most: merge into any that overlaps.
+	for (FbRect& d : dirty_) {
+		if (!d.intersect(r.inflate(1)).empty()) {
+			d = d.unite(r);
+			return;
+		}
+	}
+	dirty_.push_back(r);
+}
+
+const std::vector<FbRect>& TrackRenderer::update() {
+	dirty_.clear();
+	if (frame_.width() == 0 || frame_.height() == 0)
+		return dirty_;
+
+	if (full_redraw_) {
+		frame_.setClip(FbRect());
+		frame_.fillRect(frame_.bounds(), kBackgroundColor);
+		for (TextLine& line : lines_)
+			line.dirty = true;
+		has_view_ = false;
+		attitude_drawn_ = false;
+		marker_rect_ = FbRect();
+		full_redraw_ = false;
+		addDirty(frame_.bounds());
+	}
+
+	for (int i = 0; i < kRenderTextLines; i++) {
+		if (lines_[i].dirty)
+			drawText(i);
+	}
+	updateMap();
+	drawAttitude();
+	frame_.setClip(FbRect());
+	return dirty_;
+}
+
+void TrackRenderer::drawText(int line) {
+	const int lineHeight = Framebuffer::lineHeight(text_scale_);
+	FbRect rect;
+	if (line == 0) {
+		rect = status_rect_;
+	} else {
+		const int y = text_rect_.top + (line - 1) * lineHeight;
+		rect = FbRect(text_rect_.left, y, text_rect_.right, y + lineHeight).intersect(text_rect_);
+	}
+	lines_[line].dirty = false;
+	if (rect.empty())
+		return;
+
+	frame_.setClip(rect);
+	frame_.fillRect(rect, kBackgroundColor);
+	frame_.drawText(rect.left, rect.top, lines_[line].text.c_str(), lines_[line].color, text_scale_);
+	addDirty(rect);
+}
+
+bool TrackRenderer::mapPoint(double lat, double lon, int* x, int* y) const {
+	*x = map_rect_.left + static_cast<int>(lround((lon - view_.min_lon) * pixels_per_deg_lon_));
+	*y = map_rect_.bottom - 1 - static_cast<int>(lround((lat - view_.min_lat) * pixels_per_deg_lat_));
+	return map_rect_.contains(*x, *y);
+}
+
+void TrackRenderer::fitView(const LodBounds& bounds) {
+	const double midLat = (bounds.min_lat + bounds.max_lat) / 2;
+	const double midLon = (bounds.min_lon + bounds.max_lon) / 2;
+	const double lonScale = std::max(cos(midLat * kPi / 180), 0.01);
+
+	// Work in degrees of latitude, so that both axes share a scale.
+	double spanLat = (bounds.max_lat - bounds.min_lat) * (1 + 2 * kViewMarginFraction);
+	double spanLon = (bounds.max_lon - bounds.min_lon) * lonScale * (1 + 2 * kViewMarginFraction);
+	spanLat = std::max(spanLat, kMinViewDegrees);
+	spanLon = std::max(spanLon, kMinViewDegrees);
+
+	const double aspect = static_cast<double>(map_rect_.width()) / std::max(map_rect_.height(), 1);
+	if (spanLon / spanLat > aspect)
+		spanLat = spanLon / aspect;
+	else
+		spanLon = spanLat * aspect;
+
+	pixels_per_deg_lat_ = map_rect_.height() / spanLat;
+	pixels_per_deg_lon_ = pixels_per_deg_lat_ * lonScale;
+	view_.min_lat = midLat - spanLat / 2;
+	view_.max_lat = midLat + spanLat / 2;
+	view_.min_lon = midLon - spanLon / lonScale / 2;
+	view_.max_lon = midLon + spanLon / lonScale / 2;
+	has_view_ = true;
+}
+
+void TrackRenderer::updateMap() {
+	if (map_rect_.empty())
+		return;
+
+	LodBounds bounds;
+	const bool hasTrack = track_ != nullptr && track_->bounds(&bounds);
+	const size_t count = hasTrack ? track_->sampleCount() : 0;
+
+	bool redraw = !has_view_ || count < track_drawn_;
+	if (hasTrack) {
+		const double edgeLat = (view_.max_lat - view_.min_lat) * kViewEdgeFraction;
+		const double edgeLon = (view_.max_lon - view_.min_lon) * kViewEdgeFraction;
+		if (!has_view_ || bounds.min_lat < view_.min_lat + edgeLat || bounds.max_lat > view_.max_lat - edgeLat ||
+			bounds.min_lon < view_.min_lon + edgeLon || bounds.max_lon > view_.max_lon - edgeLon) {
+			fitView(bounds);
+			redraw = true;
+		}
+	}
+
+	if (redraw) {
+		if (!hasTrack) {
+			view_ = LodBounds();
+			has_view_ = true;
+		}
+		redrawTrack();
+	} else if (count > track_drawn_) {
+		appendTrack();
+	}
+	updateMarker(redraw);
+}
+
+void TrackRenderer::redrawTrack() {
+	map_layer_.setClip(map_rect_);
+	map_layer_.fillRect(map_rect_, kMapColor);
+	const FbRect inner = map_rect_.inflate(-1);
+
+	points_.clear();
+	track_drawn_ = 0;
+	if (track_ != nullptr && pixels_per_deg_lat_ > 0) {
+		track_->query(view_, 1 / pixels_per_deg_lat_, &points_);
+		map_layer_.setClip(inner);
+		int px = 0, py = 0;
+		for (size_t i = 0; i < points_.size(); i++) {
+			int x, y;
+			mapPoint(points_[i].lat, points_[i].lon, &x, &y);
+			if (i > 0)
+				map_layer_.drawLine(px, py, x, y, kTrackColor);
+			px = x;
+			py = y;
+		}
+		if (!points_.empty()) {
+			last_drawn_ = points_.back();
+			track_drawn_ = last_drawn_.index + 1;
+		}
+	}
+
+	map_layer_.setClip(map_rect_);
+	const FbRect& r = map_rect_;
+	map_layer_.drawLine(r.left, r.top, r.right - 1, r.top, kMapBorderColor);
+	map_layer_.drawLine(r.left, r.bottom - 1, r.right - 1, r.bottom - 1, kMapBorderColor);
+	map_layer_.drawLine(r.left, r.top, r.left, r.bottom - 1, kMapBorderColor);
+	map_layer_.drawLine(r.right - 1, r.top, r.right - 1, r.bottom - 1, kMapBorderColor);
+
+	frame_.copyFrom(map_layer_, map_rect_);
+	addDirty(map_rect_);
+}
+
+void TrackRenderer::appendTrack() {
+	points_.clear();
+	track_->pointsSince(static_cast<uint32_t>(track_drawn_), &points_);
+	if (points_.empty())
+		return;
+
+	map_layer_.setClip(map_rect_.inflate(-1));
+	int px, py;
+	mapPoint(last_drawn_.lat, last_drawn_.lon, &px, &py);
+	FbRect changed(px, py, px + 1, py + 1);
+	for (const LodPoint& point : points_) {
+		int x, y;
+		mapPoint(point.lat, point.lon, &x, &y);
+		map_layer_.drawLine(px, py, x, y, kTrackColor);
+		changed = changed.unite(FbRect(x, y, x + 1, y + 1));
+		px = x;
+		py = y;
+	}
+	last_drawn_ = points_.back();
+	track_drawn_ = last_drawn_.index + 1;
+
+	changed = changed.intersect(map_rect_);
+	frame_.copyFrom(map_layer_, changed);
+	addDirty(changed);
+	// The copy may have painted over part of the marker.
+	if (!changed.intersect(marker_rect_).empty())
+		updateMarker(true);
+}
+
+void TrackRenderer::updateMarker(bool force) {
+	int x = INT32_MIN, y = INT32_MIN;
+	int heading = 0;
+	if (has_aircraft_ && has_view_ && pixels_per_deg_lat_ > 0) {
+		if (!mapPoint(aircraft_.gps_lat, aircraft_.gps_lon, &x, &y))
+			x = y = INT32_MIN;
+		heading = static_cast<int>(lround(aircraft_.heading)) % 360;
+	}
+	if (!force && x == marker_x_ && y == marker_y_ && heading == marker_heading_)
+		return;
+
+	// Restore what was under the old marker.
+	if (!marker_rect_.empty()) {
+		frame_.copyFrom(map_layer_, marker_rect_);
+		addDirty(marker_rect_);
+		marker_rect_ = FbRect();
+	}
+	marker_x_ = x;
+	marker_y_ = y;
+	marker_heading_ = heading;
+	if (x == INT32_MIN)
+		return;
+
+	// An arrowhead pointing along the heading.
+	const double h = heading * kPi / 180;
+	const double s = sin(h), c = cos(h);
+	auto rotate = [&](double fx, double fy, int* ox, int* oy) {
+		*ox = x + static_cast<int>(lround(fx * c - fy * s));
+		*oy = y + static_cast<int>(lround(fx * s + fy * c));
+	};
+	int x0, y0, x1, y1, x2, y2;
+	rotate(0, -kMarkerSize, &x0, &y0);
+	rotate(-kMarkerSize * 0.6, kMarkerSize * 0.7, &x1, &y1);
+	rotate(kMarkerSize * 0.6, kMarkerSize * 0.7, &x2, &y2);
+
+	frame_.setClip(map_rect_.inflate(-1));
+	frame_.fillTriangle(x0, y0, x1, y1, x2, y2, kMarkerColor);
+	marker_rect_ = FbRect(x - kMarkerSize - 1, y - kMarkerSize - 1, x + kMarkerSize + 2, y + kMarkerSize + 2)
+		.intersect(map_rect_);
+	addDirty(marker_rect_);
+}
+
+void TrackRenderer::drawAttitude() {
+	if (attitude_rect_.width() < 8)
+		return;
+
+	// SimConnect pitch is positive nose down; bank is drawn as the
+	// ForeFlight output reports it.
+	const double pitch = has_aircraft_ ? -aircraft_.pitch : 0;
+	const double bank = has_aircraft_ ? aircraft_.bank : 0;
+	if (attitude_drawn_ && attitude_valid_ == has_aircraft_ &&
+		fabs(pitch - attitude_pitch_) < kAttitudeRedrawDegrees &&
+		fabs(bank - attitude_bank_) < kAttitudeRedrawDegrees)
+		return;
+	attitude_drawn_ = true;
+	attitude_valid_ = has_aircraft_;
+	attitude_pitch_ = pitch;
+	attitude_bank_ = bank;
+
+	const FbRect& r = attitude_rect_;
+	const int radius = r.width() / 2 - 1;
+	const int cx = r.left + r.width() / 2;
+	const int cy = r.top + r.height() / 2;
+	frame_.setClip(r);
+	frame_.fillRect(r, kBackgroundColor);
+
+	if (!has_aircraft_) {
+		frame_.fillCircle(cx, cy, radius, kMapColor);
+	} else {
+		// A pixel at (dx, dy) from the center is sky when it lies above
+		// the horizon line, which is rotated by the bank and displaced by
+		// the pitch.
+		const double roll = bank * kPi / 180;
+		const double sr = sin(roll), cr = cos(roll);
+		const double pitchPx = pitch * radius / kAttitudeDegreesPerRadius;
+		for (int dy = -radius; dy <= radius; dy++) {
+			const int y = cy + dy;
+			if (y < r.top || y >= r.bottom)
+				continue;
+			int halfWidth = 0;
+			while ((halfWidth + 1) * (halfWidth + 1) + dy * dy <= radius * radius)
+				halfWidth++;
+			FbColor* row = frame_.row(y);
+			const double base = dy * cr - pitchPx;
+			for (int dx = -halfWidth; dx <= halfWidth; dx++) {
+				const double v = base - dx * sr;
+				row[cx + dx] = v < -0.5 ? kSkyColor : (v > 0.5 ? kGroundColor : kHorizonColor);
+			}
+		}
+
+		// Pitch ladder every 10 degrees.
+		for (int deg = -20; deg <= 20; deg += 10) {
+			if (deg == 0)
+				continue;
+			const double offset = (pitch - deg) * radius / kAttitudeDegreesPerRadius;
+			const double half = radius * (deg % 20 == 0 ? 0.25 : 0.15);
+			// Points along the rung, rotated with the horizon.
+			const double mx = -offset * sr, my = offset * cr;
+			const int xa = cx + static_cast<int>(lround(mx - half * cr));
+			const int ya = cy + static_cast<int>(lround(my - half * sr));
+			const int xb = cx + static_cast<int>(lround(mx + half * cr));
+			const int yb = cy + static_cast<int>(lround(my + half * sr));
+			if ((xa - cx) * (xa - cx) + (ya - cy) * (ya - cy) < radius * radius)
+				frame_.drawLine(xa, ya, xb, yb, kHorizonColor);
+		}
+
+		// The fixed aircraft symbol.
+		const int wing = radius / 2;
+		frame_.fillRect(FbRect(cx - wing, cy - 1, cx - wing / 3, cy + 2), kSymbolColor);
+		frame_.fillRect(FbRect(cx + wing / 3, cy - 1, cx + wing, cy + 2), kSymbolColor);
+		frame_.fillRect(FbRect(cx - 1, cy - 1, cx + 2, cy + 2), kSymbolColor);
+	}
+	frame_.drawCircle(cx, cy, radius, kInstrumentColor);
+	addDirty(r);
+}
@@ -0,0 +1,106 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Framebuffer.h"
+#include "SimData.h"
+#include "TrackLod.h"
+
+constexpr int kRenderTextLines = 20;
+
+// Draws the main window's contents into a Framebuffer: status and value
+// text, a moving map of the current flight and an attitude indicator. It
+// has no Windows dependencies, so it can be run and benchmarked anywhere.
+//
+// update() redraws only what changed since the previous call and reports
+// those regions. The map keeps the track in a layer of its own and appends
+// new samples to it, so the aircraft marker moving over it costs a few
+// hundred pixels rather than a redraw of the track.
+class TrackRenderer {
+public:
+	explicit TrackRenderer(const TrackLod* track) : track_(track) {}
+
+	void resize(int width, int height);
+
+	void setText(int line, const char* text, FbColor color);
+	void clearText(int line) { setText(line, "", 0); }
+	void setAircraft(const SimData* data);  // nullptr when there is none
+
+	// Brings the framebuffer up to date and returns the regions that
+	// changed. The vector is reused by the next call.
+	const std::vector<FbRect>& update();
+
+	// Forces everything to be redrawn by the next update().
+	void invalidate() { full_redraw_ = true; }
+
+	const Framebuffer& framebuffer() const { return frame_; }
+
+private:
+	struct TextLine {
+		std::string text;
+		FbColor color = 0;
+		bool dirty = false;
+	};
+
+	void layout();
+	void drawText(int line);
+	void updateMap();
+	void redrawTrack();
+	void appendTrack();
+	bool mapPoint(double lat, double lon, int* x, int* y) const;
+	void fitView(const LodBounds& bounds);
+	void updateMarker(bool force);
+	void drawAttitude();
+	void addDirty(const FbRect& rect);
+
+	const TrackLod* track_;
+	Framebuffer frame_;
+	Framebuffer map_layer_;
+	std::vector<FbRect> dirty_;
+	bool full_redraw_ = true;
+
+	FbRect status_rect_;
+	FbRect text_rect_;
+	FbRect map_rect_;
+	FbRect attitude_rect_;
+	int text_scale_ = 2;
+	TextLine lines_[kRenderTextLines];
+
+	bool has_aircraft_ = false;
+	SimData aircraft_ = {};
+
+	// Map projection: the view's south-west corner and scale.
+	bool has_view_ = false;
+	LodBounds view_ = {};
+	double pixels_per_deg_lat_ = 0;
+	double pixels_per_deg_lon_ = 0;
+	size_t track_drawn_ = 0;    // samples drawn into map_layer_
+	LodPoint last_drawn_ = {};
+	std::vector<LodPoint> points_;
+
+	FbRect marker_rect_;        // where the marker was last drawn
+	int marker_x_ = INT32_MIN;
+	int marker_y_ = INT32_MIN;
+	int marker_heading_ = 0;
+
+	bool attitude_drawn_ = false;
+	bool attitude_valid_ = false;
+	double attitude_pitch_ = 0;
+	double attitude_bank_ = 0;
+};
@@ -0,0 +1,108 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+
+#include "TrackSimplifier.h"
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kMetersPerDegreeLat = 111320.0;
+
+TrackSimplifier::TrackSimplifier(double horizontalToleranceM, double verticalToleranceM, int window) :
+	horizontal_tolerance_sq_(horizontalToleranceM * horizontalToleranceM),
+	vertical_tolerance_(verticalToleranceM), window_(window > 1 ? window : 1) {
+	buffered_.reserve(window_);
+}
+
+void TrackSimplifier::reset() {
+	has_anchor_ = false;
+	has_last_ = false;
+	buffered_.clear();
+}
+
+TrackSimplifier::Point TrackSimplifier::project(const SimSample& sample) const {
+	// An equirectangular projection around the anchor is plenty accurate
+	// over the few kilometers a window spans.
+	double dlon = sample.data.gps_lon - anchor_.data.gps_lon;
+	if (dlon > 180) dlon -= 360;
+	if (dlon < -180) dlon += 360;
+	Point p;
+	p.x = dlon * meters_per_degree_lon_;
+	p.y = (sample.data.gps_lat - anchor_.data.gps_lat) * kMetersPerDegreeLat;
+	p.alt = sample.data.gps_alt;
+	return p;
+}
+
+bool TrackSimplifier::segmentFits(const Point& end) const {
+	const double lengthSq = end.x * end.x + end.y * end.y;
+	for (const Point& p : buffered_) {
+		double t = 0;
+		if (lengthSq > 0) {
+			t = (p.x * end.x + p.y * end.y) / lengthSq;
+			if (t < 0) t = 0;
+			if (t > 1) t = 1;
+		}
+		const double dx = p.x - t * end.x;
+		const double dy = p.y - t * end.y;
+		if (dx * dx + dy * dy > horizontal_tolerance_sq_)
+			return false;
+		const double alt = anchor_.data.gps_alt + t * (end.alt - anchor_.data.gps_alt);
+		if (fabs(p.alt - alt) > vertical_tolerance_)
+			return false;
+	}
+	return true;
+}
+
+bool TrackSimplifier::push(const SimSample& sample, SimSample* emitted) {
+	if (horizontal_tolerance_sq_ <= 0) {
+		*emitted = sample;
+		return true;
+	}
+
+	if (!has_anchor_) {
+		anchor_ = sample;
+		meters_per_degree_lon_ = kMetersPerDegreeLat * cos(sample.data.gps_lat * kPi / 180);
+		has_anchor_ = true;
+		*emitted = sample;
+		return true;
+	}
+
+	const Point p = project(sample);
+	if (has_last_ && (buffered_.size() >= window_ || !segmentFits(p))) {
+		// The previous sample becomes the new anchor; the current one is
+		// the only point after it so far.
+		anchor_ = last_;
+		meters_per_degree_lon_ = kMetersPerDegreeLat * cos(last_.data.gps_lat * kPi / 180);
+		buffered_.clear();
+		*emitted = last_;
+		last_ = sample;
+		buffered_.push_back(project(sample));
+		return true;
+	}
+
+	last_ = sample;
+	has_last_ = true;
+	buffered_.push_back(p);
+	return false;
+}
+
+bool TrackSimplifier::flush(SimSample* emitted) {
+	if (!has_last_)
+		return false;
+	*emitted = last_;
+	has_last_ = false;
+	buffered_.clear();
+	return true;
+}
@@ -0,0 +1,70 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+
+#include "SimData.h"
+
+// Points held back at most before the simplifier emits one regardless.
+constexpr int kSimplifierWindow = 256;
+
+// Online line simplification for streaming export. A sliding-window variant
+// of Douglas-Peucker: points are buffered after the last emitted point (the
+// anchor) for as long as a straight segment from the anchor to the newest
+// point passes within the tolerance of every buffered point. When it no
+// longer does, the point before the newest becomes the next anchor.
+//
+// Memory and the work per point are bounded by the window, so a flight of
+// any length is simplified in one pass. Compared to the offline algorithm it
+// may keep a few more points but never drops one that deviates further than
+// the tolerance.
+class TrackSimplifier {
+public:
+	// A horizontal tolerance of zero disables simplification.
+	TrackSimplifier(double horizontalToleranceM, double verticalToleranceM,
+		int window = kSimplifierWindow);
+
+	// Feeds the next sample. Returns true and sets *emitted if a sample is
+	// ready to be written.
+	bool push(const SimSample& sample, SimSample* emitted);
+
+	// Emits the final held-back sample, if any.
+	bool flush(SimSample* emitted);
+
+	void reset();
+
+private:
+	struct Point {
+		double x;  // meters east of the anchor
+		double y;  // meters north of the anchor
+		double alt;
+	};
+
+	Point project(const SimSample& sample) const;
+	bool segmentFits(const Point& end) const;
+
+	double horizontal_tolerance_sq_;
+	double vertical_tolerance_;
+	size_t window_;
+
+	bool has_anchor_ = false;
+	SimSample anchor_;
+	double meters_per_degree_lon_ = 0;
+	bool has_last_ = false;
+	SimSample last_;
+	std::vector<Point> buffered_;
+};
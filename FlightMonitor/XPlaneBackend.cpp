@@ -0,0 +1,187 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "winfx.h"
+#include "XPlaneBackend.h"
+#include "SimInterface.h"
+
+// Room for a burst of packets between dispatches.
+constexpr int kXPlaneReceiveBufferBytes = 1 << 20;
+
+XPlaneBackend::XPlaneBackend(const char* xplaneAddress, u_short listenPort) :
+	xplane_address_(xplaneAddress ? xplaneAddress : ""),
+	listen_port_(listenPort ? listenPort : (xplaneAddress && *xplaneAddress ? 0 : kXPlaneDataPort)) {
+}
+
+HRESULT XPlaneBackend::open(HWND hwnd, UINT userMessage, HANDLE event) {
+	close();
+
+	if (!xplane_address_.empty()) {
+		xplane_addr_.sin_family = AF_INET;
+		xplane_addr_.sin_port = htons(kXPlaneCommandPort);
+		if (inet_pton(AF_INET, xplane_address_.c_str(), &xplane_addr_.sin_addr) != 1) {
+			winfx::DebugOut(L"Bad X-Plane address %S\n", xplane_address_.c_str());
+			return E_INVALIDARG;
+		}
+	}
+
+	sock_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock_ == INVALID_SOCKET) {
+		winfx::DebugOut(L"Error %d allocating socket\n", WSAGetLastError());
+		return E_FAIL;
+	}
+	int bufferBytes = kXPlaneReceiveBufferBytes;
+	setsockopt(sock_, SOL_SOCKET, SO_RCVBUF, (const char*)&bufferBytes, sizeof(bufferBytes));
+
+	sockaddr_in local = { 0 };
+	local.sin_family = AF_INET;
+	local.sin_port = htons(listen_port_);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	int length = sizeof(local);
+	if (bind(sock_, (const sockaddr*)&local, sizeof(local)) == SOCKET_ERROR ||
+		getsockname(sock_, (sockaddr*)&local, &length) == SOCKET_ERROR) {
+		winfx::DebugOut(L"Error %d binding X-Plane port %d\n", WSAGetLastError(), listen_port_);
+		close();
+		return E_FAIL;
+	}
+	port_ = ntohs(local.sin_port);
+
+	// Both of these also make the socket non-blocking.
+	int result = 0;
+	if (hwnd != NULL)
+		result = WSAAsyncSelect(sock_, hwnd, userMessage, FD_READ);
+	else if (event != NULL)
+		result = WSAEventSelect(sock_, event, FD_READ);
+	else {
+		u_long nonBlocking = 1;
+		result = ioctlsocket(sock_, FIONBIO, &nonBlocking);
+	}
+	if (result == SOCKET_ERROR) {
+		winfx::DebugOut(L"Error %d selecting X-Plane socket\n", WSAGetLastError());
+		close();
+		return E_FAIL;
+	}
+
+	buffers_.resize(kXPlaneBatchPackets * kXPlaneMaxPacket);
+	if (!xplane_address_.empty()) {
+		if (FAILED(subscribe(kXPlaneRrefFrequency))) {
+			close();
+			return E_FAIL;
+		}
+		last_packet_ms_ = GetTickCount64();
+
+		// Without a window or an event the caller polls dispatch() anyway.
+		hwnd_ = hwnd;
+		user_message_ = userMessage;
+		event_ = event;
+		if ((hwnd != NULL || event != NULL) &&
+			!CreateTimerQueueTimer(&timer_, NULL, wake, this, kXPlaneResubscribeMs, kXPlaneResubscribeMs,
+				WT_EXECUTEDEFAULT)) {
+			winfx::DebugOut(L"Error %d creating X-Plane subscription timer\n", GetLastError());
+			timer_ = NULL;
+			close();
+			return E_FAIL;
+		}
+	}
+	winfx::DebugOut(L"Listening for X-Plane on port %d\n", port_);
+	return S_OK;
+}
+
+HRESULT XPlaneBackend::subscribe(int frequency) {
+	uint8_t request[kXPlaneRrefRequestSize];
+	for (int id = 0; id < kRrefCount; id++) {
+		const size_t size = buildXPlaneRrefRequest(id, frequency, request);
+		if (sendto(sock_, (const char*)request, (int)size, 0, (const sockaddr*)&xplane_addr_,
+			sizeof(xplane_addr_)) == SOCKET_ERROR) {
+			winfx::DebugOut(L"Error %d sending RREF request\n", WSAGetLastError());
+			return E_FAIL;
+		}
+	}
+	last_subscribe_ms_ = GetTickCount64();
+	return S_OK;
+}
+
+// On a timer-queue thread: has dispatch() called as if a packet had come.
+VOID CALLBACK XPlaneBackend::wake(PVOID param, BOOLEAN) {
+	XPlaneBackend* backend = (XPlaneBackend*)param;
+	if (backend->hwnd_ != NULL)
+		PostMessage(backend->hwnd_, backend->user_message_, 0, 0);
+	else
+		SetEvent(backend->event_);
+}
+
+HRESULT XPlaneBackend::dispatch(SimulatorInterface* sim) {
+	if (sock_ == INVALID_SOCKET)
+		return E_FAIL;
+
+	// Take everything waiting, up to a batch, before handing any of it on.
+	int count = 0;
+	while (count < kXPlaneBatchPackets) {
+		char* buffer = (char*)buffers_.data() + count * kXPlaneMaxPacket;
+		const int size = recvfrom(sock_, buffer, (int)kXPlaneMaxPacket, 0, NULL, NULL);
+		if (size == SOCKET_ERROR) {
+			const int err = WSAGetLastError();
+			// ICMP port unreachable from a request X-Plane was not there for.
+			if (err == WSAECONNRESET || err == WSAEMSGSIZE)
+				continue;
+			if (err != WSAEWOULDBLOCK) {
+				winfx::DebugOut(L"Error %d receiving from X-Plane\n", err);
+				return HRESULT_FROM_WIN32(err);
+			}
+			break;
+		}
+		sizes_[count++] = size;
+	}
+
+	// ICMP port unreachable, swallowed above, is all a request sent before
+	// X-Plane was listening gets back, so keep asking while it is quiet.
+	if (!xplane_address_.empty()) {
+		const ULONGLONG now = GetTickCount64();
+		if (count > 0)
+			last_packet_ms_ = now;
+		else if (now - last_packet_ms_ >= kXPlaneResubscribeMs &&
+			now - last_subscribe_ms_ >= kXPlaneResubscribeMs)
+			subscribe(kXPlaneRrefFrequency);
+	}
+
+	// Parsed in place, into the one SimData that carries over between
+	// packets, so a packet with only some groups keeps the others.
+	for (int i = 0; i < count; i++) {
+		const uint8_t* packet = buffers_.data() + i * kXPlaneMaxPacket;
+		const unsigned fields = parseXPlanePacket(packet, sizes_[i], &data_);
+		packets_++;
+		if (fields == 0)
+			ignored_++;
+		else if (fields & kSimFieldPosition)
+			sim->setSimData(&data_);
+	}
+	return S_OK;
+}
+
+void XPlaneBackend::close() {
+	if (sock_ == INVALID_SOCKET)
+		return;
+	if (timer_ != NULL) {
+		// Waits for a callback that is running.
+		DeleteTimerQueueTimer(NULL, timer_, INVALID_HANDLE_VALUE);
+		timer_ = NULL;
+	}
+	if (!xplane_address_.empty())
+		subscribe(0);
+	closesocket(sock_);
+	sock_ = INVALID_SOCKET;
+	port_ = 0;
+}
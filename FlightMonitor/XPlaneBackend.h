@@ -0,0 +1,83 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "winfx.h"
+#include "SimBackend.h"
+#include "SimData.h"
+#include "XPlaneProtocol.h"
+
+// Datagrams read per pass in dispatch(); whatever is left is read on the
+// next pass, since the socket stays signaled.
+constexpr int kXPlaneBatchPackets = 32;
+
+// Subscribed datarefs are sent this many times a second.
+constexpr int kXPlaneRrefFrequency = 30;
+
+// With nothing from X-Plane for this long the subscriptions are sent again,
+// checked on a timer of the same interval.
+constexpr DWORD kXPlaneResubscribeMs = 1500;
+
+// Data from X-Plane over UDP. Given X-Plane's address it subscribes to the
+// datarefs it needs with RREF requests and reads the replies on a port of its
+// own, so nothing has to be set up in X-Plane and several copies can run
+// side by side. Without one it listens on kXPlaneDataPort for the DATA
+// packets X-Plane sends once its Data Output is pointed at this machine.
+//
+// Each packet that carries a position is one sample. There is no goodbye in
+// the protocol, so the session stays connected when X-Plane goes quiet.
+// X-Plane forgets subscriptions when it restarts and never hears ones sent
+// before it started, so while it is quiet a timer wakes dispatch() to send
+// them again.
+class XPlaneBackend : public SimBackend {
+public:
+	explicit XPlaneBackend(const char* xplaneAddress = nullptr, u_short listenPort = 0);
+	~XPlaneBackend() { close(); }
+
+	HRESULT open(HWND hwnd, UINT userMessage, HANDLE event) override;
+	HRESULT dispatch(SimulatorInterface* sim) override;
+	void close() override;
+
+	// The port packets are read from, once open.
+	u_short port() const { return port_; }
+	uint64_t packetsReceived() const { return packets_; }
+	uint64_t packetsIgnored() const { return ignored_; }
+
+private:
+	HRESULT subscribe(int frequency);
+	static VOID CALLBACK wake(PVOID param, BOOLEAN fired);
+
+	std::string xplane_address_;
+	u_short listen_port_;
+	u_short port_ = 0;
+	SOCKET sock_ = INVALID_SOCKET;
+	sockaddr_in xplane_addr_ = { 0 };
+	HWND hwnd_ = NULL;
+	UINT user_message_ = 0;
+	HANDLE event_ = NULL;
+	HANDLE timer_ = NULL;
+	ULONGLONG last_packet_ms_ = 0;
+	ULONGLONG last_subscribe_ms_ = 0;
+	std::vector<uint8_t> buffers_;     // kXPlaneBatchPackets of kXPlaneMaxPacket
+	int sizes_[kXPlaneBatchPackets] = { 0 };
+	SimData data_;
+	uint64_t packets_ = 0;
+	uint64_t ignored_ = 0;
+};
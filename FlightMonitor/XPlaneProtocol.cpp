@@ -0,0 +1,171 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <string.h>
+
+#include "XPlaneProtocol.h"
+
+constexpr double kFeetToMeters = 0.3048;
+constexpr double kKnotsToMps = 0.514444;
+constexpr double kFpmToMps = 0.00508;
+
+// X-Plane's marker for a value that is not being sent.
+constexpr float kXPlaneUnused = -999.0f;
+
+const char* const kXPlaneRrefNames[kRrefCount] = {
+	"sim/flightmodel/position/latitude",
+	"sim/flightmodel/position/longitude",
+	"sim/flightmodel/position/elevation",
+	"sim/flightmodel/position/groundspeed",
+	"sim/flightmodel/position/hpath",
+	"sim/flightmodel/position/theta",
+	"sim/flightmodel/position/phi",
+	"sim/flightmodel/position/psi",
+	"sim/flightmodel/position/vh_ind",
+	"sim/flightmodel2/misc/gforce_normal",
+	"sim/flightmodel/position/y_agl",
+	"sim/flightmodel/failures/onground_any",
+};
+
+static int32_t readInt(const uint8_t* p) {
+	int32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static float readFloat(const uint8_t* p) {
+	float value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static void writeInt(uint8_t* p, int32_t value) {
+	memcpy(p, &value, sizeof(value));
+}
+
+static void writeFloat(uint8_t* p, double value) {
+	const float f = (float)value;
+	memcpy(p, &f, sizeof(f));
+}
+
+static unsigned parseDataGroup(int group, const uint8_t* values, SimData* data) {
+	float v[8];
+	memcpy(v, values, sizeof(v));
+	switch (group) {
+	case kXPlaneGroupSpeeds:
+		data->gps_groundspeed = v[3] * kKnotsToMps;
+		return kSimFieldTrack;
+	case kXPlaneGroupVertical:
+		data->vertical_speed = v[2] * kFpmToMps;
+		data->g_force = v[4];
+		return kSimFieldVertical;
+	case kXPlaneGroupAttitude:
+		data->pitch = -v[0];
+		data->bank = -v[1];
+		data->heading = v[2];
+		return kSimFieldAttitude;
+	case kXPlaneGroupPaths:
+		data->gps_track = v[2];
+		return kSimFieldTrack;
+	case kXPlaneGroupPosition:
+		data->gps_lat = v[0];
+		data->gps_lon = v[1];
+		data->gps_alt = v[2] * kFeetToMeters;
+		data->alt_agl = v[3] * kFeetToMeters;
+		if (v[4] != kXPlaneUnused)
+			data->on_ground = v[4] != 0 ? 1 : 0;
+		return kSimFieldPosition | kSimFieldVertical;
+	default:
+		return 0;
+	}
+}
+
+static unsigned parseRref(int id, float value, SimData* data) {
+	switch (id) {
+	case kRrefLatitude: data->gps_lat = value; return kSimFieldPosition;
+	case kRrefLongitude: data->gps_lon = value; return kSimFieldPosition;
+	case kRrefElevation: data->gps_alt = value; return kSimFieldPosition;
+	case kRrefGroundspeed: data->gps_groundspeed = value; return kSimFieldTrack;
+	case kRrefTrack: data->gps_track = value; return kSimFieldTrack;
+	case kRrefPitch: data->pitch = -value; return kSimFieldAttitude;
+	case kRrefRoll: data->bank = -value; return kSimFieldAttitude;
+	case kRrefHeading: data->heading = value; return kSimFieldAttitude;
+	case kRrefVerticalSpeed: data->vertical_speed = value; return kSimFieldVertical;
+	case kRrefGForce: data->g_force = value; return kSimFieldVertical;
+	case kRrefAgl: data->alt_agl = value; return kSimFieldVertical;
+	case kRrefOnGround: data->on_ground = value != 0 ? 1 : 0; return kSimFieldVertical;
+	default: return 0;
+	}
+}
+
+unsigned parseXPlanePacket(const uint8_t* packet, size_t size, SimData* data) {
+	if (size < 5)
+		return 0;
+	unsigned fields = 0;
+	if (memcmp(packet, "DATA", 4) == 0) {
+		for (size_t offset = 5; offset + 36 <= size; offset += 36)
+			fields |= parseDataGroup(readInt(packet + offset), packet + offset + 4, data);
+	} else if (memcmp(packet, "RREF", 4) == 0) {
+		for (size_t offset = 5; offset + 8 <= size; offset += 8)
+			fields |= parseRref(readInt(packet + offset), readFloat(packet + offset + 4), data);
+	}
+	return fields;
+}
+
+size_t buildXPlaneRrefRequest(int id, int frequency, uint8_t out[kXPlaneRrefRequestSize]) {
+	memset(out, 0, kXPlaneRrefRequestSize);
+	memcpy(out, "RREF", 4);
+	writeInt(out + 5, frequency);
+	writeInt(out + 9, id);
+	memcpy(out + 13, kXPlaneRrefNames[id], strlen(kXPlaneRrefNames[id]));
+	return kXPlaneRrefRequestSize;
+}
+
+size_t encodeXPlaneData(const SimData& data, uint8_t out[kXPlaneDataPacketSize]) {
+	memcpy(out, "DATA", 4);
+	out[4] = '*';
+	uint8_t* p = out + 5;
+	auto group = [&](int index, double v0, double v1, double v2, double v3, double v4) {
+		const double values[8] = { v0, v1, v2, v3, v4, kXPlaneUnused, kXPlaneUnused, kXPlaneUnused };
+		writeInt(p, index);
+		for (int i = 0; i < 8; i++)
+			writeFloat(p + 4 + i * 4, values[i]);
+		p += 36;
+	};
+	group(kXPlaneGroupSpeeds, kXPlaneUnused, kXPlaneUnused, kXPlaneUnused,
+		data.gps_groundspeed / kKnotsToMps, kXPlaneUnused);
+	group(kXPlaneGroupVertical, kXPlaneUnused, kXPlaneUnused, data.vertical_speed / kFpmToMps,
+		kXPlaneUnused, data.g_force);
+	group(kXPlaneGroupAttitude, -data.pitch, -data.bank, data.heading, data.heading, kXPlaneUnused);
+	group(kXPlaneGroupPaths, kXPlaneUnused, kXPlaneUnused, data.gps_track, kXPlaneUnused, kXPlaneUnused);
+	group(kXPlaneGroupPosition, data.gps_lat, data.gps_lon, data.gps_alt / kFeetToMeters,
+		data.alt_agl / kFeetToMeters, data.on_ground);
+	return p - out;
+}
+
+size_t encodeXPlaneRref(const SimData& data, uint8_t out[kXPlaneRrefPacketSize]) {
+	memcpy(out, "RREF", 4);
+	out[4] = ',';
+	const double values[kRrefCount] = {
+		data.gps_lat, data.gps_lon, data.gps_alt, data.gps_groundspeed, data.gps_track,
+		-data.pitch, -data.bank, data.heading, data.vertical_speed, data.g_force, data.alt_agl, data.on_ground,
+	};
+	uint8_t* p = out + 5;
+	for (int id = 0; id < kRrefCount; id++, p += 8) {
+		writeInt(p, id);
+		writeFloat(p + 4, values[id]);
+	}
+	return p - out;
+}
@@ -0,0 +1,85 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SimData.h"
+
+// X-Plane's UDP output, in the two forms it comes in:
+//
+// DATA, what X-Plane sends to the address set under Settings > Data Output:
+// "DATA" and one byte, then for each selected group an int32 group index and
+// eight float32 values, -999 where a value is unused.
+//
+// RREF, what X-Plane sends to whoever asked for particular datarefs: "RREF"
+// and one byte, then for each dataref the int32 id it was requested with and
+// its float32 value. Requests go to X-Plane's command port and replies come
+// back to the port they were sent from.
+//
+// Everything is little-endian. Angles follow X-Plane, pitch up and roll right
+// positive, and are flipped to SimData's, which follows SimConnect.
+
+constexpr uint16_t kXPlaneCommandPort = 49000;
+constexpr uint16_t kXPlaneDataPort = 49003;
+
+// Large enough for any packet X-Plane sends.
+constexpr size_t kXPlaneMaxPacket = 1500;
+
+// DATA groups read, as numbered in X-Plane 11 and 12.
+constexpr int kXPlaneGroupSpeeds = 3;       // [3] groundspeed, knots
+constexpr int kXPlaneGroupVertical = 4;     // [2] vertical speed, fpm; [4] normal load
+constexpr int kXPlaneGroupAttitude = 17;    // [0] pitch, [1] roll, [2] true heading
+constexpr int kXPlaneGroupPaths = 18;       // [2] track (hpath)
+constexpr int kXPlaneGroupPosition = 20;    // [0] lat, [1] lon, [2] ft MSL, [3] ft AGL, [4] on runway
+
+// The datarefs FlightMonitor subscribes to, in RREF id order.
+enum XPlaneRref {
+	kRrefLatitude = 0,
+	kRrefLongitude,
+	kRrefElevation,     // m MSL
+	kRrefGroundspeed,   // m/s
+	kRrefTrack,
+	kRrefPitch,
+	kRrefRoll,
+	kRrefHeading,
+	kRrefVerticalSpeed, // m/s
+	kRrefGForce,
+	kRrefAgl,           // m
+	kRrefOnGround,
+	kRrefCount
+};
+
+extern const char* const kXPlaneRrefNames[kRrefCount];
+
+// The size of a DATA packet from encodeXPlaneData() and an RREF one from
+// encodeXPlaneRref().
+constexpr size_t kXPlaneDataPacketSize = 5 + 5 * 36;
+constexpr size_t kXPlaneRrefPacketSize = 5 + kRrefCount * 8;
+constexpr size_t kXPlaneRrefRequestSize = 413;
+
+// Updates the fields of data that the packet carries, straight from the
+// packet, and returns the SimField groups it carried, or 0 for a packet that
+// is not DATA or RREF. Allocates nothing.
+unsigned parseXPlanePacket(const uint8_t* packet, size_t size, SimData* data);
+
+// Asks X-Plane to send dataref id frequency times a second; 0 stops it.
+size_t buildXPlaneRrefRequest(int id, int frequency, uint8_t out[kXPlaneRrefRequestSize]);
+
+// The packets X-Plane would send for data, for testing without X-Plane.
+size_t encodeXPlaneData(const SimData& data, uint8_t out[kXPlaneDataPacketSize]);
+size_t encodeXPlaneRref(const SimData& data, uint8_t out[kXPlaneRrefPacketSize]);
@@ -61,9 +61,10 @@ public:
 	HINSTANCE getInstance() { return hInst; }
 	DWORD getExitCode() { return dwExitCode; }
 	std::wstring loadString(UINT uID) {
-		wchar_t buffer[1024];
-		LoadStringW(hInst, uID, buffer, 1024);
-		return std::wstring(buffer);
+		// Given no buffer, LoadString points into the resource itself.
+		const wchar_t* text = nullptr;
+		int length = LoadStringW(hInst, uID, reinterpret_cast<LPWSTR>(&text), 0);
+		return length > 0 ? std::wstring(text, length) : std::wstring();
 	}
 
 	virtual bool initInstance(HINSTANCE hInst, HINSTANCE hInstPrev);
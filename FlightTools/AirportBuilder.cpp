@@ -0,0 +1,373 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+
+#include "framework.h"
+#include "AirportBuilder.h"
+#include "Geodesy.h"
+#include "MappedFile.h"
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kFeetPerMeter = 3.28084;
+
+// Latitudes synthetic airports are scattered between.
+constexpr double kSyntheticSouth = -60;
+constexpr double kSyntheticNorth = 70;
+
+// Splits a CSV file into records, following RFC 4180 quoting: quoted fields
+// may hold commas, newlines and doubled quotes.
+class CsvReader {
+public:
+	HRESULT open(LPCWSTR path) {
+		HRESULT hr = file_.open(path);
+		if (FAILED(hr))
+			return hr;
+		p_ = reinterpret_cast<const char*>(file_.data());
+		end_ = p_ + file_.size();
+		// The header names the columns.
+		std::vector<std::string> header;
+		if (!next(&header))
+			return E_FAIL;
+		for (size_t i = 0; i < header.size(); i++)
+			columns_[header[i]] = i;
+		return S_OK;
+	}
+
+	// Column index by header name, or -1.
+	int column(const char* name) const {
+		auto it = columns_.find(name);
+		return it == columns_.end() ? -1 : (int)it->second;
+	}
+
+	bool next(std::vector<std::string>* fields) {
+		fields->clear();
+		if (p_ >= end_)
+			return false;
+		std::string field;
+		bool quoted = false;
+		while (p_ < end_) {
+			const char c = *p_++;
+			if (quoted) {
+				if (c != '"')
+					field += c;
+				else if (p_ < end_ && *p_ == '"')
+					field += *p_++;
+				else
+					quoted = false;
+			} else if (c == '"') {
+				quoted = true;
+			} else if (c == ',') {
+				fields->push_back(field);
+				field.clear();
+			} else if (c == '\n') {
+				break;
+			} else if (c != '\r') {
+				field += c;
+			}
+		}
+		fields->push_back(field);
+		return true;
+	}
+
+private:
+	MappedFile file_;
+	const char* p_ = nullptr;
+	const char* end_ = nullptr;
+	std::unordered_map<std::string, size_t> columns_;
+};
+
+static const std::string& field(const std::vector<std::string>& fields, int column) {
+	static const std::string empty;
+	return column >= 0 && (size_t)column < fields.size() ? fields[column] : empty;
+}
+
+static double number(const std::string& text, double fallback = 0) {
+	return text.empty() ? fallback : atof(text.c_str());
+}
+
+static AirportKind airportKind(const std::string& type) {
+	if (type == "large_airport")
+		return kAirportLarge;
+	if (type == "medium_airport")
+		return kAirportMedium;
+	if (type == "small_airport")
+		return kAirportSmall;
+	if (type == "heliport")
+		return kAirportHeliport;
+	if (type == "seaplane_base")
+		return kAirportSeaplaneBase;
+	return kAirportOther;
+}
+
+static AirportKind navaidKind(const std::string& type) {
+	if (type.compare(0, 3, "VOR") == 0 || type == "TACAN")
+		return kNavaidVor;
+	if (type.compare(0, 3, "NDB") == 0)
+		return kNavaidNdb;
+	if (type == "DME")
+		return kNavaidDme;
+	return kNavaidOther;
+}
+
+static AirportRunwayEnd runwayEnd(const std::string& ident, double heading, double lengthFt) {
+	AirportRunwayEnd end = {};
+	strncpy_s(end.ident, ident.c_str(), _TRUNCATE);
+	heading = fmod(heading, 360);
+	if (heading < 0)
+		heading += 360;
+	end.heading = (uint16_t)lround(heading * 10) % 3600;
+	end.length_m = (uint16_t)std::min(65535.0, lengthFt / kFeetPerMeter);
+	return end;
+}
+
+// The true heading of a runway end: as given, else from its coordinates,
+// else from its number, which is magnetic but better than nothing.
+static bool runwayHeading(const std::string& given, double lat1, double lon1, double lat2, double lon2,
+	bool haveEnds, const std::string& ident, double* heading) {
+	if (!given.empty()) {
+		*heading = atof(given.c_str());
+		return true;
+	}
+	if (haveEnds) {
+		*heading = greatCircleBearing(lat1, lon1, lat2, lon2);
+		return true;
+	}
+	const int number = atoi(ident.c_str());
+	if (number < 1 || number > 36)
+		return false;
+	*heading = number * 10.0;
+	return true;
+}
+
+static void loadRunways(LPCWSTR path, const std::unordered_map<std::string, size_t>& byId,
+	std::vector<AirportSource>* out) {
+	CsvReader csv;
+	if (FAILED(csv.open(path))) {
+		fwprintf(stderr, L"Could not read %s\n", path);
+		return;
+	}
+	const int airportRef = csv.column("airport_ref");
+	const int closed = csv.column("closed");
+	const int length = csv.column("length_ft");
+	const int leIdent = csv.column("le_ident");
+	const int leLat = csv.column("le_latitude_deg");
+	const int leLon = csv.column("le_longitude_deg");
+	const int leHeading = csv.column("le_heading_degT");
+	const int heIdent = csv.column("he_ident");
+	const int heLat = csv.column("he_latitude_deg");
+	const int heLon = csv.column("he_longitude_deg");
+	const int heHeading = csv.column("he_heading_degT");
+
+	std::vector<std::string> f;
+	while (csv.next(&f)) {
+		auto it = byId.find(field(f, airportRef));
+		if (it == byId.end() || field(f, closed) == "1")
+			continue;
+		AirportSource& airport = (*out)[it->second];
+		const double lengthFt = number(field(f, length));
+		const bool haveEnds = !field(f, leLat).empty() && !field(f, heLat).empty();
+		const double lat1 = number(field(f, leLat)), lon1 = number(field(f, leLon));
+		const double lat2 = number(field(f, heLat)), lon2 = number(field(f, heLon));
+
+		double heading;
+		if (!field(f, leIdent).empty() &&
+			runwayHeading(field(f, leHeading), lat1, lon1, lat2, lon2, haveEnds, field(f, leIdent), &heading))
+			airport.runways.push_back(runwayEnd(field(f, leIdent), heading, lengthFt));
+		if (!field(f, heIdent).empty() &&
+			runwayHeading(field(f, heHeading), lat2, lon2, lat1, lon1, haveEnds, field(f, heIdent), &heading))
+			airport.runways.push_back(runwayEnd(field(f, heIdent), heading, lengthFt));
+	}
+}
+
+static void loadNavaids(LPCWSTR path, std::vector<AirportSource>* out) {
+	CsvReader csv;
+	if (FAILED(csv.open(path))) {
+		fwprintf(stderr, L"Could not read %s\n", path);
+		return;
+	}
+	const int ident = csv.column("ident");
+	const int name = csv.column("name");
+	const int type = csv.column("type");
+	const int lat = csv.column("latitude_deg");
+	const int lon = csv.column("longitude_deg");
+	const int elevation = csv.column("elevation_ft");
+
+	std::vector<std::string> f;
+	while (csv.next(&f)) {
+		if (field(f, lat).empty() || field(f, lon).empty())
+			continue;
+		AirportSource navaid;
+		navaid.ident = field(f, ident);
+		navaid.name = field(f, name);
+		navaid.lat = number(field(f, lat));
+		navaid.lon = number(field(f, lon));
+		navaid.elevation_ft = (int)number(field(f, elevation));
+		navaid.kind = navaidKind(field(f, type));
+		out->push_back(navaid);
+	}
+}
+
+bool loadOurAirports(LPCWSTR airports, LPCWSTR runways, LPCWSTR navaids,
+	std::vector<AirportSource>* out) {
+	CsvReader csv;
+	if (FAILED(csv.open(airports))) {
+		fwprintf(stderr, L"Could not read %s\n", airports);
+		return false;
+	}
+	const int id = csv.column("id");
+	const int ident = csv.column("ident");
+	const int type = csv.column("type");
+	const int name = csv.column("name");
+	const int lat = csv.column("latitude_deg");
+	const int lon = csv.column("longitude_deg");
+	const int elevation = csv.column("elevation_ft");
+	if (ident < 0 || lat < 0 || lon < 0) {
+		fwprintf(stderr, L"%s is not an OurAirports airports.csv\n", airports);
+		return false;
+	}
+
+	std::unordered_map<std::string, size_t> byId;
+	std::vector<std::string> f;
+	while (csv.next(&f)) {
+		if (field(f, type) == "closed" || field(f, lat).empty() || field(f, lon).empty())
+			continue;
+		AirportSource airport;
+		airport.ident = field(f, ident);
+		airport.name = field(f, name);
+		airport.lat = number(field(f, lat));
+		airport.lon = number(field(f, lon));
+		airport.elevation_ft = (int)number(field(f, elevation));
+		airport.kind = airportKind(field(f, type));
+		byId[field(f, id)] = out->size();
+		out->push_back(airport);
+	}
+
+	if (runways != nullptr)
+		loadRunways(runways, byId, out);
+	if (navaids != nullptr)
+		loadNavaids(navaids, out);
+	return true;
+}
+
+void generateSyntheticAirports(size_t count, uint32_t seed, std::vector<AirportSource>* out) {
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<double> unit(0, 1);
+	std::uniform_int_distribution<int> letter('A', 'Z');
+	char ident[8];
+	for (size_t i = 0; i < count; i++) {
+		AirportSource airport;
+		// Uniform over the sphere between the two latitudes.
+		const double south = sin(kSyntheticSouth * kPi / 180);
+		const double north = sin(kSyntheticNorth * kPi / 180);
+		airport.lat = asin(south + unit(random) * (north - south)) * 180 / kPi;
+		airport.lon = unit(random) * 360 - 180;
+		snprintf(ident, sizeof(ident), "%c%c%c%c", letter(random), letter(random), letter(random), letter(random));
+		airport.ident = ident;
+		airport.name = airport.ident + " Synthetic";
+		airport.elevation_ft = (int)(unit(random) * 5000);
+		airport.kind = (AirportKind)(random() % (kAirportSeaplaneBase + 1));
+
+		const int runways = 1 + random() % 3;
+		for (int r = 0; r < runways; r++) {
+			const int number = 1 + random() % 18;
+			const double heading = number * 10 + unit(random) * 10 - 5;
+			const double lengthFt = 2000 + unit(random) * 9000;
+			snprintf(ident, sizeof(ident), "%02d", number);
+			airport.runways.push_back(runwayEnd(ident, heading, lengthFt));
+			snprintf(ident, sizeof(ident), "%02d", number + 18);
+			airport.runways.push_back(runwayEnd(ident, heading + 180, lengthFt));
+		}
+		out->push_back(airport);
+	}
+}
+
+struct KdItem {
+	float v[3];
+	uint32_t source;
+};
+
+// Orders items so the middle of every range splits it on the range's axis,
+// exactly as AirportDatabase::search walks it.
+static void kdOrder(std::vector<KdItem>* items, size_t lo, size_t hi, int axis) {
+	while (hi - lo > 1) {
+		const size_t mid = lo + (hi - lo) / 2;
+		std::nth_element(items->begin() + lo, items->begin() + mid, items->begin() + hi,
+			[axis](const KdItem& a, const KdItem& b) { return a.v[axis] < b.v[axis]; });
+		const int next = axis == 2 ? 0 : axis + 1;
+		kdOrder(items, lo, mid, next);
+		lo = mid + 1;
+		axis = next;
+	}
+}
+
+bool writeAirportDatabase(LPCWSTR path, const std::vector<AirportSource>& sources) {
+	std::vector<KdItem> items(sources.size());
+	for (size_t i = 0; i < sources.size(); i++) {
+		airportUnitVector(sources[i].lat, sources[i].lon, items[i].v);
+		items[i].source = (uint32_t)i;
+	}
+	kdOrder(&items, 0, items.size(), 0);
+
+	std::vector<AirportEntry> entries;
+	std::vector<AirportRunwayEnd> runways;
+	std::string strings(1, '\0');  // offset 0 is the empty string
+	entries.reserve(items.size());
+	auto addString = [&strings](const std::string& s) {
+		const uint32_t offset = (uint32_t)strings.size();
+		strings.append(s.c_str(), strlen(s.c_str()) + 1);
+		return offset;
+	};
+	for (const KdItem& item : items) {
+		const AirportSource& source = sources[item.source];
+		AirportEntry e = {};
+		e.x = item.v[0];
+		e.y = item.v[1];
+		e.z = item.v[2];
+		e.lat = (int32_t)lround(source.lat * kAirportPositionScale);
+		e.lon = (int32_t)lround(source.lon * kAirportPositionScale);
+		e.elevation_ft = (int16_t)std::max(-32768, std::min(32767, source.elevation_ft));
+		e.kind = source.kind;
+		e.runway_count = (uint8_t)std::min<size_t>(source.runways.size(), 255);
+		e.first_runway = (uint32_t)runways.size();
+		e.ident = addString(source.ident);
+		e.name = addString(source.name);
+		runways.insert(runways.end(), source.runways.begin(), source.runways.begin() + e.runway_count);
+		entries.push_back(e);
+	}
+
+	AirportFileHeader header = {};
+	header.magic = kAirportFileMagic;
+	header.version = kAirportFileVersion;
+	header.entry_count = (uint32_t)entries.size();
+	header.runway_count = (uint32_t)runways.size();
+	header.strings_bytes = (uint32_t)strings.size();
+
+	FILE* file = nullptr;
+	if (_wfopen_s(&file, path, L"wb") != 0 || file == nullptr)
+		return false;
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	if (!entries.empty())
+		written = written && fwrite(entries.data(), sizeof(AirportEntry), entries.size(), file) == entries.size();
+	if (!runways.empty())
+		written = written && fwrite(runways.data(), sizeof(AirportRunwayEnd), runways.size(), file) == runways.size();
+	written = written && fwrite(strings.data(), strings.size(), 1, file) == 1;
+	return fclose(file) == 0 && written;
+}
@@ -0,0 +1,46 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "AirportDatabase.h"
+
+// One airport or navaid on its way into an AirportDatabase file.
+struct AirportSource {
+	std::string ident;
+	std::string name;
+	double lat = 0;
+	double lon = 0;
+	int elevation_ft = 0;
+	AirportKind kind = kAirportOther;
+	std::vector<AirportRunwayEnd> runways;
+};
+
+// Reads the OurAirports CSV exports (https://ourairports.com/data/).
+// runways and navaids may be null. Closed airports and runways are left out.
+bool loadOurAirports(LPCWSTR airports, LPCWSTR runways, LPCWSTR navaids,
+	std::vector<AirportSource>* out);
+
+// Scatters count airports with runways over the populated latitudes, for
+// benchmarks when the real data is not at hand.
+void generateSyntheticAirports(size_t count, uint32_t seed, std::vector<AirportSource>* out);
+
+// Writes the database, in k-d tree order.
+bool writeAirportDatabase(LPCWSTR path, const std::vector<AirportSource>& sources);
@@ -0,0 +1,176 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+
+#include "framework.h"
+#include "AppPaths.h"
+#include "AirportBuilder.h"
+#include "AirportDatabase.h"
+#include "Commands.h"
+
+// buildairports writes the database FlightMonitor looks in for the nearest
+// airport, from the OurAirports CSV files or a synthetic set. airports
+// times opening and querying a database and checks the k-d search against
+// a linear scan.
+
+constexpr size_t kDefaultNearest = 5;
+constexpr int kBenchQueries = 100000;
+constexpr int kCheckQueries = 1000;
+constexpr uint32_t kSyntheticAirportSeed = 1;
+
+static std::wstring defaultAirportFile() {
+	const std::wstring directory = getAppDataDirectory(L"Navdata");
+	return directory.empty() ? std::wstring() : directory + L"\\" + kAirportFileName;
+}
+
+int buildAirportsCommand(int argc, wchar_t** argv) {
+	LPCWSTR airports = nullptr;
+	LPCWSTR runways = nullptr;
+	LPCWSTR navaids = nullptr;
+	std::wstring out = defaultAirportFile();
+	size_t synthetic = 0;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--runways") == 0 && i + 1 < argc)
+			runways = argv[++i];
+		else if (wcscmp(argv[i], L"--navaids") == 0 && i + 1 < argc)
+			navaids = argv[++i];
+		else if (wcscmp(argv[i], L"--out") == 0 && i + 1 < argc)
+			out = argv[++i];
+		else if (wcscmp(argv[i], L"--synthetic") == 0 && i + 1 < argc)
+			synthetic = (size_t)_wtoi(argv[++i]);
+		else
+			airports = argv[i];
+	}
+	if ((airports == nullptr && synthetic == 0) || out.empty()) {
+		fwprintf(stderr, L"usage: buildairports <airports.csv> [--runways <runways.csv>] [--navaids <navaids.csv>] [--out <file>]\n"
+			L"       buildairports --synthetic <count> [--out <file>]\n");
+		return 2;
+	}
+
+	const double start = toolSeconds();
+	std::vector<AirportSource> sources;
+	if (synthetic > 0)
+		generateSyntheticAirports(synthetic, kSyntheticAirportSeed, &sources);
+	else if (!loadOurAirports(airports, runways, navaids, &sources))
+		return 1;
+	if (!writeAirportDatabase(out.c_str(), sources)) {
+		fwprintf(stderr, L"Could not write %s\n", out.c_str());
+		return 1;
+	}
+
+	size_t runwayEnds = 0;
+	for (const AirportSource& source : sources)
+		runwayEnds += source.runways.size();
+	wprintf(L"%zu entries, %zu runway ends written to %s in %.2f s\n",
+		sources.size(), runwayEnds, out.c_str(), toolSeconds() - start);
+	return 0;
+}
+
+static void printNearest(const AirportDatabase& db, double lat, double lon, size_t k) {
+	std::vector<AirportMatch> matches;
+	db.nearest(lat, lon, k, kAirportKindsAll, &matches);
+	for (const AirportMatch& match : matches) {
+		wprintf(L"%-8S %6.1f km %5.1f  %S\n", db.ident(match.index), match.distance_m / 1000,
+			match.bearing, db.name(match.index));
+		const AirportEntry& e = db.entry(match.index);
+		for (int r = 0; r < e.runway_count; r++) {
+			const AirportRunwayEnd& end = db.runways(match.index)[r];
+			wprintf(L"         runway %-3.3S %5.1f true %5u m\n", end.ident, end.heading / 10.0, end.length_m);
+		}
+	}
+}
+
+// Nearest entries of any kind by looking at every one.
+static void linearNearest(const AirportDatabase& db, double lat, double lon, size_t k,
+	std::vector<std::pair<float, uint32_t>>* out) {
+	float point[3];
+	airportUnitVector(lat, lon, point);
+	out->clear();
+	for (uint32_t i = 0; i < db.size(); i++) {
+		const AirportEntry& e = db.entry(i);
+		const float dx = e.x - point[0], dy = e.y - point[1], dz = e.z - point[2];
+		out->push_back(std::make_pair(dx * dx + dy * dy + dz * dz, i));
+	}
+	k = std::min(k, out->size());
+	std::partial_sort(out->begin(), out->begin() + k, out->end());
+	out->resize(k);
+}
+
+int airportsCommand(int argc, wchar_t** argv) {
+	std::wstring path = defaultAirportFile();
+	bool near = false;
+	double lat = 0, lon = 0;
+	size_t k = kDefaultNearest;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--near") == 0 && i + 2 < argc) {
+			near = true;
+			lat = _wtof(argv[++i]);
+			lon = _wtof(argv[++i]);
+		} else if (wcscmp(argv[i], L"--count") == 0 && i + 1 < argc) {
+			k = std::max(1, _wtoi(argv[++i]));
+		} else {
+			path = argv[i];
+		}
+	}
+
+	AirportDatabase db;
+	const double openStart = toolSeconds();
+	if (FAILED(db.open(path.c_str()))) {
+		fwprintf(stderr, L"Could not open %s\n", path.c_str());
+		return 1;
+	}
+	std::vector<AirportMatch> matches;
+	db.nearest(0, 0, k, kAirportKindsAll, &matches);
+	wprintf(L"%zu entries, open and first query %.2f ms\n", db.size(), (toolSeconds() - openStart) * 1000);
+
+	if (near) {
+		printNearest(db, lat, lon, k);
+		return 0;
+	}
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> latitude(-60, 70);
+	std::uniform_real_distribution<double> longitude(-180, 180);
+
+	const double start = toolSeconds();
+	double checksum = 0;
+	for (int i = 0; i < kBenchQueries; i++) {
+		db.nearest(latitude(random), longitude(random), k, kAirportKindsAll, &matches);
+		checksum += matches.empty() ? 0 : matches[0].distance_m;
+	}
+	const double seconds = toolSeconds() - start;
+	wprintf(L"%d queries for %zu nearest, %.2f us/query\n", kBenchQueries, k, seconds / kBenchQueries * 1e6);
+
+	int mismatches = 0;
+	std::vector<std::pair<float, uint32_t>> expected;
+	for (int i = 0; i < kCheckQueries; i++) {
+		const double qlat = latitude(random), qlon = longitude(random);
+		db.nearest(qlat, qlon, k, kAirportKindsAll, &matches);
+		linearNearest(db, qlat, qlon, k, &expected);
+		bool same = matches.size() == expected.size();
+		for (size_t j = 0; same && j < matches.size(); j++) {
+			// Equally distant entries may come in either order.
+			const AirportEntry& found = db.entry(matches[j].index);
+			const AirportEntry& wanted = db.entry(expected[j].second);
+			same = found.x == wanted.x && found.y == wanted.y && found.z == wanted.z;
+		}
+		mismatches += same ? 0 : 1;
+	}
+	wprintf(L"%d of %d queries matched a linear scan\n", kCheckQueries - mismatches, kCheckQueries);
+	return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include "framework.h"
+#include "AirspaceDatabase.h"
+#include "AirspaceMonitor.h"
+#include "Commands.h"
+#include "SyntheticFlight.h"
+
+// Flies a generated flight through airspace, from OpenAir files or made up,
+// and reports the alerts and the cost per sample. Every sample is also
+// checked against a linear scan of all the airspaces, which must agree, and
+// climbing and descending into airspace above and below must be warned of.
+// --scaling times both as the number of synthetic airspaces grows.
+
+constexpr double kAirspaceToolSamplesPerSecond = 5;
+constexpr int64_t kAirspaceToolStartTimeMs = 1600000000000ll;
+constexpr double kAirspaceToolMetersPerDegree = 111320;
+
+// Synthetic airspace is scattered one per this many meters square, about
+// as thick as over central Europe.
+constexpr double kSyntheticAirspaceSpacing = 40000;
+
+static std::string openAirCoordinate(double lat, double lon) {
+	char text[64];
+	snprintf(text, sizeof(text), "%d:%06.3f %c %d:%06.3f %c",
+		(int)fabs(lat), fmod(fabs(lat), 1) * 60, lat < 0 ? 'S' : 'N',
+		(int)fabs(lon), fmod(fabs(lon), 1) * 60, lon < 0 ? 'W' : 'E');
+	return text;
+}
+
+// OpenAir text for count airspaces around (lat, lon): circles and
+// irregular polygons, at all heights, of every class.
+static std::string syntheticOpenAir(size_t count, double lat, double lon, uint32_t seed) {
+	static const char* const kClasses[] = { "B", "C", "D", "E", "R", "P", "Q", "CTR", "G" };
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<double> unit(0, 1);
+
+	const double side = sqrt((double)count) * kSyntheticAirspaceSpacing;
+	const double dlat = side / kAirspaceToolMetersPerDegree;
+	const double dlon = dlat / cos(lat * 3.14159265358979323846 / 180);
+	std::string text = "* Synthetic airspace\r\n";
+	char line[128];
+	for (size_t i = 0; i < count; i++) {
+		const double centerLat = lat + (unit(random) - 0.5) * dlat;
+		const double centerLon = lon + (unit(random) - 0.5) * dlon;
+		const double floorFt = unit(random) < 0.3 ? 0 : floor(unit(random) * 100) * 100;
+		const double ceilingFt = floorFt + 1000 + floor(unit(random) * 100) * 100;
+
+		text += "AC ";
+		text += kClasses[random() % (sizeof(kClasses) / sizeof(kClasses[0]))];
+		snprintf(line, sizeof(line), "\r\nAN SYNTHETIC %zu\r\n", i);
+		text += line;
+		if (floorFt == 0)
+			text += "AL SFC\r\n";
+		else {
+			snprintf(line, sizeof(line), "AL %.0fft %s\r\n", floorFt, unit(random) < 0.2 ? "AGL" : "MSL");
+			text += line;
+		}
+		snprintf(line, sizeof(line), "AH %.0fft MSL\r\n", ceilingFt);
+		text += line;
+
+		const double radiusNm = 3 + unit(random) * 12;
+		if (random() % 2) {
+			text += "V X=" + openAirCoordinate(centerLat, centerLon) + "\r\n";
+			snprintf(line, sizeof(line), "DC %.2f\r\n", radiusNm);
+			text += line;
+		} else {
+			const int vertices = 5 + random() % 8;
+			for (int v = 0; v < vertices; v++) {
+				const double angle = 2 * 3.14159265358979323846 * v / vertices;
+				const double r = radiusNm * 1852 * (0.6 + 0.4 * unit(random)) / kAirspaceToolMetersPerDegree;
+				text += "DP " + openAirCoordinate(centerLat + r * cos(angle),
+					centerLon + r * sin(angle) / cos(centerLat * 3.14159265358979323846 / 180)) + "\r\n";
+			}
+		}
+	}
+	return text;
+}
+
+class EventCounter : public AirspaceCallbacks {
+public:
+	void onAirspaceEnter(const Airspace& airspace) override { enters++; }
+	void onAirspaceExit(const Airspace& airspace) override { exits++; }
+	void onAirspaceAhead(const Airspace& airspace, double seconds) override { aheads++; }
+
+	uint64_t enters = 0;
+	uint64_t exits = 0;
+	uint64_t aheads = 0;
+};
+
+// Remembers which airspaces were warned of, to check each entry was.
+class EntryWarnings : public AirspaceCallbacks {
+public:
+	void onAirspaceEnter(const Airspace& airspace) override {
+		enters++;
+		if (std::find(warned.begin(), warned.end(), airspace.name) != warned.end())
+			warned_enters++;
+	}
+	void onAirspaceExit(const Airspace& airspace) override {}
+	void onAirspaceAhead(const Airspace& airspace, double seconds) override { warned.push_back(airspace.name); }
+
+	std::vector<std::string> warned;
+	int enters = 0;
+	int warned_enters = 0;
+};
+
+// Holds over one spot under a shelf, climbs into it, then descends out of
+// it into an area below. Both entries must have been warned of.
+static bool checkVerticalLookahead() {
+	const double lat = 47.5, lon = -122.3;
+	const std::string center = openAirCoordinate(lat, lon);
+	const std::string text =
+		"AC C\r\nAN SHELF ABOVE\r\nAL 5000ft MSL\r\nAH 8000ft MSL\r\nV X=" + center + "\r\nDC 10\r\n"
+		"AC R\r\nAN AREA BELOW\r\nAL SFC\r\nAH 2000ft MSL\r\nV X=" + center + "\r\nDC 10\r\n";
+	AirspaceDatabase db;
+	db.parseOpenAir(text.data(), text.size());
+	db.buildIndex();
+	AirspaceMonitor monitor(&db);
+	EntryWarnings events;
+	monitor.addCallback(&events);
+	monitor.onStateChange(SimInterfaceInFlight);
+
+	SimSample sample;
+	sample.data.gps_lat = lat;
+	sample.data.gps_lon = lon;
+	sample.data.gps_alt = 900;
+	const double dt = 1 / kAirspaceToolSamplesPerSecond;
+	// Up 1000 m into the shelf, then down 1600 m, through its floor and into
+	// the area below.
+	const double climbs[][2] = { { 5, 200 }, { -5, 320 } };
+	for (const auto& climb : climbs) {
+		sample.data.vertical_speed = climb[0];
+		for (int i = 0; i < climb[1] * kAirspaceToolSamplesPerSecond; i++) {
+			monitor.onSample(sample);
+			sample.data.gps_alt += climb[0] * dt;
+		}
+	}
+	wprintf(L"Climbing and descending in place: %d entries, %d warned of\n", events.enters, events.warned_enters);
+	return events.enters == 2 && events.warned_enters == 2;
+}
+
+struct AirspaceRun {
+	double monitor_us = 0;      // per sample
+	double linear_us = 0;
+	uint64_t enters = 0;
+	uint64_t exits = 0;
+	uint64_t aheads = 0;
+	uint64_t refreshes = 0;
+	uint64_t mismatches = 0;
+};
+
+static AirspaceRun fly(const AirspaceDatabase& db, const std::vector<SimSample>& samples) {
+	AirspaceRun run;
+	AirspaceMonitor monitor(&db);
+	EventCounter events;
+	monitor.addCallback(&events);
+	monitor.onStateChange(SimInterfaceInFlight);
+
+	double start = toolSeconds();
+	for (const SimSample& sample : samples)
+		monitor.onSample(sample);
+	run.monitor_us = (toolSeconds() - start) / samples.size() * 1e6;
+	run.enters = events.enters;
+	run.exits = events.exits;
+	run.aheads = events.aheads;
+	run.refreshes = monitor.refreshes();
+
+	// The same, testing every airspace every sample.
+	std::vector<uint32_t> inside, next;
+	uint64_t enters = 0, exits = 0;
+	start = toolSeconds();
+	for (const SimSample& sample : samples) {
+		const SimData& data = sample.data;
+		next.clear();
+		for (uint32_t i = 0; i < db.size(); i++) {
+			if (db.withinLimits(i, data.gps_alt, 0) && db.containsPoint(i, data.gps_lat, data.gps_lon))
+				next.push_back(i);
+		}
+		for (uint32_t i : next)
+			enters += std::find(inside.begin(), inside.end(), i) == inside.end() ? 1 : 0;
+		for (uint32_t i : inside)
+			exits += std::find(next.begin(), next.end(), i) == next.end() ? 1 : 0;
+		inside.swap(next);
+	}
+	run.linear_us = (toolSeconds() - start) / samples.size() * 1e6;
+	run.mismatches = (enters != run.enters ? 1 : 0) + (exits != run.exits ? 1 : 0);
+	return run;
+}
+
+int airspaceCommand(int argc, wchar_t** argv) {
+	size_t synthetic = 0;
+	bool scaling = false;
+	std::vector<wchar_t*> inputs;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--synthetic") == 0 && i + 1 < argc)
+			synthetic = (size_t)_wtoi(argv[++i]);
+		else if (wcscmp(argv[i], L"--scaling") == 0)
+			scaling = true;
+		else
+			inputs.push_back(argv[i]);
+	}
+
+	SyntheticFlight flight(kAirspaceToolStartTimeMs, kAirspaceToolSamplesPerSecond);
+	std::vector<SimSample> samples((size_t)(kSyntheticCycleSeconds * kAirspaceToolSamplesPerSecond));
+	double minLat = 90, maxLat = -90, minLon = 180, maxLon = -180;
+	for (SimSample& sample : samples) {
+		sample = flight.next();
+		minLat = std::min(minLat, sample.data.gps_lat);
+		maxLat = std::max(maxLat, sample.data.gps_lat);
+		minLon = std::min(minLon, sample.data.gps_lon);
+		maxLon = std::max(maxLon, sample.data.gps_lon);
+	}
+	const double centerLat = (minLat + maxLat) / 2;
+	const double centerLon = (minLon + maxLon) / 2;
+
+	if (scaling) {
+		wprintf(L"%10s %12s %12s %10s\n", L"airspaces", L"us/sample", L"linear", L"refreshes");
+		for (size_t count = 1000; count <= 64000; count *= 4) {
+			AirspaceDatabase db;
+			const std::string text = syntheticOpenAir(count, centerLat, centerLon, 1);
+			db.parseOpenAir(text.data(), text.size());
+			db.buildIndex();
+			const AirspaceRun run = fly(db, samples);
+			wprintf(L"%10zu %12.2f %12.2f %10llu%s\n", db.size(), run.monitor_us, run.linear_us,
+				run.refreshes, run.mismatches ? L"  MISMATCH" : L"");
+		}
+		return 0;
+	}
+
+	AirspaceDatabase db;
+	const double start = toolSeconds();
+	if (synthetic > 0) {
+		const std::string text = syntheticOpenAir(synthetic, centerLat, centerLon, 1);
+		db.parseOpenAir(text.data(), text.size());
+	}
+	for (const std::wstring& path : expandInputFiles((int)inputs.size(), inputs.data(), L".txt")) {
+		if (FAILED(db.loadOpenAir(path.c_str())))
+			fwprintf(stderr, L"Could not read %s\n", path.c_str());
+	}
+	db.buildIndex();
+	if (db.size() == 0) {
+		fwprintf(stderr, L"No airspace given\n");
+		return 2;
+	}
+	wprintf(L"%zu airspaces loaded and indexed in %.1f ms\n", db.size(), (toolSeconds() - start) * 1000);
+
+	const AirspaceRun run = fly(db, samples);
+	wprintf(L"%zu samples: %llu entries, %llu exits, %llu ahead warnings, %llu candidate refreshes\n",
+		samples.size(), run.enters, run.exits, run.aheads, run.refreshes);
+	wprintf(L"%.2f us/sample, %.2f us/sample testing every airspace\n", run.monitor_us, run.linear_us);
+	if (run.mismatches) {
+		fwprintf(stderr, L"Entries and exits differ from a linear scan\n");
+		return 1;
+	}
+	if (!checkVerticalLookahead()) {
+		fwprintf(stderr, L"Airspace above or below was entered without warning\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,162 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "framework.h"
+#include "Commands.h"
+#include "AllocTracker.h"
+#include "ForeFlightBroadcaster.h"
+#include "ReplayPipeline.h"
+#include "SimInterface.h"
+#include "SinkScheduler.h"
+#include "SyntheticFlight.h"
+
+// Checks that flying allocates nothing once a flight is under way. Runs the
+// main window's sinks over two generated flights, the first to warm up and
+// the second measured from a few seconds in, and lists what each sink and
+// setSimData allocated. Flights are replayed as fast as they go, with each
+// sink fed at its own rate by sample time; --live then runs the real
+// scheduler for a few seconds at the simulator's frame rate. Fails if
+// anything measured allocated.
+
+constexpr int64_t kAllocsStartTimeMs = 1600000000000ll;
+constexpr double kAllocsSamplesPerSecond = 60;
+
+// Seconds into a flight before counting starts: starting one opens files
+// and the like, which is not steady state.
+constexpr double kAllocsSettleSeconds = 2;
+
+constexpr wchar_t kAllocsDirectory[] = L"FlightMonitorAllocs";
+
+// Sites that ran, and those of them that allocated.
+static int reportSites() {
+	int allocating = 0;
+	wprintf(L"%-24s %10s %12s %12s\n", L"site", L"calls", L"allocations", L"bytes");
+	for (const AllocSite* site : allocSites()) {
+		if (site->calls() == 0)
+			continue;
+		wprintf(L"%-24S %10llu %12llu %12llu\n", site->name(), site->calls(), site->allocations(), site->bytes());
+		if (site->allocations() != 0)
+			allocating++;
+	}
+	return allocating;
+}
+
+static int replayFlights() {
+	ReplayPipeline pipeline(kAllocsDirectory);
+	ReplayScheduler replay(pipeline.sinks());
+	// The ForeFlight reports are two sinks of the broadcaster's own.
+	SinkScheduler broadcasts;
+	pipeline.broadcaster.registerSinks(broadcasts);
+	SimulatorInterface sim;
+	sim.events().subscribeAll(&broadcasts);
+	sim.events().subscribeAll(&replay);
+	broadcasts.start();
+
+	SyntheticFlight flight(kAllocsStartTimeMs, kAllocsSamplesPerSecond);
+	const size_t perFlight = (size_t)(kSyntheticCycleSeconds * kAllocsSamplesPerSecond);
+	const size_t settle = (size_t)(kAllocsSettleSeconds * kAllocsSamplesPerSecond);
+	for (int f = 0; f < 2; f++) {
+		// A sample with no position in between is the simulator's menu,
+		// so each generated flight is a flight of its own in every sink.
+		if (f > 0) {
+			const SimData menu = {};
+			sim.setSimData(&menu);
+		}
+		for (size_t i = 0; i < perFlight; i++) {
+			if (f == 1 && i == settle)
+				resetAllocSites();
+			const SimSample sample = flight.next();
+			replay.setTime(sample.time_ms);
+			sim.setSimData(&sample.data);
+			pipeline.landing.drain();
+		}
+	}
+	broadcasts.stop();
+
+	wprintf(L"Second of two generated flights at %.0f Hz:\n", kAllocsSamplesPerSecond);
+	return reportSites();
+}
+
+static void feedRealTime(SimulatorInterface& sim, SyntheticFlight& flight, double seconds) {
+	const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1 / kAllocsSamplesPerSecond));
+	auto next = std::chrono::steady_clock::now();
+	for (int i = 0; i < seconds * kAllocsSamplesPerSecond; i++) {
+		const SimSample sample = flight.next();
+		sim.setSimData(&sample.data);
+		next += interval;
+		std::this_thread::sleep_until(next);
+	}
+}
+
+static int liveScheduler(double seconds) {
+	ReplayPipeline pipeline(kAllocsDirectory);
+	SinkScheduler scheduler;
+	pipeline.registerSinks(scheduler);
+	SimulatorInterface sim;
+	sim.events().subscribeAll(&scheduler);
+	scheduler.start();
+
+	// The takeoff as fast as it goes, then a few seconds at the real rate
+	// so every sink has opened what it keeps open and the scheduler's
+	// queues have settled before counting starts.
+	SyntheticFlight flight(kAllocsStartTimeMs, kAllocsSamplesPerSecond);
+	for (int i = 0; i < 60 * kAllocsSamplesPerSecond; i++) {
+		const SimSample sample = flight.next();
+		sim.setSimData(&sample.data);
+	}
+	feedRealTime(sim, flight, kAllocsSettleSeconds);
+	resetAllocSites();
+
+	feedRealTime(sim, flight, seconds);
+	scheduler.stop();
+
+	wprintf(L"\n%.0f s through the scheduler at %.0f Hz:\n", seconds, kAllocsSamplesPerSecond);
+	return reportSites();
+}
+
+int allocsCommand(int argc, wchar_t** argv) {
+	double live = 0;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--live") == 0 && i + 1 < argc)
+			live = std::max(_wtof(argv[++i]), 1.0);
+		else {
+			fwprintf(stderr, L"Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (!FLIGHTMONITOR_ALLOC_TRACKING) {
+		fwprintf(stderr, L"Built without allocation tracking\n");
+		return 2;
+	}
+	if (FAILED(ForeFlightBroadcaster::InitWinsock()))
+		return 1;
+
+	int allocating = replayFlights();
+	if (live > 0)
+		allocating += liveScheduler(live);
+	if (allocating != 0) {
+		fwprintf(stderr, L"%d sites allocated in steady state\n", allocating);
+		return 1;
+	}
+	wprintf(L"No allocations in steady state\n");
+	return 0;
+}
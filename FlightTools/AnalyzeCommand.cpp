@@ -0,0 +1,165 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+
+#include "framework.h"
+#include "Commands.h"
+#include "FleetStats.h"
+#include "ThreadPool.h"
+
+// Statistics across an archive of recordings. Every file is a task on a
+// work-stealing pool; a task maps its file, decodes the channels it needs
+// and folds the result into its worker's own FleetTotals, so the only
+// shared writes are to the task's own slot in the per-flight results.
+
+// Padded so neighbouring workers' totals do not share a cache line.
+struct WorkerTotals {
+	FleetTotals totals;
+	char padding[64];
+};
+
+struct AnalyzeRun {
+	FleetTotals totals;
+	std::vector<FlightSummary> flights;
+	std::vector<bool> failed;
+	double seconds = 0;
+};
+
+static void runAnalysis(const std::vector<std::wstring>& files, const AnalyzeOptions& options,
+	unsigned threads, AnalyzeRun* run) {
+	run->flights.assign(files.size(), FlightSummary());
+	run->failed.assign(files.size(), false);
+	run->totals = FleetTotals();
+
+	const double start = toolSeconds();
+	ThreadPool pool(threads);
+	std::vector<WorkerTotals> partials(pool.threadCount());
+	std::vector<char> failed(files.size(), 0);
+
+	for (size_t i = 0; i < files.size(); i++) {
+		pool.submit([&, i] {
+			FleetTotals& totals = partials[ThreadPool::currentWorker()].totals;
+			TrackReader reader;
+			if (FAILED(reader.open(files[i].c_str())) ||
+				!analyzeFlight(reader, options, &run->flights[i], &totals)) {
+				failed[i] = 1;
+				return;
+			}
+			totals.add(run->flights[i]);
+			totals.bytes += reader.fileSize();
+		});
+	}
+	pool.wait();
+
+	for (const WorkerTotals& partial : partials)
+		run->totals.merge(partial.totals);
+	for (size_t i = 0; i < files.size(); i++)
+		run->failed[i] = failed[i] != 0;
+	run->seconds = toolSeconds() - start;
+}
+
+static void printThroughput(unsigned threads, const AnalyzeRun& run, double baseline) {
+	wprintf(L"%3u threads  %7.3f s  %8.1f M samples/s  %7.2f GB/s  speedup %5.2f\n",
+		threads, run.seconds, run.totals.samples / run.seconds / 1e6,
+		run.totals.bytes / run.seconds / 1e9, baseline / run.seconds);
+}
+
+static void printTotals(const AnalyzeOptions& options, const FleetTotals& totals) {
+	wprintf(L"flights            %llu\n", totals.flights);
+	wprintf(L"samples            %llu\n", totals.samples);
+	wprintf(L"hours flying       %.1f\n", totals.flight_seconds / 3600);
+	wprintf(L"landings           %llu\n", totals.landings);
+	wprintf(L"max bank           %.1f deg\n", totals.max_bank_deg);
+	wprintf(L"max altitude       %.0f m\n", totals.max_alt_m);
+	wprintf(L"hours above %.0f m  %.1f\n", options.above_altitude_m, totals.time_above_s / 3600);
+
+	wprintf(L"groundspeed (samples per %.0f kt bin):\n", kSpeedBinKnots);
+	for (int i = 0; i < kSpeedBins; i++) {
+		if (totals.speed_histogram[i] == 0)
+			continue;
+		wprintf(L"  %3.0f-%-3.0f kt%s %12llu\n", i * kSpeedBinKnots, (i + 1) * kSpeedBinKnots,
+			i == kSpeedBins - 1 ? L"+" : L" ", totals.speed_histogram[i]);
+	}
+}
+
+int analyzeCommand(int argc, wchar_t** argv) {
+	AnalyzeOptions options;
+	unsigned threads = 0;
+	bool scaling = false;
+	bool perFlight = false;
+	std::vector<wchar_t*> inputs;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--above") == 0 && i + 1 < argc)
+			options.above_altitude_m = _wtof(argv[++i]);
+		else if (wcscmp(argv[i], L"--threads") == 0 && i + 1 < argc)
+			threads = static_cast<unsigned>(_wtoi(argv[++i]));
+		else if (wcscmp(argv[i], L"--scaling") == 0)
+			scaling = true;
+		else if (wcscmp(argv[i], L"--flights") == 0)
+			perFlight = true;
+		else
+			inputs.push_back(argv[i]);
+	}
+
+	std::vector<std::wstring> files = expandInputFiles((int)inputs.size(), inputs.data(), kTrackFileExtension);
+	if (files.empty()) {
+		fwprintf(stderr, L"No track files given\n");
+		return 2;
+	}
+
+	AnalyzeRun run;
+	if (scaling) {
+		// One untimed pass so every run reads from the page cache.
+		runAnalysis(files, options, 0, &run);
+
+		const unsigned maxThreads = std::thread::hardware_concurrency();
+		double baseline = 0;
+		for (unsigned n = 1; ; n *= 2) {
+			if (n > maxThreads)
+				n = maxThreads;
+			runAnalysis(files, options, n, &run);
+			if (n == 1)
+				baseline = run.seconds;
+			printThroughput(n, run, baseline);
+			if (n == maxThreads)
+				break;
+		}
+		wprintf(L"\n");
+	} else {
+		runAnalysis(files, options, threads, &run);
+	}
+
+	for (size_t i = 0; i < files.size(); i++) {
+		if (run.failed[i])
+			fwprintf(stderr, L"Could not read %s\n", files[i].c_str());
+	}
+	if (perFlight) {
+		wprintf(L"file,samples,hours_flying,max_bank_deg,max_alt_m,minutes_above,landings\n");
+		for (size_t i = 0; i < files.size(); i++) {
+			const FlightSummary& f = run.flights[i];
+			if (!run.failed[i]) {
+				wprintf(L"%s,%llu,%.2f,%.1f,%.0f,%.1f,%d\n", files[i].c_str(), f.samples,
+					f.flight_seconds / 3600, f.max_bank_deg, f.max_alt_m, f.time_above_s / 60, f.landings);
+			}
+		}
+		wprintf(L"\n");
+	}
+	printTotals(options, run.totals);
+	if (!scaling) {
+		wprintf(L"\n%.3f s, %.1f M samples/s\n", run.seconds, run.totals.samples / run.seconds / 1e6);
+	}
+	return 0;
+}
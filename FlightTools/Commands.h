@@ -0,0 +1,59 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "framework.h"
+
+// FlightTools subcommands. Each takes the arguments after its name and
+// returns the process exit code.
+struct ToolCommand {
+	LPCWSTR name;
+	LPCWSTR usage;
+	int (*run)(int argc, wchar_t** argv);
+};
+
+int airportsCommand(int argc, wchar_t** argv);
+int allocsCommand(int argc, wchar_t** argv);
+int airspaceCommand(int argc, wchar_t** argv);
+int analyzeCommand(int argc, wchar_t** argv);
+int buildAirportsCommand(int argc, wchar_t** argv);
+int derivedCommand(int argc, wchar_t** argv);
+int eventsCommand(int argc, wchar_t** argv);
+int exportCommand(int argc, wchar_t** argv);
+int geodesyCommand(int argc, wchar_t** argv);
+int generateArchiveCommand(int argc, wchar_t** argv);
+int landingCommand(int argc, wchar_t** argv);
+int phasesCommand(int argc, wchar_t** argv);
+int rangeCommand(int argc, wchar_t** argv);
+int renderCommand(int argc, wchar_t** argv);
+int rxStatsCommand(int argc, wchar_t** argv);
+int sendBenchCommand(int argc, wchar_t** argv);
+int sessionsCommand(int argc, wchar_t** argv);
+int simVarsCommand(int argc, wchar_t** argv);
+int soakCommand(int argc, wchar_t** argv);
+int terrainCommand(int argc, wchar_t** argv);
+int trackStatsCommand(int argc, wchar_t** argv);
+int xplaneCommand(int argc, wchar_t** argv);
+
+// Expands each argument that names a directory into the files in it with the
+// given extension. Other arguments are passed through as files.
+std::vector<std::wstring> expandInputFiles(int argc, wchar_t** argv, LPCWSTR extension);
+
+// Seconds on a monotonic clock, for timing.
+double toolSeconds();
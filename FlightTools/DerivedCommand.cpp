@@ -0,0 +1,211 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+#include "framework.h"
+#include "Commands.h"
+#include "DerivedQuantities.h"
+#include "SyntheticFlight.h"
+
+// Runs generated flights, drifted by a known wind, through the derived
+// quantity engine. Prints what following each demand costs per sample,
+// with three subscribers reading what they asked for, and checks the
+// values with everything requested against the generated truth.
+
+constexpr int64_t kDerivedStartTimeMs = 1600000000000ll;
+constexpr double kDerivedPi = 3.14159265358979323846;
+constexpr double kDerivedMetersPerDegree = 111320;
+constexpr double kDerivedGravity = 9.80665;
+constexpr int kDerivedSubscribers = 3;
+
+// Blows from the west south west, in m/s and degrees.
+constexpr double kDerivedWindMps = 12;
+constexpr double kDerivedWindFromDegrees = 250;
+
+struct DerivedDemand {
+	const wchar_t* name;
+	unsigned quantities;
+};
+
+static const DerivedDemand kDerivedDemands[] = {
+	{ L"nothing", 0 },
+	{ L"vertical speed", derivedBit(kDerivedVerticalSpeed) },
+	{ L"turn rate", derivedBit(kDerivedTurnRate) },
+	{ L"load factor", derivedBit(kDerivedLoadFactor) },
+	{ L"wind", derivedBit(kDerivedWindSpeed) | derivedBit(kDerivedWindDirection) },
+	{ L"everything", (1u << kDerivedQuantityCount) - 1 },
+};
+
+static std::vector<SimSample> generateSamples(int flights, double rate) {
+	SyntheticFlight flight(kDerivedStartTimeMs, rate);
+	const size_t count = (size_t)(kSyntheticCycleSeconds * rate) * flights;
+	const double windNorth = -kDerivedWindMps * cos(kDerivedWindFromDegrees * kDerivedPi / 180);
+	const double windEast = -kDerivedWindMps * sin(kDerivedWindFromDegrees * kDerivedPi / 180);
+	std::vector<SimSample> samples(count);
+	// Each step of the generated track is moved again, plus the wind's
+	// drift, from where the drifted track has got to.
+	SimSample previous = flight.next();
+	double lat = previous.data.gps_lat, lon = previous.data.gps_lon;
+	for (size_t i = 0; i < count; i++) {
+		SimSample sample = i ? flight.next() : previous;
+		const double north = (sample.data.gps_lat - previous.data.gps_lat) * kDerivedMetersPerDegree;
+		const double east = (sample.data.gps_lon - previous.data.gps_lon) * kDerivedMetersPerDegree *
+			cos(sample.data.gps_lat * kDerivedPi / 180);
+		previous = sample;
+		lat += (north + (i ? windNorth / rate : 0)) / kDerivedMetersPerDegree;
+		lon += (east + (i ? windEast / rate : 0)) / (kDerivedMetersPerDegree * cos(lat * kDerivedPi / 180));
+		sample.data.gps_lat = lat;
+		sample.data.gps_lon = lon;
+		samples[i] = sample;
+	}
+	return samples;
+}
+
+static int measureDemand(const DerivedDemand& demand, const std::vector<SimSample>& samples) {
+	DerivedQuantities derived;
+	for (int i = 0; i < kDerivedSubscribers; i++)
+		derived.request(demand.quantities);
+
+	double sum = 0;
+	const double start = toolSeconds();
+	for (const SimSample& sample : samples) {
+		derived.onSample(sample);
+		for (int i = 0; i < kDerivedSubscribers; i++) {
+			for (int q = 0; q < kDerivedQuantityCount; q++) {
+				if (demand.quantities & derivedBit((DerivedQuantity)q)) {
+					const double value = derived.value((DerivedQuantity)q);
+					if (!isnan(value))
+						sum += value;
+				}
+			}
+		}
+	}
+	const double seconds = toolSeconds() - start;
+
+	const double n = (double)samples.size();
+	wprintf(L"%-16s %10.1f %9.2f %12.2f  (%g)\n", demand.name, seconds / n * 1e9,
+		derived.updates() / n, derived.evaluations() / n, sum / n);
+
+	// Nothing requested is nothing followed, and each value is worked out
+	// at most once a sample however many read it.
+	int followed = 0;
+	for (int q = 0; q < kDerivedQuantityCount; q++)
+		if (derived.demand() & derivedBit((DerivedQuantity)q))
+			followed++;
+	if (derived.updates() > samples.size() * followed || derived.evaluations() > samples.size() * followed) {
+		fwprintf(stderr, L"%s: more work than the %d quantities followed\n", demand.name, followed);
+		return 1;
+	}
+	return 0;
+}
+
+// With everything requested, the largest error in each quantity where the
+// truth is known: vertical speed and turn rate away from the changes in
+// the profile, load factor in the air, and the wind through cruise once a
+// turn has shown it. The nose comes up 5 degrees at the start of the climb,
+// so the pitch rate there must read positive.
+static int checkValues(const std::vector<SimSample>& samples, double rate) {
+	DerivedQuantities derived;
+	derived.request((1u << kDerivedQuantityCount) - 1);
+
+	double climbError = 0, turnError = 0, loadError = 0, windError = 0, directionError = 0;
+	double climbPitchRate = 0;
+	int windSamples = 0;
+	for (size_t i = 0; i < samples.size(); i++) {
+		const SimSample& sample = samples[i];
+		derived.onSample(sample);
+		const double t = i / rate;
+		const double cycle = fmod(t, kSyntheticCycleSeconds);
+		const double turn = syntheticTurnRate(t);
+		const bool steady = t >= 3 && turn == syntheticTurnRate(t - 3) &&
+			syntheticTurnRate(t + 1) == turn;
+
+		const double climb = derived.value(kDerivedVerticalSpeed);
+		const double previous = i >= (size_t)(3 * rate) ? samples[i - (size_t)(3 * rate)].data.vertical_speed : NAN;
+		if (!isnan(climb) && previous == sample.data.vertical_speed)
+			climbError = std::max(climbError, fabs(climb - sample.data.vertical_speed));
+
+		const double turnRate = derived.value(kDerivedTurnRate);
+		if (!isnan(turnRate) && steady)
+			turnError = std::max(turnError, fabs(turnRate - turn));
+
+		// In a turn at a steady airspeed the only acceleration is toward
+		// its centre.
+		const double load = derived.value(kDerivedLoadFactor);
+		if (!isnan(load) && steady && cycle > 45 && cycle < kSyntheticCycleSeconds - 65 &&
+			previous == sample.data.vertical_speed) {
+			const double across = sample.data.gps_groundspeed * turn * kDerivedPi / 180;
+			const double truth = sqrt(across * across + kDerivedGravity * kDerivedGravity) / kDerivedGravity;
+			loadError = std::max(loadError, fabs(load - truth));
+		}
+
+		const double pitchRate = derived.value(kDerivedPitchRate);
+		if (!isnan(pitchRate) && cycle >= 40 && cycle < 42 && fabs(pitchRate) > fabs(climbPitchRate))
+			climbPitchRate = pitchRate;
+
+		const double wind = derived.value(kDerivedWindSpeed);
+		const double direction = derived.value(kDerivedWindDirection);
+		if (cycle > 1740 && cycle < 6000) {
+			if (isnan(wind) || isnan(direction)) {
+				windError = INFINITY;
+			} else {
+				windError = std::max(windError, fabs(wind - kDerivedWindMps));
+				directionError = std::max(directionError,
+					fabs(remainder(direction - kDerivedWindFromDegrees, 360.0)));
+			}
+			windSamples++;
+		}
+	}
+
+	wprintf(L"Largest errors: vertical speed %.3f m/s, turn rate %.3f deg/s, load factor %.3f G,\n"
+		L"wind %.2f m/s and %.1f degrees over %d cruise samples\n"
+		L"Pitch rate at the start of the climb %.1f deg/s\n",
+		climbError, turnError, loadError, windError, directionError, windSamples, climbPitchRate);
+	if (climbError > 0.1 || turnError > 0.1 || loadError > 0.02 || windError > 0.5 || directionError > 3 ||
+		climbPitchRate <= 0) {
+		fwprintf(stderr, L"Derived quantities are too far from the generated flight\n");
+		return 1;
+	}
+	return 0;
+}
+
+int derivedCommand(int argc, wchar_t** argv) {
+	int flights = 1;
+	double rate = 20;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--flights") == 0 && i + 1 < argc)
+			flights = std::max(1, _wtoi(argv[++i]));
+		else if (wcscmp(argv[i], L"--rate") == 0 && i + 1 < argc)
+			rate = std::max(1.0, _wtof(argv[++i]));
+		else {
+			fwprintf(stderr, L"Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	const std::vector<SimSample> samples = generateSamples(flights, rate);
+	wprintf(L"%d flights, %zu samples at %g Hz, %d subscribers\n", flights, samples.size(), rate,
+		kDerivedSubscribers);
+	wprintf(L"%-16s %10s %9s %12s\n", L"demand", L"ns/sample", L"updates", L"evaluations");
+	int errors = 0;
+	for (const DerivedDemand& demand : kDerivedDemands)
+		errors += measureDemand(demand, samples);
+	errors += checkValues(samples, rate);
+	return errors ? 1 : 0;
+}
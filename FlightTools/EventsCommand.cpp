@@ -0,0 +1,156 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "framework.h"
+#include "Commands.h"
+#include "EventBus.h"
+#include "SimInterface.h"
+#include "SyntheticFlight.h"
+
+// Times delivering simulator samples three ways: through an EventBus, which
+// makes a virtual call per listener, through a static EventPipeline of the
+// same listeners, and with one slow listener, called directly and then
+// behind a QueuedListener, to show how much of it the publisher waits for.
+
+constexpr int64_t kEventsStartTimeMs = 1600000000000ll;
+constexpr double kEventsSamplesPerSecond = 60;
+
+// What the slow listener spends on each event, as a disk write or a
+// redraw might.
+constexpr int kSlowListenerMs = 2;
+constexpr size_t kSlowEvents = 200;
+
+// About what the cheap real listeners do with a sample.
+class CountingListener : public EventListener<SimDataEvent> {
+public:
+	void onEvent(const SimDataEvent& event) override {
+		sum += event.data.gps_alt;
+		count++;
+	}
+
+	double sum = 0;
+	uint64_t count = 0;
+};
+
+class SlowListener : public EventListener<SimDataEvent> {
+public:
+	void onEvent(const SimDataEvent&) override {
+		std::this_thread::sleep_for(std::chrono::milliseconds(kSlowListenerMs));
+		count++;
+	}
+
+	uint64_t count = 0;
+};
+
+static std::vector<SimDataEvent> generateEvents(size_t count) {
+	SyntheticFlight flight(kEventsStartTimeMs, kEventsSamplesPerSecond);
+	std::vector<SimDataEvent> events(count);
+	for (SimDataEvent& event : events)
+		event.data = flight.next().data;
+	return events;
+}
+
+// Best of three passes, in ns per event.
+template <typename Publisher>
+static double timePublish(const std::vector<SimDataEvent>& events, Publisher& publisher) {
+	double seconds = HUGE_VAL;
+	for (int pass = 0; pass < 3; pass++) {
+		const double start = toolSeconds();
+		for (const SimDataEvent& event : events)
+			publisher.publish(event);
+		seconds = std::min(seconds, toolSeconds() - start);
+	}
+	return seconds / events.size() * 1e9;
+}
+
+static int fastListeners(size_t count) {
+	const std::vector<SimDataEvent> events = generateEvents(count);
+
+	CountingListener a[4];
+	SimEventBus bus;
+	for (CountingListener& listener : a)
+		bus.subscribe<SimDataEvent>(&listener);
+	const double busNs = timePublish(events, bus);
+
+	CountingListener b[4];
+	EventPipeline<CountingListener, CountingListener, CountingListener, CountingListener> pipeline(
+		b[0], b[1], b[2], b[3]);
+	const double pipelineNs = timePublish(events, pipeline);
+
+	wprintf(L"%zu samples to 4 listeners: bus %.1f ns/sample, pipeline %.1f ns/sample\n",
+		count, busNs, pipelineNs);
+	for (int i = 0; i < 4; i++) {
+		if (a[i].count != b[i].count || a[i].sum != b[i].sum) {
+			fwprintf(stderr, L"The bus and the pipeline delivered different samples\n");
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int slowListener() {
+	const std::vector<SimDataEvent> events = generateEvents(kSlowEvents);
+
+	CountingListener fast;
+	SlowListener direct;
+	SimEventBus bus;
+	bus.subscribe<SimDataEvent>(&direct);
+	bus.subscribe<SimDataEvent>(&fast);
+	double start = toolSeconds();
+	for (const SimDataEvent& event : events)
+		bus.publish(event);
+	const double directUs = (toolSeconds() - start) / events.size() * 1e6;
+
+	SlowListener slow;
+	QueuedListener<SimDataEvent> queued(&slow);
+	SimEventBus queuedBus;
+	queuedBus.subscribe<SimDataEvent>(&queued);
+	queuedBus.subscribe<SimDataEvent>(&fast);
+	queued.start();
+	start = toolSeconds();
+	for (const SimDataEvent& event : events)
+		queuedBus.publish(event);
+	const double queuedUs = (toolSeconds() - start) / events.size() * 1e6;
+	queued.stop();
+
+	wprintf(L"A %d ms listener called directly holds each sample %.0f us\n", kSlowListenerMs, directUs);
+	wprintf(L"Behind a queue: %.1f us; it got %llu of %zu samples, %llu dropped\n", queuedUs,
+		slow.count, events.size(), queued.dropped());
+	if (slow.count + queued.dropped() != events.size()) {
+		fwprintf(stderr, L"The queue lost samples it did not count as dropped\n");
+		return 1;
+	}
+	return 0;
+}
+
+int eventsCommand(int argc, wchar_t** argv) {
+	size_t count = 1000000;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--samples") == 0 && i + 1 < argc)
+			count = std::max(_wtoi(argv[++i]), 1);
+		else {
+			fwprintf(stderr, L"Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+	return fastListeners(count) | slowListener();
+}
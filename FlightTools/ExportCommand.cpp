@@ -0,0 +1,165 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+
+#include "framework.h"
+#include "Commands.h"
+#include "TrackExport.h"
+#include "TrackFile.h"
+#include "TrackSimplifier.h"
+
+// Exports recordings to GPX, KML or CSV. Each file is decoded one block at a
+// time straight into the simplifier and the output buffer, so memory stays
+// flat however long the flight.
+
+// Default simplification for GPX and KML. CSV is meant for analysis and is
+// exported in full unless a tolerance is given.
+constexpr double kDefaultExportToleranceM = 5.0;
+
+struct ExportOptions {
+	ExportFormat format = ExportFormat::Kml;
+	double tolerance_m = -1;   // negative: the format's default
+	std::wstring out_directory;
+};
+
+struct ExportResult {
+	uint64_t samples_in = 0;
+	uint64_t samples_out = 0;
+	uint64_t bytes = 0;
+};
+
+static std::string toUtf8(const std::wstring& str) {
+	int length = WideCharToMultiByte(CP_UTF8, 0, str.c_str(), (int)str.size(), NULL, 0, NULL, NULL);
+	std::string result(length, '\0');
+	if (length > 0)
+		WideCharToMultiByte(CP_UTF8, 0, str.c_str(), (int)str.size(), &result[0], length, NULL, NULL);
+	return result;
+}
+
+static std::wstring outputPath(const std::wstring& input, const ExportOptions& options) {
+	size_t slash = input.find_last_of(L"\\/");
+	size_t dot = input.find_last_of(L'.');
+	if (dot == std::wstring::npos || (slash != std::wstring::npos && dot < slash))
+		dot = input.size();
+
+	std::wstring path;
+	if (options.out_directory.empty())
+		path = input.substr(0, dot);
+	else
+		path = options.out_directory + L"\\" + input.substr(slash + 1, dot - slash - 1);
+
+	const char* extension = exportFormatExtension(options.format);
+	while (*extension)
+		path += static_cast<wchar_t>(*extension++);
+	return path;
+}
+
+static HRESULT exportFile(const std::wstring& input, const ExportOptions& options, ExportResult* result) {
+	TrackReader reader;
+	HRESULT hr = reader.open(input.c_str());
+	if (FAILED(hr)) {
+		fwprintf(stderr, L"Could not read %s\n", input.c_str());
+		return hr;
+	}
+
+	const std::wstring output = outputPath(input, options);
+	FILE* file = nullptr;
+	if (_wfopen_s(&file, output.c_str(), L"wb") != 0 || file == nullptr) {
+		fwprintf(stderr, L"Could not create %s\n", output.c_str());
+		return E_FAIL;
+	}
+
+	double tolerance = options.tolerance_m;
+	if (tolerance < 0)
+		tolerance = (options.format == ExportFormat::Csv) ? 0 : kDefaultExportToleranceM;
+	TrackSimplifier simplifier(tolerance, tolerance);
+
+	// The stream's buffer is too large to want on the stack.
+	std::unique_ptr<ExportStream> out = std::make_unique<ExportStream>(file);
+	std::unique_ptr<TrackExporter> exporter = makeTrackExporter(options.format, out.get());
+
+	size_t slash = input.find_last_of(L"\\/");
+	exporter->begin(toUtf8(slash == std::wstring::npos ? input : input.substr(slash + 1)).c_str());
+
+	TrackColumns columns;
+	SimSample emitted;
+	for (size_t i = 0; i < reader.blockCount(); i++) {
+		if (!reader.readBlock(i, &columns))
+			continue;
+		for (int j = 0; j < columns.count; j++) {
+			result->samples_in++;
+			if (simplifier.push(columns.sample(j), &emitted)) {
+				exporter->point(emitted);
+				result->samples_out++;
+			}
+		}
+	}
+	if (simplifier.flush(&emitted)) {
+		exporter->point(emitted);
+		result->samples_out++;
+	}
+	exporter->end();
+
+	out->flush();
+	result->bytes = out->bytesWritten();
+	const bool failed = out->failed();
+	fclose(file);
+	if (failed) {
+		fwprintf(stderr, L"Error writing %s\n", output.c_str());
+		return E_FAIL;
+	}
+	return S_OK;
+}
+
+int exportCommand(int argc, wchar_t** argv) {
+	ExportOptions options;
+	std::vector<wchar_t*> inputs;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--format") == 0 && i + 1 < argc) {
+			std::string name = toUtf8(argv[++i]);
+			if (!parseExportFormat(name.c_str(), &options.format)) {
+				fwprintf(stderr, L"Unknown format %s\n", argv[i]);
+				return 2;
+			}
+		} else if (wcscmp(argv[i], L"--tolerance") == 0 && i + 1 < argc) {
+			options.tolerance_m = _wtof(argv[++i]);
+		} else if (wcscmp(argv[i], L"--out") == 0 && i + 1 < argc) {
+			options.out_directory = argv[++i];
+		} else {
+			inputs.push_back(argv[i]);
+		}
+	}
+
+	std::vector<std::wstring> files = expandInputFiles((int)inputs.size(), inputs.data(), kTrackFileExtension);
+	if (files.empty()) {
+		fwprintf(stderr, L"No track files given\n");
+		return 2;
+	}
+
+	int status = 0;
+	for (const std::wstring& path : files) {
+		ExportResult result;
+		const double start = toolSeconds();
+		if (FAILED(exportFile(path, options, &result))) {
+			status = 1;
+			continue;
+		}
+		const double seconds = toolSeconds() - start;
+		wprintf(L"%s: %llu of %llu points, %llu bytes, %.3f s\n", outputPath(path, options).c_str(),
+			result.samples_out, result.samples_in, result.bytes, seconds);
+	}
+	return status;
+}
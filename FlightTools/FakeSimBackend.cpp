@@ -0,0 +1,90 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include "framework.h"
+#include "FakeSimBackend.h"
+#include "SimInterface.h"
+
+HRESULT FakeSimBackend::open(HWND, UINT, HANDLE event) {
+	event_ = event;
+	open_ = true;
+	return S_OK;
+}
+
+HRESULT FakeSimBackend::dispatch(SimulatorInterface* sim) {
+	dispatching_.clear();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		dispatching_.swap(pending_);
+	}
+
+	const Clock::time_point now = Clock::now();
+	for (const Frame& frame : dispatching_) {
+		const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - frame.produced).count();
+		latency_ns_.fetch_add(ns, std::memory_order_relaxed);
+		if (ns > latency_ns_max_.load(std::memory_order_relaxed))
+			latency_ns_max_.store(ns, std::memory_order_relaxed);
+		delivered_.fetch_add(1, std::memory_order_relaxed);
+		sim->setSimData(&frame.data);
+	}
+	return S_OK;
+}
+
+void FakeSimBackend::close() {
+	open_ = false;
+	std::lock_guard<std::mutex> lock(mutex_);
+	pending_.clear();
+}
+
+void FakeSimBackend::produce(Clock::time_point now) {
+	if (!open_)
+		return;
+	Frame frame = { flight_.next().data, now };
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_.push_back(frame);
+	}
+	produced_.fetch_add(1, std::memory_order_relaxed);
+	SetEvent(event_);
+}
+
+double FakeSimBackend::latencyMeanUs() const {
+	const uint64_t count = delivered_;
+	return count ? latency_ns_ / 1000.0 / count : 0;
+}
+
+void FakeSimDriver::start(double framesPerSecond) {
+	stopping_ = false;
+	thread_ = std::thread(&FakeSimDriver::run, this, framesPerSecond);
+}
+
+void FakeSimDriver::stop() {
+	stopping_ = true;
+	if (thread_.joinable())
+		thread_.join();
+}
+
+void FakeSimDriver::run(double framesPerSecond) {
+	const auto interval = std::chrono::duration_cast<FakeSimBackend::Clock::duration>(
+		std::chrono::duration<double>(1 / framesPerSecond));
+	auto next = FakeSimBackend::Clock::now();
+	while (!stopping_) {
+		const auto now = FakeSimBackend::Clock::now();
+		for (FakeSimBackend* backend : backends_)
+			backend->produce(now);
+		next += interval;
+		std::this_thread::sleep_until(next);
+	}
+}
@@ -0,0 +1,86 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "framework.h"
+#include "SimBackend.h"
+#include "SyntheticFlight.h"
+
+// A stand-in for SimConnect. Once opened it is fed SyntheticFlight frames by
+// a FakeSimDriver and, like SimConnect, sets its event whenever frames are
+// waiting to be dispatched.
+class FakeSimBackend : public SimBackend {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	FakeSimBackend(int64_t startTimeMs, double samplesPerSecond, uint32_t seed) :
+		flight_(startTimeMs, samplesPerSecond, seed) {}
+
+	HRESULT open(HWND hwnd, UINT userMessage, HANDLE event) override;
+	HRESULT dispatch(SimulatorInterface* sim) override;
+	void close() override;
+
+	// Called by the driver thread for each frame.
+	void produce(Clock::time_point now);
+
+	// Safe to read from any thread.
+	uint64_t produced() const { return produced_; }
+	uint64_t delivered() const { return delivered_; }
+	double latencyMeanUs() const;
+	double latencyMaxUs() const { return latency_ns_max_ / 1000.0; }
+
+private:
+	struct Frame {
+		SimData data;
+		Clock::time_point produced;
+	};
+
+	SyntheticFlight flight_;
+	HANDLE event_ = NULL;
+	std::atomic<bool> open_{ false };
+	std::mutex mutex_;
+	std::vector<Frame> pending_;    // guarded by mutex_
+	std::vector<Frame> dispatching_;
+
+	std::atomic<uint64_t> produced_{ 0 };
+	std::atomic<uint64_t> delivered_{ 0 };
+	std::atomic<uint64_t> latency_ns_{ 0 };
+	std::atomic<uint64_t> latency_ns_max_{ 0 };
+};
+
+// Produces a frame for every backend at the simulator's frame rate, from one
+// thread, as a room of simulators would.
+class FakeSimDriver {
+public:
+	~FakeSimDriver() { stop(); }
+
+	void add(FakeSimBackend* backend) { backends_.push_back(backend); }
+	void start(double framesPerSecond);
+	void stop();
+
+private:
+	void run(double framesPerSecond);
+
+	std::vector<FakeSimBackend*> backends_;
+	std::thread thread_;
+	std::atomic<bool> stopping_{ false };
+};
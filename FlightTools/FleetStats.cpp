@@ -0,0 +1,116 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stddef.h>
+#include <vector>
+
+#include "FleetStats.h"
+#include "ColumnReductions.h"
+
+constexpr int kAltChannel = offsetof(SimData, gps_alt) / sizeof(double);
+constexpr int kSpeedChannel = offsetof(SimData, gps_groundspeed) / sizeof(double);
+constexpr int kBankChannel = offsetof(SimData, bank) / sizeof(double);
+
+constexpr double kMpsToKnots = 1.943844;
+
+// A sample gap longer than this (a pause, a reconnect) is not flight time.
+constexpr double kMaxSampleGapS = 5;
+
+// Landing detection by groundspeed with hysteresis: an aircraft that has
+// been faster than kAirborneSpeedMps and then slows below kStoppedSpeedMps
+// has landed. Touch-and-goes are not counted.
+constexpr double kAirborneSpeedMps = 30;   // about 58 knots
+constexpr double kStoppedSpeedMps = 8;     // fast taxi
+
+void FleetTotals::add(const FlightSummary& flight) {
+	flights++;
+	samples += flight.samples;
+	flight_seconds += flight.flight_seconds;
+	time_above_s += flight.time_above_s;
+	landings += flight.landings;
+	if (flight.max_bank_deg > max_bank_deg)
+		max_bank_deg = flight.max_bank_deg;
+	if (flight.max_alt_m > max_alt_m)
+		max_alt_m = flight.max_alt_m;
+}
+
+void FleetTotals::merge(const FleetTotals& other) {
+	flights += other.flights;
+	samples += other.samples;
+	bytes += other.bytes;
+	flight_seconds += other.flight_seconds;
+	time_above_s += other.time_above_s;
+	landings += other.landings;
+	if (other.max_bank_deg > max_bank_deg)
+		max_bank_deg = other.max_bank_deg;
+	if (other.max_alt_m > max_alt_m)
+		max_alt_m = other.max_alt_m;
+	for (int i = 0; i < kSpeedBins; i++)
+		speed_histogram[i] += other.speed_histogram[i];
+}
+
+bool analyzeFlight(const TrackReader& reader, const AnalyzeOptions& options,
+	FlightSummary* summary, FleetTotals* totals) {
+	const uint64_t mask = (1ull << kAltChannel) | (1ull << kSpeedChannel) | (1ull << kBankChannel);
+
+	TrackColumns columns;
+	std::vector<double> durations;
+	bool airborne = false;
+	double maxAlt = -HUGE_VAL;
+
+	for (size_t b = 0; b < reader.blockCount(); b++) {
+		if (!reader.readBlock(b, &columns, mask))
+			return false;
+		const size_t n = columns.count;
+		if (n == 0)
+			continue;
+		const double* alt = columns.channel(kAltChannel);
+		const double* speed = columns.channel(kSpeedChannel);
+		const double* bank = columns.channel(kBankChannel);
+
+		// The last sample of a block lasts until the first of the next.
+		const int64_t next = (b + 1 < reader.blockCount()) ?
+			reader.block(b + 1).first_time_ms : columns.time_ms[n - 1];
+		durations.resize(n);
+		columnDurations(columns.time_ms.data(), n, next, kMaxSampleGapS, durations.data());
+
+		summary->samples += n;
+		summary->flight_seconds += columnWeightedAbove(speed, durations.data(), n, kAirborneSpeedMps);
+		summary->time_above_s += columnWeightedAbove(alt, durations.data(), n, options.above_altitude_m);
+		const double blockBank = columnMaxAbs(bank, n);
+		if (blockBank > summary->max_bank_deg)
+			summary->max_bank_deg = blockBank;
+		const double blockAlt = columnMax(alt, n);
+		if (blockAlt > maxAlt)
+			maxAlt = blockAlt;
+
+		for (size_t i = 0; i < n; i++) {
+			int bin = static_cast<int>(speed[i] * kMpsToKnots / kSpeedBinKnots);
+			if (bin < 0) bin = 0;
+			if (bin >= kSpeedBins) bin = kSpeedBins - 1;
+			totals->speed_histogram[bin]++;
+
+			if (speed[i] > kAirborneSpeedMps) {
+				airborne = true;
+			} else if (airborne && speed[i] < kStoppedSpeedMps) {
+				airborne = false;
+				summary->landings++;
+			}
+		}
+	}
+
+	summary->max_alt_m = summary->samples ? maxAlt : 0;
+	return true;
+}
@@ -0,0 +1,61 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "TrackFile.h"
+
+// Groundspeed distribution in 10 knot bins; the last bin collects anything
+// faster.
+constexpr int kSpeedBins = 40;
+constexpr double kSpeedBinKnots = 10;
+
+struct AnalyzeOptions {
+	double above_altitude_m = 3048;  // 10,000 ft
+};
+
+// Results for one recording.
+struct FlightSummary {
+	uint64_t samples = 0;
+	double flight_seconds = 0;
+	double max_bank_deg = 0;
+	double max_alt_m = 0;
+	double time_above_s = 0;
+	int landings = 0;
+};
+
+// Totals over many recordings. Each worker thread accumulates its own and
+// they are merged once at the end.
+struct FleetTotals {
+	uint64_t flights = 0;
+	uint64_t samples = 0;
+	uint64_t bytes = 0;
+	double flight_seconds = 0;
+	double time_above_s = 0;
+	uint64_t landings = 0;
+	double max_bank_deg = 0;
+	double max_alt_m = 0;
+	uint64_t speed_histogram[kSpeedBins] = { 0 };
+
+	void add(const FlightSummary& flight);
+	void merge(const FleetTotals& other);
+};
+
+// Scans one recording, decoding only the channels the statistics need.
+// Groundspeed samples are added to totals->speed_histogram.
+bool analyzeFlight(const TrackReader& reader, const AnalyzeOptions& options,
+	FlightSummary* summary, FleetTotals* totals);
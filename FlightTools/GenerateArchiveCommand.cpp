@@ -0,0 +1,82 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <atomic>
+
+#include "framework.h"
+#include "Commands.h"
+#include "SyntheticFlight.h"
+#include "ThreadPool.h"
+#include "TrackFile.h"
+
+// Writes an archive of synthetic recordings, for benchmarking analyze and
+// friends at sizes no real archive reaches yet.
+
+constexpr double kGeneratedSamplesPerSecond = 10;
+constexpr int64_t kGeneratedStartTimeMs = 1577836800000ll;  // 2020-01-01
+constexpr int64_t kMsPerDay = 86400000;
+
+static uint64_t generateFlight(const std::wstring& directory, uint32_t index, double hours) {
+	wchar_t name[64];
+	swprintf_s(name, L"\\synthetic-%06u%s", index, kTrackFileExtension);
+	const int64_t start = kGeneratedStartTimeMs + index * kMsPerDay;
+
+	TrackWriter writer;
+	if (FAILED(writer.open((directory + name).c_str(), start, "synthetic")))
+		return 0;
+	SyntheticFlight flight(start, kGeneratedSamplesPerSecond, index + 1);
+	const uint64_t count = static_cast<uint64_t>(hours * 3600 * kGeneratedSamplesPerSecond);
+	for (uint64_t i = 0; i < count; i++)
+		writer.append(flight.next());
+	writer.close();
+	return writer.bytesWritten();
+}
+
+int generateArchiveCommand(int argc, wchar_t** argv) {
+	if (argc < 2) {
+		fwprintf(stderr, L"usage: genarchive <directory> <gigabytes> [--hours <per flight>]\n");
+		return 2;
+	}
+	const std::wstring directory = argv[0];
+	const double targetBytes = _wtof(argv[1]) * 1e9;
+	double hours = kSyntheticCycleSeconds / 3600;
+	for (int i = 2; i < argc; i++) {
+		if (wcscmp(argv[i], L"--hours") == 0 && i + 1 < argc)
+			hours = _wtof(argv[++i]);
+	}
+
+	CreateDirectory(directory.c_str(), NULL);
+	const double start = toolSeconds();
+
+	// Size one flight to work out how many make up the archive.
+	const uint64_t first = generateFlight(directory, 0, hours);
+	if (first == 0) {
+		fwprintf(stderr, L"Could not write to %s\n", directory.c_str());
+		return 1;
+	}
+	const uint32_t count = static_cast<uint32_t>(targetBytes / first) + 1;
+
+	std::atomic<uint64_t> total(first);
+	{
+		ThreadPool pool;
+		for (uint32_t i = 1; i < count; i++)
+			pool.submit([&, i] { total += generateFlight(directory, i, hours); });
+		pool.wait();
+	}
+
+	wprintf(L"%u flights, %.2f GB in %.1f s\n", count, total / 1e9, toolSeconds() - start);
+	return 0;
+}
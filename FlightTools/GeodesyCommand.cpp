@@ -0,0 +1,201 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "framework.h"
+#include "Commands.h"
+#include "Geodesy.h"
+#include "GeodesyBatch.h"
+
+// Checks each GeodesyBatch kernel the CPU has against the <cmath> versions
+// in Geodesy.h and times them all. Points are spread over the globe, with
+// as many again within a few kilometers of the origin, where the haversine
+// matters most; several origins cover the poles and the date line.
+
+constexpr size_t kGeodesyDefaultPoints = 1000000;
+constexpr double kGeodesyNearDegrees = 0.05;
+
+struct GeodesyOriginCase {
+	double lat;
+	double lon;
+	double alt;
+};
+
+static const GeodesyOriginCase kGeodesyOrigins[] = {
+	{ 47.4502, -122.3088, 130 },
+	{ -33.9461, 151.1772, 6 },
+	{ 78.2461, 15.4656, 28 },
+	{ 0.5, 179.95, 3000 },
+	{ 89.999, -45, 0 },
+	{ -90, 0, 2835 },
+};
+
+struct GeodesyPoints {
+	std::vector<double> lat, lon, alt;
+};
+
+static GeodesyPoints makePoints(const GeodesyOriginCase& origin, size_t count, uint32_t seed) {
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<double> unit(0, 1);
+	GeodesyPoints points;
+	points.lat.resize(count);
+	points.lon.resize(count);
+	points.alt.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		if (i % 2 == 0) {
+			points.lat[i] = asin(2 * unit(random) - 1) * 180 / 3.14159265358979323846;
+			points.lon[i] = unit(random) * 360 - 180;
+		} else {
+			points.lat[i] = std::max(-90.0, std::min(90.0, origin.lat + (2 * unit(random) - 1) * kGeodesyNearDegrees));
+			points.lon[i] = remainder(origin.lon + (2 * unit(random) - 1) * kGeodesyNearDegrees, 360.0);
+		}
+		points.alt[i] = unit(random) * 12000 - 400;
+	}
+	return points;
+}
+
+struct GeodesyErrors {
+	double distance = 0;
+	double bearing = 0;
+	double position = 0;
+};
+
+// Best of three passes, in ns per point.
+template <typename F>
+static double timePoints(size_t count, F f) {
+	double seconds = HUGE_VAL;
+	for (int pass = 0; pass < 3; pass++) {
+		const double start = toolSeconds();
+		f();
+		seconds = std::min(seconds, toolSeconds() - start);
+	}
+	return seconds / count * 1e9;
+}
+
+int geodesyCommand(int argc, wchar_t** argv) {
+	size_t count = kGeodesyDefaultPoints;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--points") == 0 && i + 1 < argc)
+			count = std::max(_wtoi(argv[++i]), 1);
+		else {
+			fwprintf(stderr, L"Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+	const size_t perOrigin = std::max(count / ARRAYSIZE(kGeodesyOrigins), (size_t)1);
+	count = perOrigin * ARRAYSIZE(kGeodesyOrigins);
+
+	// The <cmath> answers, which are also the reference.
+	std::vector<GeodesyPoints> points;
+	std::vector<GeoOrigin> origins;
+	std::vector<double> distance(count), bearing(count), x(count), y(count), z(count);
+	std::vector<double> east(count), north(count), up(count);
+	for (size_t o = 0; o < ARRAYSIZE(kGeodesyOrigins); o++) {
+		const GeodesyOriginCase& c = kGeodesyOrigins[o];
+		points.push_back(makePoints(c, perOrigin, (uint32_t)o + 1));
+		origins.push_back(makeGeoOrigin(c.lat, c.lon, c.alt));
+	}
+	const double cmathDistanceNs = timePoints(count, [&]() {
+		for (size_t o = 0; o < origins.size(); o++) {
+			const GeodesyPoints& p = points[o];
+			for (size_t i = 0; i < perOrigin; i++) {
+				const size_t j = o * perOrigin + i;
+				distance[j] = greatCircleDistance(origins[o].lat, origins[o].lon, p.lat[i], p.lon[i]);
+				bearing[j] = greatCircleBearing(origins[o].lat, origins[o].lon, p.lat[i], p.lon[i]);
+			}
+		}
+	});
+	const double cmathEcefNs = timePoints(count, [&]() {
+		for (size_t o = 0; o < origins.size(); o++) {
+			const GeodesyPoints& p = points[o];
+			for (size_t i = 0; i < perOrigin; i++) {
+				const size_t j = o * perOrigin + i;
+				geodeticToEcef(p.lat[i], p.lon[i], p.alt[i], &x[j], &y[j], &z[j]);
+			}
+		}
+	});
+	for (size_t o = 0; o < origins.size(); o++) {
+		const GeodesyPoints& p = points[o];
+		for (size_t i = 0; i < perOrigin; i++) {
+			const size_t j = o * perOrigin + i;
+			geodeticToEnu(origins[o].lat, origins[o].lon, origins[o].alt, p.lat[i], p.lon[i], p.alt[i],
+				&east[j], &north[j], &up[j]);
+		}
+	}
+
+	wprintf(L"%zu points from %zu origins, ns per point:\n", count, origins.size());
+	wprintf(L"%-10s %14s %8s %8s %14s %14s %14s\n", L"kernel", L"dist+bearing", L"ECEF", L"ENU",
+		L"distance err", L"bearing err", L"position err");
+	wprintf(L"%-10s %14.1f %8.1f %8s\n", L"<cmath>", cmathDistanceNs, cmathEcefNs, L"-");
+
+	int failures = 0;
+	std::vector<double> d(count), b(count), px(count), py(count), pz(count);
+	const GeodesyKernel best = bestGeodesyKernel();
+	for (int k = kGeodesyScalar; k <= best; k++) {
+		setGeodesyKernel((GeodesyKernel)k);
+		const double distanceNs = timePoints(count, [&]() {
+			for (size_t o = 0; o < origins.size(); o++) {
+				const GeodesyPoints& p = points[o];
+				batchDistanceBearing(origins[o], p.lat.data(), p.lon.data(), perOrigin,
+					&d[o * perOrigin], &b[o * perOrigin]);
+			}
+		});
+		GeodesyErrors errors;
+		for (size_t j = 0; j < count; j++) {
+			errors.distance = std::max(errors.distance, fabs(d[j] - distance[j]));
+			errors.bearing = std::max(errors.bearing, fabs(remainder(b[j] - bearing[j], 360.0)));
+		}
+
+		const double ecefNs = timePoints(count, [&]() {
+			for (size_t o = 0; o < origins.size(); o++) {
+				const GeodesyPoints& p = points[o];
+				const size_t j = o * perOrigin;
+				batchToEcef(p.lat.data(), p.lon.data(), p.alt.data(), perOrigin, &px[j], &py[j], &pz[j]);
+			}
+		});
+		for (size_t j = 0; j < count; j++) {
+			errors.position = std::max(errors.position,
+				std::max(fabs(px[j] - x[j]), std::max(fabs(py[j] - y[j]), fabs(pz[j] - z[j]))));
+		}
+
+		const double enuNs = timePoints(count, [&]() {
+			for (size_t o = 0; o < origins.size(); o++) {
+				const GeodesyPoints& p = points[o];
+				const size_t j = o * perOrigin;
+				batchToEnu(origins[o], p.lat.data(), p.lon.data(), p.alt.data(), perOrigin,
+					&px[j], &py[j], &pz[j]);
+			}
+		});
+		for (size_t j = 0; j < count; j++) {
+			errors.position = std::max(errors.position,
+				std::max(fabs(px[j] - east[j]), std::max(fabs(py[j] - north[j]), fabs(pz[j] - up[j]))));
+		}
+
+		wprintf(L"%-10S %14.1f %8.1f %8.1f %14.2e %14.2e %14.2e\n", geodesyKernelName((GeodesyKernel)k),
+			distanceNs, ecefNs, enuNs, errors.distance, errors.bearing, errors.position);
+		if (errors.distance > kGeodesyBatchMaxDistanceError || errors.bearing > kGeodesyBatchMaxBearingError ||
+			errors.position > kGeodesyBatchMaxPositionError) {
+			fwprintf(stderr, L"%S is outside the documented error bounds\n", geodesyKernelName((GeodesyKernel)k));
+			failures++;
+		}
+	}
+	setGeodesyKernel(best);
+	return failures ? 1 : 0;
+}
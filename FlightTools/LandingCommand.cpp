@@ -0,0 +1,239 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "framework.h"
+#include "Commands.h"
+#include "FlightPhaseDetector.h"
+#include "LandingCapture.h"
+#include "SampleRing.h"
+#include "SyntheticFlight.h"
+#include "TrackFile.h"
+
+// Replays flights through the landing capture and prints a report for each
+// touchdown. --synthetic replays generated flights at the simulator's
+// frame rate, once with the simulator's on-ground flag, vertical speed and
+// load factor and once without, and checks both against the profile. It
+// also has a reader copy from a ring that a writer keeps lapping, and
+// checks that no copied sample was half written.
+
+constexpr double kLandingToolSamplesPerSecond = 60;
+constexpr int64_t kLandingToolStartTimeMs = 1600000000000ll;
+constexpr double kLandingToolMpsToFpm = 196.850394;
+
+// SyntheticFlight descends at this rate onto a runway 120 m up, at 90 knots,
+// touching down 60 s before the end of each cycle with a 1.4 G bump and its
+// heading 3 degrees right of its track.
+constexpr double kSyntheticSinkMps = -2480.0 / (kSyntheticCycleSeconds - 6060);
+constexpr double kSyntheticApproachMps = 90 * 0.514444;
+constexpr double kSyntheticContactSeconds = kSyntheticCycleSeconds - 60;
+constexpr double kSyntheticFloatMeters = 15.24 / -kSyntheticSinkMps * kSyntheticApproachMps;
+constexpr double kSyntheticGForce = 1.4;
+constexpr double kSyntheticCrab = 3;
+
+// A small ring, so the writer laps the reader all the time.
+constexpr size_t kRingStressSamples = 64;
+constexpr double kRingStressSeconds = 2;
+
+class ReportLog : public LandingCallbacks {
+public:
+	void onLandingReport(const LandingReport& report) override {
+		reports.push_back(report);
+	}
+	std::vector<LandingReport> reports;
+};
+
+static void printReport(const LandingReport& report, int64_t startMs) {
+	const int64_t s = (report.time_ms - startMs) / 1000;
+	wprintf(L"  %02lld:%02lld:%02lld  %5.0f fpm  %4.2f G  ", s / 3600, s / 60 % 60, s % 60,
+		report.vertical_speed * kLandingToolMpsToFpm, report.g_force);
+	if (report.float_distance >= 0)
+		wprintf(L"float %4.0f m  ", report.float_distance);
+	else
+		wprintf(L"float   -- m  ");
+	wprintf(L"centerline %+5.1f m  crab %+4.1f%s\n", report.centerline_offset, report.crab,
+		report.from_on_ground ? L"" : L"  (estimated contact)");
+}
+
+// Feeds samples through a detector and a capture, as the scheduler would,
+// and returns the reports and the time per sample.
+static double replay(const std::vector<SimSample>& samples, std::vector<LandingReport>* reports) {
+	FlightPhaseDetector detector;
+	LandingCapture capture;
+	ReportLog log;
+	capture.addCallback(&log);
+	detector.addCallback(&capture);
+	capture.start(std::wstring());
+	capture.onStateChange(SimInterfaceInFlight);
+
+	int64_t next_phase_ms = 0;
+	const double start = toolSeconds();
+	for (const SimSample& sample : samples) {
+		capture.onSample(sample);
+		if (sample.time_ms >= next_phase_ms) {
+			detector.onSample(sample);
+			next_phase_ms = sample.time_ms + (int64_t)(1000 / kFlightPhaseSamplesPerSecond);
+		}
+		capture.drain();
+	}
+	const double seconds = toolSeconds() - start;
+	capture.stop();
+	*reports = log.reports;
+	return samples.empty() ? 0 : seconds / samples.size();
+}
+
+static int checkSynthetic(LPCWSTR name, const std::vector<LandingReport>& reports, int flights, bool exact) {
+	int errors = 0;
+	if (reports.size() != (size_t)flights) {
+		fwprintf(stderr, L"%s: %zu reports for %d flights\n", name, reports.size(), flights);
+		return 1;
+	}
+	for (size_t i = 0; i < reports.size(); i++) {
+		const LandingReport& r = reports[i];
+		printReport(r, kLandingToolStartTimeMs);
+		const double t = (r.time_ms - kLandingToolStartTimeMs) / 1000.0 - i * kSyntheticCycleSeconds;
+		const bool good =
+			fabs(t - kSyntheticContactSeconds) <= (exact ? 0.05 : 1.5) &&
+			fabs(r.vertical_speed - kSyntheticSinkMps) <= (exact ? 0.01 : 0.3) &&
+			(!exact || fabs(r.g_force - kSyntheticGForce) <= 0.05) &&
+			fabs(r.float_distance - kSyntheticFloatMeters) <= (exact ? 5 : 60) &&
+			fabs(r.centerline_offset) <= 1 &&
+			fabs(r.crab - kSyntheticCrab) <= 0.1;
+		if (!good) {
+			fwprintf(stderr, L"%s: landing %zu is off the profile\n", name, i + 1);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+// Every field of stress sample i is i, so a torn one does not match.
+static void setStressSample(SimSample* sample, int64_t i) {
+	const double v = (double)i;
+	sample->time_ms = i;
+	SimData& d = sample->data;
+	d.gps_alt = d.gps_lat = d.gps_lon = d.gps_track = d.gps_groundspeed = v;
+	d.pitch = d.bank = d.heading = d.vertical_speed = d.g_force = d.alt_agl = d.on_ground = v;
+}
+
+static bool isStressSample(const SimSample& sample, uint64_t i) {
+	const double v = (double)i;
+	const SimData& d = sample.data;
+	return sample.time_ms == (int64_t)i &&
+		d.gps_alt == v && d.gps_lat == v && d.gps_lon == v && d.gps_track == v &&
+		d.gps_groundspeed == v && d.pitch == v && d.bank == v && d.heading == v &&
+		d.vertical_speed == v && d.g_force == v && d.alt_agl == v && d.on_ground == v;
+}
+
+// The reader asks for everything held, so it keeps reading the slot the
+// writer is about to reuse.
+static int ringStress() {
+	SampleRing<kRingStressSamples> ring;
+	std::atomic<bool> done{ false };
+	std::thread writer([&ring, &done] {
+		SimSample sample;
+		for (int64_t i = 0; !done.load(std::memory_order_relaxed); i++) {
+			setStressSample(&sample, i);
+			ring.push(sample);
+		}
+	});
+
+	std::vector<SimSample> out;
+	uint64_t copies = 0, copied = 0, torn = 0;
+	const double start = toolSeconds();
+	while (toolSeconds() - start < kRingStressSeconds) {
+		const uint64_t first = ring.copy(0, UINT64_MAX, &out);
+		for (size_t i = 0; i < out.size(); i++) {
+			if (!isStressSample(out[i], first + i))
+				torn++;
+		}
+		copies++;
+		copied += out.size();
+	}
+	done = true;
+	writer.join();
+
+	wprintf(L"Ring stress: %llu copies, %llu samples, %llu torn, %llu written\n",
+		copies, copied, torn, ring.written());
+	if (torn != 0) {
+		fwprintf(stderr, L"The ring returned samples that were being overwritten\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int syntheticLandings(int flights) {
+	SyntheticFlight flight(kLandingToolStartTimeMs, kLandingToolSamplesPerSecond);
+	std::vector<SimSample> samples((size_t)(kSyntheticCycleSeconds * kLandingToolSamplesPerSecond * flights));
+	for (SimSample& sample : samples)
+		sample = flight.next();
+
+	std::vector<LandingReport> reports;
+	double perSample = replay(samples, &reports);
+	wprintf(L"With the simulator's flags: %.1f ns/sample\n", perSample * 1e9);
+	int errors = checkSynthetic(L"flags", reports, flights, true);
+
+	// As from a simulator that only gives position and attitude.
+	for (SimSample& sample : samples) {
+		sample.data.vertical_speed = 0;
+		sample.data.g_force = 0;
+		sample.data.alt_agl = 0;
+		sample.data.on_ground = 0;
+	}
+	perSample = replay(samples, &reports);
+	wprintf(L"Without: %.1f ns/sample\n", perSample * 1e9);
+	errors += checkSynthetic(L"estimated", reports, flights, false);
+	errors += ringStress();
+	return errors ? 1 : 0;
+}
+
+int landingCommand(int argc, wchar_t** argv) {
+	if (argc >= 2 && wcscmp(argv[0], L"--synthetic") == 0)
+		return syntheticLandings(std::max(_wtoi(argv[1]), 1));
+
+	std::vector<std::wstring> files = expandInputFiles(argc, argv, kTrackFileExtension);
+	if (files.empty()) {
+		fwprintf(stderr, L"No track files given\n");
+		return 2;
+	}
+
+	TrackColumns columns;
+	std::vector<SimSample> samples;
+	std::vector<LandingReport> reports;
+	for (const std::wstring& path : files) {
+		TrackReader reader;
+		if (FAILED(reader.open(path.c_str()))) {
+			fwprintf(stderr, L"Could not read %s\n", path.c_str());
+			continue;
+		}
+		samples.clear();
+		for (size_t i = 0; i < reader.blockCount(); i++) {
+			if (!reader.readBlock(i, &columns))
+				continue;
+			for (int j = 0; j < columns.count; j++)
+				samples.push_back(columns.sample(j));
+		}
+		replay(samples, &reports);
+		wprintf(L"%s: %zu landings\n", path.c_str(), reports.size());
+		for (const LandingReport& report : reports)
+			printReport(report, samples.empty() ? 0 : samples.front().time_ms);
+	}
+	return 0;
+}
@@ -0,0 +1,274 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+
+#include "framework.h"
+#include "Commands.h"
+#include "FlightPhaseDetector.h"
+#include "SyntheticFlight.h"
+#include "TrackFile.h"
+
+// Replays recordings through the flight phase detector and lists what it
+// found. With --synthetic, replays generated flights instead and checks
+// every phase change, liftoff and touchdown against the known profile.
+
+constexpr double kPhasesSamplesPerSecond = 10;
+constexpr int64_t kPhasesStartTimeMs = 1600000000000ll;
+constexpr double kPhasesMpsToFpm = 196.850394;
+
+// Each generated flight should go through exactly these.
+static const FlightPhase kSyntheticPhases[] = {
+	kPhaseTakeoffRoll, kPhaseClimb, kPhaseCruise, kPhaseDescent, kPhaseApproach, kPhaseRollout, kPhaseTaxi,
+};
+
+// SyntheticFlight lifts off 40 s into each cycle and levels off on the
+// runway 60 s before its end, descending at this rate.
+constexpr double kSyntheticLiftoffSeconds = 40;
+constexpr double kSyntheticTouchdownSeconds = kSyntheticCycleSeconds - 60;
+constexpr double kSyntheticSinkRateMps = -2480.0 / (kSyntheticCycleSeconds - 6060);
+
+// A descent that levels off in the air, slow enough to be landing, and the
+// time it holds there.
+constexpr double kLevelOffSpeedMps = 70;
+constexpr double kLevelOffSinkRateMps = -5;
+constexpr double kLevelOffDescentSeconds = 100;
+constexpr double kLevelOffHoldSeconds = 150;
+// Generated flights are in the cruise by then.
+constexpr double kLevelOffDepartureSeconds = 1300;
+
+static void printTime(int64_t ms) {
+	const int64_t s = ms / 1000;
+	wprintf(L"  %02lld:%02lld:%02lld  ", s / 3600, s / 60 % 60, s % 60);
+}
+
+class PhaseLog : public FlightPhaseCallbacks {
+public:
+	explicit PhaseLog(bool verbose) : verbose_(verbose) {}
+
+	void onFlightPhase(FlightPhase phase, const SimSample& sample) override {
+		phases.push_back(phase);
+		if (verbose_) {
+			printTime(sample.time_ms - start_ms);
+			wprintf(L"%S\n", flightPhaseName(phase));
+		}
+	}
+
+	void onLiftoff(const SimSample& sample) override {
+		liftoffs.push_back(sample.time_ms);
+		if (verbose_) {
+			printTime(sample.time_ms - start_ms);
+			wprintf(L"Liftoff at %0.0f kt\n", sample.data.gps_groundspeed * 1.943844);
+		}
+	}
+
+	void onTouchdown(const TouchdownInfo& touchdown) override {
+		touchdowns.push_back(touchdown);
+		if (verbose_) {
+			printTime(touchdown.time_ms - start_ms);
+			wprintf(L"Touchdown at %0.0f fpm, %0.0f kt\n",
+				touchdown.vertical_speed * kPhasesMpsToFpm, touchdown.groundspeed * 1.943844);
+		}
+	}
+
+	int64_t start_ms = 0;
+	std::vector<FlightPhase> phases;
+	std::vector<int64_t> liftoffs;
+	std::vector<TouchdownInfo> touchdowns;
+
+private:
+	bool verbose_;
+};
+
+// Levels off in the air with, in turn, no sign of the ground at all, the
+// simulator's height above the ground, and only the altitude of the field
+// it departed from. None of these is a touchdown.
+static int checkLevelOff(bool verbose) {
+	static const wchar_t* const kGroundSources[] = {
+		L"no ground data", L"height above ground", L"departure field",
+	};
+	int errors = 0;
+	const int sources = (int)(sizeof(kGroundSources) / sizeof(kGroundSources[0]));
+	for (int source = 0; source < sources; source++) {
+		std::vector<SimSample> samples;
+		SimSample sample;
+		if (source == 2) {
+			// Take off first so the detector knows the field's altitude,
+			// without the simulator's ground data.
+			SyntheticFlight flight(kPhasesStartTimeMs, kPhasesSamplesPerSecond);
+			for (int i = 0; i < kLevelOffDepartureSeconds * kPhasesSamplesPerSecond; i++) {
+				sample = flight.next();
+				sample.data.alt_agl = 0;
+				sample.data.on_ground = 0;
+				samples.push_back(sample);
+			}
+		} else {
+			sample.time_ms = kPhasesStartTimeMs;
+			sample.data.gps_alt = 2600;
+		}
+
+		const double cruiseAlt = sample.data.gps_alt;
+		const int count = (int)((kLevelOffDescentSeconds + kLevelOffHoldSeconds) * kPhasesSamplesPerSecond);
+		for (int i = 1; i <= count; i++) {
+			const double t = i / kPhasesSamplesPerSecond;
+			sample.time_ms += (int64_t)(1000 / kPhasesSamplesPerSecond);
+			sample.data.gps_alt = cruiseAlt + kLevelOffSinkRateMps * std::min(t, kLevelOffDescentSeconds);
+			sample.data.gps_groundspeed = kLevelOffSpeedMps;
+			sample.data.vertical_speed = t < kLevelOffDescentSeconds ? kLevelOffSinkRateMps : 0;
+			sample.data.alt_agl = source == 1 ? sample.data.gps_alt - 120 : 0;
+			sample.data.on_ground = 0;
+			samples.push_back(sample);
+		}
+
+		FlightPhaseDetector detector;
+		PhaseLog log(verbose);
+		log.start_ms = samples.front().time_ms;
+		detector.addCallback(&log);
+		if (verbose)
+			wprintf(L"Level-off in the air, %s:\n", kGroundSources[source]);
+		for (const SimSample& s : samples)
+			detector.onSample(s);
+
+		const bool descended = std::find(log.phases.begin(), log.phases.end(), kPhaseDescent) != log.phases.end();
+		const bool rollout = std::find(log.phases.begin(), log.phases.end(), kPhaseRollout) != log.phases.end();
+		if (!descended || rollout || !log.touchdowns.empty() || detector.phase() != kPhaseCruise) {
+			fwprintf(stderr, L"Level-off in the air with %s: %S, %zu touchdowns\n", kGroundSources[source],
+				!descended ? "no descent" : rollout ? "rollout" : flightPhaseName(detector.phase()),
+				log.touchdowns.size());
+			errors++;
+		}
+	}
+	wprintf(L"%d level-offs in the air: %S\n", sources, errors ? "some taken for touchdowns" : "no touchdowns");
+	return errors;
+}
+
+static int syntheticPhases(int flights, bool verbose) {
+	const size_t perFlight = (size_t)(kSyntheticCycleSeconds * kPhasesSamplesPerSecond);
+	SyntheticFlight flight(kPhasesStartTimeMs, kPhasesSamplesPerSecond);
+	std::vector<SimSample> samples(perFlight * flights);
+	for (SimSample& sample : samples)
+		sample = flight.next();
+
+	FlightPhaseDetector detector;
+	PhaseLog log(verbose);
+	log.start_ms = kPhasesStartTimeMs;
+	detector.addCallback(&log);
+	const double start = toolSeconds();
+	for (const SimSample& sample : samples)
+		detector.onSample(sample);
+	const double seconds = toolSeconds() - start;
+
+	int errors = 0;
+	// Joining on the ground, the detector starts out taxiing.
+	const size_t count = sizeof(kSyntheticPhases) / sizeof(kSyntheticPhases[0]);
+	if (log.phases.size() != 1 + count * flights) {
+		fwprintf(stderr, L"%zu phase changes, expected %zu\n", log.phases.size(), 1 + count * flights);
+		errors++;
+	} else {
+		for (size_t i = 1; i < log.phases.size(); i++) {
+			if (log.phases[i] != kSyntheticPhases[(i - 1) % count]) {
+				fwprintf(stderr, L"Phase change %zu is %S, expected %S\n", i,
+					flightPhaseName(log.phases[i]), flightPhaseName(kSyntheticPhases[(i - 1) % count]));
+				errors++;
+			}
+		}
+	}
+	if (log.liftoffs.size() != (size_t)flights || log.touchdowns.size() != (size_t)flights) {
+		fwprintf(stderr, L"%zu liftoffs and %zu touchdowns in %d flights\n",
+			log.liftoffs.size(), log.touchdowns.size(), flights);
+		errors++;
+	}
+
+	double worstLiftoff = 0, worstTouchdown = 0, worstRate = 0;
+	for (size_t i = 0; i < log.liftoffs.size(); i++) {
+		const double t = (log.liftoffs[i] - kPhasesStartTimeMs) / 1000.0 - i * kSyntheticCycleSeconds;
+		worstLiftoff = std::max(worstLiftoff, fabs(t - kSyntheticLiftoffSeconds));
+	}
+	for (size_t i = 0; i < log.touchdowns.size(); i++) {
+		const TouchdownInfo& touchdown = log.touchdowns[i];
+		const double t = (touchdown.time_ms - kPhasesStartTimeMs) / 1000.0 - i * kSyntheticCycleSeconds;
+		worstTouchdown = std::max(worstTouchdown, fabs(t - kSyntheticTouchdownSeconds));
+		worstRate = std::max(worstRate, fabs(touchdown.vertical_speed - kSyntheticSinkRateMps));
+	}
+	wprintf(L"%d flights, %zu samples: %.1f ns/sample\n", flights, samples.size(),
+		seconds / samples.size() * 1e9);
+	wprintf(L"liftoff within %.1f s, touchdown within %.1f s and %.2f m/s of the truth\n",
+		worstLiftoff, worstTouchdown, worstRate);
+
+	// Detection waits for evidence, but not for long.
+	if (worstLiftoff > 5 || worstTouchdown > 2 || worstRate > 0.3) {
+		fwprintf(stderr, L"Events are too far from the generated flight\n");
+		errors++;
+	}
+	errors += checkLevelOff(verbose);
+	return errors ? 1 : 0;
+}
+
+int phasesCommand(int argc, wchar_t** argv) {
+	bool quiet = false;
+	int synthetic = 0;
+	std::vector<wchar_t*> inputs;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--synthetic") == 0 && i + 1 < argc)
+			synthetic = _wtoi(argv[++i]);
+		else if (wcscmp(argv[i], L"--quiet") == 0)
+			quiet = true;
+		else
+			inputs.push_back(argv[i]);
+	}
+	if (synthetic > 0)
+		return syntheticPhases(synthetic, !quiet);
+
+	std::vector<std::wstring> files = expandInputFiles((int)inputs.size(), inputs.data(), kTrackFileExtension);
+	if (files.empty()) {
+		fwprintf(stderr, L"No track files given\n");
+		return 2;
+	}
+
+	uint64_t samples = 0, liftoffs = 0, touchdowns = 0;
+	double seconds = 0;
+	TrackColumns columns;
+	for (const std::wstring& path : files) {
+		TrackReader reader;
+		if (FAILED(reader.open(path.c_str()))) {
+			fwprintf(stderr, L"Could not read %s\n", path.c_str());
+			continue;
+		}
+		if (!quiet)
+			wprintf(L"%s\n", path.c_str());
+
+		FlightPhaseDetector detector;
+		PhaseLog log(!quiet);
+		log.start_ms = reader.blockCount() ? reader.block(0).first_time_ms : 0;
+		detector.addCallback(&log);
+		for (size_t i = 0; i < reader.blockCount(); i++) {
+			if (!reader.readBlock(i, &columns))
+				continue;
+			const double start = toolSeconds();
+			for (int j = 0; j < columns.count; j++)
+				detector.onSample(columns.sample(j));
+			seconds += toolSeconds() - start;
+			samples += columns.count;
+		}
+		liftoffs += log.liftoffs.size();
+		touchdowns += log.touchdowns.size();
+	}
+	wprintf(L"%zu flights: %llu liftoffs, %llu touchdowns, %.1f ns/sample\n", files.size(),
+		liftoffs, touchdowns, samples ? seconds / samples * 1e9 : 0.0);
+	return 0;
+}
@@ -0,0 +1,378 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "Commands.h"
+#include "SyntheticFlight.h"
+#include "TrackFile.h"
+
+// Seeks and range scans over a recording through its index: the sample at
+// a time into the flight, or the samples in a time window, area or band of
+// altitudes, decoding only the blocks that may hold them. --index writes
+// indexes for recordings made before they had them. --synthetic records a
+// generated flight and checks every kind of query against a full decode,
+// with and without the index.
+
+constexpr double kRangeSamplesPerSecond = 10;
+constexpr int64_t kRangeStartTimeMs = 1600000000000ll;
+constexpr int kRangeChecks = 500;
+
+constexpr int kAltChannel = offsetof(SimData, gps_alt) / sizeof(double);
+constexpr int kLatChannel = offsetof(SimData, gps_lat) / sizeof(double);
+constexpr int kLonChannel = offsetof(SimData, gps_lon) / sizeof(double);
+constexpr int kOnGroundChannel = offsetof(SimData, on_ground) / sizeof(double);
+
+// "1:23:45", "T+01:23:45", "83:45" or "5025" into milliseconds.
+static int64_t parseOffset(const wchar_t* text) {
+	if (text[0] == L'T' && text[1] == L'+')
+		text += 2;
+	double seconds = 0;
+	while (*text) {
+		wchar_t* end = nullptr;
+		const double part = wcstod(text, &end);
+		if (end == text)
+			break;
+		seconds = seconds * 60 + part;
+		text = *end == L':' ? end + 1 : end;
+	}
+	return (int64_t)llround(seconds * 1000);
+}
+
+static void printOffset(int64_t ms) {
+	const int64_t s = ms / 1000;
+	wprintf(L"T+%lld:%02lld:%02lld.%03lld", s / 3600, s / 60 % 60, s % 60, ms % 1000);
+}
+
+static void printSample(const TrackColumns& columns, int index, int64_t startMs) {
+	const SimSample sample = columns.sample(index);
+	printOffset(sample.time_ms - startMs);
+	wprintf(L"  %10.5f %11.5f %7.0f m %4.0f kt %3.0f deg\n", sample.data.gps_lat, sample.data.gps_lon,
+		sample.data.gps_alt, sample.data.gps_groundspeed * 1.943844, sample.data.gps_track);
+}
+
+// The time of the last touchdown, looking back from the end one block at a
+// time at the on-ground flag alone; 0 if there is none.
+static int64_t findLastTouchdown(const TrackReader& reader) {
+	TrackColumns columns;
+	bool laterOnGround = false;
+	int64_t laterTime = 0;
+	for (size_t b = reader.blockCount(); b-- > 0;) {
+		if (!reader.readBlock(b, &columns, 1ull << kOnGroundChannel))
+			continue;
+		const double* onGround = columns.channel(kOnGroundChannel);
+		for (int i = columns.count - 1; i >= 0; i--) {
+			if (laterOnGround && onGround[i] == 0)
+				return laterTime;
+			laterOnGround = onGround[i] != 0;
+			laterTime = columns.time_ms[i];
+		}
+	}
+	return 0;
+}
+
+// Decodes the blocks query selects and counts, or prints, the samples in it.
+static uint64_t runQuery(TrackReader& reader, const TrackQuery& query, bool print, int64_t startMs,
+	size_t* blocksRead, size_t* ruledOut, size_t* bytesRead) {
+	std::vector<TrackBlockView> views;
+	*ruledOut = reader.scan(query, &views);
+	*blocksRead = views.size();
+	*bytesRead = 0;
+
+	// Printing needs every channel, counting only those the query reads.
+	const uint64_t mask = print ? ~0ull : (1ull << kAltChannel) | (1ull << kLatChannel) | (1ull << kLonChannel);
+	uint64_t count = 0;
+	TrackColumns columns;
+	for (const TrackBlockView& view : views) {
+		if (!view.decode(&columns, mask))
+			continue;
+		*bytesRead += view.size;
+		int begin, end;
+		trackTimeSlice(columns, query.from_ms, query.to_ms, &begin, &end);
+		const double* lat = columns.channel(kLatChannel);
+		const double* lon = columns.channel(kLonChannel);
+		const double* alt = columns.channel(kAltChannel);
+		for (int i = begin; i < end; i++) {
+			if (!query.matches(columns.time_ms[i], lat[i], lon[i], alt[i]))
+				continue;
+			count++;
+			if (print)
+				printSample(columns, i, startMs);
+		}
+	}
+	return count;
+}
+
+static int indexRecordings(int argc, wchar_t** argv) {
+	std::vector<std::wstring> files = expandInputFiles(argc, argv, kTrackFileExtension);
+	int errors = 0;
+	for (const std::wstring& path : files) {
+		TrackReader reader;
+		if (FAILED(reader.open(path.c_str()))) {
+			fwprintf(stderr, L"Could not read %s\n", path.c_str());
+			errors++;
+			continue;
+		}
+		if (reader.indexedBlockCount() == reader.blockCount())
+			continue;
+		const std::wstring indexPath = trackIndexPath(path.c_str());
+		if (FAILED(reader.writeIndex(indexPath.c_str()))) {
+			fwprintf(stderr, L"Could not write %s\n", indexPath.c_str());
+			errors++;
+			continue;
+		}
+		wprintf(L"%s: %zu blocks\n", indexPath.c_str(), reader.blockCount());
+	}
+	return errors ? 1 : 0;
+}
+
+// Every sample of the recording, decoded the slow way.
+struct DecodedFlight {
+	std::vector<int64_t> times;
+	std::vector<double> lat, lon, alt;
+
+	uint64_t count(const TrackQuery& query) const {
+		uint64_t n = 0;
+		for (size_t i = 0; i < times.size(); i++)
+			n += query.matches(times[i], lat[i], lon[i], alt[i]) ? 1 : 0;
+		return n;
+	}
+};
+
+// Runs the checks against reader, opened with or without its index.
+static int checkQueries(TrackReader& reader, const DecodedFlight& flight, const wchar_t* how) {
+	std::mt19937 random(7);
+	const int64_t first = flight.times.front();
+	const int64_t last = flight.times.back();
+	std::uniform_int_distribution<int64_t> anyTime(first - 1000, last + 1000);
+	std::uniform_int_distribution<size_t> anySample(0, flight.times.size() - 1);
+	int errors = 0;
+
+	// Seeking lands on the first sample at or after the time.
+	TrackColumns columns;
+	for (int i = 0; i < kRangeChecks; i++) {
+		const int64_t time = anyTime(random);
+		const size_t expected = std::lower_bound(flight.times.begin(), flight.times.end(), time) - flight.times.begin();
+		const size_t block = reader.seek(time);
+		int64_t found = -1;
+		if (block < reader.blockCount() && reader.readBlock(block, &columns, 0)) {
+			int begin, end;
+			trackTimeSlice(columns, time, INT64_MAX, &begin, &end);
+			if (begin < end)
+				found = columns.time_ms[begin];
+		}
+		const int64_t truth = expected < flight.times.size() ? flight.times[expected] : -1;
+		if (found != truth) {
+			fwprintf(stderr, L"%s: seeking %lld found %lld, expected %lld\n", how, time, found, truth);
+			errors++;
+		}
+	}
+
+	// Time windows, areas and altitude bands, alone and together.
+	double selected = 0, total = 0;
+	double scanSeconds = 0;
+	for (int i = 0; i < kRangeChecks; i++) {
+		TrackQuery query;
+		const int kind = i % 4;
+		if (kind == 0 || kind == 3) {
+			query.from_ms = anyTime(random);
+			query.to_ms = query.from_ms + 120000;
+		}
+		if (kind == 1 || kind == 3) {
+			const size_t at = anySample(random);
+			query.has_area = true;
+			query.min_lat = flight.lat[at] - 0.05;
+			query.max_lat = flight.lat[at] + 0.05;
+			query.min_lon = flight.lon[at] - 0.05;
+			query.max_lon = flight.lon[at] + 0.05;
+		}
+		if (kind == 2) {
+			query.min_alt = 100;
+			query.max_alt = 500;
+		}
+		size_t blocksRead, ruledOut, bytesRead;
+		const double start = toolSeconds();
+		const uint64_t count = runQuery(reader, query, false, first, &blocksRead, &ruledOut, &bytesRead);
+		scanSeconds += toolSeconds() - start;
+		const uint64_t truth = flight.count(query);
+		if (count != truth) {
+			fwprintf(stderr, L"%s: query %d matched %llu samples, expected %llu\n", how, i, count, truth);
+			errors++;
+		}
+		selected += (double)blocksRead;
+		total += (double)reader.blockCount();
+	}
+	wprintf(L"%-14s %zu of %zu blocks indexed, queries decode %.1f%% of blocks, %.1f us each\n", how,
+		reader.indexedBlockCount(), reader.blockCount(), selected / total * 100, scanSeconds / kRangeChecks * 1e6);
+	return errors;
+}
+
+static int syntheticRange(double hours) {
+	wchar_t temp[MAX_PATH] = { 0 };
+	GetTempPath(ARRAYSIZE(temp), temp);
+	const std::wstring path = std::wstring(temp) + L"FlightMonitorRange" + kTrackFileExtension;
+	const std::wstring indexPath = trackIndexPath(path.c_str());
+
+	DecodedFlight flight;
+	{
+		TrackWriter writer;
+		if (FAILED(writer.open(path.c_str(), kRangeStartTimeMs, "synthetic"))) {
+			fwprintf(stderr, L"Could not write %s\n", path.c_str());
+			return 1;
+		}
+		SyntheticFlight generator(kRangeStartTimeMs, kRangeSamplesPerSecond);
+		const uint64_t count = (uint64_t)(hours * 3600 * kRangeSamplesPerSecond);
+		for (uint64_t i = 0; i < count; i++) {
+			const SimSample sample = generator.next();
+			writer.append(sample);
+			flight.times.push_back(sample.time_ms);
+			flight.lat.push_back(sample.data.gps_lat);
+			flight.lon.push_back(sample.data.gps_lon);
+			flight.alt.push_back(sample.data.gps_alt);
+		}
+		writer.close();
+	}
+	wprintf(L"%.1f hours, %zu samples\n", hours, flight.times.size());
+
+	int errors = 0;
+	{
+		TrackReader reader;
+		if (FAILED(reader.open(path.c_str()))) {
+			fwprintf(stderr, L"Could not read %s\n", path.c_str());
+			return 1;
+		}
+		if (reader.indexedBlockCount() != reader.blockCount() || reader.sampleCount() != flight.times.size()) {
+			fwprintf(stderr, L"The index covers %zu of %zu blocks\n", reader.indexedBlockCount(), reader.blockCount());
+			errors++;
+		}
+		errors += checkQueries(reader, flight, L"indexed");
+	}
+
+	// As a recording made before indexes: walked, bounded on demand, and
+	// then given its index.
+	DeleteFile(indexPath.c_str());
+	{
+		TrackReader reader;
+		if (FAILED(reader.open(path.c_str())))
+			return 1;
+		errors += checkQueries(reader, flight, L"walked");
+		if (FAILED(reader.writeIndex(indexPath.c_str()))) {
+			fwprintf(stderr, L"Could not write %s\n", indexPath.c_str());
+			errors++;
+		}
+	}
+	{
+		TrackReader reader;
+		if (FAILED(reader.open(path.c_str())))
+			return 1;
+		errors += checkQueries(reader, flight, L"backfilled");
+	}
+
+	DeleteFile(path.c_str());
+	DeleteFile(indexPath.c_str());
+	return errors ? 1 : 0;
+}
+
+int rangeCommand(int argc, wchar_t** argv) {
+	if (argc >= 2 && wcscmp(argv[0], L"--synthetic") == 0)
+		return syntheticRange(std::max(0.1, _wtof(argv[1])));
+	if (argc >= 1 && wcscmp(argv[0], L"--index") == 0)
+		return indexRecordings(argc - 1, argv + 1);
+	if (argc < 1) {
+		fwprintf(stderr, L"No track file given\n");
+		return 2;
+	}
+
+	TrackReader reader;
+	if (FAILED(reader.open(argv[0]))) {
+		fwprintf(stderr, L"Could not read %s\n", argv[0]);
+		return 1;
+	}
+	if (reader.blockCount() == 0)
+		return 0;
+	const int64_t startMs = reader.block(0).first_time_ms;
+
+	TrackQuery query;
+	bool print = false;
+	int64_t at = -1;
+	double beforeTouchdown = 0;
+	for (int i = 1; i < argc; i++) {
+		if (wcscmp(argv[i], L"--at") == 0 && i + 1 < argc)
+			at = startMs + parseOffset(argv[++i]);
+		else if (wcscmp(argv[i], L"--from") == 0 && i + 1 < argc)
+			query.from_ms = startMs + parseOffset(argv[++i]);
+		else if (wcscmp(argv[i], L"--to") == 0 && i + 1 < argc)
+			query.to_ms = startMs + parseOffset(argv[++i]);
+		else if (wcscmp(argv[i], L"--touchdown") == 0 && i + 1 < argc)
+			beforeTouchdown = _wtof(argv[++i]);
+		else if (wcscmp(argv[i], L"--area") == 0 && i + 4 < argc) {
+			const double lat0 = _wtof(argv[++i]), lon0 = _wtof(argv[++i]);
+			const double lat1 = _wtof(argv[++i]), lon1 = _wtof(argv[++i]);
+			query.has_area = true;
+			query.min_lat = std::min(lat0, lat1);
+			query.max_lat = std::max(lat0, lat1);
+			query.min_lon = std::min(lon0, lon1);
+			query.max_lon = std::max(lon0, lon1);
+		} else if (wcscmp(argv[i], L"--above") == 0 && i + 1 < argc)
+			query.min_alt = _wtof(argv[++i]);
+		else if (wcscmp(argv[i], L"--below") == 0 && i + 1 < argc)
+			query.max_alt = _wtof(argv[++i]);
+		else if (wcscmp(argv[i], L"--samples") == 0)
+			print = true;
+		else {
+			fwprintf(stderr, L"Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	const double start = toolSeconds();
+	if (at >= 0) {
+		const size_t block = reader.seek(at);
+		TrackColumns columns;
+		int begin = 0, end = 0;
+		if (block < reader.blockCount() && reader.readBlock(block, &columns))
+			trackTimeSlice(columns, at, INT64_MAX, &begin, &end);
+		if (begin == end) {
+			fwprintf(stderr, L"Nothing recorded at or after that time\n");
+			return 1;
+		}
+		printSample(columns, begin, startMs);
+		wprintf(L"Block %zu of %zu in %.0f us\n", block, reader.blockCount(), (toolSeconds() - start) * 1e6);
+		return 0;
+	}
+
+	if (beforeTouchdown > 0) {
+		const int64_t touchdown = findLastTouchdown(reader);
+		if (touchdown == 0) {
+			fwprintf(stderr, L"No touchdown recorded\n");
+			return 1;
+		}
+		query.to_ms = touchdown;
+		query.from_ms = touchdown - (int64_t)(beforeTouchdown * 1000);
+	}
+
+	size_t blocksRead, ruledOut, bytesRead;
+	const uint64_t count = runQuery(reader, query, print, startMs, &blocksRead, &ruledOut, &bytesRead);
+	wprintf(L"%llu samples from %zu of %zu blocks (%zu ruled out by their bounds), %.1f of %.1f MB, %.0f us\n",
+		count, blocksRead, reader.blockCount(), ruledOut, bytesRead / 1e6, reader.fileSize() / 1e6,
+		(toolSeconds() - start) * 1e6);
+	return 0;
+}
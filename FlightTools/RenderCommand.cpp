@@ -0,0 +1,106 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+
+#include "framework.h"
+#include "Commands.h"
+#include "SyntheticFlight.h"
+#include "TrackRenderer.h"
+
+// Drives the main window's renderer with a generated flight, the way the
+// window does at its default size, and reports what each frame costs. With
+// --png, writes the last frame out so the drawing can be looked at.
+
+constexpr double kRenderSamplesPerSecond = 10;
+constexpr int kRenderSamplesPerFrame = 10;  // one frame per second of flight
+constexpr int64_t kRenderStartTimeMs = 1600000000000ll;
+constexpr int kRenderWidth = 400;
+constexpr int kRenderHeight = 300;
+
+int renderCommand(int argc, wchar_t** argv) {
+	double minutes = 60;
+	const wchar_t* pngPath = nullptr;
+	for (int i = 0; i + 1 < argc; i += 2) {
+		if (wcscmp(argv[i], L"--minutes") == 0) {
+			minutes = _wtof(argv[i + 1]);
+		} else if (wcscmp(argv[i], L"--png") == 0) {
+			pngPath = argv[i + 1];
+		} else {
+			fwprintf(stderr, L"Unknown option %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	TrackLod track;
+	TrackRenderer renderer(&track);
+	renderer.resize(kRenderWidth, kRenderHeight);
+	SyntheticFlight flight(kRenderStartTimeMs, kRenderSamplesPerSecond);
+
+	const uint64_t count = (uint64_t)(minutes * 60 * kRenderSamplesPerSecond);
+	uint64_t frames = 0;
+	uint64_t dirtyPixels = 0;
+	double seconds = 0;
+	char buf[64];
+	for (uint64_t i = 0; i < count; i++) {
+		const SimSample sample = flight.next();
+		const SimData& data = sample.data;
+		track.append(data.gps_lat, data.gps_lon, data.gps_alt);
+		if (i % kRenderSamplesPerFrame != 0)
+			continue;
+
+		const double start = toolSeconds();
+		renderer.setText(0, "In Flight", fbRgb(64, 255, 64));
+		snprintf(buf, sizeof(buf), "GPS ALT: %0.2f m", data.gps_alt);
+		renderer.setText(1, buf, 0);
+		snprintf(buf, sizeof(buf), "GPS LAT: %0.4f", data.gps_lat);
+		renderer.setText(2, buf, 0);
+		snprintf(buf, sizeof(buf), "GPS LON: %0.4f", data.gps_lon);
+		renderer.setText(3, buf, 0);
+		snprintf(buf, sizeof(buf), "GPS TRK: %0.1f", data.gps_track);
+		renderer.setText(4, buf, 0);
+		snprintf(buf, sizeof(buf), "GPS GS:  %0.1f m/s", data.gps_groundspeed);
+		renderer.setText(5, buf, 0);
+		snprintf(buf, sizeof(buf), "PITCH: %0.3f", data.pitch);
+		renderer.setText(7, buf, 0);
+		snprintf(buf, sizeof(buf), "BANK:  %0.3f", data.bank);
+		renderer.setText(8, buf, 0);
+		snprintf(buf, sizeof(buf), "HDG:   %0.1f", data.heading);
+		renderer.setText(9, buf, 0);
+		renderer.setAircraft(&data);
+		for (const FbRect& rect : renderer.update())
+			dirtyPixels += (uint64_t)rect.width() * rect.height();
+		seconds += toolSeconds() - start;
+		frames++;
+	}
+
+	if (frames == 0) {
+		fwprintf(stderr, L"Nothing to render\n");
+		return 2;
+	}
+	wprintf(L"%llu frames  %.1f us/frame  %.0f of %d pixels changed per frame  %llu track points\n",
+		frames, seconds / frames * 1e6, (double)dirtyPixels / frames,
+		kRenderWidth * kRenderHeight, (unsigned long long)track.sampleCount());
+
+	if (pngPath != nullptr) {
+		char path[MAX_PATH];
+		if (WideCharToMultiByte(CP_ACP, 0, pngPath, -1, path, sizeof(path), NULL, NULL) == 0 ||
+			!renderer.framebuffer().writePng(path)) {
+			fwprintf(stderr, L"Could not write %s\n", pngPath);
+			return 1;
+		}
+	}
+	return 0;
+}
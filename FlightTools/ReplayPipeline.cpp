@@ -0,0 +1,109 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+
+#include "framework.h"
+#include "ReplayPipeline.h"
+
+static void addGridAirspace(AirspaceDatabase* db) {
+	constexpr double kCell = 0.15;
+	for (int i = 0; i < 40; i++) {
+		for (int j = 0; j < 40; j++) {
+			const double lat = 44.5 + i * kCell;
+			const double lon = -125.3 + j * kCell;
+			const std::vector<AirspacePoint> square = {
+				{ lat, lon }, { lat + kCell, lon }, { lat + kCell, lon + kCell }, { lat, lon + kCell },
+			};
+			db->add("GRID", (i + j) % 4 == 0 ? kAirspaceD : kAirspaceE, { 0, false }, { 1500, false }, square);
+		}
+	}
+	db->buildIndex();
+}
+
+ReplayPipeline::ReplayPipeline(const wchar_t* directoryName) : directory_name(directoryName) {
+	broadcaster.init(kReplayDestination, kReplayPort);
+	addGridAirspace(&airspaces);
+	recorder.setDirectory(directory());
+	phases.addCallback(&landing);
+	landing.start(std::wstring());
+}
+
+ReplayPipeline::~ReplayPipeline() {
+	landing.stop();
+	recorder.close();
+	removeRecordings();
+}
+
+std::wstring ReplayPipeline::directory() const {
+	wchar_t temp[MAX_PATH] = { 0 };
+	GetTempPath(ARRAYSIZE(temp), temp);
+	std::wstring path = std::wstring(temp) + directory_name;
+	CreateDirectory(path.c_str(), NULL);
+	return path;
+}
+
+void ReplayPipeline::removeRecordings() const {
+	const std::wstring dir = directory();
+	for (LPCWSTR extension : { kTrackFileExtension, kTrackIndexExtension }) {
+		WIN32_FIND_DATA fd;
+		HANDLE find = FindFirstFile((dir + L"\\*" + extension).c_str(), &fd);
+		if (find == INVALID_HANDLE_VALUE)
+			continue;
+		do {
+			DeleteFile((dir + L"\\" + fd.cFileName).c_str());
+		} while (FindNextFile(find, &fd));
+		FindClose(find);
+	}
+}
+
+void ReplayPipeline::registerSinks(SinkScheduler& scheduler) {
+	broadcaster.registerSinks(scheduler);
+	for (OutputSink* sink : sinks())
+		scheduler.addSink(sink);
+}
+
+std::vector<OutputSink*> ReplayPipeline::sinks() {
+	return { &nmea, &phases, &recorder, &track_sink, &terrain, &nearest, &airspace, &landing };
+}
+
+ReplayScheduler::ReplayScheduler(const std::vector<OutputSink*>& sinks) {
+	for (OutputSink* sink : sinks) {
+		Slot slot;
+		slot.sink = sink;
+		slot.allocs.reset(new AllocSite(sink->sinkName()));
+		slots_.push_back(std::move(slot));
+	}
+}
+
+void ReplayScheduler::onEvent(const SimDataEvent& event) {
+	SimSample sample;
+	sample.time_ms = time_ms_;
+	sample.data = event.data;
+	for (Slot& slot : slots_) {
+		const double rate = slot.sink->sinkRate();
+		if (rate > 0 && time_ms_ < slot.next_due_ms)
+			continue;
+		slot.next_due_ms = std::max(slot.next_due_ms + (int64_t)(1000 / rate), time_ms_);
+		AllocScope scope(*slot.allocs);
+		slot.sink->onSample(sample);
+		slot.sink->onFlush();
+	}
+}
+
+void ReplayScheduler::onEvent(const SimStateEvent& event) {
+	for (Slot& slot : slots_)
+		slot.sink->onStateChange(event.state);
+}
@@ -0,0 +1,94 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "AirspaceDatabase.h"
+#include "AirspaceMonitor.h"
+#include "AllocTracker.h"
+#include "FlightPhaseDetector.h"
+#include "FlightRecorder.h"
+#include "ForeFlightBroadcaster.h"
+#include "LandingCapture.h"
+#include "NearestAirport.h"
+#include "NmeaBroadcaster.h"
+#include "OutputSink.h"
+#include "SinkScheduler.h"
+#include "TerrainService.h"
+#include "TrackLodSink.h"
+
+// The main window's sinks without the window, for tools that run the app's
+// per-sample work over generated flights.
+
+// The reports go to a port on this machine that nothing listens on.
+constexpr char kReplayDestination[] = "127.0.0.1";
+constexpr u_short kReplayPort = 49098;
+
+// Everything MainWindow feeds, with recordings going to directoryName under
+// the temporary directory and a grid of airspace around where
+// SyntheticFlight flies, so the monitor has candidates to refresh and
+// boundaries to cross.
+struct ReplayPipeline {
+	explicit ReplayPipeline(const wchar_t* directoryName);
+	~ReplayPipeline();
+
+	std::wstring directory() const;
+	void removeRecordings() const;
+
+	void registerSinks(SinkScheduler& scheduler);
+	// All but the ForeFlight reports, which are sinks of the broadcaster's own.
+	std::vector<OutputSink*> sinks();
+
+	std::wstring directory_name;
+	ForeFlightBroadcaster broadcaster;
+	NmeaBroadcaster nmea;
+	TerrainService terrain;
+	FlightPhaseDetector phases{ &terrain };
+	FlightRecorder recorder{ &phases };
+	TrackLod track;
+	TrackLodSink track_sink{ &track };
+	NearestAirport nearest;
+	AirspaceDatabase airspaces;
+	AirspaceMonitor airspace{ &airspaces, &terrain };
+	LandingCapture landing;
+};
+
+// Feeds sinks on the calling thread at their own rates by sample time, as
+// the scheduler would at real time, so flights can go through as fast as
+// they run. What each sink allocates is added to an AllocSite of its name.
+class ReplayScheduler : public EventListener<SimDataEvent>, public EventListener<SimStateEvent> {
+public:
+	explicit ReplayScheduler(const std::vector<OutputSink*>& sinks);
+
+	void setTime(int64_t timeMs) { time_ms_ = timeMs; }
+
+	void onEvent(const SimDataEvent& event) override;
+	void onEvent(const SimStateEvent& event) override;
+
+private:
+	struct Slot {
+		OutputSink* sink = nullptr;
+		int64_t next_due_ms = 0;
+		std::unique_ptr<AllocSite> allocs;
+	};
+	std::vector<Slot> slots_;
+	int64_t time_ms_ = 0;
+};
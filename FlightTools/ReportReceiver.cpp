@@ -0,0 +1,428 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "framework.h"
+#include "ReportReceiver.h"
+#include "ForeFlightBroadcaster.h"
+#include "NmeaBroadcaster.h"
+
+constexpr int64_t kMsPerDay = 86400000;
+constexpr int kReceiveBufferBytes = 4 << 20;
+
+static uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// A decimal number such as -122.3088 at *p, which is left after it. No
+// exponents; the reports never use them.
+static bool parseNumber(const char** p, const char* end, double* out) {
+	static const double kScale[] = { 1, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8, 1e-9 };
+	const char* s = *p;
+	const bool negative = s < end && *s == '-';
+	if (s < end && (*s == '-' || *s == '+'))
+		s++;
+	uint64_t mantissa = 0;
+	int digits = 0, decimals = 0;
+	for (; s < end && *s >= '0' && *s <= '9'; s++, digits++)
+		mantissa = mantissa * 10 + (*s - '0');
+	if (s < end && *s == '.') {
+		for (s++; s < end && *s >= '0' && *s <= '9'; s++, digits++) {
+			if (decimals < (int)ARRAYSIZE(kScale) - 1) {
+				mantissa = mantissa * 10 + (*s - '0');
+				decimals++;
+			}
+		}
+	}
+	if (digits == 0 || digits > 18)
+		return false;
+	const double value = (double)mantissa * kScale[decimals];
+	*out = negative ? -value : value;
+	*p = s;
+	return true;
+}
+
+static bool startsWith(const char* data, size_t size, const char* prefix) {
+	const size_t n = strlen(prefix);
+	return size >= n && memcmp(data, prefix, n) == 0;
+}
+
+static bool parseForeFlight(const char* data, size_t size, int fields, ReceivedReport* report) {
+	const char* const end = data + size;
+	const char* p = data + 4;
+	const char* const comma = static_cast<const char*>(memchr(p, ',', end - p));
+	if (comma == nullptr)
+		return false;
+	report->name.data = p;
+	report->name.size = comma - p;
+	report->field_count = 0;
+	p = comma;
+	while (p < end && report->field_count < kReceivedMaxFields) {
+		if (*p != ',')
+			return false;
+		p++;
+		if (!parseNumber(&p, end, &report->fields[report->field_count]))
+			return false;
+		report->field_count++;
+	}
+	return p == end && report->field_count == fields;
+}
+
+static int hexDigit(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+// hhmmss.ss, the first field of RMC and GGA.
+static int64_t parseNmeaTime(const char* p, const char* end) {
+	if (end - p < 6)
+		return -1;
+	for (int i = 0; i < 6; i++) {
+		if (p[i] < '0' || p[i] > '9')
+			return -1;
+	}
+	const int hours = (p[0] - '0') * 10 + (p[1] - '0');
+	const int minutes = (p[2] - '0') * 10 + (p[3] - '0');
+	const int seconds = (p[4] - '0') * 10 + (p[5] - '0');
+	double fraction = 0;
+	if (end - p > 6 && p[6] == '.') {
+		const char* f = p + 6;
+		double scale = 0.1;
+		for (f++; f < end && *f >= '0' && *f <= '9'; f++, scale /= 10)
+			fraction += (*f - '0') * scale;
+	}
+	return ((hours * 60 + minutes) * 60 + seconds) * 1000ll + (int64_t)llround(fraction * 1000);
+}
+
+static bool parseNmea(const char* data, size_t size, ReceivedReport* report) {
+	static const char kName[] = "NMEA";
+	report->name.data = kName;
+	report->name.size = sizeof(kName) - 1;
+	report->sentences = 0;
+	const char* p = data;
+	const char* const end = data + size;
+	while (p < end) {
+		if (*p != '$')
+			return false;
+		const char* const star = static_cast<const char*>(memchr(p, '*', end - p));
+		if (star == nullptr || end - star < 3)
+			return false;
+		uint8_t checksum = 0;
+		for (const char* c = p + 1; c < star; c++)
+			checksum ^= (uint8_t)*c;
+		const int high = hexDigit(star[1]), low = hexDigit(star[2]);
+		if (high < 0 || low < 0 || checksum != (high << 4 | low))
+			return false;
+
+		// "$GPRMC,hhmmss.ss,..."
+		if (report->time_of_day_ms < 0 && star - p > 7 && p[6] == ',' &&
+			(memcmp(p + 3, "RMC", 3) == 0 || memcmp(p + 3, "GGA", 3) == 0))
+			report->time_of_day_ms = parseNmeaTime(p + 7, star);
+
+		report->sentences++;
+		p = star + 3;
+		while (p < end && (*p == '\r' || *p == '\n'))
+			p++;
+	}
+	return report->sentences > 0;
+}
+
+bool parseReceivedReport(const char* data, size_t size, ReceivedReport* report) {
+	report->time_of_day_ms = -1;
+	report->field_count = 0;
+	report->sentences = 0;
+	if (startsWith(data, size, "XGPS")) {
+		report->kind = kReceivedXgps;
+		return parseForeFlight(data, size, 5, report);
+	}
+	if (startsWith(data, size, "XATT")) {
+		report->kind = kReceivedXatt;
+		return parseForeFlight(data, size, 3, report);
+	}
+	if (startsWith(data, size, "$")) {
+		report->kind = kReceivedNmea;
+		return parseNmea(data, size, report);
+	}
+	return false;
+}
+
+static const char* kindName(ReceivedKind kind) {
+	switch (kind) {
+	case kReceivedXgps: return "XGPS";
+	case kReceivedXatt: return "XATT";
+	case kReceivedNmea: return "NMEA";
+	}
+	return "?";
+}
+
+// The longest a sender of this kind goes between reports while flying.
+static int64_t expectedIntervalUs(ReceivedKind kind) {
+	switch (kind) {
+	case kReceivedXgps: return positionReportThresholds().keepalive_ms * 1000;
+	case kReceivedXatt: return attitudeReportThresholds().keepalive_ms * 1000;
+	case kReceivedNmea: return (int64_t)(1e6 / kNmeaUdpReportsPerSecond);
+	}
+	return 1000000;
+}
+
+double StreamStats::packetsPerSecond() const {
+	if (packets < 2 || last_us <= first_us)
+		return 0;
+	return (packets - 1) / ((last_us - first_us) / 1e6);
+}
+
+double StreamStats::jitterPercentileMs(double fraction) const {
+	uint64_t total = 0;
+	for (uint64_t count : jitter_histogram)
+		total += count;
+	if (total == 0)
+		return 0;
+	uint64_t seen = 0;
+	for (int i = 0; i < kJitterBuckets - 1; i++) {
+		seen += jitter_histogram[i];
+		if (seen >= fraction * total)
+			return kJitterBucketMs[i];
+	}
+	return HUGE_VAL;
+}
+
+StreamStats& ReceiverStats::stream(uint32_t address, uint16_t port, const ReceivedReport& report) {
+	uint64_t key = fnv1a(&address, sizeof(address));
+	key = fnv1a(&port, sizeof(port), key);
+	key = fnv1a(&report.kind, sizeof(report.kind), key);
+	key = fnv1a(report.name.data, report.name.size, key);
+	auto matches = [&](const StreamStats& s) {
+		return s.address == address && s.port == port && s.kind == report.kind &&
+			s.name.size() == report.name.size && memcmp(s.name.data(), report.name.data, report.name.size) == 0;
+	};
+	auto found = index_.find(key);
+	if (found != index_.end() && matches(streams_[found->second]))
+		return streams_[found->second];
+	// A new stream, or on the rare hash collision, a search.
+	for (StreamStats& s : streams_) {
+		if (matches(s))
+			return s;
+	}
+	StreamStats s;
+	s.address = address;
+	s.port = port;
+	s.kind = report.kind;
+	s.name.assign(report.name.data, report.name.size);
+	streams_.push_back(s);
+	index_.emplace(key, streams_.size() - 1);
+	return streams_.back();
+}
+
+void ReceiverStats::onDatagram(uint32_t address, uint16_t port, const char* data, size_t size,
+	int64_t receivedUs, int64_t receivedUtcMs) {
+	datagrams_++;
+	ReceivedReport report;
+	if (!parseReceivedReport(data, size, &report)) {
+		malformed_++;
+		return;
+	}
+	StreamStats& s = stream(address, port, report);
+	const uint64_t hash = fnv1a(data, size);
+	s.packets++;
+	s.bytes += size;
+	if (s.packets == 1) {
+		s.first_us = receivedUs;
+	} else {
+		const int64_t interval = receivedUs - s.last_us;
+		if (hash == s.last_hash && interval < kDuplicateWindowUs) {
+			s.duplicates++;
+			return;
+		}
+		s.longest_interval_us = std::max(s.longest_interval_us, interval);
+		if (interval > expectedIntervalUs(s.kind) * kGapFactor)
+			s.gaps++;
+		if (s.last_interval_us >= 0) {
+			const double variation = fabs((double)(interval - s.last_interval_us));
+			s.jitter_us += (variation - s.jitter_us) / 16;
+			int bucket = 0;
+			while (bucket < kJitterBuckets - 1 && variation > kJitterBucketMs[bucket] * 1000)
+				bucket++;
+			s.jitter_histogram[bucket]++;
+		}
+		s.last_interval_us = interval;
+	}
+	s.last_us = receivedUs;
+	s.last_hash = hash;
+
+	if (report.time_of_day_ms >= 0) {
+		int64_t age = receivedUtcMs % kMsPerDay - report.time_of_day_ms;
+		if (age >= kMsPerDay / 2)
+			age -= kMsPerDay;
+		else if (age < -kMsPerDay / 2)
+			age += kMsPerDay;
+		if (s.aged == 0 || age < s.age_min_ms)
+			s.age_min_ms = (double)age;
+		if (s.aged == 0 || age > s.age_max_ms)
+			s.age_max_ms = (double)age;
+		s.age_sum_ms += age;
+		s.aged++;
+	}
+}
+
+void ReceiverStats::print(FILE* out, bool histograms) const {
+	fwprintf(out, L"%-21s %-4s %-12s %9s %8s %9s %6s %6s %5s %9s %5s %13s\n", L"sender", L"type", L"name",
+		L"packets", L"per s", L"jitter ms", L"p50", L"p99", L"gaps", L"longest s", L"dups", L"age ms");
+	for (const StreamStats& s : streams_) {
+		const uint32_t a = ntohl(s.address);
+		wchar_t sender[32];
+		swprintf_s(sender, L"%u.%u.%u.%u:%u", a >> 24, (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff, ntohs(s.port));
+		wchar_t age[32] = L"-";
+		if (s.aged > 0)
+			swprintf_s(age, L"%.0f / %.0f", s.age_sum_ms / s.aged, s.age_max_ms);
+		fwprintf(out, L"%-21s %-4S %-12.12S %9llu %8.2f %9.2f %6.1f %6.1f %5llu %9.2f %5llu %13s\n", sender,
+			kindName(s.kind), s.name.c_str(), s.packets, s.packetsPerSecond(), s.jitter_us / 1000,
+			s.jitterPercentileMs(0.5), s.jitterPercentileMs(0.99), s.gaps, s.longest_interval_us / 1e6,
+			s.duplicates, age);
+		if (!histograms)
+			continue;
+		for (int i = 0; i < kJitterBuckets; i++) {
+			if (i < kJitterBuckets - 1)
+				fwprintf(out, L"    <= %5.1f ms %9llu\n", kJitterBucketMs[i], s.jitter_histogram[i]);
+			else
+				fwprintf(out, L"     > %5.1f ms %9llu\n", kJitterBucketMs[i - 1], s.jitter_histogram[i]);
+		}
+	}
+	if (malformed_ != 0)
+		fwprintf(out, L"%llu of %llu datagrams were not reports\n", malformed_, datagrams_);
+}
+
+HRESULT ReportReceiver::open(u_short port, const char* address) {
+	SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock == INVALID_SOCKET)
+		return E_FAIL;
+
+	// Shared with any EFB listening on the same machine, and with room to
+	// queue bursts from many senders.
+	char reuse = 1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	int buffer = kReceiveBufferBytes;
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer, sizeof(buffer));
+	u_long nonBlocking = 1;
+	ioctlsocket(sock, FIONBIO, &nonBlocking);
+
+	sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if ((address != nullptr && inet_pton(AF_INET, address, &addr.sin_addr) != 1) ||
+		bind(sock, (const sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+		fwprintf(stderr, L"Could not listen on port %u: error %d\n", port, WSAGetLastError());
+		closesocket(sock);
+		return E_FAIL;
+	}
+	int length = sizeof(addr);
+	getsockname(sock, (sockaddr*)&addr, &length);
+	port_ = ntohs(addr.sin_port);
+	sockets_.push_back(sock);
+	return S_OK;
+}
+
+int ReportReceiver::receive(int timeoutMs, ReceiverStats* stats) {
+	fd_set readable;
+	FD_ZERO(&readable);
+	for (SOCKET sock : sockets_)
+		FD_SET(sock, &readable);
+	timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+	if (select(0, &readable, nullptr, nullptr, &timeout) <= 0)
+		return 0;
+
+	int received = 0;
+	for (SOCKET sock : sockets_) {
+		if (!FD_ISSET(sock, &readable))
+			continue;
+		for (;;) {
+			sockaddr_in from = { 0 };
+			int fromLength = sizeof(from);
+			const int n = recvfrom(sock, buffer_, sizeof(buffer_), 0, (sockaddr*)&from, &fromLength);
+			if (n < 0)
+				break;
+			received++;
+			drop_owed_ += drop_fraction_;
+			if (drop_owed_ >= 1) {
+				drop_owed_ -= 1;
+				dropped_++;
+				continue;
+			}
+			const auto now = std::chrono::steady_clock::now().time_since_epoch();
+			const auto utc = std::chrono::system_clock::now().time_since_epoch();
+			stats->onDatagram(from.sin_addr.s_addr, from.sin_port, buffer_, n,
+				std::chrono::duration_cast<std::chrono::microseconds>(now).count(),
+				std::chrono::duration_cast<std::chrono::milliseconds>(utc).count());
+		}
+	}
+	return received;
+}
+
+int ReportReceiver::sendFeedback(const ReceiverStats& stats) {
+	if (sockets_.empty())
+		return 0;
+	const std::vector<StreamStats>& streams = stats.streams();
+	int sent = 0;
+	for (size_t i = 0; i < streams.size(); i++) {
+		const StreamStats& s = streams[i];
+		if (s.kind == kReceivedNmea)
+			continue;
+		// Once per sender and name, for its XGPS and XATT together.
+		bool reported = false;
+		uint64_t reports = 0;
+		for (size_t j = 0; j < streams.size() && !reported; j++) {
+			const StreamStats& other = streams[j];
+			if (other.kind == kReceivedNmea || other.address != s.address || other.port != s.port ||
+				other.name != s.name)
+				continue;
+			reported = j < i;
+			reports += other.packets;
+		}
+		if (reported)
+			continue;
+
+		char text[128];
+		const int size = snprintf(text, sizeof(text), "%s%s,%llu", kFeedbackPrefix, s.name.c_str(), reports);
+		if (size <= 0 || size >= (int)sizeof(text))
+			continue;
+		sockaddr_in to = { 0 };
+		to.sin_family = AF_INET;
+		to.sin_addr.s_addr = s.address;
+		to.sin_port = s.port;
+		if (sendto(sockets_[0], text, size, 0, (const sockaddr*)&to, sizeof(to)) != SOCKET_ERROR)
+			sent++;
+	}
+	return sent;
+}
+
+void ReportReceiver::close() {
+	for (SOCKET sock : sockets_)
+		closesocket(sock);
+	sockets_.clear();
+}
@@ -0,0 +1,163 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "framework.h"
+
+// The receiving end of FlightMonitor's UDP outputs, for checking what EFBs
+// actually get: ForeFlight XGPS and XATT reports and NMEA datagrams, parsed
+// in place, and per stream (sender, report type and aircraft name) the
+// packet rate, how regularly they arrive, gaps, duplicates and, where the
+// report carries the time it was made, how old it was on arrival.
+
+enum ReceivedKind {
+	kReceivedXgps,
+	kReceivedXatt,
+	kReceivedNmea,
+};
+
+constexpr int kReceivedMaxFields = 8;
+
+// Some bytes of a datagram.
+struct TextSpan {
+	const char* data = nullptr;
+	size_t size = 0;
+};
+
+// One datagram, pointing into its buffer.
+struct ReceivedReport {
+	ReceivedKind kind = kReceivedXgps;
+	TextSpan name;                       // the aircraft for XGPS/XATT, "NMEA" otherwise
+	int field_count = 0;                 // numbers after the name, XGPS/XATT only
+	double fields[kReceivedMaxFields];
+	int sentences = 0;                   // NMEA only
+	int64_t time_of_day_ms = -1;         // UTC from $GPRMC or $GPGGA, if present
+};
+
+// False unless data is one complete report: an XGPS or XATT with the right
+// number of fields, or NMEA sentences with good checksums.
+bool parseReceivedReport(const char* data, size_t size, ReceivedReport* report);
+
+// Interval-to-interval variation in arrival times, in buckets up to each
+// of these many milliseconds; the last collects anything longer.
+constexpr double kJitterBucketMs[] = { 0.1, 0.5, 1, 2, 5, 10, 20, 50, 100, 200, 500 };
+constexpr int kJitterBuckets = ARRAYSIZE(kJitterBucketMs) + 1;
+
+// The same report twice within this long is counted as a duplicate rather
+// than a keepalive.
+constexpr int64_t kDuplicateWindowUs = 50000;
+
+// A stream is counted as having a gap when nothing arrives for this much
+// longer than its sender ever waits: its keepalive, or for NMEA its report
+// interval.
+constexpr double kGapFactor = 1.5;
+
+struct StreamStats {
+	uint32_t address = 0;                // network order
+	uint16_t port = 0;                   // network order
+	ReceivedKind kind = kReceivedXgps;
+	std::string name;
+
+	uint64_t packets = 0;
+	uint64_t bytes = 0;
+	uint64_t duplicates = 0;
+	uint64_t gaps = 0;
+	int64_t first_us = 0;
+	int64_t last_us = 0;
+	int64_t longest_interval_us = 0;
+
+	// RFC 3550's smoothed estimate, and every variation that went into it.
+	double jitter_us = 0;
+	uint64_t jitter_histogram[kJitterBuckets] = { 0 };
+
+	// Arrival time less the report's own time, for reports that have one.
+	uint64_t aged = 0;
+	double age_sum_ms = 0;
+	double age_min_ms = 0;
+	double age_max_ms = 0;
+
+	double packetsPerSecond() const;
+	// The upper edge of the bucket holding the given fraction of variations.
+	double jitterPercentileMs(double fraction) const;
+
+	// Kept for the next packet.
+	uint64_t last_hash = 0;
+	int64_t last_interval_us = -1;
+};
+
+class ReceiverStats {
+public:
+	// Counts one datagram from address:port (network order) that arrived at
+	// receivedUs on a monotonic clock, and at receivedUtcMs since the epoch.
+	void onDatagram(uint32_t address, uint16_t port, const char* data, size_t size,
+		int64_t receivedUs, int64_t receivedUtcMs);
+
+	const std::vector<StreamStats>& streams() const { return streams_; }
+	uint64_t datagrams() const { return datagrams_; }
+	uint64_t malformed() const { return malformed_; }
+
+	// A line per stream, with the jitter buckets under each if histograms.
+	void print(FILE* out, bool histograms) const;
+
+private:
+	StreamStats& stream(uint32_t address, uint16_t port, const ReceivedReport& report);
+
+	std::vector<StreamStats> streams_;
+	std::unordered_map<uint64_t, size_t> index_;
+	uint64_t datagrams_ = 0;
+	uint64_t malformed_ = 0;
+};
+
+// UDP sockets on one or more ports, drained into a ReceiverStats.
+class ReportReceiver {
+public:
+	~ReportReceiver() { close(); }
+
+	// Port 0 takes any free port; address is an IPv4 address to bind to,
+	// all interfaces by default.
+	HRESULT open(u_short port, const char* address = nullptr);
+	// The port the last open bound, in host order.
+	u_short port() const { return port_; }
+
+	// Waits up to timeoutMs for a datagram on any port, then takes every
+	// one queued. Returns how many, including any dropped.
+	int receive(int timeoutMs, ReceiverStats* stats);
+	void close();
+
+	// Throws away this fraction of datagrams, evenly spread, before they
+	// are counted: a lossy link for testing senders that adapt to one.
+	void setDropFraction(double fraction) { drop_fraction_ = fraction; }
+	uint64_t dropped() const { return dropped_; }
+
+	// Tells each ForeFlight sender how many of its reports have arrived,
+	// with an XFBK datagram per sender and aircraft name. Returns how many
+	// were sent.
+	int sendFeedback(const ReceiverStats& stats);
+
+private:
+	std::vector<SOCKET> sockets_;
+	u_short port_ = 0;
+	double drop_fraction_ = 0;
+	double drop_owed_ = 0;
+	uint64_t dropped_ = 0;
+	char buffer_[2048];
+};
@@ -0,0 +1,224 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "framework.h"
+#include "Commands.h"
+#include "ForeFlightBroadcaster.h"
+#include "NmeaBroadcaster.h"
+#include "ReportReceiver.h"
+#include "SimInterface.h"
+#include "SinkScheduler.h"
+#include "SyntheticFlight.h"
+
+// Listens for FlightMonitor's UDP reports, as an EFB would, and prints what
+// each stream looked like on arrival. --loopback sends a generated flight
+// through real ForeFlight and NMEA broadcasters on this machine, several
+// senders at once, and checks that every report arrived once and on time,
+// or with --loss, that the senders slowed down when told reports were lost.
+
+constexpr double kRxSamplesPerSecond = 60;
+constexpr int kRxPollMs = 50;
+
+// How often a receiver tells ForeFlight senders what has arrived.
+constexpr double kRxFeedbackSeconds = 1;
+
+// Loopback time after the senders stop for the last reports to be read.
+constexpr int kRxDrainMs = 250;
+
+// NMEA sentences are stamped when built and sent within a sample, so on
+// this machine they should arrive within a few report intervals.
+constexpr double kRxMaxLoopbackAgeMs = 1000;
+
+static int listenForReports(const std::vector<u_short>& ports, double seconds, bool histograms, bool feedback) {
+	ReportReceiver receiver;
+	for (u_short port : ports) {
+		if (FAILED(receiver.open(port)))
+			return 1;
+	}
+	wprintf(L"Listening for %.0f s\n", seconds);
+	ReceiverStats stats;
+	const double start = toolSeconds();
+	double fed = start;
+	while (toolSeconds() - start < seconds) {
+		receiver.receive(kRxPollMs, &stats);
+		if (feedback && toolSeconds() - fed >= kRxFeedbackSeconds) {
+			receiver.sendFeedback(stats);
+			fed = toolSeconds();
+		}
+	}
+	stats.print(stdout, histograms);
+	return 0;
+}
+
+static int loopback(int senders, double seconds, bool histograms, double loss) {
+	ReportReceiver receiver;
+	if (FAILED(receiver.open(0, "127.0.0.1")))
+		return 1;
+	receiver.setDropFraction(loss);
+	const u_short port = receiver.port();
+
+	std::vector<std::unique_ptr<ForeFlightBroadcaster>> broadcasters;
+	SinkScheduler scheduler;
+	for (int i = 0; i < senders; i++) {
+		char name[16];
+		sprintf_s(name, "LOOP%d", i);
+		broadcasters.emplace_back(new ForeFlightBroadcaster);
+		if (FAILED(broadcasters.back()->init("127.0.0.1", port, name)))
+			return 1;
+		broadcasters.back()->registerSinks(scheduler);
+	}
+	NmeaBroadcaster nmea;
+	if (FAILED(nmea.init(nullptr, "127.0.0.1", port)))
+		return 1;
+	scheduler.addSink(&nmea);
+	SimulatorInterface sim;
+	sim.events().subscribeAll(&scheduler);
+
+	ReceiverStats stats;
+	std::atomic<bool> done{ false };
+	std::thread reader([&]() {
+		double fed = toolSeconds();
+		while (!done) {
+			receiver.receive(kRxPollMs, &stats);
+			if (toolSeconds() - fed >= kRxFeedbackSeconds) {
+				receiver.sendFeedback(stats);
+				fed = toolSeconds();
+			}
+		}
+	});
+
+	scheduler.start();
+	SyntheticFlight flight(0, kRxSamplesPerSecond);
+	const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1 / kRxSamplesPerSecond));
+	auto next = std::chrono::steady_clock::now();
+	for (int i = 0; i < seconds * kRxSamplesPerSecond; i++) {
+		const SimSample sample = flight.next();
+		sim.setSimData(&sample.data);
+		next += interval;
+		std::this_thread::sleep_until(next);
+	}
+	scheduler.stop();
+	std::this_thread::sleep_for(std::chrono::milliseconds(kRxDrainMs));
+	done = true;
+	reader.join();
+	nmea.close();
+
+	wprintf(L"%d senders and NMEA to port %u for %.0f s:\n", senders, port, seconds);
+	stats.print(stdout, histograms);
+	if (loss > 0)
+		wprintf(L"Dropped %llu datagrams\n", receiver.dropped());
+	for (int i = 0; i < senders; i++) {
+		wprintf(L"LOOP%d: %.2f Hz XATT, %.2f Hz XGPS after %llu decreases\n", i,
+			broadcasters[i]->attitudeRate(), broadcasters[i]->positionRate(), broadcasters[i]->rateDecreases());
+	}
+
+	int failures = 0;
+	auto fail = [&](LPCWSTR what, const std::string& name) {
+		fwprintf(stderr, L"%s: %S\n", what, name.c_str());
+		failures++;
+	};
+	for (int i = 0; i < senders; i++) {
+		char name[16];
+		sprintf_s(name, "LOOP%d", i);
+		if (loss > 0) {
+			if (broadcasters[i]->rateDecreases() == 0) {
+				fwprintf(stderr, L"%S: did not slow down\n", name);
+				failures++;
+			}
+			continue;
+		}
+		if (broadcasters[i]->rateDecreases() != 0) {
+			fwprintf(stderr, L"%S: slowed down with nothing lost\n", name);
+			failures++;
+		}
+		uint64_t received = 0;
+		for (const StreamStats& s : stats.streams()) {
+			if (s.name == name)
+				received += s.packets;
+		}
+		if (received != broadcasters[i]->packetsSent()) {
+			fwprintf(stderr, L"%S: sent %llu, received %llu\n", name, broadcasters[i]->packetsSent(), received);
+			failures++;
+		}
+	}
+	size_t nmeaStreams = 0;
+	for (const StreamStats& s : stats.streams()) {
+		if (s.duplicates != 0)
+			fail(L"Duplicates", s.name);
+		if (s.kind != kReceivedNmea)
+			continue;
+		nmeaStreams++;
+		if (s.aged == 0 || s.age_max_ms > kRxMaxLoopbackAgeMs || s.age_min_ms < -kRxMaxLoopbackAgeMs)
+			fail(L"NMEA times out of range", s.name);
+	}
+	if (stats.streams().size() != (size_t)senders * 2 + 1 || nmeaStreams != 1) {
+		fwprintf(stderr, L"Expected %d streams, received %zu\n", senders * 2 + 1, stats.streams().size());
+		failures++;
+	}
+	if (stats.malformed() != 0) {
+		fwprintf(stderr, L"%llu malformed datagrams\n", stats.malformed());
+		failures++;
+	}
+	if (failures != 0)
+		return 1;
+	if (loss > 0)
+		wprintf(L"Every sender slowed down\n");
+	else
+		wprintf(L"Every report arrived once\n");
+	return 0;
+}
+
+int rxStatsCommand(int argc, wchar_t** argv) {
+	std::vector<u_short> ports;
+	double seconds = 0, loss = 0;
+	int senders = 4;
+	bool loop = false, histograms = false, feedback = false;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--port") == 0 && i + 1 < argc)
+			ports.push_back((u_short)_wtoi(argv[++i]));
+		else if (wcscmp(argv[i], L"--seconds") == 0 && i + 1 < argc)
+			seconds = std::max(_wtof(argv[++i]), 1.0);
+		else if (wcscmp(argv[i], L"--senders") == 0 && i + 1 < argc)
+			senders = std::max(_wtoi(argv[++i]), 1);
+		else if (wcscmp(argv[i], L"--loss") == 0 && i + 1 < argc)
+			loss = std::min(std::max(_wtof(argv[++i]), 0.0), 100.0) / 100;
+		else if (wcscmp(argv[i], L"--loopback") == 0)
+			loop = true;
+		else if (wcscmp(argv[i], L"--feedback") == 0)
+			feedback = true;
+		else if (wcscmp(argv[i], L"--histogram") == 0)
+			histograms = true;
+		else {
+			fwprintf(stderr, L"Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (FAILED(ForeFlightBroadcaster::InitWinsock()))
+		return 1;
+	if (loop)
+		return loopback(senders, seconds > 0 ? seconds : loss > 0 ? 30 : 10, histograms, loss);
+	if (ports.empty())
+		ports.push_back(FF_GPS_PORT);
+	return listenForReports(ports, seconds > 0 ? seconds : 30, histograms, feedback);
+}
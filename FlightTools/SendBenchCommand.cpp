@@ -0,0 +1,141 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "Commands.h"
+#include "DatagramSender.h"
+#include "ForeFlightBroadcaster.h"
+#include "SyntheticFlight.h"
+
+// Compares the ways ForeFlightBroadcaster can send: one sendto per report,
+// and Registered I/O queuing reports and submitting each tick's together.
+// Sends ForeFlight reports from a generated flight over loopback, --burst
+// to a tick (as many outputs or destinations would), and prints for each
+// the system calls made and the CPU time per thousand packets.
+
+constexpr int64_t kSendBenchStartTimeMs = 1600000000000ll;
+constexpr size_t kSendBenchReports = 1024;
+
+static double processCpuSeconds() {
+	FILETIME created, exited, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+		return 0;
+	auto seconds = [](const FILETIME& t) {
+		return (((uint64_t)t.dwHighDateTime << 32) | t.dwLowDateTime) * 1e-7;
+	};
+	return seconds(kernel) + seconds(user);
+}
+
+// The reports the broadcaster would send, alternately position and attitude.
+static std::vector<std::string> generateReports() {
+	SyntheticFlight flight(kSendBenchStartTimeMs, kAttitueReportsPerSecond);
+	std::vector<std::string> reports;
+	char buffer[256];
+	while (reports.size() < kSendBenchReports) {
+		const SimData data = flight.next().data;
+		sprintf_s(buffer, "XGPSMSFS,%0.4f,%0.4f,%0.1f,%0.2f,%01.f",
+			data.gps_lon, data.gps_lat, data.gps_alt, data.gps_track, data.gps_groundspeed);
+		reports.push_back(buffer);
+		sprintf_s(buffer, "XATTMSFS,%0.4f,%0.4f,%0.4f", data.heading, -data.pitch, data.bank);
+		reports.push_back(buffer);
+	}
+	return reports;
+}
+
+static bool benchmark(DatagramBackend backend, const std::vector<std::string>& reports,
+	const sockaddr_in& to, size_t packets, size_t burst) {
+	std::unique_ptr<DatagramSender> sender = createDatagramSender(backend);
+	if (FAILED(sender->open())) {
+		wprintf(L"%-16s unavailable\n", datagramBackendName(backend));
+		return true;
+	}
+
+	auto run = [&](size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			const std::string& report = reports[i % reports.size()];
+			sender->send(report.data(), (int)report.size(), to);
+			if ((i + 1) % burst == 0)
+				sender->flush();
+		}
+		sender->flush();
+	};
+	run(std::min(packets, reports.size()));
+
+	const uint64_t calls = sender->systemCalls();
+	const uint64_t failed = sender->failed();
+	const double cpu = processCpuSeconds();
+	const double start = toolSeconds();
+	run(packets);
+	// Waits for the last completions.
+	sender->close();
+	const double seconds = toolSeconds() - start;
+	const double cpuUs = (processCpuSeconds() - cpu) * 1e6;
+	const uint64_t made = sender->systemCalls() - calls;
+
+	wprintf(L"%-16s %12.0f %12llu %12.0f %10.3f %14.1f %8llu\n", datagramBackendName(backend),
+		packets / seconds, made, made / seconds, (double)made / packets, cpuUs * 1000 / packets,
+		sender->failed() - failed);
+	return sender->failed() == failed;
+}
+
+int sendBenchCommand(int argc, wchar_t** argv) {
+	size_t packets = 1000000;
+	size_t burst = 8;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--packets") == 0 && i + 1 < argc)
+			packets = std::max(_wtoi(argv[++i]), 1);
+		else if (wcscmp(argv[i], L"--burst") == 0 && i + 1 < argc)
+			burst = std::max(_wtoi(argv[++i]), 1);
+		else {
+			fwprintf(stderr, L"Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (FAILED(ForeFlightBroadcaster::InitWinsock()))
+		return 1;
+
+	// Somewhere to send to that never reads, so the receiving side costs
+	// nothing and datagrams beyond its buffer are dropped as on a busy
+	// network.
+	SOCKET sink = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	sockaddr_in to = { 0 };
+	to.sin_family = AF_INET;
+	inet_pton(AF_INET, "127.0.0.1", &to.sin_addr);
+	int length = sizeof(to);
+	if (sink == INVALID_SOCKET || bind(sink, (const sockaddr*)&to, sizeof(to)) == SOCKET_ERROR ||
+		getsockname(sink, (sockaddr*)&to, &length) == SOCKET_ERROR) {
+		fwprintf(stderr, L"Could not open a loopback socket: error %d\n", WSAGetLastError());
+		return 1;
+	}
+
+	const std::vector<std::string> reports = generateReports();
+	wprintf(L"%zu packets, %zu to a flush:\n", packets, burst);
+	wprintf(L"%-16s %12s %12s %12s %10s %14s %8s\n", L"backend", L"packets/s", L"syscalls",
+		L"syscalls/s", L"per packet", L"CPU us per 1k", L"failed");
+	bool ok = true;
+	for (DatagramBackend backend : { kDatagramSendto, kDatagramRegisteredIo })
+		ok &= benchmark(backend, reports, to, packets, burst);
+	closesocket(sink);
+	if (!ok) {
+		fwprintf(stderr, L"Sends failed\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,155 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "framework.h"
+#include "Commands.h"
+#include "FakeSimBackend.h"
+#include "ForeFlightBroadcaster.h"
+#include "SessionManager.h"
+
+// Runs many simulator sessions against fake simulators that produce frames
+// at the simulator's frame rate, and checks that every session got every
+// frame. Prints each session's counters, the time from a frame being
+// produced to its dispatch, and the time spent in each dispatch.
+// --scaling repeats the run for a growing number of sessions.
+
+constexpr int64_t kSessionsStartTimeMs = 1600000000000ll;
+
+// The reports go to a port on this machine that nothing listens on.
+constexpr char kSessionsDestination[] = "127.0.0.1";
+constexpr u_short kSessionsPort = 49099;
+
+struct SessionsResult {
+	int errors = 0;
+	size_t threads = 0;
+	uint64_t frames = 0;
+	double latency_us_mean = 0;
+	double latency_us_max = 0;
+	double dispatch_us_mean = 0;
+	double dispatch_us_max = 0;
+};
+
+static SessionsResult runSessions(int count, double rate, double seconds, size_t perThread, bool verbose) {
+	SessionManager manager;
+	FakeSimDriver driver;
+	std::vector<FakeSimBackend*> fakes;
+	for (int i = 0; i < count; i++) {
+		SessionConfig config;
+		config.name = L"Sim " + std::to_wstring(i + 1);
+		config.destination = kSessionsDestination;
+		config.port = kSessionsPort;
+		config.sim_name = "SIM" + std::to_string(i + 1);
+		config.record = false;
+		FakeSimBackend* fake = new FakeSimBackend(kSessionsStartTimeMs, rate, i + 1);
+		fakes.push_back(fake);
+		driver.add(fake);
+		manager.add(config, std::unique_ptr<SimBackend>(fake));
+	}
+
+	manager.start(perThread);
+	driver.start(rate);
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	driver.stop();
+	// Let the last frames through before the sessions close.
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	SessionsResult result;
+	result.threads = manager.threadCount();
+	std::vector<SessionMetrics> metrics;
+	for (int i = 0; i < count; i++)
+		metrics.push_back(manager.session(i).metrics());
+	manager.stop();
+
+	if (verbose)
+		wprintf(L"session   frames  dispatches  latency us mean/max  dispatch us mean/max\n");
+	double latencySum = 0, dispatchSum = 0;
+	uint64_t dispatches = 0;
+	for (int i = 0; i < count; i++) {
+		const SessionMetrics& m = metrics[i];
+		const FakeSimBackend* fake = fakes[i];
+		if (verbose) {
+			wprintf(L"%-8s %7llu  %10llu  %8.1f %9.1f  %9.2f %9.1f\n", manager.session(i).config().name.c_str(),
+				m.samples, m.dispatches, fake->latencyMeanUs(), fake->latencyMaxUs(),
+				m.dispatch_us_mean, m.dispatch_us_max);
+		}
+		if (m.samples != fake->produced() || m.connects != 1 || m.state != SimInterfaceInFlight) {
+			fwprintf(stderr, L"%s: %llu of %llu frames, %llu connects\n", manager.session(i).config().name.c_str(),
+				m.samples, fake->produced(), m.connects);
+			result.errors++;
+		}
+		result.frames += m.samples;
+		latencySum += fake->latencyMeanUs() * fake->delivered();
+		result.latency_us_max = std::max(result.latency_us_max, fake->latencyMaxUs());
+		dispatchSum += m.dispatch_us_mean * m.dispatches;
+		dispatches += m.dispatches;
+		result.dispatch_us_max = std::max(result.dispatch_us_max, m.dispatch_us_max);
+	}
+	if (result.frames > 0)
+		result.latency_us_mean = latencySum / result.frames;
+	if (dispatches > 0)
+		result.dispatch_us_mean = dispatchSum / dispatches;
+	return result;
+}
+
+int sessionsCommand(int argc, wchar_t** argv) {
+	int count = 16;
+	double rate = 60;
+	double seconds = 10;
+	size_t perThread = kSessionsPerThread;
+	bool scaling = false;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--count") == 0 && i + 1 < argc)
+			count = std::max(_wtoi(argv[++i]), 1);
+		else if (wcscmp(argv[i], L"--rate") == 0 && i + 1 < argc)
+			rate = std::max(_wtof(argv[++i]), 1.0);
+		else if (wcscmp(argv[i], L"--seconds") == 0 && i + 1 < argc)
+			seconds = std::max(_wtof(argv[++i]), 0.1);
+		else if (wcscmp(argv[i], L"--per-thread") == 0 && i + 1 < argc)
+			perThread = std::max(_wtoi(argv[++i]), 1);
+		else if (wcscmp(argv[i], L"--scaling") == 0)
+			scaling = true;
+		else {
+			fwprintf(stderr, L"Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	if (FAILED(ForeFlightBroadcaster::InitWinsock()))
+		return 1;
+
+	if (!scaling) {
+		const SessionsResult r = runSessions(count, rate, seconds, perThread, true);
+		wprintf(L"%d sessions on %zu threads at %.0f Hz: %llu frames, latency %.1f us mean %.1f us max, "
+			L"dispatch %.2f us mean\n", count, r.threads, rate, r.frames, r.latency_us_mean, r.latency_us_max,
+			r.dispatch_us_mean);
+		return r.errors ? 1 : 0;
+	}
+
+	int errors = 0;
+	wprintf(L"sessions  threads    frames  latency us mean/max  dispatch us mean/max\n");
+	for (int n = 1; n <= count; n *= 2) {
+		const SessionsResult r = runSessions(n, rate, seconds, perThread, false);
+		wprintf(L"%8d  %7zu  %8llu  %8.1f %9.1f  %9.2f %9.1f\n", n, r.threads, r.frames,
+			r.latency_us_mean, r.latency_us_max, r.dispatch_us_mean, r.dispatch_us_max);
+		errors += r.errors;
+	}
+	return errors ? 1 : 0;
+}
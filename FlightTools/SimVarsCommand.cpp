@@ -0,0 +1,227 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "Commands.h"
+#include "SimVarChannels.h"
+#include "TrackFile.h"
+
+// Times decoding extra SimVars through their offset tables and records a
+// flight's worth of them to a .fmvar and back, checking that every value
+// and name survives. The channels come from a simvars.txt or, with
+// --synthetic, are made up at a spread of types and periods.
+
+constexpr int64_t kSimVarsStartTimeMs = 1600000000000ll;
+constexpr int kSimVarsDefaultChannels = 120;
+
+// Simulated time the round trip covers, long enough for every group to
+// fill some blocks.
+constexpr int kSimVarsRecordSeconds = 600;
+
+// How often the recorder would pick up what has been decoded.
+constexpr int kSimVarsUpdateMs = 100;
+
+static std::vector<SimVarConfig> syntheticConfig(int channels) {
+	static const int kPeriods[] = { 16, 100, 250, 1000, 5000 };
+	static const SimVarType kTypes[] = { kSimVarFloat64, kSimVarFloat32, kSimVarInt32, kSimVarInt64 };
+	std::vector<SimVarConfig> configs(channels);
+	for (int i = 0; i < channels; i++) {
+		char name[64];
+		sprintf_s(name, "SYNTHETIC VAR:%d", i + 1);
+		configs[i].name = name;
+		configs[i].units = "number";
+		configs[i].type = kTypes[i % ARRAYSIZE(kTypes)];
+		configs[i].period_ms = kPeriods[i % ARRAYSIZE(kPeriods)];
+	}
+	return configs;
+}
+
+// A payload for group as the simulator would pack it, with values that
+// each type holds exactly; expected gets them as doubles.
+static void makePayload(const SimVarGroup& group, std::mt19937& random, std::vector<uint8_t>* payload,
+	double* expected) {
+	std::uniform_int_distribution<int32_t> values(-1000000, 1000000);
+	payload->resize(group.payload_bytes);
+	uint8_t* const p = payload->data();
+	for (size_t i = 0; i < group.fields.size(); i++) {
+		const SimVarField& field = group.fields[i];
+		const int32_t v = values(random);
+		switch (field.type) {
+		case kSimVarFloat64: { double d = v / 64.0; memcpy(p + field.offset, &d, sizeof(d)); expected[i] = d; break; }
+		case kSimVarFloat32: { float f = v / 64.0f; memcpy(p + field.offset, &f, sizeof(f)); expected[i] = f; break; }
+		case kSimVarInt32: { memcpy(p + field.offset, &v, sizeof(v)); expected[i] = v; break; }
+		case kSimVarInt64: { int64_t l = (int64_t)v << 20; memcpy(p + field.offset, &l, sizeof(l)); expected[i] = (double)l; break; }
+		}
+	}
+}
+
+static int timeDecode(SimVarChannels& channels) {
+	const std::vector<SimVarGroup>& groups = channels.groups();
+	std::mt19937 random(1);
+	std::vector<std::vector<uint8_t>> payloads(groups.size());
+	std::vector<double> expected(channels.channelCount());
+	for (size_t g = 0; g < groups.size(); g++)
+		makePayload(groups[g], random, &payloads[g], &expected[groups[g].first]);
+
+	// Every group's payload in turn, as if they all arrived at once.
+	constexpr int kRounds = 100000;
+	const double start = toolSeconds();
+	for (int r = 0; r < kRounds; r++) {
+		for (size_t g = 0; g < groups.size(); g++)
+			channels.decode(g, payloads[g].data(), payloads[g].size());
+	}
+	const double seconds = toolSeconds() - start;
+
+	std::vector<double> latest(channels.channelCount());
+	channels.latest(latest.data());
+	for (size_t c = 0; c < latest.size(); c++) {
+		if (latest[c] != expected[c]) {
+			fwprintf(stderr, L"Channel %zu decoded as %f, not %f\n", c, latest[c], expected[c]);
+			return 1;
+		}
+	}
+
+	const double payloadNs = seconds / ((double)kRounds * groups.size()) * 1e9;
+	const double channelNs = seconds / ((double)kRounds * channels.channelCount()) * 1e9;
+	wprintf(L"%zu channels in %zu groups: %.0f ns per payload, %.1f ns per channel\n",
+		channels.channelCount(), groups.size(), payloadNs, channelNs);
+	return 0;
+}
+
+// Decodes every group at its period, with the writer picking up what it
+// can as the recorder would, then reads the file back. decode() stamps the
+// samples with the wall clock, so only the values are compared.
+static int roundTrip(SimVarChannels& channels) {
+	const std::vector<SimVarGroup>& groups = channels.groups();
+	wchar_t temp[MAX_PATH] = { 0 };
+	GetTempPath(ARRAYSIZE(temp), temp);
+	const std::wstring path = std::wstring(temp) + L"FlightMonitorSimVars" + kSimVarFileExtension;
+
+	SimVarWriter writer;
+	if (FAILED(writer.open(path.c_str(), kSimVarsStartTimeMs, channels))) {
+		fwprintf(stderr, L"Could not create %s\n", path.c_str());
+		return 1;
+	}
+
+	std::mt19937 random(2);
+	std::vector<uint8_t> payload;
+	std::vector<std::vector<double>> expected(channels.channelCount());
+	std::vector<double> row(channels.channelCount());
+	for (int ms = 0; ms < kSimVarsRecordSeconds * 1000; ms++) {
+		for (size_t g = 0; g < groups.size(); g++) {
+			if (ms % groups[g].period_ms != 0)
+				continue;
+			makePayload(groups[g], random, &payload, row.data());
+			channels.decode(g, payload.data(), payload.size());
+			for (size_t i = 0; i < groups[g].fields.size(); i++)
+				expected[groups[g].first + i].push_back(row[i]);
+		}
+		if (ms % kSimVarsUpdateMs == 0)
+			writer.update();
+	}
+	writer.close();
+
+	TrackReader reader;
+	if (FAILED(reader.open(path.c_str()))) {
+		fwprintf(stderr, L"Could not read %s back\n", path.c_str());
+		return 1;
+	}
+	int errors = 0;
+	if (reader.channelNames().size() != channels.channelCount()) {
+		fwprintf(stderr, L"%zu channel names read back, not %zu\n", reader.channelNames().size(),
+			channels.channelCount());
+		errors++;
+	} else {
+		for (size_t c = 0; c < channels.channelCount(); c++) {
+			if (reader.channelNames()[c].compare(0, channels.channel(c).name.size(), channels.channel(c).name) != 0) {
+				fwprintf(stderr, L"Channel %zu is named %S\n", c, reader.channelNames()[c].c_str());
+				errors++;
+			}
+		}
+	}
+
+	std::vector<size_t> next(channels.channelCount());
+	TrackColumns columns;
+	for (size_t b = 0; b < reader.blockCount() && errors == 0; b++) {
+		if (!reader.readBlock(b, &columns)) {
+			fwprintf(stderr, L"Block %zu is malformed\n", b);
+			errors++;
+			break;
+		}
+		for (int i = 0; i < columns.channel_count; i++) {
+			const size_t c = columns.first_channel + i;
+			for (int s = 0; s < columns.count; s++) {
+				if (c >= expected.size() || next[c] >= expected[c].size() ||
+					columns.channels[i][s] != expected[c][next[c]]) {
+					fwprintf(stderr, L"Channel %zu sample %zu does not match\n", c, next[c]);
+					errors++;
+					break;
+				}
+				next[c]++;
+			}
+		}
+	}
+	for (size_t c = 0; c < expected.size() && errors == 0; c++) {
+		if (next[c] != expected[c].size()) {
+			fwprintf(stderr, L"Channel %zu has %zu samples, not %zu\n", c, next[c], expected[c].size());
+			errors++;
+		}
+	}
+
+	wprintf(L"%d s recorded: %llu samples in %zu blocks, %zu bytes\n", kSimVarsRecordSeconds,
+		reader.sampleCount(), reader.blockCount(), reader.fileSize());
+	DeleteFile(path.c_str());
+	return errors ? 1 : 0;
+}
+
+int simVarsCommand(int argc, wchar_t** argv) {
+	std::wstring file;
+	int synthetic = kSimVarsDefaultChannels;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--synthetic") == 0 && i + 1 < argc)
+			synthetic = std::max(_wtoi(argv[++i]), 1);
+		else if (argv[i][0] != L'-' && file.empty())
+			file = argv[i];
+		else {
+			fwprintf(stderr, L"Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	std::vector<SimVarConfig> configs;
+	if (file.empty()) {
+		configs = syntheticConfig(synthetic);
+	} else if (FAILED(loadSimVarConfig(file.c_str(), &configs)) || configs.empty()) {
+		fwprintf(stderr, L"No SimVars in %s\n", file.c_str());
+		return 1;
+	}
+
+	SimVarChannels channels;
+	channels.configure(configs);
+	if (timeDecode(channels) != 0)
+		return 1;
+	// A fresh set, so that the history starts empty.
+	SimVarChannels recorded;
+	recorded.configure(configs);
+	return roundTrip(recorded);
+}
@@ -0,0 +1,349 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "framework.h"
+#include <psapi.h>
+#include "Commands.h"
+#include "AllocTracker.h"
+#include "ReplayPipeline.h"
+#include "SimInterface.h"
+#include "SinkScheduler.h"
+#include "SyntheticFlight.h"
+
+// Runs the main window's pipeline for days of simulated time, as fast as it
+// goes, to catch slow leaks and slowdowns. A stand-in for SimConnect feeds a
+// generated flight and now and then quits, reports an exception, fails a
+// dispatch, refuses to reconnect or goes back to the menu; the harness
+// reconnects through SimulatorInterface as MainWindow does. Every so often
+// it samples the working set, private bytes, handles, the dispatch thread's
+// live allocations and the time each sample took through the sinks, and
+// fails if a resource keeps growing or the 99th percentile drifts.
+
+constexpr int64_t kSoakStartTimeMs = 1600000000000ll;
+constexpr wchar_t kSoakDirectory[] = L"FlightMonitorSoak";
+
+// As MainWindow's reconnect timer.
+constexpr int64_t kSoakReconnectMs = 5000;
+
+// Opens refused after a quit with a refused reconnect, and how long the
+// simulator sits in its menu.
+constexpr int kSoakRefusedOpens = 3;
+constexpr int64_t kSoakMenuMs = 60000;
+
+// Points before this far in are caches and files warming up and are not
+// judged. The rest are judged in quarters.
+constexpr double kSoakWarmupFraction = 0.1;
+constexpr int kSoakMinJudgedPoints = 8;
+
+// Growth across every quarter that adds up to less than these is noise.
+constexpr double kSoakMemoryToleranceBytes = 1 << 20;
+constexpr double kSoakHandleTolerance = 8;
+constexpr double kSoakAllocationTolerance = 1000;
+
+// The last quarter's typical 99th percentile may be this much above the
+// first's, and this many microseconds, before it counts as drift.
+constexpr double kSoakP99DriftFactor = 1.5;
+constexpr double kSoakP99DriftFloorUs = 20;
+
+using Clock = std::chrono::steady_clock;
+
+enum SoakFault {
+	kSoakQuit,                // SIMCONNECT_RECV_ID_QUIT
+	kSoakException,           // SIMCONNECT_RECV_ID_EXCEPTION in place of a sample
+	kSoakDispatchError,       // SimConnect_CallDispatch fails
+	kSoakRefusedReconnect,    // quits, then the next opens fail
+	kSoakMenu,                // back to the menu, ending the flight
+	kSoakFaultKinds,
+};
+
+static const wchar_t* const kSoakFaultNames[] = {
+	L"quit", L"exception", L"dispatch error", L"refused reconnect", L"menu",
+};
+
+// Hands SimulatorInterface one sample per dispatch, or the fault it is told
+// to inject next.
+class SoakBackend : public SimBackend {
+public:
+	HRESULT open(HWND, UINT, HANDLE) override {
+		if (refused_opens_ > 0) {
+			refused_opens_--;
+			return E_FAIL;
+		}
+		open_ = true;
+		return S_OK;
+	}
+
+	HRESULT dispatch(SimulatorInterface* sim) override {
+		const SoakFault fault = fault_;
+		fault_ = kSoakFaultKinds;
+		switch (fault) {
+		case kSoakQuit:
+		case kSoakRefusedReconnect:
+			sim->onSimDisconnect();
+			return S_OK;
+		case kSoakException:
+			return S_OK;
+		case kSoakDispatchError:
+			return E_FAIL;
+		default:
+			sim->setSimData(&data_);
+			return S_OK;
+		}
+	}
+
+	void close() override { open_ = false; }
+
+	void setData(const SimData& data) { data_ = data; }
+	void inject(SoakFault fault) {
+		fault_ = fault;
+		if (fault == kSoakRefusedReconnect)
+			refused_opens_ = kSoakRefusedOpens;
+	}
+
+private:
+	bool open_ = false;
+	SimData data_;
+	SoakFault fault_ = kSoakFaultKinds;
+	int refused_opens_ = 0;
+};
+
+// Starts the reconnect timer when the simulator goes, as MainWindow does.
+class SoakReconnect : public EventListener<SimDisconnectEvent> {
+public:
+	void onEvent(const SimDisconnectEvent&) override {
+		disconnects++;
+		reconnect_at_ms = now_ms + kSoakReconnectMs;
+	}
+
+	int64_t now_ms = 0;
+	int64_t reconnect_at_ms = 0;
+	uint64_t disconnects = 0;
+};
+
+struct SoakPoint {
+	double hours = 0;
+	double working_set = 0;
+	double private_bytes = 0;
+	double handles = 0;
+	double live_allocations = 0;
+	double allocations_per_sample = 0;
+	double p50_us = 0;
+	double p99_us = 0;
+};
+
+static void sampleProcess(SoakPoint* point) {
+	PROCESS_MEMORY_COUNTERS_EX memory = { 0 };
+	memory.cb = sizeof(memory);
+	if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&memory, sizeof(memory))) {
+		point->working_set = (double)memory.WorkingSetSize;
+		point->private_bytes = (double)memory.PrivateUsage;
+	}
+	DWORD handles = 0;
+	if (GetProcessHandleCount(GetCurrentProcess(), &handles))
+		point->handles = handles;
+	const AllocCounts& counts = threadAllocCounts();
+	point->live_allocations = (double)(counts.allocations - counts.frees);
+}
+
+// The given fraction of latencies, which it reorders.
+static double percentileUs(std::vector<float>& latencies, double fraction) {
+	if (latencies.empty())
+		return 0;
+	const size_t k = std::min(latencies.size() - 1, (size_t)(fraction * latencies.size()));
+	std::nth_element(latencies.begin(), latencies.begin() + k, latencies.end());
+	return latencies[k];
+}
+
+static double median(std::vector<double> values) {
+	if (values.empty())
+		return 0;
+	std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+	return values[values.size() / 2];
+}
+
+// Fails a resource whose highest value rose in every quarter of the judged
+// points, by more than tolerance in all.
+static bool checkGrowth(const std::vector<SoakPoint>& points, size_t first, double SoakPoint::*field,
+	const wchar_t* name, double tolerance) {
+	const size_t quarter = (points.size() - first) / 4;
+	double highs[4];
+	for (int q = 0; q < 4; q++) {
+		highs[q] = -HUGE_VAL;
+		const size_t end = q == 3 ? points.size() : first + (q + 1) * quarter;
+		for (size_t i = first + q * quarter; i < end; i++)
+			highs[q] = std::max(highs[q], points[i].*field);
+	}
+	if (highs[0] < highs[1] && highs[1] < highs[2] && highs[2] < highs[3] && highs[3] - highs[0] > tolerance) {
+		fwprintf(stderr, L"%s grew in every quarter: %.0f, %.0f, %.0f, %.0f\n", name,
+			highs[0], highs[1], highs[2], highs[3]);
+		return false;
+	}
+	return true;
+}
+
+static bool checkDrift(const std::vector<SoakPoint>& points, size_t first) {
+	const size_t quarter = (points.size() - first) / 4;
+	std::vector<double> early, late;
+	for (size_t i = first; i < first + quarter; i++)
+		early.push_back(points[i].p99_us);
+	for (size_t i = points.size() - quarter; i < points.size(); i++)
+		late.push_back(points[i].p99_us);
+	const double before = median(early), after = median(late);
+	if (after > before * kSoakP99DriftFactor && after - before > kSoakP99DriftFloorUs) {
+		fwprintf(stderr, L"p99 drifted from %.1f us to %.1f us\n", before, after);
+		return false;
+	}
+	return true;
+}
+
+int soakCommand(int argc, wchar_t** argv) {
+	double hours = 24;
+	double rate = 60;
+	double faultsPerHour = 4;
+	double pointMinutes = 15;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--hours") == 0 && i + 1 < argc)
+			hours = std::max(_wtof(argv[++i]), 0.1);
+		else if (wcscmp(argv[i], L"--rate") == 0 && i + 1 < argc)
+			rate = std::max(_wtof(argv[++i]), 1.0);
+		else if (wcscmp(argv[i], L"--faults") == 0 && i + 1 < argc)
+			faultsPerHour = std::max(_wtof(argv[++i]), 0.0);
+		else if (wcscmp(argv[i], L"--every") == 0 && i + 1 < argc)
+			pointMinutes = std::max(_wtof(argv[++i]), 1.0);
+		else {
+			fwprintf(stderr, L"Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (FAILED(ForeFlightBroadcaster::InitWinsock()))
+		return 1;
+
+	ReplayPipeline pipeline(kSoakDirectory);
+	ReplayScheduler replay(pipeline.sinks());
+	SinkScheduler broadcasts;
+	pipeline.broadcaster.registerSinks(broadcasts);
+	SoakBackend* backend = new SoakBackend;
+	SimulatorInterface sim{ std::unique_ptr<SimBackend>(backend) };
+	SoakReconnect reconnect;
+	sim.events().subscribeAll(&broadcasts);
+	sim.events().subscribeAll(&replay);
+	sim.events().subscribe<SimDisconnectEvent>(&reconnect);
+	broadcasts.start();
+
+	std::mt19937 random(1);
+	std::exponential_distribution<double> faultInterval(faultsPerHour / 3600000.0);
+	std::uniform_int_distribution<int> faultKind(0, kSoakFaultKinds - 1);
+	uint64_t faults[kSoakFaultKinds] = { 0 };
+
+	const int64_t endMs = (int64_t)(hours * 3600000);
+	const int64_t pointMs = (int64_t)(pointMinutes * 60000);
+	int64_t nextFaultMs = faultsPerHour > 0 ? (int64_t)faultInterval(random) : INT64_MAX;
+	int64_t nextPointMs = pointMs;
+	int64_t menuUntilMs = 0;
+	std::vector<float> latencies;
+	latencies.reserve((size_t)(pointMinutes * 60 * rate) + 1);
+	std::vector<SoakPoint> points;
+	uint64_t windowAllocations = threadAllocCounts().allocations;
+	uint64_t samples = 0;
+
+	wprintf(L"%.0f simulated hours at %.0f Hz, %.1f faults an hour\n", hours, rate, faultsPerHour);
+	wprintf(L"%8s %12s %12s %8s %12s %10s %9s %9s\n", L"hours", L"working set", L"private", L"handles",
+		L"live allocs", L"allocs/smp", L"p50 us", L"p99 us");
+	const double start = toolSeconds();
+	SyntheticFlight flight(kSoakStartTimeMs, rate);
+	sim.connectSim(NULL, 0);
+	for (;;) {
+		const SimSample sample = flight.next();
+		const int64_t now = sample.time_ms - kSoakStartTimeMs;
+		if (now >= endMs)
+			break;
+		reconnect.now_ms = now;
+
+		if (now >= nextFaultMs) {
+			const SoakFault fault = (SoakFault)faultKind(random);
+			faults[fault]++;
+			if (fault == kSoakMenu)
+				menuUntilMs = now + kSoakMenuMs;
+			else
+				backend->inject(fault);
+			nextFaultMs = now + std::max<int64_t>(1, (int64_t)faultInterval(random));
+		}
+
+		if (!sim.isConnected() && now >= reconnect.reconnect_at_ms && FAILED(sim.connectSim(NULL, 0)))
+			reconnect.reconnect_at_ms = now + kSoakReconnectMs;
+		if (sim.isConnected()) {
+			if (now < menuUntilMs)
+				backend->setData(SimData());
+			else
+				backend->setData(sample.data);
+			replay.setTime(sample.time_ms);
+			const Clock::time_point before = Clock::now();
+			sim.dispatch();
+			pipeline.landing.drain();
+			latencies.push_back(std::chrono::duration<float, std::micro>(Clock::now() - before).count());
+			samples++;
+		}
+
+		if (now >= nextPointMs) {
+			SoakPoint point;
+			point.hours = now / 3600000.0;
+			sampleProcess(&point);
+			const uint64_t allocations = threadAllocCounts().allocations;
+			point.allocations_per_sample = latencies.empty() ? 0 :
+				(double)(allocations - windowAllocations) / latencies.size();
+			point.p50_us = percentileUs(latencies, 0.5);
+			point.p99_us = percentileUs(latencies, 0.99);
+			wprintf(L"%8.2f %12.0f %12.0f %8.0f %12.0f %10.3f %9.1f %9.1f\n", point.hours, point.working_set,
+				point.private_bytes, point.handles, point.live_allocations, point.allocations_per_sample,
+				point.p50_us, point.p99_us);
+			points.push_back(point);
+			latencies.clear();
+			// Finished flights are of no further use and would fill the disk.
+			pipeline.removeRecordings();
+			windowAllocations = threadAllocCounts().allocations;
+			nextPointMs += pointMs;
+		}
+	}
+	sim.close();
+	broadcasts.stop();
+
+	wprintf(L"%llu samples in %.1f s, %llu disconnects;", samples, toolSeconds() - start, reconnect.disconnects);
+	for (int i = 0; i < kSoakFaultKinds; i++)
+		wprintf(L" %llu %s", faults[i], kSoakFaultNames[i]);
+	wprintf(L"\n");
+
+	const size_t first = (size_t)(points.size() * kSoakWarmupFraction);
+	if (points.size() - first < kSoakMinJudgedPoints) {
+		fwprintf(stderr, L"Too few points to judge; run for longer or sample more often\n");
+		return 1;
+	}
+	bool ok = true;
+	ok &= checkGrowth(points, first, &SoakPoint::working_set, L"Working set", kSoakMemoryToleranceBytes);
+	ok &= checkGrowth(points, first, &SoakPoint::private_bytes, L"Private bytes", kSoakMemoryToleranceBytes);
+	ok &= checkGrowth(points, first, &SoakPoint::handles, L"Handles", kSoakHandleTolerance);
+	ok &= checkGrowth(points, first, &SoakPoint::live_allocations, L"Live allocations", kSoakAllocationTolerance);
+	ok &= checkDrift(points, first);
+	if (!ok)
+		return 1;
+	wprintf(L"No growth or drift\n");
+	return 0;
+}
@@ -0,0 +1,99 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+
+#include "SyntheticFlight.h"
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kMetersPerDegree = 111320.0;
+constexpr double kKnotsToMps = 0.514444;
+
+double syntheticTurnRate(double t) {
+	const double cycle = fmod(t, kSyntheticCycleSeconds);
+	const double turnPhase = fmod(t, 600.0);
+	return (cycle > 40 && turnPhase > 500 && turnPhase < 530) ? 3.0 : 0.0;
+}
+
+SyntheticFlight::SyntheticFlight(int64_t startTimeMs, double samplesPerSecond, uint32_t seed) :
+	start_time_ms_(startTimeMs), interval_s_(1.0 / samplesPerSecond),
+	lat_(47.4502), lon_(-122.3088), track_(340.0), random_(seed), noise_(0.0, 0.05) {
+	// Spread flights from different seeds around a few degrees.
+	lat_ += (seed % 97) * 0.05;
+	lon_ += (seed % 89) * 0.05;
+	track_ = (seed * 37) % 360;
+}
+
+SimSample SyntheticFlight::next() {
+	const double t = index_ * interval_s_;
+
+	// Each two hour cycle is one flight, in meters and m/s: a 40 s takeoff
+	// roll, a climb to 2600 m, cruise, a descent back to 120 m and a 60 s
+	// landing rollout to a stop.
+	const double cycle = fmod(t, kSyntheticCycleSeconds);
+	double alt = 120;
+	double groundspeed = 90 * kKnotsToMps;
+	double pitch = 0;
+	double climb = 0;
+	bool onGround = false;
+	if (cycle < 40) {
+		groundspeed *= cycle / 40;
+		onGround = true;
+	} else if (cycle < 1200) {
+		climb = 2480.0 / 1160;
+		alt = 120 + climb * (cycle - 40);
+		pitch = -5.0;
+	} else if (cycle < 6000) {
+		alt = 2600;
+		groundspeed = 120 * kKnotsToMps;
+	} else if (cycle < kSyntheticCycleSeconds - 60) {
+		climb = -2480.0 / (kSyntheticCycleSeconds - 6060);
+		alt = 2600 + climb * (cycle - 6000);
+		pitch = 2.0;
+	} else {
+		groundspeed *= (kSyntheticCycleSeconds - cycle) / 60;
+		onGround = true;
+	}
+
+	// A firm arrival: a short load factor bump as the gear takes the weight.
+	const double sinceTouchdown = cycle - (kSyntheticCycleSeconds - 60);
+	const double gForce = (sinceTouchdown >= 0 && sinceTouchdown < 0.3) ? 1.4 : 1.0;
+
+	// A standard-rate turn now and then while airborne.
+	const double turnRate = syntheticTurnRate(t);
+	track_ = fmod(track_ + turnRate * interval_s_ + 360.0, 360.0);
+
+	const double distance = groundspeed * interval_s_;
+	lat_ += distance * cos(track_ * kPi / 180) / kMetersPerDegree;
+	lon_ += distance * sin(track_ * kPi / 180) / (kMetersPerDegree * cos(lat_ * kPi / 180));
+
+	SimSample sample;
+	sample.time_ms = start_time_ms_ + (int64_t)llround(t * 1000);
+	sample.data.gps_alt = alt + noise_(random_);
+	sample.data.gps_lat = lat_;
+	sample.data.gps_lon = lon_;
+	sample.data.gps_track = track_;
+	sample.data.gps_groundspeed = groundspeed;
+	sample.data.pitch = pitch + noise_(random_);
+	sample.data.bank = (turnRate != 0 ? -20.0 : 0.0) + noise_(random_);
+	sample.data.heading = fmod(track_ + 3.0 + 360.0, 360.0);
+	sample.data.vertical_speed = climb;
+	sample.data.g_force = gForce + noise_(random_) * 0.1;
+	sample.data.alt_agl = sample.data.gps_alt - 120;
+	sample.data.on_ground = onGround ? 1 : 0;
+
+	index_++;
+	return sample;
+}
@@ -0,0 +1,49 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <random>
+
+#include "SimData.h"
+
+// Length of one generated flight, takeoff roll to stop.
+constexpr double kSyntheticCycleSeconds = 7200;
+
+// The turn rate, right in degrees per second, t seconds into the generated
+// flights: a standard-rate turn for 30 s in every ten minutes once airborne.
+double syntheticTurnRate(double t);
+
+// Generates a plausible flight for benchmarks when no recordings are at
+// hand: takeoff, climb, cruise with gentle turns, descent and landing, with
+// a little attitude noise. Generating past kSyntheticCycleSeconds starts
+// another flight. Deterministic for a given seed.
+class SyntheticFlight {
+public:
+	SyntheticFlight(int64_t startTimeMs, double samplesPerSecond, uint32_t seed = 1);
+
+	SimSample next();
+
+private:
+	int64_t start_time_ms_;
+	double interval_s_;
+	uint64_t index_ = 0;
+	double lat_;
+	double lon_;
+	double track_;
+	std::mt19937 random_;
+	std::normal_distribution<double> noise_;
+};
@@ -0,0 +1,169 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <set>
+#include <vector>
+
+#include "framework.h"
+#include "Commands.h"
+#include "SyntheticFlight.h"
+#include "TerrainService.h"
+
+// Times terrain lookups along a generated flight, the way TerrainService
+// makes them as a sink. With --generate, first writes synthetic SRTM tiles
+// under the flight so it runs without downloading any, and checks every
+// lookup against the surface the tiles were made from.
+
+constexpr double kTerrainToolSamplesPerSecond = 10;
+constexpr int kTerrainToolSamplesPerPrefetch = 10;
+constexpr int64_t kTerrainToolStartTimeMs = 1600000000000ll;
+
+// Generated tiles: 3 arc-second, with a patch of void posts in each.
+constexpr int kSyntheticTileSize = kTerrainTileSize3;
+constexpr int kSyntheticVoidFirst = 600;
+constexpr int kSyntheticVoidLast = 610;
+
+// Rolling hills and ridges, between about 100 and 1800 meters.
+static double syntheticTerrain(double lat, double lon) {
+	return 900 + 500 * sin(lat * 7.1) * cos(lon * 4.3) + 300 * sin(lat * 23.0 + lon * 17.0) +
+		80 * cos(lat * 61.0 - lon * 53.0);
+}
+
+static bool writeSyntheticTile(const std::wstring& directory, int lat, int lon) {
+	const int size = kSyntheticTileSize;
+	std::vector<uint8_t> posts((size_t)size * size * 2);
+	for (int row = 0; row < size; row++) {
+		const double postLat = lat + 1 - (double)row / (size - 1);
+		for (int column = 0; column < size; column++) {
+			const double postLon = lon + (double)column / (size - 1);
+			const bool isVoid = row >= kSyntheticVoidFirst && row <= kSyntheticVoidLast &&
+				column >= kSyntheticVoidFirst && column <= kSyntheticVoidLast;
+			const int16_t height = isVoid ? kTerrainVoid : (int16_t)lround(syntheticTerrain(postLat, postLon));
+			uint8_t* p = &posts[((size_t)row * size + column) * 2];
+			p[0] = (uint8_t)((uint16_t)height >> 8);
+			p[1] = (uint8_t)height;
+		}
+	}
+
+	const std::wstring path = directory + L"\\" + terrainTileName(lat, lon);
+	FILE* file = nullptr;
+	if (_wfopen_s(&file, path.c_str(), L"wb") != 0 || file == nullptr)
+		return false;
+	const bool written = fwrite(posts.data(), posts.size(), 1, file) == 1;
+	fclose(file);
+	return written;
+}
+
+// Writes a tile under every sample of the flight, and one all round.
+static bool generateTiles(const std::wstring& directory, const std::vector<SimSample>& samples) {
+	std::set<std::pair<int, int>> tiles;
+	for (const SimSample& sample : samples) {
+		const int lat = (int)floor(sample.data.gps_lat);
+		const int lon = (int)floor(sample.data.gps_lon);
+		for (int dlat = -1; dlat <= 1; dlat++) {
+			for (int dlon = -1; dlon <= 1; dlon++)
+				tiles.insert(std::make_pair(lat + dlat, lon + dlon));
+		}
+	}
+
+	CreateDirectory(directory.c_str(), NULL);
+	for (const auto& tile : tiles) {
+		if (!writeSyntheticTile(directory, tile.first, tile.second)) {
+			fwprintf(stderr, L"Could not write %s\n", terrainTileName(tile.first, tile.second).c_str());
+			return false;
+		}
+	}
+	wprintf(L"wrote %zu tiles to %s\n", tiles.size(), directory.c_str());
+	return true;
+}
+
+struct LookupPass {
+	uint64_t found = 0;
+	double seconds = 0;
+	double max_error = 0;
+	double checksum = 0;
+};
+
+static LookupPass lookupPass(TerrainService* terrain, const std::vector<SimSample>& samples, bool check) {
+	LookupPass pass;
+	const double start = toolSeconds();
+	for (size_t i = 0; i < samples.size(); i++) {
+		const SimData& data = samples[i].data;
+		if (i % kTerrainToolSamplesPerPrefetch == 0)
+			terrain->prefetch(data.gps_lat, data.gps_lon, data.gps_track, data.gps_groundspeed);
+		double meters;
+		if (!terrain->elevation(data.gps_lat, data.gps_lon, &meters))
+			continue;
+		pass.found++;
+		pass.checksum += meters;
+		if (check) {
+			// Posts are rounded to whole meters and the surface curves
+			// between them.
+			const double error = fabs(meters - syntheticTerrain(data.gps_lat, data.gps_lon));
+			pass.max_error = std::max(pass.max_error, error);
+		}
+	}
+	pass.seconds = toolSeconds() - start;
+	return pass;
+}
+
+int terrainCommand(int argc, wchar_t** argv) {
+	if (argc < 1) {
+		fwprintf(stderr, L"usage: terrain <directory> [--generate] [--minutes <n>]\n");
+		return 2;
+	}
+	const std::wstring directory = argv[0];
+	bool generate = false;
+	double minutes = kSyntheticCycleSeconds / 60;
+	for (int i = 1; i < argc; i++) {
+		if (wcscmp(argv[i], L"--generate") == 0)
+			generate = true;
+		else if (wcscmp(argv[i], L"--minutes") == 0 && i + 1 < argc)
+			minutes = _wtof(argv[++i]);
+	}
+
+	SyntheticFlight flight(kTerrainToolStartTimeMs, kTerrainToolSamplesPerSecond);
+	std::vector<SimSample> samples((size_t)(minutes * 60 * kTerrainToolSamplesPerSecond));
+	for (SimSample& sample : samples)
+		sample = flight.next();
+	if (samples.empty())
+		return 2;
+	if (generate && !generateTiles(directory, samples))
+		return 1;
+
+	TerrainService terrain;
+	if (FAILED(terrain.open(directory))) {
+		fwprintf(stderr, L"Could not use %s\n", directory.c_str());
+		return 1;
+	}
+
+	// The first pass maps tiles as the flight reaches them; the second
+	// finds them all mapped, as a flight does once prefetch is ahead of it.
+	const LookupPass cold = lookupPass(&terrain, samples, generate);
+	const LookupPass warm = lookupPass(&terrain, samples, generate);
+	for (const LookupPass* pass : { &cold, &warm }) {
+		wprintf(L"%-5s %zu lookups, %llu with data, %.1f ns/lookup",
+			pass == &cold ? L"cold" : L"warm", samples.size(), pass->found,
+			pass->seconds / samples.size() * 1e9);
+		if (generate)
+			wprintf(L", max error %.2f m", pass->max_error);
+		wprintf(L"\n");
+	}
+	wprintf(L"%llu hits, %llu synchronous loads, %llu prefetched, %zu tiles mapped\n",
+		terrain.hits(), terrain.misses(), terrain.prefetched(), terrain.mappedTiles());
+	return 0;
+}
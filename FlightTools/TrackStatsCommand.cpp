@@ -0,0 +1,136 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+
+#include "framework.h"
+#include "Commands.h"
+#include "SyntheticFlight.h"
+#include "TrackFile.h"
+
+// Reports how well recordings compress and how fast they decode. With
+// --synthetic, encodes a generated flight in memory instead, which also
+// times the encoder.
+
+// Size of a sample stored without compression: timestamp plus channels.
+constexpr size_t kRawSampleBytes = sizeof(int64_t) + kTrackChannels * sizeof(double);
+
+constexpr double kSyntheticSamplesPerSecond = 10;
+constexpr int64_t kSyntheticStartTimeMs = 1600000000000ll;
+
+struct TrackStats {
+	uint64_t samples = 0;
+	uint64_t compressed_bytes = 0;
+	double decode_seconds = 0;
+	double checksum = 0;
+};
+
+static void decodeAll(const TrackReader& reader, TrackStats* stats) {
+	TrackColumns columns;
+	double checksum = 0;
+	const double start = toolSeconds();
+	for (size_t i = 0; i < reader.blockCount(); i++) {
+		if (!reader.readBlock(i, &columns))
+			continue;
+		// Touch the decoded data so the decode cannot be optimized away.
+		checksum += columns.channel(0)[columns.count - 1];
+	}
+	stats->decode_seconds += toolSeconds() - start;
+	stats->checksum += checksum;
+}
+
+static void printStats(LPCWSTR name, const TrackStats& stats) {
+	const double raw = (double)stats.samples * kRawSampleBytes;
+	wprintf(L"%-40s %10llu samples %10llu bytes  ratio %5.2f  %6.2f bits/sample  %7.1f M samples/s\n",
+		name, stats.samples, stats.compressed_bytes,
+		stats.compressed_bytes ? raw / stats.compressed_bytes : 0.0,
+		stats.samples ? stats.compressed_bytes * 8.0 / stats.samples : 0.0,
+		stats.decode_seconds > 0 ? stats.samples / stats.decode_seconds / 1e6 : 0.0);
+}
+
+static int syntheticStats(double minutes) {
+	const uint64_t count = (uint64_t)(minutes * 60 * kSyntheticSamplesPerSecond);
+	SyntheticFlight flight(kSyntheticStartTimeMs, kSyntheticSamplesPerSecond);
+
+	std::vector<SimSample> samples;
+	samples.reserve((size_t)count);
+	for (uint64_t i = 0; i < count; i++)
+		samples.push_back(flight.next());
+
+	// Lay the blocks out exactly as a recording would be.
+	std::vector<uint8_t> file(sizeof(TrackFileHeader));
+	TrackFileHeader header = { 0 };
+	header.magic = kTrackFileMagic;
+	header.version = kTrackFileVersion;
+	header.channel_count = kTrackChannels;
+	header.created_time_ms = kSyntheticStartTimeMs;
+	memcpy(file.data(), &header, sizeof(header));
+
+	TrackBlockEncoder encoder;
+	const double start = toolSeconds();
+	for (const SimSample& sample : samples) {
+		encoder.append(sample);
+		if (encoder.full())
+			encoder.finish(&file);
+	}
+	encoder.finish(&file);
+	const double encodeSeconds = toolSeconds() - start;
+
+	TrackReader reader;
+	if (!reader.attach(file.data(), file.size())) {
+		fwprintf(stderr, L"Synthetic track did not read back\n");
+		return 1;
+	}
+
+	TrackStats stats;
+	stats.samples = reader.sampleCount();
+	stats.compressed_bytes = file.size();
+	decodeAll(reader, &stats);
+	printStats(L"(synthetic)", stats);
+	wprintf(L"encode %.1f M samples/s\n", encodeSeconds > 0 ? count / encodeSeconds / 1e6 : 0.0);
+	return 0;
+}
+
+int trackStatsCommand(int argc, wchar_t** argv) {
+	if (argc >= 2 && wcscmp(argv[0], L"--synthetic") == 0)
+		return syntheticStats(_wtof(argv[1]));
+
+	std::vector<std::wstring> files = expandInputFiles(argc, argv, kTrackFileExtension);
+	if (files.empty()) {
+		fwprintf(stderr, L"No track files given\n");
+		return 2;
+	}
+
+	TrackStats total;
+	for (const std::wstring& path : files) {
+		TrackReader reader;
+		if (FAILED(reader.open(path.c_str()))) {
+			fwprintf(stderr, L"Could not read %s\n", path.c_str());
+			continue;
+		}
+		TrackStats stats;
+		stats.samples = reader.sampleCount();
+		stats.compressed_bytes = reader.fileSize();
+		decodeAll(reader, &stats);
+		printStats(path.c_str(), stats);
+
+		total.samples += stats.samples;
+		total.compressed_bytes += stats.compressed_bytes;
+		total.decode_seconds += stats.decode_seconds;
+	}
+	if (files.size() > 1)
+		printStats(L"(total)", total);
+	return 0;
+}
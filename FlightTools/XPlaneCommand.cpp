@@ -0,0 +1,213 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "framework.h"
+#include "Commands.h"
+#include "ForeFlightBroadcaster.h"
+#include "SimInterface.h"
+#include "SyntheticFlight.h"
+#include "XPlaneBackend.h"
+#include "XPlaneProtocol.h"
+
+// Stands in for X-Plane. By default encodes a generated flight as DATA and
+// RREF packets and times parsing them, checking that every field comes back.
+// --udp sends the packets over loopback to an XPlaneBackend at --rate
+// packets a second, alternating the two kinds, and reports the packets lost
+// and the time from each send to its sample reaching the callbacks.
+
+constexpr int64_t kXPlaneToolStartTimeMs = 1600000000000ll;
+constexpr double kXPlaneToolSamplesPerSecond = 60;
+constexpr u_short kXPlaneToolPort = 49103;
+
+using Clock = std::chrono::steady_clock;
+
+// X-Plane sends floats, so positions come back to about a meter.
+static bool closeEnough(const SimData& a, const SimData& b) {
+	return fabs(a.gps_lat - b.gps_lat) < 1e-5 && fabs(a.gps_lon - b.gps_lon) < 1e-5 &&
+		fabs(a.gps_alt - b.gps_alt) < 0.01 && fabs(a.gps_track - b.gps_track) < 1e-3 &&
+		fabs(a.gps_groundspeed - b.gps_groundspeed) < 1e-3 && fabs(a.pitch - b.pitch) < 1e-4 &&
+		fabs(a.bank - b.bank) < 1e-4 && fabs(a.heading - b.heading) < 1e-3 &&
+		fabs(a.vertical_speed - b.vertical_speed) < 1e-4 && fabs(a.g_force - b.g_force) < 1e-4 &&
+		fabs(a.alt_agl - b.alt_agl) < 0.01 && a.on_ground == b.on_ground;
+}
+
+static std::vector<SimData> generateFrames(size_t count) {
+	SyntheticFlight flight(kXPlaneToolStartTimeMs, kXPlaneToolSamplesPerSecond);
+	std::vector<SimData> frames(count);
+	for (SimData& frame : frames)
+		frame = flight.next().data;
+	return frames;
+}
+
+static int parseBenchmark(size_t count) {
+	const std::vector<SimData> frames = generateFrames(count);
+	int errors = 0;
+	for (int rref = 0; rref < 2; rref++) {
+		const size_t packetSize = rref ? kXPlaneRrefPacketSize : kXPlaneDataPacketSize;
+		std::vector<uint8_t> packets(count * packetSize);
+		for (size_t i = 0; i < count; i++) {
+			if (rref)
+				encodeXPlaneRref(frames[i], &packets[i * packetSize]);
+			else
+				encodeXPlaneData(frames[i], &packets[i * packetSize]);
+		}
+
+		SimData data;
+		size_t mismatches = 0;
+		double seconds = HUGE_VAL;
+		for (int pass = 0; pass < 3; pass++) {
+			mismatches = 0;
+			const double start = toolSeconds();
+			for (size_t i = 0; i < count; i++) {
+				const unsigned fields = parseXPlanePacket(&packets[i * packetSize], packetSize, &data);
+				if (fields != kSimFieldAll || !closeEnough(data, frames[i]))
+					mismatches++;
+			}
+			seconds = std::min(seconds, toolSeconds() - start);
+		}
+		wprintf(L"%s: %zu packets of %zu bytes, %.1f ns/packet, %.0f MB/s\n", rref ? L"RREF" : L"DATA",
+			count, packetSize, seconds / count * 1e9, count * packetSize / seconds / 1e6);
+		if (mismatches) {
+			fwprintf(stderr, L"%zu packets did not parse back to the frame they were made from\n", mismatches);
+			errors++;
+		}
+	}
+	return errors ? 1 : 0;
+}
+
+class LoopbackLog : public EventListener<SimDataEvent> {
+public:
+	LoopbackLog(const std::vector<SimData>& frames, const std::vector<std::atomic<int64_t>>& sentNs) :
+		frames_(frames), sent_ns_(sentNs) {}
+
+	void onEvent(const SimDataEvent& event) override {
+		const int64_t now = Clock::now().time_since_epoch().count();
+		if (received < frames_.size()) {
+			const int64_t ns = now - sent_ns_[received];
+			latency_ns += ns;
+			latency_ns_max = std::max(latency_ns_max, ns);
+			if (!closeEnough(event.data, frames_[received]))
+				mismatches++;
+		}
+		received++;
+	}
+
+	size_t received = 0;
+	size_t mismatches = 0;
+	int64_t latency_ns = 0;
+	int64_t latency_ns_max = 0;
+
+private:
+	const std::vector<SimData>& frames_;
+	const std::vector<std::atomic<int64_t>>& sent_ns_;
+};
+
+static int loopback(double rate, double seconds) {
+	if (FAILED(ForeFlightBroadcaster::InitWinsock()))
+		return 1;
+
+	const size_t count = (size_t)(rate * seconds);
+	const std::vector<SimData> frames = generateFrames(count);
+	std::vector<std::atomic<int64_t>> sentNs(count);
+
+	XPlaneBackend* backend = new XPlaneBackend(nullptr, kXPlaneToolPort);
+	SimulatorInterface sim{ std::unique_ptr<SimBackend>(backend) };
+	LoopbackLog log(frames, sentNs);
+	sim.events().subscribe<SimDataEvent>(&log);
+	HANDLE event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (FAILED(sim.connectSim(NULL, 0, event))) {
+		fwprintf(stderr, L"Could not open port %d\n", kXPlaneToolPort);
+		CloseHandle(event);
+		return 1;
+	}
+
+	std::atomic<bool> sent{ false };
+	std::thread sender([&]() {
+		SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		sockaddr_in to = { 0 };
+		to.sin_family = AF_INET;
+		to.sin_port = htons(kXPlaneToolPort);
+		to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / rate));
+		auto next = Clock::now();
+		uint8_t packet[kXPlaneDataPacketSize > kXPlaneRrefPacketSize ? kXPlaneDataPacketSize : kXPlaneRrefPacketSize];
+		for (size_t i = 0; i < count; i++) {
+			const size_t size = (i % 2) ? encodeXPlaneRref(frames[i], packet) : encodeXPlaneData(frames[i], packet);
+			sentNs[i] = Clock::now().time_since_epoch().count();
+			sendto(sock, (const char*)packet, (int)size, 0, (const sockaddr*)&to, sizeof(to));
+			next += interval;
+			std::this_thread::sleep_until(next);
+		}
+		closesocket(sock);
+		sent = true;
+	});
+
+	uint64_t dispatches = 0;
+	auto quiet = Clock::time_point::max();
+	while (Clock::now() < quiet) {
+		if (WaitForSingleObject(event, 50) == WAIT_OBJECT_0) {
+			sim.dispatch();
+			dispatches++;
+		}
+		if (sent && quiet == Clock::time_point::max())
+			quiet = Clock::now() + std::chrono::milliseconds(200);
+	}
+	sender.join();
+	const uint64_t packets = backend->packetsReceived();
+	sim.close();
+	CloseHandle(event);
+
+	const size_t measured = std::min(log.received, count);
+	wprintf(L"%zu packets sent at %.0f/s, %zu received, %.2f per dispatch\n", count, rate, log.received,
+		dispatches ? (double)packets / dispatches : 0.0);
+	wprintf(L"Latency %.1f us mean, %.1f us max\n", measured ? log.latency_ns / 1000.0 / measured : 0.0,
+		log.latency_ns_max / 1000.0);
+	if (log.received != count || log.mismatches) {
+		fwprintf(stderr, L"%zu lost, %zu out of order or garbled\n", count - measured, log.mismatches);
+		return 1;
+	}
+	return 0;
+}
+
+int xplaneCommand(int argc, wchar_t** argv) {
+	size_t frames = 1000000;
+	bool udp = false;
+	double rate = 1000;
+	double seconds = 5;
+	for (int i = 0; i < argc; i++) {
+		if (wcscmp(argv[i], L"--frames") == 0 && i + 1 < argc)
+			frames = std::max(_wtoi(argv[++i]), 1);
+		else if (wcscmp(argv[i], L"--udp") == 0)
+			udp = true;
+		else if (wcscmp(argv[i], L"--rate") == 0 && i + 1 < argc)
+			rate = std::max(_wtof(argv[++i]), 1.0);
+		else if (wcscmp(argv[i], L"--seconds") == 0 && i + 1 < argc)
+			seconds = std::max(_wtof(argv[++i]), 0.1);
+		else {
+			fwprintf(stderr, L"Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+	return udp ? loopback(rate, seconds) : parseBenchmark(frames);
+}
@@ -0,0 +1,93 @@
+// Copyright(C) 2020 Alan Pearson
+//
+// This program is free software : you can redistribute it and /or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.If not, see < https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <chrono>
+
+#include "framework.h"
+#include "Commands.h"
+
+static const ToolCommand kCommands[] = {
+	{ L"airports", L"[file.fmapt] [--near <lat> <lon>] [--count <n>]", airportsCommand },
+	{ L"allocs", L"[--live <seconds>]", allocsCommand },
+	{ L"airspace", L"<file.txt|directory>... [--synthetic <count>] [--scaling]", airspaceCommand },
+	{ L"analyze", L"<file.fmtrk|directory>... [--above <meters>] [--threads <n>] [--scaling] [--flights]", analyzeCommand },
+	{ L"buildairports", L"<airports.csv> [--runways <csv>] [--navaids <csv>] [--out <file>] | --synthetic <count>", buildAirportsCommand },
+	{ L"derived", L"[--flights <n>] [--rate <hz>]", derivedCommand },
+	{ L"events", L"[--samples <n>]", eventsCommand },
+	{ L"export", L"<file.fmtrk|directory>... [--format gpx|kml|csv] [--tolerance <meters>] [--out <directory>]", exportCommand },
+	{ L"geodesy", L"[--points <n>]", geodesyCommand },
+	{ L"genarchive", L"<directory> <gigabytes> [--hours <per flight>]", generateArchiveCommand },
+	{ L"landing", L"<file.fmtrk|directory>... | --synthetic <flights>", landingCommand },
+	{ L"phases", L"<file.fmtrk|directory>... [--synthetic <flights>] [--quiet]", phasesCommand },
+	{ L"range", L"<file.fmtrk> [--at <h:mm:ss>] [--from <h:mm:ss>] [--to <h:mm:ss>] [--touchdown <seconds>] [--area <lat> <lon> <lat> <lon>] [--above <m>] [--below <m>] [--samples] | --index <file.fmtrk|directory>... | --synthetic <hours>", rangeCommand },
+	{ L"render", L"[--minutes <n>] [--png <file>]", renderCommand },
+	{ L"rxstats", L"[--port <n>]... [--seconds <n>] [--histogram] [--feedback] | --loopback [--senders <n>] [--seconds <n>] [--loss <pct>]", rxStatsCommand },
+	{ L"sendbench", L"[--packets <n>] [--burst <n>]", sendBenchCommand },
+	{ L"sessions", L"[--count <n>] [--rate <hz>] [--seconds <n>] [--per-thread <n>] [--scaling]", sessionsCommand },
+	{ L"simvars", L"[simvars.txt] [--synthetic <channels>]", simVarsCommand },
+	{ L"soak", L"[--hours <n>] [--rate <hz>] [--faults <per hour>] [--every <minutes>]", soakCommand },
+	{ L"terrain", L"<directory> [--generate] [--minutes <n>]", terrainCommand },
+	{ L"trackstats", L"<file.fmtrk|directory>... [--synthetic <minutes>]", trackStatsCommand },
+	{ L"xplane", L"[--frames <n>] | --udp [--rate <packets/s>] [--seconds <n>]", xplaneCommand },
+};
+
+static void usage() {
+	fwprintf(stderr, L"usage: FlightTools <command> [arguments]\n\n");
+	for (const ToolCommand& command : kCommands)
+		fwprintf(stderr, L"  %s %s\n", command.name, command.usage);
+}
+
+std::vector<std::wstring> expandInputFiles(int argc, wchar_t** argv, LPCWSTR extension) {
+	std::vector<std::wstring> files;
+	for (int i = 0; i < argc; i++) {
+		DWORD attributes = GetFileAttributes(argv[i]);
+		if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+			files.push_back(argv[i]);
+			continue;
+		}
+
+		std::wstring directory(argv[i]);
+		std::wstring pattern = directory + L"\\*" + extension;
+		WIN32_FIND_DATA fd;
+		HANDLE find = FindFirstFile(pattern.c_str(), &fd);
+		if (find == INVALID_HANDLE_VALUE)
+			continue;
+		do {
+			if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+				files.push_back(directory + L"\\" + fd.cFileName);
+		} while (FindNextFile(find, &fd));
+		FindClose(find);
+	}
+	return files;
+}
+
+double toolSeconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int wmain(int argc, wchar_t** argv) {
+	if (argc < 2) {
+		usage();
+		return 2;
+	}
+	for (const ToolCommand& command : kCommands) {
+		if (wcscmp(argv[1], command.name) == 0)
+			return command.run(argc - 2, argv + 2);
+	}
+	fwprintf(stderr, L"Unknown command %s\n\n", argv[1]);
+	usage();
+	return 2;
+}